@@ -51,30 +51,17 @@ void internal_set_debug_level(int level)
 #ifndef STRIP_DEBUG_CODE
 static void debug_print_line(const char *func, const char *file, int line, const char *buffer)
 {
-	char *str_time = NULL;
-	char *header = NULL;
+	char str_time[16];
 	time_t the_time;
 
 	time(&the_time);
-	str_time = (char*)malloc(255);
-	strftime(str_time, 254, "%H:%M:%S", localtime (&the_time));
+	strftime(str_time, sizeof(str_time), "%H:%M:%S", localtime (&the_time));
 
-	/* generate header text */
-	(void)asprintf(&header, "%s %s:%d %s()", str_time, file, line, func);
-	free (str_time);
-
-	/* trim ending newlines */
-
-	/* print header */
-	printf ("%s: ", header);
-
-	/* print actual debug content */
-	printf ("%s\n", buffer);
+	/* print header and actual debug content */
+	printf ("%s %s:%d %s(): %s\n", str_time, file, line, func, buffer);
 
 	/* flush this output, as we need to debug */
 	fflush (stdout);
-
-	free (header);
 }
 #endif
 
@@ -148,7 +135,8 @@ void debug_buffer_to_file(const char *file, const char *data, const int length)
 void debug_plist_real(const char *func, const char *file, int line, plist_t plist)
 {
 #ifndef STRIP_DEBUG_CODE
-	if (!plist)
+	/* avoid converting the plist if it would not be printed */
+	if (!plist || !debug_level)
 		return;
 
 	char *buffer = NULL;
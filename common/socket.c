@@ -29,6 +29,7 @@
 #include <sys/stat.h>
 #ifdef WIN32
 #include <winsock2.h>
+#include <ws2tcpip.h>
 #include <windows.h>
 static int wsa_init = 0;
 #else
@@ -194,8 +195,11 @@ int socket_connect(const char *addr, uint16_t port)
 {
 	int sfd = -1;
 	int yes = 1;
-	struct hostent *hp;
-	struct sockaddr_in saddr;
+	int res;
+	struct addrinfo hints;
+	struct addrinfo *result = NULL;
+	struct addrinfo *rp;
+	char portstr[8];
 #ifdef WIN32
 	WSADATA wsa_data;
 	if (!wsa_init) {
@@ -212,39 +216,47 @@ int socket_connect(const char *addr, uint16_t port)
 		return -1;
 	}
 
-	if ((hp = gethostbyname(addr)) == NULL) {
-		if (verbose >= 2)
-			fprintf(stderr, "%s: unknown host '%s'\n", __func__, addr);
-		return -1;
-	}
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_protocol = IPPROTO_TCP;
+	snprintf(portstr, sizeof(portstr), "%u", port);
 
-	if (!hp->h_addr) {
+	res = getaddrinfo(addr, portstr, &hints, &result);
+	if (res != 0) {
 		if (verbose >= 2)
-			fprintf(stderr, "%s: gethostbyname returned NULL address!\n",
-					__func__);
+			fprintf(stderr, "%s: unknown host '%s': %s\n", __func__, addr, gai_strerror(res));
 		return -1;
 	}
 
-	if (0 > (sfd = socket(PF_INET, SOCK_STREAM, IPPROTO_TCP))) {
-		perror("socket()");
-		return -1;
-	}
+	/* try each address until a connection succeeds */
+	for (rp = result; rp != NULL; rp = rp->ai_next) {
+		sfd = socket(rp->ai_family, rp->ai_socktype, rp->ai_protocol);
+		if (sfd < 0) {
+			continue;
+		}
 
-	if (setsockopt(sfd, SOL_SOCKET, SO_REUSEADDR, (void*)&yes, sizeof(int)) == -1) {
-		perror("setsockopt()");
+		if (setsockopt(sfd, SOL_SOCKET, SO_REUSEADDR, (void*)&yes, sizeof(int)) == -1) {
+			perror("setsockopt()");
+			socket_close(sfd);
+			sfd = -1;
+			continue;
+		}
+
+		if (connect(sfd, rp->ai_addr, rp->ai_addrlen) == 0) {
+			break;
+		}
+		if (verbose >= 2)
+			fprintf(stderr, "%s: connect: %s\n", __func__, strerror(errno));
 		socket_close(sfd);
-		return -1;
+		sfd = -2;
 	}
+	freeaddrinfo(result);
 
-	memset((void *) &saddr, 0, sizeof(saddr));
-	saddr.sin_family = AF_INET;
-	saddr.sin_addr.s_addr = *(uint32_t *) hp->h_addr;
-	saddr.sin_port = htons(port);
-
-	if (connect(sfd, (struct sockaddr *) &saddr, sizeof(saddr)) < 0) {
+	if (sfd == -1) {
+		perror("socket()");
+	} else if (sfd == -2) {
 		perror("connect");
-		socket_close(sfd);
-		return -2;
 	}
 
 	return sfd;
@@ -0,0 +1,318 @@
+/*
+ * trace.c
+ * Recording of timed spans for tracing connection setup and requests
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "trace.h"
+
+#ifdef HAVE_TRACING
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "thread.h"
+#include "utils.h"
+
+#ifdef _MSC_VER
+#define TRACE_THREAD_LOCAL __declspec(thread)
+#else
+#define TRACE_THREAD_LOCAL __thread
+#endif
+
+struct trace_event {
+	uint64_t timestamp;
+	const char *name;
+	char phase;
+	char arg[TRACE_ARG_SIZE];
+};
+
+struct trace_buffer {
+	struct trace_buffer *next;
+	uint32_t tid;
+	uint32_t head;
+	uint32_t count;
+	/* trace_generation at the time the events were recorded */
+	uint32_t generation;
+	/* set once the owning thread exited, protected by trace_mutex */
+	int exited;
+	struct trace_event events[TRACE_RING_SIZE];
+};
+
+volatile int trace_active = 0;
+
+static TRACE_THREAD_LOCAL struct trace_buffer *trace_local = NULL;
+static struct trace_buffer *trace_buffers = NULL;
+static uint32_t trace_next_tid = 1;
+/* incremented by trace_clear(), buffers of older generations count as empty */
+static volatile uint32_t trace_generation = 0;
+static mutex_t trace_mutex;
+static thread_once_t trace_once = THREAD_ONCE_INIT;
+#ifdef WIN32
+static DWORD trace_key;
+#else
+static pthread_key_t trace_key;
+#endif
+
+/**
+ * Called when a thread that recorded events exits. Its buffer is kept until
+ * the events were exported or cleared, or reused by another thread.
+ */
+#ifdef WIN32
+static VOID WINAPI trace_thread_exit(PVOID data)
+#else
+static void trace_thread_exit(void *data)
+#endif
+{
+	struct trace_buffer *buffer = (struct trace_buffer*)data;
+	if (!buffer)
+		return;
+	mutex_lock(&trace_mutex);
+	buffer->exited = 1;
+	mutex_unlock(&trace_mutex);
+}
+
+static void trace_init(void)
+{
+	mutex_init(&trace_mutex);
+#ifdef WIN32
+	trace_key = FlsAlloc(trace_thread_exit);
+#else
+	pthread_key_create(&trace_key, trace_thread_exit);
+#endif
+}
+
+/* must be called with trace_mutex held */
+static void trace_free_exited(void)
+{
+	struct trace_buffer **pbuf = &trace_buffers;
+	while (*pbuf) {
+		struct trace_buffer *buffer = *pbuf;
+		if (buffer->exited) {
+			*pbuf = buffer->next;
+			free(buffer);
+		} else {
+			pbuf = &buffer->next;
+		}
+	}
+}
+
+void trace_set_enabled(int enable)
+{
+	thread_once(&trace_once, trace_init);
+	trace_active = (enable) ? 1 : 0;
+}
+
+/**
+ * Returns the ring buffer of the calling thread. On first use the buffer
+ * of a thread that exited is reused, so the number of buffers is bounded by
+ * the number of threads recording at the same time.
+ */
+static struct trace_buffer *trace_get_buffer(void)
+{
+	struct trace_buffer *buffer;
+
+	if (trace_local)
+		return trace_local;
+
+	thread_once(&trace_once, trace_init);
+
+	mutex_lock(&trace_mutex);
+	for (buffer = trace_buffers; buffer; buffer = buffer->next) {
+		if (buffer->exited)
+			break;
+	}
+	if (buffer) {
+		buffer->exited = 0;
+		buffer->head = 0;
+		buffer->count = 0;
+	} else {
+		buffer = (struct trace_buffer*)calloc(1, sizeof(struct trace_buffer));
+		if (!buffer) {
+			mutex_unlock(&trace_mutex);
+			return NULL;
+		}
+		buffer->next = trace_buffers;
+		trace_buffers = buffer;
+	}
+	buffer->tid = trace_next_tid++;
+	buffer->generation = trace_generation;
+	mutex_unlock(&trace_mutex);
+
+#ifdef WIN32
+	FlsSetValue(trace_key, buffer);
+#else
+	pthread_setspecific(trace_key, buffer);
+#endif
+	trace_local = buffer;
+	return buffer;
+}
+
+void trace_record(const char *name, const char *arg, char phase)
+{
+	struct trace_buffer *buffer = trace_get_buffer();
+	if (!buffer)
+		return;
+
+	if (buffer->generation != trace_generation) {
+		/* cleared, only the owning thread resets its buffer */
+		buffer->generation = trace_generation;
+		buffer->head = 0;
+		buffer->count = 0;
+	}
+
+	struct trace_event *ev = &buffer->events[buffer->head];
+	ev->timestamp = get_monotonic_time_us();
+	ev->name = name;
+	ev->phase = phase;
+	if (arg) {
+		strncpy(ev->arg, arg, TRACE_ARG_SIZE - 1);
+		ev->arg[TRACE_ARG_SIZE - 1] = '\0';
+	} else {
+		ev->arg[0] = '\0';
+	}
+
+	buffer->head = (buffer->head + 1) % TRACE_RING_SIZE;
+	if (buffer->count < TRACE_RING_SIZE)
+		buffer->count++;
+}
+
+void trace_clear(void)
+{
+	thread_once(&trace_once, trace_init);
+
+	mutex_lock(&trace_mutex);
+	trace_generation++;
+	trace_free_exited();
+	mutex_unlock(&trace_mutex);
+}
+
+static void trace_write_json_string(FILE *f, const char *str)
+{
+	fputc('"', f);
+	for (; *str; str++) {
+		unsigned char c = (unsigned char)*str;
+		if (c == '"' || c == '\\') {
+			fputc('\\', f);
+			fputc(c, f);
+		} else if (c < 0x20) {
+			fprintf(f, "\\u%04x", c);
+		} else {
+			fputc(c, f);
+		}
+	}
+	fputc('"', f);
+}
+
+static void trace_write_le(FILE *f, uint64_t value, int size)
+{
+	int i;
+	for (i = 0; i < size; i++) {
+		fputc((int)((value >> (8 * i)) & 0xff), f);
+	}
+}
+
+/**
+ * Writes all recorded events to the given file.
+ *
+ * The Chrome format is the JSON trace event format that chrome://tracing
+ * and Perfetto load. The binary format starts with the 8 byte magic
+ * "IDEVTRC1" followed by the events, each consisting of a 64 bit timestamp
+ * in microseconds, a 32 bit thread number (both little endian), the phase
+ * character 'B' or 'E', the length of the name and of the argument as one
+ * byte each, and the name and argument without terminating zero.
+ *
+ * Events of threads that are still recording may be incomplete. The
+ * buffers of threads that exited are released afterwards.
+ *
+ * @return 0 on success, -1 if the file could not be written.
+ */
+int trace_export(const char *filename, enum trace_format format)
+{
+	struct trace_buffer *buffer;
+	int first = 1;
+
+	thread_once(&trace_once, trace_init);
+
+	FILE *f = fopen(filename, "wb");
+	if (!f)
+		return -1;
+
+	if (format == TRACE_FORMAT_BINARY) {
+		fwrite("IDEVTRC1", 1, 8, f);
+	} else {
+		fputs("{\"traceEvents\":[", f);
+	}
+
+	mutex_lock(&trace_mutex);
+	for (buffer = trace_buffers; buffer; buffer = buffer->next) {
+		if (buffer->generation != trace_generation)
+			continue;
+		uint32_t count = buffer->count;
+		uint32_t start = (count < TRACE_RING_SIZE) ? 0 : buffer->head;
+		uint32_t i;
+		for (i = 0; i < count; i++) {
+			struct trace_event *ev = &buffer->events[(start + i) % TRACE_RING_SIZE];
+			if (!ev->name)
+				continue;
+			if (format == TRACE_FORMAT_BINARY) {
+				size_t name_len = strlen(ev->name);
+				size_t arg_len = strlen(ev->arg);
+				if (name_len > 255)
+					name_len = 255;
+				trace_write_le(f, ev->timestamp, 8);
+				trace_write_le(f, buffer->tid, 4);
+				fputc(ev->phase, f);
+				fputc((int)name_len, f);
+				fputc((int)arg_len, f);
+				fwrite(ev->name, 1, name_len, f);
+				fwrite(ev->arg, 1, arg_len, f);
+			} else {
+				fputs((first) ? "\n" : ",\n", f);
+				first = 0;
+				fputs("{\"name\":", f);
+				trace_write_json_string(f, ev->name);
+				fprintf(f, ",\"ph\":\"%c\",\"ts\":%llu,\"pid\":1,\"tid\":%u", ev->phase, (unsigned long long)ev->timestamp, buffer->tid);
+				if (ev->arg[0] != '\0') {
+					fputs(",\"args\":{\"arg\":", f);
+					trace_write_json_string(f, ev->arg);
+					fputc('}', f);
+				}
+				fputc('}', f);
+			}
+		}
+	}
+	/* the events of exited threads are not needed anymore */
+	trace_free_exited();
+	mutex_unlock(&trace_mutex);
+
+	if (format != TRACE_FORMAT_BINARY) {
+		fputs("\n],\"displayTimeUnit\":\"ms\"}\n", f);
+	}
+
+	int res = (ferror(f)) ? -1 : 0;
+	if (fclose(f) != 0)
+		res = -1;
+	return res;
+}
+
+#endif
@@ -0,0 +1,66 @@
+/*
+ * trace.h
+ * Recording of timed spans for tracing connection setup and requests
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef __TRACE_H
+#define __TRACE_H
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+/*
+ * Spans are recorded as begin and end events into a ring buffer owned by
+ * the calling thread, so recording takes no lock. Names must be string
+ * literals as only the pointer is stored; the optional argument is copied
+ * and truncated. Without --enable-tracing all trace_* macros compile to
+ * nothing, with it a disabled tracer costs a single branch.
+ */
+#ifdef HAVE_TRACING
+
+/* number of events kept per thread */
+#define TRACE_RING_SIZE 4096
+
+/* maximum length of the argument stored with an event */
+#define TRACE_ARG_SIZE 24
+
+enum trace_format {
+	TRACE_FORMAT_CHROME = 0,
+	TRACE_FORMAT_BINARY = 1
+};
+
+extern volatile int trace_active;
+
+void trace_set_enabled(int enable);
+void trace_record(const char *name, const char *arg, char phase);
+void trace_clear(void);
+int trace_export(const char *filename, enum trace_format format);
+
+#define trace_begin(name) do { if (trace_active) trace_record(name, NULL, 'B'); } while (0)
+#define trace_begin_arg(name, arg) do { if (trace_active) trace_record(name, arg, 'B'); } while (0)
+#define trace_end(name) do { if (trace_active) trace_record(name, NULL, 'E'); } while (0)
+
+#else
+
+#define trace_begin(name)
+#define trace_begin_arg(name, arg)
+#define trace_end(name)
+
+#endif
+
+#endif
@@ -52,6 +52,7 @@
 #include <dirent.h>
 #include <libgen.h>
 #include <sys/stat.h>
+#include <sys/time.h>
 #include <errno.h>
 
 #ifdef WIN32
@@ -61,6 +62,7 @@
 #include "userpref.h"
 #include "debug.h"
 #include "utils.h"
+#include "thread.h"
 
 #ifndef HAVE_OPENSSL
 const ASN1_ARRAY_TYPE pkcs1_asn1_tab[] = {
@@ -93,6 +95,22 @@ const ASN1_ARRAY_TYPE pkcs1_asn1_tab[] = {
 
 static char *__config_dir = NULL;
 
+/* decoded pair records and the system BUID, saves usbmuxd round trips;
+ * off unless enabled with userpref_cache_set_enabled() */
+static thread_once_t cache_once = THREAD_ONCE_INIT;
+static mutex_t cache_mutex;
+static int cache_enabled = 0;
+static plist_t pair_record_cache = NULL;
+static char *system_buid_cache = NULL;
+/* incremented on invalidation, so records read before it are not cached */
+static unsigned int cache_generation = 0;
+
+static void userpref_cache_init(void)
+{
+	mutex_init(&cache_mutex);
+	pair_record_cache = plist_new_dict();
+}
+
 #ifdef WIN32
 static char *userpref_utf16_to_utf8(wchar_t *unistr, long len, long *items_read, long *items_written)
 {
@@ -182,15 +200,76 @@ const char *userpref_get_config_dir()
  */
 int userpref_read_system_buid(char **system_buid)
 {
+	thread_once(&cache_once, userpref_cache_init);
+
+	mutex_lock(&cache_mutex);
+	if (cache_enabled && system_buid_cache) {
+		*system_buid = strdup(system_buid_cache);
+		mutex_unlock(&cache_mutex);
+		return 0;
+	}
+	unsigned int generation = cache_generation;
+	mutex_unlock(&cache_mutex);
+
 	int res = usbmuxd_read_buid(system_buid);
 	if (res == 0) {
 		debug_info("using %s as %s", *system_buid, USERPREF_SYSTEM_BUID_KEY);
+		mutex_lock(&cache_mutex);
+		if (cache_enabled && !system_buid_cache && generation == cache_generation) {
+			system_buid_cache = strdup(*system_buid);
+		}
+		mutex_unlock(&cache_mutex);
 	} else {
 		debug_info("could not read system buid, error %d", res);
 	}
 	return res;
 }
 
+/**
+ * Drops the cached pair record of the given device, or all cached data
+ * including the system BUID if udid is NULL. Must be called when a pair
+ * record changes or the device went away, after the change was made.
+ *
+ * @param udid The udid of the device or NULL.
+ */
+void userpref_cache_invalidate(const char *udid)
+{
+	thread_once(&cache_once, userpref_cache_init);
+
+	mutex_lock(&cache_mutex);
+	cache_generation++;
+	if (udid) {
+		if (plist_dict_get_item(pair_record_cache, udid)) {
+			plist_dict_remove_item(pair_record_cache, udid);
+		}
+	} else {
+		plist_free(pair_record_cache);
+		pair_record_cache = plist_new_dict();
+		free(system_buid_cache);
+		system_buid_cache = NULL;
+	}
+	mutex_unlock(&cache_mutex);
+}
+
+/**
+ * Enables or disables caching of pair records and the system BUID.
+ * Disabling drops all cached data.
+ *
+ * @param enable 1 to enable or 0 to disable the cache.
+ */
+void userpref_cache_set_enabled(int enable)
+{
+	thread_once(&cache_once, userpref_cache_init);
+
+	mutex_lock(&cache_mutex);
+	cache_enabled = (enable != 0);
+	mutex_unlock(&cache_mutex);
+
+	if (!enable) {
+		userpref_cache_invalidate(NULL);
+	}
+}
+
 /**
  * Determines whether this device has been connected to this system before.
  *
@@ -318,6 +397,8 @@ userpref_error_t userpref_save_pair_record(const char *udid, plist_t pair_record
 
 	free(record_data);
 
+	userpref_cache_invalidate(udid);
+
 	return res == 0 ? USERPREF_E_SUCCESS: USERPREF_E_UNKNOWN_ERROR;
 }
 
@@ -335,6 +416,18 @@ userpref_error_t userpref_read_pair_record(const char *udid, plist_t *pair_recor
 	char* record_data = NULL;
 	uint32_t record_size = 0;
 
+	thread_once(&cache_once, userpref_cache_init);
+
+	mutex_lock(&cache_mutex);
+	plist_t cached = (cache_enabled) ? plist_dict_get_item(pair_record_cache, udid) : NULL;
+	if (cached) {
+		*pair_record = plist_copy(cached);
+		mutex_unlock(&cache_mutex);
+		return USERPREF_E_SUCCESS;
+	}
+	unsigned int generation = cache_generation;
+	mutex_unlock(&cache_mutex);
+
 	int res = usbmuxd_read_pair_record(udid, &record_data, &record_size);
 
 	if (res < 0) {
@@ -353,6 +446,15 @@ userpref_error_t userpref_read_pair_record(const char *udid, plist_t *pair_recor
 
 	free(record_data);
 
+	if (res == 0 && *pair_record) {
+		mutex_lock(&cache_mutex);
+		/* the record may have been replaced or deleted in the meantime */
+		if (cache_enabled && generation == cache_generation) {
+			plist_dict_set_item(pair_record_cache, udid, plist_copy(*pair_record));
+		}
+		mutex_unlock(&cache_mutex);
+	}
+
 	return res == 0 ? USERPREF_E_SUCCESS: USERPREF_E_UNKNOWN_ERROR;
 }
 
@@ -367,6 +469,8 @@ userpref_error_t userpref_delete_pair_record(const char *udid)
 {
 	int res = usbmuxd_delete_pair_record(udid);
 
+	userpref_cache_invalidate(udid);
+
 	return res == 0 ? USERPREF_E_SUCCESS: USERPREF_E_UNKNOWN_ERROR;
 }
 
@@ -394,29 +498,19 @@ static int X509_add_ext_helper(X509 *cert, int nid, char *value)
 #endif
 
 /**
- * Private function to generate required private keys and certificates.
+ * Private function to generate the root and host key pairs and certificates.
+ * They do not depend on the device and can be prepared in advance.
  *
- * @param pair_record a #PLIST_DICT that will be filled with the keys
- *   and certificates
- * @param public_key the public key to use (device public key)
+ * @param root_key_pem Receives the PEM encoded root private key
+ * @param root_cert_pem Receives the PEM encoded root certificate
+ * @param host_key_pem Receives the PEM encoded host private key
+ * @param host_cert_pem Receives the PEM encoded host certificate
  *
- * @return 1 if keys were successfully generated, 0 otherwise
+ * @return USERPREF_E_SUCCESS if the certificates were generated,
+ *   USERPREF_E_SSL_ERROR otherwise.
  */
-userpref_error_t pair_record_generate_keys_and_certs(plist_t pair_record, key_data_t public_key)
+static userpref_error_t pair_record_generate_host_keys(key_data_t *root_key_pem, key_data_t *root_cert_pem, key_data_t *host_key_pem, key_data_t *host_cert_pem)
 {
-	userpref_error_t ret = USERPREF_E_SSL_ERROR;
-
-	key_data_t dev_cert_pem = { NULL, 0 };
-	key_data_t root_key_pem = { NULL, 0 };
-	key_data_t root_cert_pem = { NULL, 0 };
-	key_data_t host_key_pem = { NULL, 0 };
-	key_data_t host_cert_pem = { NULL, 0 };
-
-	if (!pair_record || !public_key.data)
-		return USERPREF_E_INVALID_ARG;
-
-	debug_info("Generating keys and certificates...");
-
 #ifdef HAVE_OPENSSL
 	BIGNUM *e = BN_new();
 	RSA* root_keypair = RSA_new();
@@ -504,46 +598,152 @@ userpref_error_t pair_record_generate_keys_and_certs(plist_t pair_record, key_da
 
 		membp = BIO_new(BIO_s_mem());
 		if (PEM_write_bio_X509(membp, root_cert) > 0) {
-			root_cert_pem.size = BIO_get_mem_data(membp, &bdata);
-			root_cert_pem.data = (unsigned char*)malloc(root_cert_pem.size);
-			if (root_cert_pem.data) {
-				memcpy(root_cert_pem.data, bdata, root_cert_pem.size);
+			root_cert_pem->size = BIO_get_mem_data(membp, &bdata);
+			root_cert_pem->data = (unsigned char*)malloc(root_cert_pem->size);
+			if (root_cert_pem->data) {
+				memcpy(root_cert_pem->data, bdata, root_cert_pem->size);
 			}
 			BIO_free(membp);
 			membp = NULL;
 		}
 		membp = BIO_new(BIO_s_mem());
 		if (PEM_write_bio_PrivateKey(membp, root_pkey, NULL, NULL, 0, 0, NULL) > 0) {
-			root_key_pem.size = BIO_get_mem_data(membp, &bdata);
-			root_key_pem.data = (unsigned char*)malloc(root_key_pem.size);
-			if (root_key_pem.data) {
-				memcpy(root_key_pem.data, bdata, root_key_pem.size);
+			root_key_pem->size = BIO_get_mem_data(membp, &bdata);
+			root_key_pem->data = (unsigned char*)malloc(root_key_pem->size);
+			if (root_key_pem->data) {
+				memcpy(root_key_pem->data, bdata, root_key_pem->size);
 			}
 			BIO_free(membp);
 			membp = NULL;
 		}
 		membp = BIO_new(BIO_s_mem());
 		if (PEM_write_bio_X509(membp, host_cert) > 0) {
-			host_cert_pem.size = BIO_get_mem_data(membp, &bdata);
-			host_cert_pem.data = (unsigned char*)malloc(host_cert_pem.size);
-			if (host_cert_pem.data) {
-				memcpy(host_cert_pem.data, bdata, host_cert_pem.size);
+			host_cert_pem->size = BIO_get_mem_data(membp, &bdata);
+			host_cert_pem->data = (unsigned char*)malloc(host_cert_pem->size);
+			if (host_cert_pem->data) {
+				memcpy(host_cert_pem->data, bdata, host_cert_pem->size);
 			}
 			BIO_free(membp);
 			membp = NULL;
 		}
 		membp = BIO_new(BIO_s_mem());
 		if (PEM_write_bio_PrivateKey(membp, host_pkey, NULL, NULL, 0, 0, NULL) > 0) {
-			host_key_pem.size = BIO_get_mem_data(membp, &bdata);
-			host_key_pem.data = (unsigned char*)malloc(host_key_pem.size);
-			if (host_key_pem.data) {
-				memcpy(host_key_pem.data, bdata, host_key_pem.size);
+			host_key_pem->size = BIO_get_mem_data(membp, &bdata);
+			host_key_pem->data = (unsigned char*)malloc(host_key_pem->size);
+			if (host_key_pem->data) {
+				memcpy(host_key_pem->data, bdata, host_key_pem->size);
 			}
 			BIO_free(membp);
 			membp = NULL;
 		}
 	}
 
+	EVP_PKEY_free(root_pkey);
+	EVP_PKEY_free(host_pkey);
+
+	X509_free(host_cert);
+	X509_free(root_cert);
+#else
+	gnutls_x509_privkey_t root_privkey;
+	gnutls_x509_crt_t root_cert;
+	gnutls_x509_privkey_t host_privkey;
+	gnutls_x509_crt_t host_cert;
+
+	/* use less secure random to speed up key generation */
+	gcry_control(GCRYCTL_ENABLE_QUICK_RANDOM);
+
+	gnutls_x509_privkey_init(&root_privkey);
+	gnutls_x509_privkey_init(&host_privkey);
+
+	gnutls_x509_crt_init(&root_cert);
+	gnutls_x509_crt_init(&host_cert);
+
+	/* generate root key */
+	gnutls_x509_privkey_generate(root_privkey, GNUTLS_PK_RSA, 2048, 0);
+	gnutls_x509_privkey_generate(host_privkey, GNUTLS_PK_RSA, 2048, 0);
+
+	/* generate certificates */
+	gnutls_x509_crt_set_key(root_cert, root_privkey);
+	gnutls_x509_crt_set_serial(root_cert, "\x00", 1);
+	gnutls_x509_crt_set_version(root_cert, 3);
+	gnutls_x509_crt_set_ca_status(root_cert, 1);
+	gnutls_x509_crt_set_activation_time(root_cert, time(NULL));
+	gnutls_x509_crt_set_expiration_time(root_cert, time(NULL) + (60 * 60 * 24 * 365 * 10));
+	gnutls_x509_crt_sign(root_cert, root_cert, root_privkey);
+
+	gnutls_x509_crt_set_key(host_cert, host_privkey);
+	gnutls_x509_crt_set_serial(host_cert, "\x00", 1);
+	gnutls_x509_crt_set_version(host_cert, 3);
+	gnutls_x509_crt_set_ca_status(host_cert, 0);
+	gnutls_x509_crt_set_key_usage(host_cert, GNUTLS_KEY_KEY_ENCIPHERMENT | GNUTLS_KEY_DIGITAL_SIGNATURE);
+	gnutls_x509_crt_set_activation_time(host_cert, time(NULL));
+	gnutls_x509_crt_set_expiration_time(host_cert, time(NULL) + (60 * 60 * 24 * 365 * 10));
+	gnutls_x509_crt_sign(host_cert, root_cert, root_privkey);
+
+	/* export to PEM format */
+	size_t root_key_export_size = 0;
+	size_t host_key_export_size = 0;
+
+	gnutls_x509_privkey_export(root_privkey, GNUTLS_X509_FMT_PEM, NULL, &root_key_export_size);
+	gnutls_x509_privkey_export(host_privkey, GNUTLS_X509_FMT_PEM, NULL, &host_key_export_size);
+
+	root_key_pem->data = gnutls_malloc(root_key_export_size);
+	host_key_pem->data = gnutls_malloc(host_key_export_size);
+
+	gnutls_x509_privkey_export(root_privkey, GNUTLS_X509_FMT_PEM, root_key_pem->data, &root_key_export_size);
+	root_key_pem->size = root_key_export_size;
+	gnutls_x509_privkey_export(host_privkey, GNUTLS_X509_FMT_PEM, host_key_pem->data, &host_key_export_size);
+	host_key_pem->size = host_key_export_size;
+
+	size_t root_cert_export_size = 0;
+	size_t host_cert_export_size = 0;
+
+	gnutls_x509_crt_export(root_cert, GNUTLS_X509_FMT_PEM, NULL, &root_cert_export_size);
+	gnutls_x509_crt_export(host_cert, GNUTLS_X509_FMT_PEM, NULL, &host_cert_export_size);
+
+	root_cert_pem->data = gnutls_malloc(root_cert_export_size);
+	host_cert_pem->data = gnutls_malloc(host_cert_export_size);
+
+	gnutls_x509_crt_export(root_cert, GNUTLS_X509_FMT_PEM, root_cert_pem->data, &root_cert_export_size);
+	root_cert_pem->size = root_cert_export_size;
+	gnutls_x509_crt_export(host_cert, GNUTLS_X509_FMT_PEM, host_cert_pem->data, &host_cert_export_size);
+	host_cert_pem->size = host_cert_export_size;
+
+	gnutls_x509_crt_deinit(root_cert);
+	gnutls_x509_crt_deinit(host_cert);
+	gnutls_x509_privkey_deinit(root_privkey);
+	gnutls_x509_privkey_deinit(host_privkey);
+#endif
+	if (NULL != root_cert_pem->data && 0 != root_cert_pem->size &&
+		NULL != host_cert_pem->data && 0 != host_cert_pem->size)
+		return USERPREF_E_SUCCESS;
+
+	return USERPREF_E_SSL_ERROR;
+}
+
+/**
+ * Private function to generate the device certificate for the given device
+ * public key, signed with the root key.
+ *
+ * @param root_key_pem The PEM encoded root private key
+ * @param root_cert_pem The PEM encoded root certificate
+ * @param public_key The public key of the device
+ * @param dev_cert_pem Receives the PEM encoded device certificate
+ */
+static void pair_record_generate_device_cert(key_data_t *root_key_pem, key_data_t *root_cert_pem, key_data_t public_key, key_data_t *dev_cert_pem)
+{
+#ifdef HAVE_OPENSSL
+	EVP_PKEY* root_pkey = NULL;
+	{
+		BIO *membp = BIO_new_mem_buf(root_key_pem->data, root_key_pem->size);
+		root_pkey = PEM_read_bio_PrivateKey(membp, NULL, NULL, NULL);
+		BIO_free(membp);
+	}
+	if (!root_pkey) {
+		debug_info("ERROR: Could not read root private key");
+		return;
+	}
+
 	RSA *pubkey = NULL;
 	{
 		BIO *membp = BIO_new_mem_buf(public_key.data, public_key.size);
@@ -585,10 +785,10 @@ userpref_error_t pair_record_generate_keys_and_certs(plist_t pair_record, key_da
 			BIO* membp = BIO_new(BIO_s_mem());
 			if (PEM_write_bio_X509(membp, dev_cert) > 0) {
 				char *bdata = NULL;
-				dev_cert_pem.size = BIO_get_mem_data(membp, &bdata);
-				dev_cert_pem.data = (unsigned char*)malloc(dev_cert_pem.size);
-				if (dev_cert_pem.data) {
-					memcpy(dev_cert_pem.data, bdata, dev_cert_pem.size);
+				dev_cert_pem->size = BIO_get_mem_data(membp, &bdata);
+				dev_cert_pem->data = (unsigned char*)malloc(dev_cert_pem->size);
+				if (dev_cert_pem->data) {
+					memcpy(dev_cert_pem->data, bdata, dev_cert_pem->size);
 				}
 				BIO_free(membp);
 				membp = NULL;
@@ -598,87 +798,29 @@ userpref_error_t pair_record_generate_keys_and_certs(plist_t pair_record, key_da
 		}
 	}
 
-	X509V3_EXT_cleanup();
 	X509_free(dev_cert);
 
 	EVP_PKEY_free(root_pkey);
-	EVP_PKEY_free(host_pkey);
-
-	X509_free(host_cert);
-	X509_free(root_cert);
 #else
 	gnutls_x509_privkey_t root_privkey;
 	gnutls_x509_crt_t root_cert;
-	gnutls_x509_privkey_t host_privkey;
-	gnutls_x509_crt_t host_cert;
-
-	/* use less secure random to speed up key generation */
-	gcry_control(GCRYCTL_ENABLE_QUICK_RANDOM);
 
 	gnutls_x509_privkey_init(&root_privkey);
-	gnutls_x509_privkey_init(&host_privkey);
-
 	gnutls_x509_crt_init(&root_cert);
-	gnutls_x509_crt_init(&host_cert);
 
-	/* generate root key */
-	gnutls_x509_privkey_generate(root_privkey, GNUTLS_PK_RSA, 2048, 0);
-	gnutls_x509_privkey_generate(host_privkey, GNUTLS_PK_RSA, 2048, 0);
-
-	/* generate certificates */
-	gnutls_x509_crt_set_key(root_cert, root_privkey);
-	gnutls_x509_crt_set_serial(root_cert, "\x00", 1);
-	gnutls_x509_crt_set_version(root_cert, 3);
-	gnutls_x509_crt_set_ca_status(root_cert, 1);
-	gnutls_x509_crt_set_activation_time(root_cert, time(NULL));
-	gnutls_x509_crt_set_expiration_time(root_cert, time(NULL) + (60 * 60 * 24 * 365 * 10));
-	gnutls_x509_crt_sign(root_cert, root_cert, root_privkey);
-
-	gnutls_x509_crt_set_key(host_cert, host_privkey);
-	gnutls_x509_crt_set_serial(host_cert, "\x00", 1);
-	gnutls_x509_crt_set_version(host_cert, 3);
-	gnutls_x509_crt_set_ca_status(host_cert, 0);
-	gnutls_x509_crt_set_key_usage(host_cert, GNUTLS_KEY_KEY_ENCIPHERMENT | GNUTLS_KEY_DIGITAL_SIGNATURE);
-	gnutls_x509_crt_set_activation_time(host_cert, time(NULL));
-	gnutls_x509_crt_set_expiration_time(host_cert, time(NULL) + (60 * 60 * 24 * 365 * 10));
-	gnutls_x509_crt_sign(host_cert, root_cert, root_privkey);
-
-	/* export to PEM format */
-	size_t root_key_export_size = 0;
-	size_t host_key_export_size = 0;
-
-	gnutls_x509_privkey_export(root_privkey, GNUTLS_X509_FMT_PEM, NULL, &root_key_export_size);
-	gnutls_x509_privkey_export(host_privkey, GNUTLS_X509_FMT_PEM, NULL, &host_key_export_size);
-
-	root_key_pem.data = gnutls_malloc(root_key_export_size);
-	host_key_pem.data = gnutls_malloc(host_key_export_size);
-
-	gnutls_x509_privkey_export(root_privkey, GNUTLS_X509_FMT_PEM, root_key_pem.data, &root_key_export_size);
-	root_key_pem.size = root_key_export_size;
-	gnutls_x509_privkey_export(host_privkey, GNUTLS_X509_FMT_PEM, host_key_pem.data, &host_key_export_size);
-	host_key_pem.size = host_key_export_size;
-
-	size_t root_cert_export_size = 0;
-	size_t host_cert_export_size = 0;
-
-	gnutls_x509_crt_export(root_cert, GNUTLS_X509_FMT_PEM, NULL, &root_cert_export_size);
-	gnutls_x509_crt_export(host_cert, GNUTLS_X509_FMT_PEM, NULL, &host_cert_export_size);
-
-	root_cert_pem.data = gnutls_malloc(root_cert_export_size);
-	host_cert_pem.data = gnutls_malloc(host_cert_export_size);
-
-	gnutls_x509_crt_export(root_cert, GNUTLS_X509_FMT_PEM, root_cert_pem.data, &root_cert_export_size);
-	root_cert_pem.size = root_cert_export_size;
-	gnutls_x509_crt_export(host_cert, GNUTLS_X509_FMT_PEM, host_cert_pem.data, &host_cert_export_size);
-	host_cert_pem.size = host_cert_export_size;
-
-	ret = USERPREF_E_UNKNOWN_ERROR;
+	if (GNUTLS_E_SUCCESS != gnutls_x509_privkey_import(root_privkey, root_key_pem, GNUTLS_X509_FMT_PEM) ||
+	    GNUTLS_E_SUCCESS != gnutls_x509_crt_import(root_cert, root_cert_pem, GNUTLS_X509_FMT_PEM)) {
+		debug_info("ERROR: Could not import root key or certificate");
+		gnutls_x509_crt_deinit(root_cert);
+		gnutls_x509_privkey_deinit(root_privkey);
+		return;
+	}
 
 	gnutls_datum_t modulus = { NULL, 0 };
 	gnutls_datum_t exponent = { NULL, 0 };
 
 	/* now decode the PEM encoded key */
-	gnutls_datum_t der_pub_key;
+	gnutls_datum_t der_pub_key = { NULL, 0 };
 	if (GNUTLS_E_SUCCESS == gnutls_pem_base64_decode_alloc("RSA PUBLIC KEY", &public_key, &der_pub_key)) {
 
 		/* initalize asn.1 parser */
@@ -699,8 +841,11 @@ userpref_error_t pair_record_generate_keys_and_certs(plist_t pair_record, key_da
 
 				ret1 = asn1_read_value(asn1_pub_key, "modulus", modulus.data, (int*)&modulus.size);
 				ret2 = asn1_read_value(asn1_pub_key, "publicExponent", exponent.data, (int*)&exponent.size);
-				if (ASN1_SUCCESS == ret1 && ASN1_SUCCESS == ret2)
-					ret = USERPREF_E_SUCCESS;
+				if (ASN1_SUCCESS != ret1 || ASN1_SUCCESS != ret2) {
+					/* skips the certificate generation below */
+					modulus.size = 0;
+					exponent.size = 0;
+				}
 			}
 			if (asn1_pub_key)
 				asn1_delete_structure(&asn1_pub_key);
@@ -712,7 +857,7 @@ userpref_error_t pair_record_generate_keys_and_certs(plist_t pair_record, key_da
 	}
 
 	/* now generate certificates */
-	if (USERPREF_E_SUCCESS == ret && 0 != modulus.size && 0 != exponent.size) {
+	if (0 != modulus.size && 0 != exponent.size) {
 		gnutls_datum_t essentially_null = { (unsigned char*)strdup("abababababababab"), strlen("abababababababab") };
 
 		gnutls_x509_privkey_t fake_privkey;
@@ -741,15 +886,13 @@ userpref_error_t pair_record_generate_keys_and_certs(plist_t pair_record, key_da
 			}
 
 			gnutls_x509_crt_set_key_usage(dev_cert, GNUTLS_KEY_DIGITAL_SIGNATURE | GNUTLS_KEY_KEY_ENCIPHERMENT);
-			gnutls_x509_crt_sign(dev_cert, root_cert, root_privkey);
-
-			if (USERPREF_E_SUCCESS == ret) {
+			if (GNUTLS_E_SUCCESS == gnutls_x509_crt_sign(dev_cert, root_cert, root_privkey)) {
 				/* if everything went well, export in PEM format */
 				size_t export_size = 0;
 				gnutls_x509_crt_export(dev_cert, GNUTLS_X509_FMT_PEM, NULL, &export_size);
-				dev_cert_pem.data = gnutls_malloc(export_size);
-				gnutls_x509_crt_export(dev_cert, GNUTLS_X509_FMT_PEM, dev_cert_pem.data, &export_size);
-				dev_cert_pem.size = export_size;
+				dev_cert_pem->data = gnutls_malloc(export_size);
+				gnutls_x509_crt_export(dev_cert, GNUTLS_X509_FMT_PEM, dev_cert_pem->data, &export_size);
+				dev_cert_pem->size = export_size;
 			} else {
 				debug_info("ERROR: Signing device certificate with root private key failed!");
 			}
@@ -763,18 +906,310 @@ userpref_error_t pair_record_generate_keys_and_certs(plist_t pair_record, key_da
 	}
 
 	gnutls_x509_crt_deinit(root_cert);
-	gnutls_x509_crt_deinit(host_cert);
 	gnutls_x509_privkey_deinit(root_privkey);
-	gnutls_x509_privkey_deinit(host_privkey);
 
 	gnutls_free(modulus.data);
 	gnutls_free(exponent.data);
 
 	gnutls_free(der_pub_key.data);
 #endif
-	if (NULL != root_cert_pem.data && 0 != root_cert_pem.size &&
-		NULL != host_cert_pem.data && 0 != host_cert_pem.size)
+}
+
+/* pool of pre-generated root and host keys */
+
+struct key_pool_entry {
+	key_data_t root_key_pem;
+	key_data_t root_cert_pem;
+	key_data_t host_key_pem;
+	key_data_t host_cert_pem;
+	struct key_pool_entry *next;
+};
+
+static thread_once_t key_pool_once = THREAD_ONCE_INIT;
+static mutex_t key_pool_mutex;
+/* signalled when a key set was taken or the pool is stopped */
+static cond_t key_pool_cond;
+static struct key_pool_entry *key_pool = NULL;
+static unsigned int key_pool_count = 0;
+static unsigned int key_pool_depth = 0;
+static int key_pool_quit = 0;
+static thread_t *key_pool_threads = NULL;
+static unsigned int key_pool_num_threads = 0;
+static uint64_t key_pool_generated = 0;
+static uint64_t key_pool_gen_usec = 0;
+
+static void key_pool_init(void)
+{
+	mutex_init(&key_pool_mutex);
+	cond_init(&key_pool_cond);
+}
+
+static uint64_t key_pool_now_usec(void)
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return (uint64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+/**
+ * Frees the data of a key or certificate generated by the functions above,
+ * which allocate it with gnutls_malloc() in GnuTLS builds.
+ */
+static void generated_key_data_free(key_data_t *key)
+{
+#ifdef HAVE_OPENSSL
+	free(key->data);
+#else
+	gnutls_free(key->data);
+#endif
+	key->data = NULL;
+	key->size = 0;
+}
+
+static void key_pool_entry_free(struct key_pool_entry *entry)
+{
+	generated_key_data_free(&entry->root_key_pem);
+	generated_key_data_free(&entry->root_cert_pem);
+	generated_key_data_free(&entry->host_key_pem);
+	generated_key_data_free(&entry->host_cert_pem);
+	free(entry);
+}
+
+/**
+ * Worker thread that keeps the key pool filled up to the configured depth.
+ */
+static void* key_pool_worker(void *arg)
+{
+	debug_info("Running");
+
+	while (1) {
+		mutex_lock(&key_pool_mutex);
+		while (!key_pool_quit && (key_pool_count >= key_pool_depth)) {
+			cond_wait(&key_pool_cond, &key_pool_mutex);
+		}
+		if (key_pool_quit) {
+			mutex_unlock(&key_pool_mutex);
+			break;
+		}
+		/* reserve the slot so other workers do not overfill the pool */
+		key_pool_count++;
+		mutex_unlock(&key_pool_mutex);
+
+		uint64_t start = key_pool_now_usec();
+		struct key_pool_entry *entry = (struct key_pool_entry*)calloc(1, sizeof(struct key_pool_entry));
+		userpref_error_t res = pair_record_generate_host_keys(&entry->root_key_pem, &entry->root_cert_pem, &entry->host_key_pem, &entry->host_cert_pem);
+		uint64_t elapsed = key_pool_now_usec() - start;
+
+		mutex_lock(&key_pool_mutex);
+		if (res == USERPREF_E_SUCCESS) {
+			entry->next = key_pool;
+			key_pool = entry;
+			key_pool_generated++;
+			key_pool_gen_usec += elapsed;
+			entry = NULL;
+		} else {
+			key_pool_count--;
+		}
+		mutex_unlock(&key_pool_mutex);
+
+		if (entry) {
+			debug_info("ERROR: Could not generate keys for the key pool");
+			key_pool_entry_free(entry);
+		}
+	}
+
+	debug_info("Exiting");
+
+	return NULL;
+}
+
+/**
+ * Takes a pre-generated set of root and host keys from the pool.
+ *
+ * @return The entry or NULL if the pool is empty or not running.
+ */
+static struct key_pool_entry *key_pool_take(void)
+{
+	struct key_pool_entry *entry = NULL;
+
+	thread_once(&key_pool_once, key_pool_init);
+
+	mutex_lock(&key_pool_mutex);
+	if (key_pool) {
+		entry = key_pool;
+		key_pool = entry->next;
+		key_pool_count--;
+		cond_signal(&key_pool_cond);
+	}
+	mutex_unlock(&key_pool_mutex);
+
+	return entry;
+}
+
+/**
+ * Starts worker threads that generate root and host keys in the background,
+ * so pairing does not have to wait for the RSA key generation.
+ *
+ * @param depth Number of key sets to keep ready.
+ * @param num_threads Number of worker threads, 0 selects one.
+ *
+ * @return USERPREF_E_SUCCESS on success, USERPREF_E_INVALID_ARG if the pool
+ *   is already running or depth is 0, or USERPREF_E_UNKNOWN_ERROR if no
+ *   worker thread could be started.
+ */
+userpref_error_t userpref_key_pool_start(unsigned int depth, unsigned int num_threads)
+{
+	unsigned int i;
+
+	if (depth == 0)
+		return USERPREF_E_INVALID_ARG;
+
+	thread_once(&key_pool_once, key_pool_init);
+
+	mutex_lock(&key_pool_mutex);
+	if (key_pool_threads) {
+		mutex_unlock(&key_pool_mutex);
+		return USERPREF_E_INVALID_ARG;
+	}
+	if (num_threads == 0)
+		num_threads = 1;
+	key_pool_depth = depth;
+	key_pool_quit = 0;
+	key_pool_threads = (thread_t*)calloc(num_threads, sizeof(thread_t));
+	key_pool_num_threads = 0;
+	if (!key_pool_threads) {
+		key_pool_depth = 0;
+		mutex_unlock(&key_pool_mutex);
+		return USERPREF_E_UNKNOWN_ERROR;
+	}
+	for (i = 0; i < num_threads; i++) {
+		if (thread_new(&key_pool_threads[i], key_pool_worker, NULL) != 0) {
+			debug_info("ERROR: Could not start key pool worker %u", i);
+			break;
+		}
+		key_pool_num_threads++;
+	}
+	if (key_pool_num_threads == 0) {
+		free(key_pool_threads);
+		key_pool_threads = NULL;
+		key_pool_depth = 0;
+		mutex_unlock(&key_pool_mutex);
+		return USERPREF_E_UNKNOWN_ERROR;
+	}
+	mutex_unlock(&key_pool_mutex);
+
+	return USERPREF_E_SUCCESS;
+}
+
+/**
+ * Stops the key pool worker threads and frees all unused keys.
+ */
+void userpref_key_pool_stop(void)
+{
+	thread_t *threads;
+	unsigned int num_threads;
+	unsigned int i;
+	struct key_pool_entry *entries;
+
+	thread_once(&key_pool_once, key_pool_init);
+
+	mutex_lock(&key_pool_mutex);
+	threads = key_pool_threads;
+	num_threads = key_pool_num_threads;
+	key_pool_threads = NULL;
+	key_pool_num_threads = 0;
+	key_pool_quit = 1;
+	cond_broadcast(&key_pool_cond);
+	mutex_unlock(&key_pool_mutex);
+
+	for (i = 0; i < num_threads; i++) {
+		thread_join(threads[i]);
+		thread_free(threads[i]);
+	}
+	free(threads);
+
+	mutex_lock(&key_pool_mutex);
+	entries = key_pool;
+	key_pool = NULL;
+	key_pool_count = 0;
+	key_pool_depth = 0;
+	mutex_unlock(&key_pool_mutex);
+
+	while (entries) {
+		struct key_pool_entry *next = entries->next;
+		key_pool_entry_free(entries);
+		entries = next;
+	}
+}
+
+/**
+ * Reports the state of the key pool.
+ *
+ * @param available Receives the number of key sets that are ready (or NULL)
+ * @param generated Receives the number of key sets generated so far (or NULL)
+ * @param rate Receives the number of key sets generated per second by a
+ *   single worker thread on average (or NULL)
+ */
+void userpref_key_pool_get_stats(unsigned int *available, uint64_t *generated, double *rate)
+{
+	thread_once(&key_pool_once, key_pool_init);
+
+	mutex_lock(&key_pool_mutex);
+	if (available) {
+		unsigned int count = 0;
+		struct key_pool_entry *entry;
+		for (entry = key_pool; entry; entry = entry->next) {
+			count++;
+		}
+		*available = count;
+	}
+	if (generated)
+		*generated = key_pool_generated;
+	if (rate)
+		*rate = (key_pool_gen_usec > 0) ? ((double)key_pool_generated * 1000000.0 / (double)key_pool_gen_usec) : 0.0;
+	mutex_unlock(&key_pool_mutex);
+}
+
+/**
+ * Private function to generate required private keys and certificates.
+ * Uses pre-generated root and host keys from the key pool if available.
+ *
+ * @param pair_record a #PLIST_DICT that will be filled with the keys
+ *   and certificates
+ * @param public_key the public key to use (device public key)
+ *
+ * @return 1 if keys were successfully generated, 0 otherwise
+ */
+userpref_error_t pair_record_generate_keys_and_certs(plist_t pair_record, key_data_t public_key)
+{
+	userpref_error_t ret = USERPREF_E_SSL_ERROR;
+
+	key_data_t dev_cert_pem = { NULL, 0 };
+	key_data_t root_key_pem = { NULL, 0 };
+	key_data_t root_cert_pem = { NULL, 0 };
+	key_data_t host_key_pem = { NULL, 0 };
+	key_data_t host_cert_pem = { NULL, 0 };
+
+	if (!pair_record || !public_key.data)
+		return USERPREF_E_INVALID_ARG;
+
+	struct key_pool_entry *pooled = key_pool_take();
+	if (pooled) {
+		debug_info("Using pre-generated keys and certificates...");
+		root_key_pem = pooled->root_key_pem;
+		root_cert_pem = pooled->root_cert_pem;
+		host_key_pem = pooled->host_key_pem;
+		host_cert_pem = pooled->host_cert_pem;
+		free(pooled);
 		ret = USERPREF_E_SUCCESS;
+	} else {
+		debug_info("Generating keys and certificates...");
+		ret = pair_record_generate_host_keys(&root_key_pem, &root_cert_pem, &host_key_pem, &host_cert_pem);
+	}
+
+	if (root_key_pem.data && root_cert_pem.data) {
+		pair_record_generate_device_cert(&root_key_pem, &root_cert_pem, public_key, &dev_cert_pem);
+	}
 
 	/* now set keys and certificates */
 	pair_record_set_item_from_key_data(pair_record, USERPREF_DEVICE_CERTIFICATE_KEY, &dev_cert_pem);
@@ -783,16 +1218,11 @@ userpref_error_t pair_record_generate_keys_and_certs(plist_t pair_record, key_da
 	pair_record_set_item_from_key_data(pair_record, USERPREF_ROOT_PRIVATE_KEY_KEY, &root_key_pem);
 	pair_record_set_item_from_key_data(pair_record, USERPREF_ROOT_CERTIFICATE_KEY, &root_cert_pem);
 
-	if (dev_cert_pem.data)
-		free(dev_cert_pem.data);
-	if (root_key_pem.data)
-		free(root_key_pem.data);
-	if (root_cert_pem.data)
-		free(root_cert_pem.data);
-	if (host_key_pem.data)
-		free(host_key_pem.data);
-	if (host_cert_pem.data)
-		free(host_cert_pem.data);
+	generated_key_data_free(&dev_cert_pem);
+	generated_key_data_free(&root_key_pem);
+	generated_key_data_free(&root_cert_pem);
+	generated_key_data_free(&host_key_pem);
+	generated_key_data_free(&host_cert_pem);
 
 	return ret;
 }
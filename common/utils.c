@@ -200,6 +200,22 @@ char *generate_uuid()
 	return uuid;
 }
 
+/**
+ * Get the time of a monotonic clock, suitable for measuring intervals.
+ *
+ * @return the time in microseconds since an unspecified starting point.
+ */
+uint64_t get_monotonic_time_us(void)
+{
+#ifdef WIN32
+	return GetTickCount64() * 1000;
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+#endif
+}
+
 void buffer_read_from_filename(const char *filename, char **buffer, uint64_t *length)
 {
 	FILE *f;
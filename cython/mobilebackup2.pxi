@@ -11,6 +11,7 @@ cdef extern from "libimobiledevice/mobilebackup2.h":
         MOBILEBACKUP2_E_BAD_VERSION = -4
         MOBILEBACKUP2_E_REPLY_NOT_OK = -5
         MOBILEBACKUP2_E_NO_COMMON_VERSION = -6
+        MOBILEBACKUP2_E_NOT_ENOUGH_DATA = -7
         MOBILEBACKUP2_E_UNKNOWN_ERROR = -256
 
     mobilebackup2_error_t mobilebackup2_client_new(idevice_t device, lockdownd_service_descriptor_t descriptor, mobilebackup2_client_t * client)
@@ -34,6 +35,7 @@ cdef class MobileBackup2Error(BaseError):
             MOBILEBACKUP2_E_BAD_VERSION: "Bad version",
             MOBILEBACKUP2_E_REPLY_NOT_OK: "Reply not OK",
             MOBILEBACKUP2_E_NO_COMMON_VERSION: "No common version",
+            MOBILEBACKUP2_E_NOT_ENOUGH_DATA: "Not enough data",
             MOBILEBACKUP2_E_UNKNOWN_ERROR: "Unknown error"
         }
         BaseError.__init__(self, *args, **kwargs)
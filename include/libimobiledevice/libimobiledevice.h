@@ -42,7 +42,10 @@ typedef enum {
 	IDEVICE_E_NO_DEVICE       = -3,
 	IDEVICE_E_NOT_ENOUGH_DATA = -4,
 	IDEVICE_E_BAD_HEADER      = -5,
-	IDEVICE_E_SSL_ERROR       = -6
+	IDEVICE_E_SSL_ERROR       = -6,
+	IDEVICE_E_WANT_READ       = -7,
+	IDEVICE_E_WANT_WRITE      = -8,
+	IDEVICE_E_CANCELLED       = -9
 } idevice_error_t;
 
 typedef struct idevice_private idevice_private;
@@ -51,6 +54,9 @@ typedef idevice_private *idevice_t; /**< The device handle. */
 typedef struct idevice_connection_private idevice_connection_private;
 typedef idevice_connection_private *idevice_connection_t; /**< The connection handle. */
 
+typedef struct idevice_cancel_private idevice_cancel_private;
+typedef idevice_cancel_private *idevice_cancel_t; /**< Cancellation token for blocking receives. */
+
 /* discovery (events/asynchronous) */
 /** The event type for device add or removal */
 enum idevice_event_type {
@@ -70,6 +76,42 @@ typedef struct {
 /** Callback to notifiy if a device was added or removed. */
 typedef void (*idevice_event_cb_t) (const idevice_event_t *event, void *user_data);
 
+typedef struct idevice_subscription_context* idevice_subscription_context_t; /**< A device event subscription. */
+
+/* event loop */
+typedef struct idevice_reactor_private idevice_reactor_private;
+typedef idevice_reactor_private *idevice_reactor_t; /**< The reactor handle. */
+
+/** Readiness events a reactor can wait for and report */
+enum idevice_reactor_event {
+	IDEVICE_REACTOR_READ  = 1 << 0,
+	IDEVICE_REACTOR_WRITE = 1 << 1,
+	IDEVICE_REACTOR_ERROR = 1 << 2
+};
+
+/** Callback invoked by a reactor when a registered connection is ready. */
+typedef void (*idevice_reactor_cb_t) (idevice_connection_t connection, int events, void *user_data);
+
+/* tracing */
+/** Output formats for recorded trace spans */
+typedef enum {
+	IDEVICE_TRACE_FORMAT_CHROME = 0, /**< JSON trace event format as loaded by chrome://tracing or Perfetto */
+	IDEVICE_TRACE_FORMAT_BINARY = 1  /**< Compact binary format */
+} idevice_trace_format_t;
+
+/* statistics */
+/** Traffic counters of a connection. */
+typedef struct {
+	uint64_t bytes_sent; /**< Bytes written to the socket, including TLS overhead. */
+	uint64_t bytes_received; /**< Bytes read from the socket, including TLS overhead. */
+	uint64_t send_calls; /**< Number of socket send operations. */
+	uint64_t recv_calls; /**< Number of socket receive operations. */
+	uint64_t tls_records_sent; /**< Number of TLS records sent (approximated from the write sizes). */
+	uint64_t tls_records_received; /**< Number of TLS records received. */
+	uint64_t send_time_us; /**< Time spent blocked in send operations, in microseconds. */
+	uint64_t recv_time_us; /**< Time spent blocked in receive operations, in microseconds. */
+} idevice_connection_stats_t;
+
 /* functions */
 
 /**
@@ -79,9 +121,118 @@ typedef void (*idevice_event_cb_t) (const idevice_event_t *event, void *user_dat
  */
 void idevice_set_debug_level(int level);
 
+/**
+ * Enable or disable kernel TLS offload for SSL enabled connections.
+ *
+ * When enabled, the record keys of newly established SSL sessions are handed
+ * to the kernel on platforms that support it (Linux with OpenSSL 3.0 or
+ * later), so that encryption no longer happens in userspace. This requires a
+ * TCP transport and an AES-GCM cipher suite; when either is unavailable the
+ * connection transparently keeps using userspace encryption.
+ *
+ * @param enable Set to 1 to enable or 0 to disable kernel TLS offload. It is
+ *     disabled by default.
+ */
+void idevice_set_ktls(int enable);
+
+/**
+ * Enable or disable in-process caching of pair records and the SystemBUID.
+ *
+ * When enabled, pair records read from usbmuxd are kept decoded in memory
+ * and reused by later connections. A cached record is dropped when it is
+ * changed through this library, and when the device is removed while
+ * device events are subscribed (see idevice_events_subscribe() and
+ * idevice_device_registry_set_enabled()). Changes made by other processes,
+ * like pairing with another tool, are not noticed, so the cache should only
+ * be enabled when this process manages the pairing.
+ *
+ * @param enable Set to 1 to enable or 0 to disable the cache. Disabling
+ *     drops all cached data. It is disabled by default.
+ */
+void idevice_set_pair_record_cache(int enable);
+
+/**
+ * Enable or disable recording of trace spans.
+ *
+ * While enabled, the library records the begin and end of connection setup
+ * phases (connecting to the device, QueryType, ValidatePair, StartSession,
+ * the SSL handshake, StartService) and of each property list sent or
+ * received into a ring buffer per thread. Only the most recent events of
+ * each thread are kept. The buffer of a thread that exited is kept until
+ * its events are exported or cleared, or it is reused by a new thread.
+ *
+ * @param enable Set to 1 to enable or 0 to disable recording. It is
+ *     disabled by default.
+ *
+ * @return IDEVICE_E_SUCCESS on success, or IDEVICE_E_UNKNOWN_ERROR if the
+ *     library was built without --enable-tracing.
+ */
+idevice_error_t idevice_trace_set_enabled(int enable);
+
+/**
+ * Write the recorded trace spans of all threads to a file.
+ *
+ * @param filename The file to write to.
+ * @param format The format to write, see idevice_trace_format_t.
+ *
+ * @return IDEVICE_E_SUCCESS on success, IDEVICE_E_INVALID_ARG when filename
+ *     is NULL, or IDEVICE_E_UNKNOWN_ERROR if the file could not be written or
+ *     the library was built without --enable-tracing.
+ */
+idevice_error_t idevice_trace_export(const char *filename, idevice_trace_format_t format);
+
+/**
+ * Discard all recorded trace spans. Memory used for threads that exited is
+ * released, which also happens when the spans are exported.
+ *
+ * @return IDEVICE_E_SUCCESS on success, or IDEVICE_E_UNKNOWN_ERROR if the
+ *     library was built without --enable-tracing.
+ */
+idevice_error_t idevice_trace_clear(void);
+
+/**
+ * Subscribe to device add/remove events. Any number of subscriptions can be
+ * active at the same time.
+ *
+ * Each subscription delivers its events on its own thread, so a slow
+ * callback only delays its own events. A device that is unplugged and
+ * plugged in again before the callback gets to the IDEVICE_DEVICE_REMOVE
+ * event is reported with a single IDEVICE_DEVICE_ADD event, and a device
+ * that is removed again before its IDEVICE_DEVICE_ADD event was delivered
+ * is not reported at all.
+ *
+ * @param context Pointer that receives the subscription context.
+ * @param callback Callback function to call.
+ * @param user_data Application-specific data passed as parameter
+ *   to the registered callback function.
+ *
+ * @return IDEVICE_E_SUCCESS on success or an error value when an error occured.
+ */
+idevice_error_t idevice_events_subscribe(idevice_subscription_context_t *context, idevice_event_cb_t callback, void *user_data);
+
+/**
+ * End a subscription created with idevice_events_subscribe(). Waits for a
+ * running callback of this subscription to return. When called from within
+ * that callback, no further events are delivered after it returns and the
+ * subscription is released by its delivery thread.
+ *
+ * @param context The subscription context to end.
+ *
+ * @return IDEVICE_E_SUCCESS on success or an error value when an error occured.
+ */
+idevice_error_t idevice_events_unsubscribe(idevice_subscription_context_t context);
+
 /**
  * Register a callback function that will be called when device add/remove
- * events occur.
+ * events occur. Registering a new callback replaces the previous one; use
+ * idevice_events_subscribe() for independent subscriptions.
+ *
+ * @note This is implemented on top of idevice_events_subscribe(), so the
+ *   callback is invoked on a separate delivery thread, not the libusbmuxd
+ *   event thread, and add and remove events for the same device that are
+ *   still waiting to be delivered are coalesced as described for
+ *   idevice_events_subscribe(). The callback may
+ *   call idevice_event_unsubscribe() or idevice_event_subscribe().
  *
  * @param callback Callback function to call.
  * @param user_data Application-specific data passed as parameter
@@ -99,6 +250,34 @@ idevice_error_t idevice_event_subscribe(idevice_event_cb_t callback, void *user_
  */
 idevice_error_t idevice_event_unsubscribe(void);
 
+/**
+ * Enable or disable the in-process device registry.
+ *
+ * When enabled, the list of attached devices is kept in memory and updated
+ * from usbmuxd device events, so that idevice_get_device_list() and
+ * idevice_new() do not have to query usbmuxd on every call. When disabled
+ * (the default) both functions query usbmuxd directly.
+ *
+ * @param enable Set to 1 to enable or 0 to disable the registry.
+ *
+ * @return IDEVICE_E_SUCCESS on success, IDEVICE_E_NO_DEVICE if usbmuxd is
+ *   not running, or IDEVICE_E_UNKNOWN_ERROR if subscribing to device events
+ *   failed.
+ */
+idevice_error_t idevice_device_registry_set_enabled(int enable);
+
+/**
+ * Get the generation counter of the device registry. It is incremented
+ * whenever a device is added to or removed from the registry, so callers
+ * can tell whether a device list they got earlier is still current.
+ *
+ * @param generation Pointer that receives the current generation.
+ *
+ * @return IDEVICE_E_SUCCESS on success, IDEVICE_E_INVALID_ARG if generation
+ *   is NULL, or IDEVICE_E_UNKNOWN_ERROR if the registry is not enabled.
+ */
+idevice_error_t idevice_device_registry_get_generation(unsigned int *generation);
+
 /* discovery (synchronous) */
 
 /**
@@ -138,6 +317,29 @@ idevice_error_t idevice_device_list_free(char **devices);
  */
 idevice_error_t idevice_new(idevice_t *device, const char *udid);
 
+/**
+ * Creates an idevice_t structure for a device that is reached directly over
+ * TCP instead of through usbmuxd, for example a network attached device or
+ * a stand-in lockdown server.
+ *
+ * Connections to the lockdown port (62078) go to the port given in address;
+ * connections to service ports go to the same port on the given host.
+ *
+ * @note The resulting idevice_t structure has to be freed with
+ * idevice_free() if it is no longer used.
+ *
+ * @param device Upon calling this function, a pointer to a location of type
+ *  idevice_t. On successful return, this location will be populated.
+ * @param udid The UDID of the device, used to look up its pair record.
+ * @param address The address of the device as "host" or "host:port". When
+ *  no port is given, 62078 is used.
+ *
+ * @return IDEVICE_E_SUCCESS if ok, IDEVICE_E_INVALID_ARG if a parameter is
+ *  NULL or the port is invalid. The device is not contacted until a
+ *  connection is made.
+ */
+idevice_error_t idevice_new_network(idevice_t *device, const char *udid, const char *address);
+
 /**
  * Cleans up an idevice structure, then frees the structure itself.
  * This is a library-level function; deals directly with the device to tear
@@ -185,6 +387,29 @@ idevice_error_t idevice_disconnect(idevice_connection_t connection);
  */
 idevice_error_t idevice_connection_send(idevice_connection_t connection, const char *data, uint32_t len, uint32_t *sent_bytes);
 
+/**
+ * Send the contents of a file to a device via the given connection.
+ *
+ * If SSL is not enabled for the connection (or the kernel handles the
+ * encryption, see idevice_set_ktls()) the data is passed from the file to
+ * the socket inside the kernel using sendfile() where available. Otherwise
+ * it is read into a buffer and sent like with idevice_connection_send().
+ *
+ * @param connection The connection to send data over.
+ * @param fd File descriptor of a regular file to read the data from.
+ * @param offset Offset in the file to start reading from. The file offset of
+ *   fd is not modified, except on WIN32.
+ * @param length Number of bytes to send.
+ * @param sent_bytes Pointer to an uint64_t that will be filled
+ *   with the number of bytes actually sent.
+ *
+ * @return IDEVICE_E_SUCCESS if ok, IDEVICE_E_NOT_ENOUGH_DATA if reading the
+ *   file failed or its end was reached before length bytes were sent (errno
+ *   is set to the error of the read in the former case and to 0 in the
+ *   latter), otherwise an error code.
+ */
+idevice_error_t idevice_connection_send_file(idevice_connection_t connection, int fd, uint64_t offset, uint64_t length, uint64_t *sent_bytes);
+
 /**
  * Receive data from a device via the given connection.
  * This function will return after the given timeout even if no data has been
@@ -217,6 +442,40 @@ idevice_error_t idevice_connection_receive_timeout(idevice_connection_t connecti
  */
 idevice_error_t idevice_connection_receive(idevice_connection_t connection, char *data, uint32_t len, uint32_t *recv_bytes);
 
+/**
+ * Receive data from a device via the given connection, waiting at most until
+ * the given deadline.
+ *
+ * Like with idevice_connection_receive_timeout() the function returns
+ * IDEVICE_E_SUCCESS with recv_bytes set to 0 when the deadline passed
+ * without any data being received. With a deadline that already passed,
+ * only data that is available right away is received. A cancel token set
+ * with idevice_connection_set_cancel() ends the wait immediately.
+ *
+ * @param connection The connection to receive data from.
+ * @param data Buffer that will be filled with the received data.
+ *   This buffer has to be large enough to hold len bytes.
+ * @param len Buffer size or number of bytes to receive.
+ * @param recv_bytes Number of bytes actually received.
+ * @param deadline Absolute deadline as returned by
+ *   idevice_deadline_from_timeout(), or 0 to wait without a time limit.
+ *
+ * @return IDEVICE_E_SUCCESS if ok, IDEVICE_E_CANCELLED if the cancel token of
+ *   the connection was triggered, otherwise an error code.
+ */
+idevice_error_t idevice_connection_receive_deadline(idevice_connection_t connection, char *data, uint32_t len, uint32_t *recv_bytes, uint64_t deadline);
+
+/**
+ * Get the absolute deadline for a timeout starting now, to be passed to the
+ * *_deadline receive functions. A deadline can be shared by several calls,
+ * e.g. to bound a complete request/response exchange.
+ *
+ * @param timeout Timeout in milliseconds.
+ *
+ * @return The deadline, or 0 (no time limit) if timeout is 0.
+ */
+uint64_t idevice_deadline_from_timeout(unsigned int timeout);
+
 /**
  * Enables SSL for the given connection.
  *
@@ -239,6 +498,218 @@ idevice_error_t idevice_connection_enable_ssl(idevice_connection_t connection);
  */
 idevice_error_t idevice_connection_disable_ssl(idevice_connection_t connection);
 
+/**
+ * Get the protocol version and cipher suite that were negotiated for an
+ * SSL enabled connection.
+ *
+ * @param connection The SSL enabled connection.
+ * @param version Pointer that will be set to a newly allocated string with
+ *     the protocol version, e.g. "TLSv1.2". Can be NULL to ignore.
+ * @param cipher Pointer that will be set to a newly allocated string with
+ *     the name of the cipher suite. Can be NULL to ignore.
+ *
+ * @return IDEVICE_E_SUCCESS on success, IDEVICE_E_INVALID_ARG when connection
+ *     is NULL or both version and cipher are NULL, or IDEVICE_E_SSL_ERROR when
+ *     SSL is not enabled for the connection.
+ */
+idevice_error_t idevice_connection_get_ssl_info(idevice_connection_t connection, char **version, char **cipher);
+
+/**
+ * Get the traffic counters of a connection. They are collected for every
+ * connection from the moment it is established.
+ *
+ * @note For SSL enabled connections using OpenSSL the socket is driven by
+ *   OpenSSL, so send_calls, recv_calls and the blocked times count the SSL
+ *   reads and writes instead of the individual socket operations.
+ *
+ * @note The counters are updated without locking. Reading them from another
+ *   thread while the connection is in use can return slightly stale values.
+ *
+ * @param connection The connection to get the counters for.
+ * @param stats Pointer to a structure that will be filled with the counters.
+ *
+ * @return IDEVICE_E_SUCCESS on success, or IDEVICE_E_INVALID_ARG when
+ *     connection or stats is NULL.
+ */
+idevice_error_t idevice_connection_get_stats(idevice_connection_t connection, idevice_connection_stats_t *stats);
+
+/**
+ * Get the underlying file descriptor of a connection, e.g. to wait for it
+ * to become readable or writable in an event loop.
+ *
+ * @note The file descriptor is owned by the connection. Do not read from,
+ *   write to, or close it directly.
+ *
+ * @param connection The connection to get the file descriptor for.
+ * @param fd Pointer to an int that will be set to the file descriptor.
+ *
+ * @return IDEVICE_E_SUCCESS if ok, otherwise an error code.
+ */
+idevice_error_t idevice_connection_get_fd(idevice_connection_t connection, int *fd);
+
+/**
+ * Switch a connection between blocking and non-blocking mode.
+ *
+ * In non-blocking mode idevice_connection_send(),
+ * idevice_connection_receive() and idevice_connection_receive_timeout()
+ * perform a single transfer and return immediately. They report success as
+ * soon as any data was transferred, so the number of bytes sent or received
+ * can be smaller than requested. If nothing could be transferred they return
+ * IDEVICE_E_WANT_READ or IDEVICE_E_WANT_WRITE, telling the caller which
+ * readiness of the file descriptor (see idevice_connection_get_fd()) to wait
+ * for before repeating the call. With SSL enabled either error can be
+ * returned for both directions. A send that failed this way must be repeated
+ * with the same data.
+ *
+ * @note The SSL handshake done by idevice_connection_enable_ssl() is always
+ *   performed in blocking mode.
+ *
+ * @param connection The connection to change.
+ * @param nonblocking 1 to enable non-blocking mode, 0 to disable it.
+ *
+ * @return IDEVICE_E_SUCCESS if ok, otherwise an error code.
+ */
+idevice_error_t idevice_connection_set_nonblocking(idevice_connection_t connection, int nonblocking);
+
+/* cancellation */
+
+/**
+ * Create a cancel token. Once triggered, receives waiting on connections
+ * the token is set for return IDEVICE_E_CANCELLED right away instead of
+ * waiting for data or their timeout. Where supported the token wakes up
+ * the waiting threads through a file descriptor, otherwise they notice it
+ * within 100 milliseconds.
+ *
+ * @param cancel Pointer that will be set to the newly created token.
+ *
+ * @return IDEVICE_E_SUCCESS if ok, otherwise an error code.
+ */
+idevice_error_t idevice_cancel_new(idevice_cancel_t *cancel);
+
+/**
+ * Free a cancel token. It must not be set for any connection anymore.
+ *
+ * @param cancel The token to free.
+ *
+ * @return IDEVICE_E_SUCCESS if ok, otherwise an error code.
+ */
+idevice_error_t idevice_cancel_free(idevice_cancel_t cancel);
+
+/**
+ * Trigger a cancel token. It stays triggered until it is reset, so all
+ * current and following receives on connections using it are cancelled.
+ * This function can be called from any thread.
+ *
+ * @param cancel The token to trigger.
+ *
+ * @return IDEVICE_E_SUCCESS if ok, otherwise an error code.
+ */
+idevice_error_t idevice_cancel_trigger(idevice_cancel_t cancel);
+
+/**
+ * Reset a triggered cancel token so receives wait normally again.
+ *
+ * @param cancel The token to reset.
+ *
+ * @return IDEVICE_E_SUCCESS if ok, otherwise an error code.
+ */
+idevice_error_t idevice_cancel_reset(idevice_cancel_t cancel);
+
+/**
+ * Set the cancel token for blocking receives on a connection. One token can
+ * be shared by any number of connections. Connections in non-blocking mode
+ * are not affected.
+ *
+ * @param connection The connection to set the token for.
+ * @param cancel The token, or NULL to remove it. It is not owned by the
+ *   connection and has to stay valid while it is set.
+ *
+ * @return IDEVICE_E_SUCCESS if ok, otherwise an error code.
+ */
+idevice_error_t idevice_connection_set_cancel(idevice_connection_t connection, idevice_cancel_t cancel);
+
+/* event loop */
+
+/**
+ * Create a reactor that waits for registered connections to become ready
+ * and dispatches their callbacks from a small pool of worker threads.
+ *
+ * @param num_threads Number of worker threads to run, 0 selects one thread.
+ *   Platforms without epoll always use a single thread.
+ * @param reactor Pointer that will be set to the newly created reactor.
+ *
+ * @return IDEVICE_E_SUCCESS if ok, otherwise an error code.
+ */
+idevice_error_t idevice_reactor_new(unsigned int num_threads, idevice_reactor_t *reactor);
+
+/**
+ * Stop the worker threads of a reactor and free it. All connections must
+ * have been removed from the reactor before.
+ *
+ * @param reactor The reactor to free.
+ *
+ * @return IDEVICE_E_SUCCESS if ok, otherwise an error code.
+ */
+idevice_error_t idevice_reactor_free(idevice_reactor_t reactor);
+
+/**
+ * Register a connection with a reactor.
+ *
+ * The callback is invoked from a reactor thread each time one of the
+ * requested events occurs. Callbacks for the same connection never run
+ * concurrently; the connection is re-armed when the callback returns.
+ * Readiness is reported level-triggered on the socket, so data that is
+ * already buffered inside the SSL layer is not signalled again. Callbacks
+ * of SSL connections should therefore read until no more data is available.
+ *
+ * @note The blocking mode of the connection is not changed, see
+ *   idevice_connection_set_nonblocking().
+ *
+ * @param reactor The reactor to register the connection with.
+ * @param connection The connection to watch.
+ * @param events A combination of IDEVICE_REACTOR_READ and
+ *   IDEVICE_REACTOR_WRITE. Errors are always reported.
+ * @param callback Callback to invoke when the connection is ready.
+ * @param user_data Application-specific data passed to the callback.
+ *
+ * @return IDEVICE_E_SUCCESS if ok, otherwise an error code.
+ */
+idevice_error_t idevice_reactor_add(idevice_reactor_t reactor, idevice_connection_t connection, int events, idevice_reactor_cb_t callback, void *user_data);
+
+/**
+ * Unregister a connection from a reactor. Can be called from within the
+ * connection's callback. When called from another thread while the callback
+ * is running, this function waits for the callback to return.
+ *
+ * @param reactor The reactor the connection was registered with.
+ * @param connection The connection to remove.
+ *
+ * @return IDEVICE_E_SUCCESS if ok, otherwise an error code.
+ */
+idevice_error_t idevice_reactor_remove(idevice_reactor_t reactor, idevice_connection_t connection);
+
+/**
+ * Set the reactor used by the library's callback based service APIs, like
+ * syslog_relay_start_capture(), np_set_notify_callback() and the
+ * asynchronous installation_proxy commands. When set, these APIs register
+ * their connection with the given reactor instead of creating a dedicated
+ * thread per client. The default is NULL, meaning one thread per client.
+ *
+ * @note The reactor must outlive all clients that were started while it was
+ *   set as default.
+ *
+ * @param reactor The reactor to use, or NULL to restore the thread per
+ *   client behaviour.
+ */
+void idevice_set_default_reactor(idevice_reactor_t reactor);
+
+/**
+ * Get the reactor set with idevice_set_default_reactor().
+ *
+ * @return The default reactor or NULL if none is set.
+ */
+idevice_reactor_t idevice_get_default_reactor(void);
+
 /* misc */
 
 /**
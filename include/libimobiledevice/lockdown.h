@@ -171,6 +171,43 @@ lockdownd_error_t lockdownd_query_type(lockdownd_client_t client, char **type);
  */
 lockdownd_error_t lockdownd_get_value(lockdownd_client_t client, const char *domain, const char *key, plist_t *value);
 
+/**
+ * Retrieves several values of a domain at once. All GetValue requests are
+ * sent before the responses are read, which saves a round trip per key
+ * compared to calling lockdownd_get_value() repeatedly.
+ *
+ * @param client An initialized lockdownd client.
+ * @param domain The domain to query on or NULL for global domain
+ * @param keys Array of the key names to request
+ * @param count Number of entries in keys and values
+ * @param values Array that receives a plist node for each key, or NULL if
+ *  the device did not return a value for it. Each node has to be freed with
+ *  plist_free().
+ *
+ * @return LOCKDOWN_E_SUCCESS if all values were retrieved, otherwise the
+ *  error of the first key that failed. LOCKDOWN_E_INVALID_ARG when client,
+ *  keys or values is NULL.
+ */
+lockdownd_error_t lockdownd_get_values(lockdownd_client_t client, const char *domain, const char **keys, unsigned int count, plist_t *values);
+
+/**
+ * Enables a cache for values that never change for a device, like
+ * UniqueDeviceID, ProductType or SerialNumber of the global domain.
+ * lockdownd_get_value() and lockdownd_get_values() then only query each of
+ * these values once per device. The cache of a device is invalidated by
+ * lockdownd_set_value() and lockdownd_remove_value().
+ *
+ * @param enable 1 to enable the cache, 0 to disable (the default) and clear it.
+ */
+void lockdownd_value_cache_set_enabled(int enable);
+
+/**
+ * Removes the cached values of a device.
+ *
+ * @param udid The UDID of the device or NULL to clear the whole cache.
+ */
+void lockdownd_value_cache_invalidate(const char *udid);
+
 /**
  * Sets a preferences value using a plist and optional by domain and/or key name.
  *
@@ -227,6 +264,23 @@ lockdownd_error_t lockdownd_start_service(lockdownd_client_t client, const char
  */
 lockdownd_error_t lockdownd_start_service_with_escrow_bag(lockdownd_client_t client, const char *identifier, lockdownd_service_descriptor_t *service);
 
+/**
+ * Requests to start several services at once. All StartService requests
+ * are sent before the responses are read, which saves a round trip per
+ * service compared to calling lockdownd_start_service() repeatedly.
+ *
+ * @param client The lockdownd client
+ * @param identifiers Array of the identifiers of the services to start
+ * @param count Number of entries in identifiers and services
+ * @param services Array that receives a service descriptor for each
+ *   identifier, or NULL for services that could not be started. Each
+ *   descriptor has to be freed with lockdownd_service_descriptor_free().
+ *
+ * @return LOCKDOWN_E_SUCCESS if all services were started, otherwise the
+ *  error of the first service that failed.
+ */
+lockdownd_error_t lockdownd_start_services(lockdownd_client_t client, const char **identifiers, unsigned int count, lockdownd_service_descriptor_t *services);
+
 /**
  * Opens a session with lockdownd and switches to SSL mode if device wants it.
  *
@@ -279,6 +333,29 @@ lockdownd_error_t lockdownd_send(lockdownd_client_t client, plist_t plist);
  */
 lockdownd_error_t lockdownd_receive(lockdownd_client_t client, plist_t *plist);
 
+/**
+ * Sends several requests to lockdownd back-to-back and then reads the
+ * responses. lockdownd processes requests in order, so this saves a round
+ * trip per request compared to alternating lockdownd_send() and
+ * lockdownd_receive().
+ *
+ * @note This function is low-level and should only be used if you need to send
+ *        a new type of message.
+ *
+ * @param client The lockdownd client
+ * @param requests Array of request dictionaries to send. The requests are
+ *    not freed.
+ * @param count Number of entries in requests and responses
+ * @param responses Array that receives the response for each request in
+ *    order. Entries for requests that did not get a response are set to
+ *    NULL. The responses must be freed with plist_free().
+ *
+ * @return LOCKDOWN_E_SUCCESS if all requests were sent and all responses
+ *  received, LOCKDOWN_E_INVALID_ARG when a parameter is NULL or count is 0,
+ *  or the error of the first request that could not be sent or answered.
+ */
+lockdownd_error_t lockdownd_request_batch(lockdownd_client_t client, plist_t *requests, unsigned int count, plist_t *responses);
+
 /**
  * Pairs the device using the supplied pair record.
  *
@@ -349,6 +426,40 @@ lockdownd_error_t lockdownd_validate_pair(lockdownd_client_t client, lockdownd_p
  */
 lockdownd_error_t lockdownd_unpair(lockdownd_client_t client, lockdownd_pair_record_t pair_record);
 
+/**
+ * Starts generating root and host keys for new pair records in the
+ * background. Generating the RSA keys is the slowest part of pairing, so
+ * tools that pair many devices can keep a number of key sets ready and
+ * lockdownd_pair() will use them instead of generating keys on demand.
+ * The pool is refilled while it is running.
+ *
+ * @param depth The number of key sets to keep ready, must not be 0.
+ * @param num_threads The number of worker threads generating keys, pass 0
+ *    to use a single thread.
+ *
+ * @return LOCKDOWN_E_SUCCESS on success, LOCKDOWN_E_INVALID_ARG if depth is 0
+ *  or the key pool is already running, or LOCKDOWN_E_UNKNOWN_ERROR if no
+ *  worker thread could be started.
+ */
+lockdownd_error_t lockdownd_key_pool_start(unsigned int depth, unsigned int num_threads);
+
+/**
+ * Stops the background key generation and discards all unused keys.
+ */
+void lockdownd_key_pool_stop(void);
+
+/**
+ * Retrieves the state of the background key generation.
+ *
+ * @param available Set to the number of key sets that are ready for use.
+ *    Can be NULL.
+ * @param generated Set to the total number of key sets generated.
+ *    Can be NULL.
+ * @param rate Set to the average number of key sets a single worker thread
+ *    generates per second. Can be NULL.
+ */
+void lockdownd_key_pool_get_stats(unsigned int *available, uint64_t *generated, double *rate);
+
 /**
  * Activates the device. Only works within an open session.
  * The ActivationRecord plist dictionary must be obtained using the
@@ -455,6 +566,32 @@ lockdownd_error_t lockdownd_get_sync_data_classes(lockdownd_client_t client, cha
  */
 lockdownd_error_t lockdownd_data_classes_free(char **classes);
 
+/**
+ * Enables the lockdown session pool used when starting services with the
+ * *_client_start_service() functions.
+ *
+ * With the pool enabled, the authenticated lockdown session that was used to
+ * start a service is kept open and reused for the next service started on
+ * the same device over the same connection type with the same label,
+ * instead of repeating the pairing validation, session start and SSL
+ * handshake every time. A session that fails is replaced with a fresh one
+ * automatically. Sessions that stayed unused for longer than idle_timeout
+ * are closed whenever a session is acquired or released.
+ *
+ * @param idle_timeout Number of seconds an unused session is kept open.
+ *   Pass 0 to disable the pool (the default) and close all idle sessions.
+ */
+void lockdownd_session_pool_set_idle_timeout(unsigned int idle_timeout);
+
+/**
+ * Closes the idle pooled lockdown sessions of a device, e.g. after it was
+ * disconnected, along with the expired sessions of other devices.
+ *
+ * @param udid The UDID of the device or NULL to close the idle sessions of
+ *   all devices.
+ */
+void lockdownd_session_pool_flush(const char *udid);
+
 /**
  * Frees memory of a service descriptor as returned by lockdownd_start_service()
  *
@@ -127,6 +127,25 @@ mobile_image_mounter_error_t mobile_image_mounter_lookup_image(mobile_image_moun
  */
 mobile_image_mounter_error_t mobile_image_mounter_upload_image(mobile_image_mounter_client_t client, const char *image_type, size_t image_size, const char *signature, uint16_t signature_size, mobile_image_mounter_upload_cb_t upload_cb, void* userdata);
 
+/**
+ * Uploads an image from a file to the device.
+ * Unlike mobile_image_mounter_upload_image() the image data does not pass
+ * through a userspace buffer if the connection allows sending directly from
+ * the file, see idevice_connection_send_file().
+ *
+ * @param client The connected mobile_image_mounter client.
+ * @param image_type Type of image that is being uploaded.
+ * @param fd File descriptor of the image file. Data is sent starting at
+ *    offset 0.
+ * @param image_size Size of the image to upload.
+ * @param signature Pointer to a buffer holding the images' signature
+ * @param signature_size Size of the buffer pointed to by signature
+ *
+ * @return MOBILE_IMAGE_MOUNTER_E_SUCCESS on succes, or a
+ *    MOBILE_IMAGE_MOUNTER_E_* error code otherwise.
+ */
+mobile_image_mounter_error_t mobile_image_mounter_upload_image_file(mobile_image_mounter_client_t client, const char *image_type, int fd, size_t image_size, const char *signature, uint16_t signature_size);
+
 /**
  * Mounts an image on the device.
  *
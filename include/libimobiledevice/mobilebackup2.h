@@ -42,12 +42,26 @@ typedef enum {
 	MOBILEBACKUP2_E_BAD_VERSION       = -4,
 	MOBILEBACKUP2_E_REPLY_NOT_OK      = -5,
 	MOBILEBACKUP2_E_NO_COMMON_VERSION = -6,
+	MOBILEBACKUP2_E_NOT_ENOUGH_DATA   = -7,
 	MOBILEBACKUP2_E_UNKNOWN_ERROR     = -256
 } mobilebackup2_error_t;
 
 typedef struct mobilebackup2_client_private mobilebackup2_client_private;
 typedef mobilebackup2_client_private *mobilebackup2_client_t; /**< The client handle. */
 
+/**
+ * Handler for a DL* message, see mobilebackup2_set_message_handler().
+ *
+ * @param message The received DL* message plist. It is owned by the caller
+ *     and only valid while the handler runs.
+ * @param dlmessage The DL* message string of the message.
+ * @param user_data The user data passed to mobilebackup2_dispatch_message().
+ *
+ * @return A value that is passed back to the caller of
+ *     mobilebackup2_dispatch_message().
+ */
+typedef int (*mobilebackup2_message_handler_t)(plist_t message, const char *dlmessage, void *user_data);
+
 
 /**
  * Connects to the mobilebackup2 service on the specified device.
@@ -124,6 +138,41 @@ mobilebackup2_error_t mobilebackup2_send_message(mobilebackup2_client_t client,
  */
 mobilebackup2_error_t mobilebackup2_receive_message(mobilebackup2_client_t client, plist_t *msg_plist, char **dlmessage);
 
+/**
+ * Registers a handler that mobilebackup2_dispatch_message() invokes for the
+ * given DL* message type. Message types are looked up in a hash table that
+ * is rebuilt when handlers are registered, so handlers should be registered
+ * once before processing the messages of an operation.
+ *
+ * @param client The connected MobileBackup client to use.
+ * @param dlmessage The DL* message string to register the handler for, e.g.
+ *     "DLMessageDownloadFiles", or NULL to register a handler for all
+ *     messages without a handler of their own.
+ * @param handler The handler to invoke, or NULL to remove the handler.
+ *
+ * @return MOBILEBACKUP2_E_SUCCESS on success, MOBILEBACKUP2_E_INVALID_ARG if
+ *    client is invalid or dlmessage is not a DL* message string, or
+ *    MOBILEBACKUP2_E_UNKNOWN_ERROR if the handler could not be registered.
+ */
+mobilebackup2_error_t mobilebackup2_set_message_handler(mobilebackup2_client_t client, const char *dlmessage, mobilebackup2_message_handler_t handler);
+
+/**
+ * Receives a DL* message plist from the device and invokes the handler
+ * registered for it with mobilebackup2_set_message_handler(). Unlike
+ * mobilebackup2_receive_message() the DL* message string is not copied.
+ *
+ * @param client The connected MobileBackup client to use.
+ * @param user_data User data that is passed to the handler.
+ * @param result Set to the return value of the invoked handler, or to 0 if
+ *    no handler was registered for the received message. Can be NULL.
+ *
+ * @return MOBILEBACKUP2_E_SUCCESS if a DL* message was received,
+ *    MOBILEBACKUP2_E_INVALID_ARG if client is invalid,
+ *    MOBILEBACKUP2_E_PLIST_ERROR if the received plist is not a DL* message
+ *    plist, or MOBILEBACKUP2_E_MUX_ERROR if receiving from the device failed.
+ */
+mobilebackup2_error_t mobilebackup2_dispatch_message(mobilebackup2_client_t client, void *user_data, int *result);
+
 /**
  * Send binary data to the device.
  *
@@ -142,6 +191,27 @@ mobilebackup2_error_t mobilebackup2_receive_message(mobilebackup2_client_t clien
  */
 mobilebackup2_error_t mobilebackup2_send_raw(mobilebackup2_client_t client, const char *data, uint32_t length, uint32_t *bytes);
 
+/**
+ * Send binary data from a file to the device.
+ * The data is passed from the file to the connection inside the kernel when
+ * possible instead of being copied through a userspace buffer.
+ *
+ * @param client The MobileBackup client to send to.
+ * @param fd File descriptor of the file to read the data from
+ * @param offset Offset in the file to start reading from
+ * @param length Number of bytes to send
+ * @param bytes Number of bytes actually sent, also set on error
+ * @param read_error If not NULL, set to the errno value of a failed read of
+ *     the file, or to 0 if the file could be read (can be NULL to ignore)
+ *
+ * @return MOBILEBACKUP2_E_SUCCESS if all data was sent,
+ *     MOBILEBACKUP2_E_INVALID_ARG if one of the parameters is invalid,
+ *     MOBILEBACKUP2_E_NOT_ENOUGH_DATA if the file could not be read
+ *     (read_error is non-zero) or is too short (read_error is 0), or
+ *     MOBILEBACKUP2_E_MUX_ERROR if sending of the data failed.
+ */
+mobilebackup2_error_t mobilebackup2_send_raw_file(mobilebackup2_client_t client, int fd, uint64_t offset, uint64_t length, uint64_t *bytes, int *read_error);
+
 /**
  * Receive binary from the device.
  *
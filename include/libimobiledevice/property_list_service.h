@@ -38,12 +38,23 @@ typedef enum {
 	PROPERTY_LIST_SERVICE_E_MUX_ERROR       = -3,
 	PROPERTY_LIST_SERVICE_E_SSL_ERROR       = -4,
 	PROPERTY_LIST_SERVICE_E_RECEIVE_TIMEOUT = -5,
+	PROPERTY_LIST_SERVICE_E_CANCELLED       = -6,
 	PROPERTY_LIST_SERVICE_E_UNKNOWN_ERROR   = -256
 } property_list_service_error_t;
 
+/** Encoding of the plists sent by property_list_service_send_plist() */
+typedef enum {
+	PROPERTY_LIST_SERVICE_FORMAT_XML    = 0,
+	PROPERTY_LIST_SERVICE_FORMAT_BINARY = 1
+} property_list_service_format_t;
+
 typedef struct property_list_service_client_private property_list_service_private;
 typedef property_list_service_private* property_list_service_client_t; /**< The client handle. */
 
+typedef struct property_list_view_private property_list_view_private;
+typedef property_list_view_private* property_list_view_t; /**< A received plist that is decoded on demand. */
+typedef uint64_t property_list_view_node_t; /**< A node inside of a property_list_view_t, 0 if there is none. */
+
 /* Interface */
 
 /**
@@ -97,6 +108,35 @@ property_list_service_error_t property_list_service_send_xml_plist(property_list
  */
 property_list_service_error_t property_list_service_send_binary_plist(property_list_service_client_t client, plist_t plist);
 
+/**
+ * Sends a plist in the wire format preferred for the given client.
+ *
+ * Plists are sent as XML, which every iOS version accepts, unless binary
+ * was selected with property_list_service_set_wire_format(). The device
+ * answers in the format of the request, so the format of received plists
+ * does not change it.
+ *
+ * @param client The property list service client to use for sending.
+ * @param plist plist to send
+ *
+ * @return PROPERTY_LIST_SERVICE_E_SUCCESS on success,
+ *      PROPERTY_LIST_SERVICE_E_INVALID_ARG when client or plist is NULL,
+ *      PROPERTY_LIST_SERVICE_E_PLIST_ERROR when dict is not a valid plist,
+ *      or PROPERTY_LIST_SERVICE_E_UNKNOWN_ERROR when an unspecified error occurs.
+ */
+property_list_service_error_t property_list_service_send_plist(property_list_service_client_t client, plist_t plist);
+
+/**
+ * Sets the wire format used by property_list_service_send_plist().
+ *
+ * @param client The property list service client.
+ * @param format The format to send plists in.
+ *
+ * @return PROPERTY_LIST_SERVICE_E_SUCCESS on success, or
+ *      PROPERTY_LIST_SERVICE_E_INVALID_ARG when client is NULL.
+ */
+property_list_service_error_t property_list_service_set_wire_format(property_list_service_client_t client, property_list_service_format_t format);
+
 /**
  * Receives a plist using the given property list service client with specified
  * timeout.
@@ -116,6 +156,32 @@ property_list_service_error_t property_list_service_send_binary_plist(property_l
  */
 property_list_service_error_t property_list_service_receive_plist_with_timeout(property_list_service_client_t client, plist_t *plist, unsigned int timeout);
 
+/**
+ * Receives a plist using the given property list service client, giving up
+ * when the whole message was not received until the given deadline.
+ * Unlike property_list_service_receive_plist_with_timeout() the deadline
+ * also covers the message body, so a stalled transfer cannot block the
+ * caller for longer than intended.
+ * Binary or XML plists are automatically handled.
+ *
+ * @param client The property list service client to use for receiving
+ * @param plist pointer to a plist_t that will point to the received plist
+ *      upon successful return
+ * @param deadline Absolute deadline as returned by
+ *      idevice_deadline_from_timeout(), or 0 to wait without time limit.
+ *
+ * @return PROPERTY_LIST_SERVICE_E_SUCCESS on success,
+ *      PROPERTY_LIST_SERVICE_E_INVALID_ARG when client or plist is NULL,
+ *      PROPERTY_LIST_SERVICE_E_RECEIVE_TIMEOUT when the deadline passed,
+ *      PROPERTY_LIST_SERVICE_E_CANCELLED when the cancel token set with
+ *      property_list_service_set_cancel() was triggered,
+ *      PROPERTY_LIST_SERVICE_E_PLIST_ERROR when the received data cannot be
+ *      converted to a plist, PROPERTY_LIST_SERVICE_E_MUX_ERROR when a
+ *      communication error occurs, or PROPERTY_LIST_SERVICE_E_UNKNOWN_ERROR
+ *      when an unspecified error occurs.
+ */
+property_list_service_error_t property_list_service_receive_plist_with_deadline(property_list_service_client_t client, plist_t *plist, uint64_t deadline);
+
 /**
  * Receives a plist using the given property list service client.
  * Binary or XML plists are automatically handled.
@@ -137,6 +203,216 @@ property_list_service_error_t property_list_service_receive_plist_with_timeout(p
  */
 property_list_service_error_t property_list_service_receive_plist(property_list_service_client_t client, plist_t *plist);
 
+/**
+ * Receives a plist without converting it into a plist_t tree.
+ *
+ * Nodes of binary plists are decoded from the received message only when
+ * they are accessed with the property_list_view_* functions, so callers
+ * that need a few values out of a large response neither pay for parsing
+ * the whole message nor for holding all of its nodes in memory. XML plists
+ * are parsed completely and accessed through the same functions.
+ *
+ * This function uses a timeout of 10 seconds like
+ * property_list_service_receive_plist().
+ *
+ * @param client The property list service client to use for receiving
+ * @param view Pointer that will be set to the received plist upon
+ *      successful return. It has to be freed with property_list_view_free().
+ *
+ * @return PROPERTY_LIST_SERVICE_E_SUCCESS on success,
+ *      PROPERTY_LIST_SERVICE_E_INVALID_ARG when client or view is NULL,
+ *      PROPERTY_LIST_SERVICE_E_PLIST_ERROR when the received data is not a
+ *      valid plist, PROPERTY_LIST_SERVICE_E_MUX_ERROR when a communication
+ *      error occurs, or PROPERTY_LIST_SERVICE_E_UNKNOWN_ERROR when an
+ *      unspecified error occurs.
+ */
+property_list_service_error_t property_list_service_receive_plist_view(property_list_service_client_t client, property_list_view_t *view);
+
+/**
+ * Frees a plist view and the message it was decoded from. All nodes and
+ * values obtained from the view without copying become invalid.
+ *
+ * @param view The view to free.
+ */
+void property_list_view_free(property_list_view_t view);
+
+/**
+ * Get the root node of a plist view.
+ *
+ * @param view The plist view.
+ *
+ * @return The root node, or 0 if view is NULL.
+ */
+property_list_view_node_t property_list_view_get_root(property_list_view_t view);
+
+/**
+ * Get the type of a node.
+ *
+ * @param view The plist view.
+ * @param node The node.
+ *
+ * @return The type of the node, or PLIST_NONE if the node is invalid.
+ */
+plist_type property_list_view_get_node_type(property_list_view_t view, property_list_view_node_t node);
+
+/**
+ * Get the number of items of an array or dict node.
+ *
+ * @param view The plist view.
+ * @param node The array or dict node.
+ *
+ * @return The number of items, or 0 if the node is not an array or dict.
+ */
+uint32_t property_list_view_get_size(property_list_view_t view, property_list_view_node_t node);
+
+/**
+ * Get the nth item of an array node.
+ *
+ * @param view The plist view.
+ * @param node The array node.
+ * @param n The index of the item.
+ *
+ * @return The item, or 0 if the node is not an array or n is out of range.
+ */
+property_list_view_node_t property_list_view_array_get_item(property_list_view_t view, property_list_view_node_t node, uint32_t n);
+
+/**
+ * Get the value of a dict node for the given key.
+ *
+ * @param view The plist view.
+ * @param node The dict node.
+ * @param key The key to look for.
+ *
+ * @return The value, or 0 if the node is not a dict or has no such key.
+ */
+property_list_view_node_t property_list_view_dict_get_item(property_list_view_t view, property_list_view_node_t node, const char *key);
+
+/**
+ * Get the nth item of a dict node, to iterate over a dict.
+ *
+ * @param view The plist view.
+ * @param node The dict node.
+ * @param n The index of the item.
+ * @param key Set to a newly allocated copy of the key of the item, or NULL
+ *     if the item does not exist. Can be NULL.
+ *
+ * @return The value of the item, or 0 if the node is not a dict or n is out
+ *     of range.
+ */
+property_list_view_node_t property_list_view_dict_get_item_at(property_list_view_t view, property_list_view_node_t node, uint32_t n, char **key);
+
+/**
+ * Get the value of a string node.
+ *
+ * @param view The plist view.
+ * @param node The string node.
+ * @param val Set to a newly allocated copy of the string, or NULL if the node
+ *     is not a string.
+ */
+void property_list_view_get_string_val(property_list_view_t view, property_list_view_node_t node, char **val);
+
+/**
+ * Get the value of an unsigned integer node.
+ *
+ * @param view The plist view.
+ * @param node The integer node.
+ * @param val Set to the value, or 0 if the node is not an integer.
+ */
+void property_list_view_get_uint_val(property_list_view_t view, property_list_view_node_t node, uint64_t *val);
+
+/**
+ * Get the value of a boolean node.
+ *
+ * @param view The plist view.
+ * @param node The boolean node.
+ * @param val Set to the value, or 0 if the node is not a boolean.
+ */
+void property_list_view_get_bool_val(property_list_view_t view, property_list_view_node_t node, uint8_t *val);
+
+/**
+ * Get the value of a real node.
+ *
+ * @param view The plist view.
+ * @param node The real node.
+ * @param val Set to the value, or 0.0 if the node is not a real.
+ */
+void property_list_view_get_real_val(property_list_view_t view, property_list_view_node_t node, double *val);
+
+/**
+ * Get the value of a data node.
+ *
+ * @param view The plist view.
+ * @param node The data node.
+ * @param val Set to a newly allocated copy of the data, or NULL if the node
+ *     is not a data node.
+ * @param length Set to the length of the data.
+ */
+void property_list_view_get_data_val(property_list_view_t view, property_list_view_node_t node, char **val, uint64_t *length);
+
+/**
+ * Convert a node and all of its children into a plist_t, e.g. to pass a
+ * single entry of a large response on to code using libplist.
+ *
+ * @param view The plist view.
+ * @param node The node to copy.
+ *
+ * @return A newly allocated plist that has to be freed with plist_free(),
+ *     or NULL if the node is invalid or, for a binary plist that references
+ *     the same container several times, would expand into more nodes than
+ *     the plist holds references.
+ */
+plist_t property_list_view_copy_node(property_list_view_t view, property_list_view_node_t node);
+
+/**
+ * Configure how large received messages are handled.
+ *
+ * By default messages of 16 MB or more are rejected and all messages are
+ * received into memory. With a spill threshold, messages larger than the
+ * threshold are received into a temporary file in small chunks and parsed
+ * from a mapping of that file, so memory use for the raw message does not
+ * grow with its size. This is not supported on Windows.
+ *
+ * @param client The property list service client.
+ * @param max_message_size Messages of this size or larger fail with
+ *     PROPERTY_LIST_SERVICE_E_UNKNOWN_ERROR. Pass 0 for the default of 16 MB.
+ * @param spill_threshold Messages larger than this many bytes are received
+ *     into a temporary file. Pass 0 to always receive into memory.
+ *
+ * @return PROPERTY_LIST_SERVICE_E_SUCCESS on success, or
+ *     PROPERTY_LIST_SERVICE_E_INVALID_ARG when client is NULL.
+ */
+property_list_service_error_t property_list_service_set_receive_limits(property_list_service_client_t client, uint32_t max_message_size, uint32_t spill_threshold);
+
+/**
+ * Get the statistics of the buffer a property list service client reuses
+ * for receiving messages.
+ *
+ * @param client The property list service client.
+ * @param allocations Set to the number of times the receive buffer had to
+ *     be allocated or grown. Can be NULL.
+ * @param reuses Set to the number of received messages that fit into the
+ *     existing receive buffer, i.e. allocations that were avoided. Can be
+ *     NULL.
+ *
+ * @return PROPERTY_LIST_SERVICE_E_SUCCESS on success, or
+ *     PROPERTY_LIST_SERVICE_E_INVALID_ARG when client is NULL.
+ */
+property_list_service_error_t property_list_service_get_buffer_stats(property_list_service_client_t client, uint64_t *allocations, uint64_t *reuses);
+
+/**
+ * Sets a cancel token for the connection of the given property list service
+ * client. While it is set, receive operations blocked on the client return
+ * PROPERTY_LIST_SERVICE_E_CANCELLED as soon as the token is triggered.
+ *
+ * @param client The property list service client
+ * @param cancel The cancel token created with idevice_cancel_new(), or NULL
+ *     to remove a previously set token.
+ *
+ * @return PROPERTY_LIST_SERVICE_E_SUCCESS on success, or
+ *     PROPERTY_LIST_SERVICE_E_INVALID_ARG when client is invalid.
+ */
+property_list_service_error_t property_list_service_set_cancel(property_list_service_client_t client, idevice_cancel_t cancel);
+
 /**
  * Enable SSL for the given property list service client.
  *
@@ -37,12 +37,29 @@ typedef enum {
 	SERVICE_E_MUX_ERROR           = -3,
 	SERVICE_E_SSL_ERROR           = -4,
 	SERVICE_E_START_SERVICE_ERROR = -5,
+	SERVICE_E_CANCELLED           = -6,
+	SERVICE_E_NOT_ENOUGH_DATA     = -7,
 	SERVICE_E_UNKNOWN_ERROR       = -256
 } service_error_t;
 
 typedef struct service_client_private service_client_private;
 typedef service_client_private* service_client_t; /**< The client handle. */
 
+/** Number of buckets of the round-trip time histogram. */
+#define SERVICE_RTT_HISTOGRAM_BUCKETS 16
+
+/** Traffic and latency counters of a service client. */
+typedef struct {
+	idevice_connection_stats_t connection; /**< Counters of the underlying connection. */
+	uint64_t messages_sent; /**< Number of messages sent. */
+	uint64_t messages_received; /**< Number of messages received. */
+	uint64_t rtt_count; /**< Number of round trips measured. */
+	uint64_t rtt_total_us; /**< Sum of all measured round-trip times, in microseconds. */
+	/** Round-trip times: bucket 0 counts replies within 1 ms, bucket n
+	 * replies within [2^(n-1), 2^n) ms, and the last bucket all slower ones. */
+	uint64_t rtt_histogram[SERVICE_RTT_HISTOGRAM_BUCKETS];
+} service_client_stats_t;
+
 #define SERVICE_CONSTRUCTOR(x) (int32_t (*)(idevice_t, lockdownd_service_descriptor_t, void**))(x)
 
 /* Interface */
@@ -78,6 +95,29 @@ service_error_t service_client_new(idevice_t device, lockdownd_service_descripto
  */
 service_error_t service_client_factory_start_service(idevice_t device, const char* service_name, void **client, const char* label, int32_t (*constructor_func)(idevice_t, lockdownd_service_descriptor_t, void**), int32_t *error_code);
 
+/**
+ * Starts several services on the specified device with a single lockdown
+ * session and connects to all of them in parallel.
+ *
+ * @param device The device to connect to.
+ * @param service_names Array of the names of the services to start.
+ * @param count Number of entries in each of the arrays.
+ * @param clients Array that receives the newly created clients. Entries
+ *     of services that could not be started or connected are set to NULL.
+ *     The created clients must be freed with the matching free function,
+ *     also when an error is returned.
+ * @param label The label to use for communication. Usually the program name.
+ *  Pass NULL to disable sending the label in requests to lockdownd.
+ * @param constructor_funcs Array of constructors, one per service, wrapped
+ *     with SERVICE_CONSTRUCTOR(). NULL entries create plain service clients.
+ * @param error_codes Array that receives the result of each constructor,
+ *     or NULL to ignore them.
+ *
+ * @return SERVICE_E_SUCCESS if all clients were created, or
+ *     SERVICE_E_START_SERVICE_ERROR if at least one of them failed.
+ */
+service_error_t service_client_factory_start_services(idevice_t device, const char **service_names, unsigned int count, void **clients, const char* label, int32_t (**constructor_funcs)(idevice_t, lockdownd_service_descriptor_t, void**), int32_t *error_codes);
+
 /**
  * Frees a service instance.
  *
@@ -105,6 +145,27 @@ service_error_t service_client_free(service_client_t client);
  */
 service_error_t service_send(service_client_t client, const char *data, uint32_t size, uint32_t *sent);
 
+/**
+ * Sends the contents of a file using the given service client.
+ * The data is passed from the file to the connection inside the kernel when
+ * possible, see idevice_connection_send_file().
+ *
+ * @param client The service client to use for sending.
+ * @param fd File descriptor of the file to send data from
+ * @param offset Offset in the file to start sending from
+ * @param length Number of bytes to send
+ * @param sent Number of bytes sent (can be NULL to ignore)
+ *
+ * @return SERVICE_E_SUCCESS on success,
+ *      SERVICE_E_INVALID_ARG when one or more parameters are
+ *      invalid, SERVICE_E_SSL_ERROR when sending over SSL failed,
+ *      SERVICE_E_NOT_ENOUGH_DATA when the file could not be read or is
+ *      shorter than offset + length (errno is set like with
+ *      idevice_connection_send_file()), or SERVICE_E_UNKNOWN_ERROR when an
+ *      unspecified error occurs.
+ */
+service_error_t service_send_file(service_client_t client, int fd, uint64_t offset, uint64_t length, uint64_t *sent);
+
 /**
  * Receives data using the given service client with specified timeout.
  *
@@ -122,6 +183,24 @@ service_error_t service_send(service_client_t client, const char *data, uint32_t
  */
 service_error_t service_receive_with_timeout(service_client_t client, char *data, uint32_t size, uint32_t *received, unsigned int timeout);
 
+/**
+ * Receives data using the given service client until an absolute deadline.
+ *
+ * @param client The service client to use for receiving
+ * @param data Buffer that will be filled with the data received
+ * @param size Number of bytes to receive
+ * @param received Number of bytes received (can be NULL to ignore)
+ * @param deadline Absolute deadline as returned by
+ *      idevice_deadline_from_timeout(), or 0 to wait without time limit.
+ *
+ * @return SERVICE_E_SUCCESS on success (with 0 bytes received when the
+ *      deadline passed), SERVICE_E_INVALID_ARG when one or more parameters
+ *      are invalid, SERVICE_E_CANCELLED when the cancel token of the
+ *      connection was triggered, or SERVICE_E_UNKNOWN_ERROR when an
+ *      unspecified error occurs.
+ */
+service_error_t service_receive_with_deadline(service_client_t client, char *data, uint32_t size, uint32_t *received, uint64_t deadline);
+
 /**
  * Receives data using the given service client.
  *
@@ -162,6 +241,38 @@ service_error_t service_enable_ssl(service_client_t client);
  */
 service_error_t service_disable_ssl(service_client_t client);
 
+/**
+ * Get the underlying connection of the given service client.
+ *
+ * @param client The service client.
+ * @param connection Pointer that will be set to the connection used by the
+ *     service client. It is owned by the client and must not be freed.
+ *
+ * @return SERVICE_E_SUCCESS on success, or SERVICE_E_INVALID_ARG when client
+ *     or connection is NULL.
+ */
+service_error_t service_get_connection(service_client_t client, idevice_connection_t *connection);
+
+/**
+ * Get the traffic and latency counters of the given service client.
+ *
+ * Messages are counted by the message based services built on top of the
+ * service client, e.g. the property list services. A round trip is the
+ * time from the first message sent after the last reply until the next
+ * message is received, so it is the latency of a request for services
+ * that answer each request. Round trips are not measured for services
+ * where the device sends messages on its own, like notification_proxy,
+ * heartbeat, mobilebackup and mobilebackup2; their rtt fields stay 0.
+ *
+ * @param client The service client.
+ * @param stats Pointer to a structure that will be filled with the
+ *     counters.
+ *
+ * @return SERVICE_E_SUCCESS on success, or SERVICE_E_INVALID_ARG when
+ *     client or stats is NULL.
+ */
+service_error_t service_client_get_stats(service_client_t client, service_client_stats_t *stats);
+
 #ifdef __cplusplus
 }
 #endif
@@ -38,6 +38,7 @@ typedef enum {
 	SYSLOG_RELAY_E_INVALID_ARG   = -1,
 	SYSLOG_RELAY_E_MUX_ERROR     = -2,
 	SYSLOG_RELAY_E_SSL_ERROR     = -3,
+	SYSLOG_RELAY_E_CANCELLED     = -4,
 	SYSLOG_RELAY_E_UNKNOWN_ERROR = -256
 } syslog_relay_error_t;
 
@@ -70,6 +70,136 @@ static int device_link_service_get_message(plist_t dl_msg, char **message)
 	return 1;
 }
 
+/**
+ * Internally used function to look up the message string of a DL* message
+ * plist without copying it, if libplist allows to.
+ *
+ * @param dl_msg The DeviceLink property list to parse.
+ * @param copy Will be set to a newly allocated copy of the message string
+ *     when libplist cannot hand out a pointer to the string value, or to
+ *     NULL otherwise. It has to be freed by the caller.
+ *
+ * @return The DLMessage* string, or NULL if the plist does not contain any
+ *     DL* message.
+ */
+static const char *device_link_service_peek_message(plist_t dl_msg, char **copy)
+{
+	plist_t cmd = NULL;
+	const char *cmd_str = NULL;
+
+	*copy = NULL;
+
+	if ((plist_get_node_type(dl_msg) != PLIST_ARRAY) || (plist_array_get_size(dl_msg) < 1)) {
+		return NULL;
+	}
+
+	cmd = plist_array_get_item(dl_msg, 0);
+	if (!cmd || (plist_get_node_type(cmd) != PLIST_STRING)) {
+		return NULL;
+	}
+
+#ifdef HAVE_PLIST_GET_STRING_PTR
+	cmd_str = plist_get_string_ptr(cmd, NULL);
+#else
+	plist_get_string_val(cmd, copy);
+	cmd_str = *copy;
+#endif
+	if (!cmd_str || (strlen(cmd_str) < 9) || (strncmp(cmd_str, "DL", 2))) {
+		free(*copy);
+		*copy = NULL;
+		return NULL;
+	}
+
+	return cmd_str;
+}
+
+/**
+ * Internally used hash function for DL* message strings.
+ * All message strings share the same prefix, so every character is mixed in
+ * and the result is finalized to spread the low bits used for the slot.
+ */
+static uint32_t device_link_service_hash(const char *str, uint32_t seed)
+{
+	uint32_t h = 2166136261u ^ (seed * 0x9e3779b9u);
+	while (*str) {
+		h ^= (unsigned char)*str++;
+		h *= 16777619u;
+	}
+	h ^= h >> 16;
+	h *= 0x85ebca6bu;
+	h ^= h >> 13;
+	return h;
+}
+
+/**
+ * Internally used function to build the lookup table for the given handlers.
+ * It searches a table size and hash seed for which every message string
+ * maps to a slot of its own, so a lookup needs exactly one hash computation
+ * and one string comparison.
+ *
+ * @param handlers The handlers to build the table for.
+ * @param count Number of handlers.
+ * @param table Receives the allocated slots of the table.
+ * @param mask Receives the mask for slot indexes.
+ * @param seed Receives the hash seed.
+ *
+ * @return 0 on success or -1 if no collision free table could be built.
+ */
+static int device_link_service_build_handler_table(const struct device_link_service_handler *handlers, unsigned int count, unsigned int **table, uint32_t *mask, uint32_t *seed)
+{
+	uint32_t size = 4;
+	while (size < count * 2) {
+		size <<= 1;
+	}
+
+	while (size <= 65536) {
+		unsigned int *slots = (unsigned int*)malloc(size * sizeof(unsigned int));
+		uint32_t s;
+		if (!slots) {
+			return -1;
+		}
+		for (s = 0; s < 64; s++) {
+			unsigned int i;
+			memset(slots, '\0', size * sizeof(unsigned int));
+			for (i = 0; i < count; i++) {
+				uint32_t slot = device_link_service_hash(handlers[i].name, s) & (size - 1);
+				if (slots[slot]) {
+					break;
+				}
+				/* slots store the handler index + 1, 0 marks an empty slot */
+				slots[slot] = i + 1;
+			}
+			if (i == count) {
+				*table = slots;
+				*mask = size - 1;
+				*seed = s;
+				return 0;
+			}
+		}
+		free(slots);
+		size <<= 1;
+	}
+	return -1;
+}
+
+/**
+ * Internally used function to find the handler registered for the given
+ * DL* message string.
+ *
+ * @return The handler, or NULL if no handler is registered for it.
+ */
+static device_link_service_message_handler_t device_link_service_find_handler(device_link_service_client_t client, const char *dlmessage)
+{
+	if (!client->handler_slots) {
+		return NULL;
+	}
+	unsigned int idx = client->handler_slots[device_link_service_hash(dlmessage, client->handler_seed) & client->handler_mask];
+	if (idx && (strcmp(client->handlers[idx-1].name, dlmessage) == 0)) {
+		return client->handlers[idx-1].func;
+	}
+	return NULL;
+}
+
 /**
  * Creates a new device link service client.
  *
@@ -94,7 +224,7 @@ device_link_service_error_t device_link_service_client_new(idevice_t device, loc
 	}
 
 	/* create client object */
-	device_link_service_client_t client_loc = (device_link_service_client_t) malloc(sizeof(struct device_link_service_client_private));
+	device_link_service_client_t client_loc = (device_link_service_client_t) calloc(1, sizeof(struct device_link_service_client_private));
 	client_loc->parent = plistclient;
 
 	/* enable SSL if requested */
@@ -124,6 +254,12 @@ device_link_service_error_t device_link_service_client_free(device_link_service_
 	if (property_list_service_client_free(client->parent) != PROPERTY_LIST_SERVICE_E_SUCCESS) {
 		return DEVICE_LINK_SERVICE_E_UNKNOWN_ERROR;
 	}
+	unsigned int i;
+	for (i = 0; i < client->handler_count; i++) {
+		free(client->handlers[i].name);
+	}
+	free(client->handlers);
+	free(client->handler_slots);
 	free(client);
 	return DEVICE_LINK_SERVICE_E_SUCCESS;
 }
@@ -295,27 +431,30 @@ device_link_service_error_t device_link_service_send_ping(device_link_service_cl
 }
 
 /**
- * Sends a DLMessageProcessMessage plist.
+ * Sends a DLMessageProcessMessage plist, taking ownership of the message.
+ * The message is put into the DLMessageProcessMessage envelope as is
+ * instead of being copied, and freed together with the envelope.
  *
  * @param client The device link service client to use.
- * @param message PLIST_DICT to send.
+ * @param message PLIST_DICT to send. It is freed by this function, also
+ *     when an error is returned.
  *
  * @return DEVICE_LINK_SERVICE_E_SUCCESS on success,
  *     DEVICE_LINK_SERVICE_E_INVALID_ARG if client or message is invalid or
  *     message is not a PLIST_DICT, or DEVICE_LINK_SERVICE_E_MUX_ERROR if
  *     the DLMessageProcessMessage plist could not be sent.
  */
-device_link_service_error_t device_link_service_send_process_message(device_link_service_client_t client, plist_t message)
+device_link_service_error_t device_link_service_send_process_message_owned(device_link_service_client_t client, plist_t message)
 {
-	if (!client || !client->parent || !message)
-		return DEVICE_LINK_SERVICE_E_INVALID_ARG;
-
-	if (plist_get_node_type(message) != PLIST_DICT)
+	if (!client || !client->parent || !message || plist_get_node_type(message) != PLIST_DICT) {
+		if (message)
+			plist_free(message);
 		return DEVICE_LINK_SERVICE_E_INVALID_ARG;
+	}
 
 	plist_t array = plist_new_array();
 	plist_array_append_item(array, plist_new_string("DLMessageProcessMessage"));
-	plist_array_append_item(array, plist_copy(message));
+	plist_array_append_item(array, message);
 
 	device_link_service_error_t err = DEVICE_LINK_SERVICE_E_SUCCESS;
 	if (property_list_service_send_binary_plist(client->parent, array) != PROPERTY_LIST_SERVICE_E_SUCCESS) {
@@ -325,6 +464,28 @@ device_link_service_error_t device_link_service_send_process_message(device_link
 	return err;
 }
 
+/**
+ * Sends a DLMessageProcessMessage plist.
+ *
+ * @param client The device link service client to use.
+ * @param message PLIST_DICT to send.
+ *
+ * @return DEVICE_LINK_SERVICE_E_SUCCESS on success,
+ *     DEVICE_LINK_SERVICE_E_INVALID_ARG if client or message is invalid or
+ *     message is not a PLIST_DICT, or DEVICE_LINK_SERVICE_E_MUX_ERROR if
+ *     the DLMessageProcessMessage plist could not be sent.
+ */
+device_link_service_error_t device_link_service_send_process_message(device_link_service_client_t client, plist_t message)
+{
+	if (!client || !client->parent || !message)
+		return DEVICE_LINK_SERVICE_E_INVALID_ARG;
+
+	if (plist_get_node_type(message) != PLIST_DICT)
+		return DEVICE_LINK_SERVICE_E_INVALID_ARG;
+
+	return device_link_service_send_process_message_owned(client, plist_copy(message));
+}
+
 /**
  * Receives a DL* message plist
  *
@@ -360,27 +521,36 @@ device_link_service_error_t device_link_service_receive_message(device_link_serv
 }
 
 /**
- * Receives a DLMessageProcessMessage plist.
+ * Receives a DLMessageProcessMessage plist without copying the message out
+ * of the envelope it was received in.
  *
  * @param client The connected device link service client used for receiving.
- * @param message Pointer to a plist that will be set to the contents of the
- *    message contents upon successful return.
+ * @param envelope Pointer to a plist that will be set to the received
+ *    DLMessageProcessMessage array. It has to be freed by the caller, also
+ *    when an error is returned.
+ * @param message Pointer to a plist that will be set to the message contents
+ *    inside of envelope. It is only valid until envelope is freed and must
+ *    not be freed separately.
  *
  * @return DEVICE_LINK_SERVICE_E_SUCCESS when a DLMessageProcessMessage was
- *    received, DEVICE_LINK_SERVICE_E_INVALID_ARG when client or message is
+ *    received, DEVICE_LINK_SERVICE_E_INVALID_ARG when a parameter is
  *    invalid, DEVICE_LINK_SERVICE_E_PLIST_ERROR if the received plist is
  *    invalid or is not a DLMessageProcessMessage,
  *    or DEVICE_LINK_SERVICE_E_MUX_ERROR if receiving from device fails.
  */
-device_link_service_error_t device_link_service_receive_process_message(device_link_service_client_t client, plist_t *message)
+device_link_service_error_t device_link_service_receive_process_message_borrowed(device_link_service_client_t client, plist_t *envelope, plist_t *message)
 {
-	if (!client || !client->parent || !message)
+	if (!client || !client->parent || !envelope || !message)
 		return DEVICE_LINK_SERVICE_E_INVALID_ARG;
 
+	*envelope = NULL;
+	*message = NULL;
+
 	plist_t pmsg = NULL;
 	if (property_list_service_receive_plist(client->parent, &pmsg) != PROPERTY_LIST_SERVICE_E_SUCCESS) {
 		return DEVICE_LINK_SERVICE_E_MUX_ERROR;
 	}
+	*envelope = pmsg;
 
 	device_link_service_error_t err = DEVICE_LINK_SERVICE_E_UNKNOWN_ERROR;
 
@@ -400,18 +570,45 @@ device_link_service_error_t device_link_service_receive_process_message(device_l
 
 	plist_t msg_loc = plist_array_get_item(pmsg, 1);
 	if (msg_loc) {
-		*message = plist_copy(msg_loc);
+		*message = msg_loc;
 		err = DEVICE_LINK_SERVICE_E_SUCCESS;
 	} else {
-		*message = NULL;
 		err = DEVICE_LINK_SERVICE_E_PLIST_ERROR;
 	}
 
 leave:
 	if (msg)
 		free(msg);
-	if (pmsg)
-		plist_free(pmsg);
+
+	return err;
+}
+
+/**
+ * Receives a DLMessageProcessMessage plist.
+ *
+ * @param client The connected device link service client used for receiving.
+ * @param message Pointer to a plist that will be set to the contents of the
+ *    message contents upon successful return.
+ *
+ * @return DEVICE_LINK_SERVICE_E_SUCCESS when a DLMessageProcessMessage was
+ *    received, DEVICE_LINK_SERVICE_E_INVALID_ARG when client or message is
+ *    invalid, DEVICE_LINK_SERVICE_E_PLIST_ERROR if the received plist is
+ *    invalid or is not a DLMessageProcessMessage,
+ *    or DEVICE_LINK_SERVICE_E_MUX_ERROR if receiving from device fails.
+ */
+device_link_service_error_t device_link_service_receive_process_message(device_link_service_client_t client, plist_t *message)
+{
+	if (!client || !client->parent || !message)
+		return DEVICE_LINK_SERVICE_E_INVALID_ARG;
+
+	plist_t envelope = NULL;
+	plist_t msg_loc = NULL;
+	device_link_service_error_t err = device_link_service_receive_process_message_borrowed(client, &envelope, &msg_loc);
+
+	*message = (err == DEVICE_LINK_SERVICE_E_SUCCESS) ? plist_copy(msg_loc) : NULL;
+
+	if (envelope)
+		plist_free(envelope);
 
 	return err;
 }
@@ -438,6 +635,155 @@ device_link_service_error_t device_link_service_send(device_link_service_client_
 	return DEVICE_LINK_SERVICE_E_SUCCESS;
 }
 
+/**
+ * Registers a handler for a DL* message type, to be used by
+ * device_link_service_dispatch_message().
+ *
+ * @param client The device link service client to register the handler for.
+ * @param dlmessage The DL* message string the handler is invoked for, e.g.
+ *     "DLMessageDownloadFiles", or NULL to register a handler for all
+ *     messages that have no handler of their own.
+ * @param handler The handler to invoke, or NULL to remove the handler.
+ *
+ * @return DEVICE_LINK_SERVICE_E_SUCCESS on success,
+ *     DEVICE_LINK_SERVICE_E_INVALID_ARG when client is NULL or dlmessage is
+ *     not a DL* message string, or DEVICE_LINK_SERVICE_E_UNKNOWN_ERROR when
+ *     the handler table could not be built. The registered handlers are
+ *     left unchanged on error.
+ */
+device_link_service_error_t device_link_service_set_handler(device_link_service_client_t client, const char *dlmessage, device_link_service_message_handler_t handler)
+{
+	if (!client) {
+		return DEVICE_LINK_SERVICE_E_INVALID_ARG;
+	}
+	if (!dlmessage) {
+		client->default_handler = handler;
+		return DEVICE_LINK_SERVICE_E_SUCCESS;
+	}
+	if ((strlen(dlmessage) < 9) || (strncmp(dlmessage, "DL", 2))) {
+		return DEVICE_LINK_SERVICE_E_INVALID_ARG;
+	}
+
+	unsigned int i;
+	for (i = 0; i < client->handler_count; i++) {
+		if (strcmp(client->handlers[i].name, dlmessage) == 0) {
+			break;
+		}
+	}
+
+	int found = (i < client->handler_count);
+	if (found && handler) {
+		client->handlers[i].func = handler;
+		return DEVICE_LINK_SERVICE_E_SUCCESS;
+	}
+	if (!found && !handler) {
+		return DEVICE_LINK_SERVICE_E_SUCCESS;
+	}
+
+	/* build the new handler list and table first, so a failure changes nothing */
+	unsigned int count = (found) ? client->handler_count - 1 : client->handler_count + 1;
+	struct device_link_service_handler *handlers = (struct device_link_service_handler*)malloc(((count > 0) ? count : 1) * sizeof(struct device_link_service_handler));
+	if (!handlers) {
+		return DEVICE_LINK_SERVICE_E_UNKNOWN_ERROR;
+	}
+	char *name = NULL;
+	if (found) {
+		memcpy(handlers, client->handlers, i * sizeof(struct device_link_service_handler));
+		memcpy(&handlers[i], &client->handlers[i+1], (client->handler_count - i - 1) * sizeof(struct device_link_service_handler));
+	} else {
+		name = strdup(dlmessage);
+		if (!name) {
+			free(handlers);
+			return DEVICE_LINK_SERVICE_E_UNKNOWN_ERROR;
+		}
+		if (client->handler_count > 0) {
+			memcpy(handlers, client->handlers, client->handler_count * sizeof(struct device_link_service_handler));
+		}
+		handlers[client->handler_count].name = name;
+		handlers[client->handler_count].func = handler;
+	}
+
+	unsigned int *slots = NULL;
+	uint32_t mask = 0;
+	uint32_t seed = 0;
+	if (device_link_service_build_handler_table(handlers, count, &slots, &mask, &seed) < 0) {
+		debug_info("ERROR: Could not build handler table for %d handlers", count);
+		free(name);
+		free(handlers);
+		return DEVICE_LINK_SERVICE_E_UNKNOWN_ERROR;
+	}
+
+	if (found) {
+		free(client->handlers[i].name);
+	}
+	free(client->handlers);
+	free(client->handler_slots);
+	client->handlers = handlers;
+	client->handler_count = count;
+	client->handler_slots = slots;
+	client->handler_mask = mask;
+	client->handler_seed = seed;
+
+	return DEVICE_LINK_SERVICE_E_SUCCESS;
+}
+
+/**
+ * Receives a single DL* message and invokes the handler registered for it
+ * with device_link_service_set_handler().
+ *
+ * The message string is looked up in place, no copy of it is made unless
+ * libplist does not allow to access string values directly. The received
+ * message and the message string passed to the handler are only valid while
+ * the handler runs.
+ *
+ * @param client The device link service client to receive from.
+ * @param user_data User data passed to the handler.
+ * @param result Set to the return value of the invoked handler, or to 0 when
+ *     no handler was registered for the received message. Can be NULL.
+ *
+ * @return DEVICE_LINK_SERVICE_E_SUCCESS when a DL* message was received,
+ *     DEVICE_LINK_SERVICE_E_INVALID_ARG when client is invalid,
+ *     DEVICE_LINK_SERVICE_E_PLIST_ERROR when the received plist is not a
+ *     DL* message, or DEVICE_LINK_SERVICE_E_MUX_ERROR when receiving failed.
+ */
+device_link_service_error_t device_link_service_dispatch_message(device_link_service_client_t client, void *user_data, int *result)
+{
+	if (!client || !client->parent)
+		return DEVICE_LINK_SERVICE_E_INVALID_ARG;
+
+	if (result)
+		*result = 0;
+
+	plist_t msg = NULL;
+	if (property_list_service_receive_plist(client->parent, &msg) != PROPERTY_LIST_SERVICE_E_SUCCESS) {
+		return DEVICE_LINK_SERVICE_E_MUX_ERROR;
+	}
+
+	char *copy = NULL;
+	const char *dlmessage = device_link_service_peek_message(msg, &copy);
+	if (!dlmessage) {
+		debug_info("Did not receive a DL* message as expected!");
+		plist_free(msg);
+		return DEVICE_LINK_SERVICE_E_PLIST_ERROR;
+	}
+
+	device_link_service_message_handler_t handler = device_link_service_find_handler(client, dlmessage);
+	if (!handler) {
+		handler = client->default_handler;
+	}
+	if (handler) {
+		int res = handler(msg, dlmessage, user_data);
+		if (result)
+			*result = res;
+	} else {
+		debug_info("No handler registered for %s", dlmessage);
+	}
+
+	free(copy);
+	plist_free(msg);
+	return DEVICE_LINK_SERVICE_E_SUCCESS;
+}
+
 /* Generic device link service receive function.
  *
  * @param client The device link service client to use for sending
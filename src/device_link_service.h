@@ -36,8 +36,22 @@
 /** Represents an error code. */
 typedef int16_t device_link_service_error_t;
 
+/** Handler for a received DL* message, see device_link_service_set_handler() */
+typedef int (*device_link_service_message_handler_t)(plist_t message, const char *dlmessage, void *user_data);
+
+struct device_link_service_handler {
+	char *name;
+	device_link_service_message_handler_t func;
+};
+
 struct device_link_service_client_private {
 	property_list_service_client_t parent;
+	struct device_link_service_handler *handlers;
+	unsigned int handler_count;
+	unsigned int *handler_slots;
+	uint32_t handler_mask;
+	uint32_t handler_seed;
+	device_link_service_message_handler_t default_handler;
 };
 
 typedef struct device_link_service_client_private *device_link_service_client_t;
@@ -48,9 +62,13 @@ device_link_service_error_t device_link_service_version_exchange(device_link_ser
 device_link_service_error_t device_link_service_send_ping(device_link_service_client_t client, const char *message);
 device_link_service_error_t device_link_service_receive_message(device_link_service_client_t client, plist_t *msg_plist, char **dlmessage);
 device_link_service_error_t device_link_service_send_process_message(device_link_service_client_t client, plist_t message);
+device_link_service_error_t device_link_service_send_process_message_owned(device_link_service_client_t client, plist_t message);
 device_link_service_error_t device_link_service_receive_process_message(device_link_service_client_t client, plist_t *message);
+device_link_service_error_t device_link_service_receive_process_message_borrowed(device_link_service_client_t client, plist_t *envelope, plist_t *message);
 device_link_service_error_t device_link_service_disconnect(device_link_service_client_t client, const char *message);
 device_link_service_error_t device_link_service_send(device_link_service_client_t client, plist_t plist);
 device_link_service_error_t device_link_service_receive(device_link_service_client_t client, plist_t *plist);
+device_link_service_error_t device_link_service_set_handler(device_link_service_client_t client, const char *dlmessage, device_link_service_message_handler_t handler);
+device_link_service_error_t device_link_service_dispatch_message(device_link_service_client_t client, void *user_data, int *result);
 
 #endif
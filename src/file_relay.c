@@ -79,7 +79,7 @@ LIBIMOBILEDEVICE_API file_relay_error_t file_relay_request_sources_timeout(file_
 	plist_t dict = plist_new_dict();
 	plist_dict_set_item(dict, "Sources", array);
 
-	if (property_list_service_send_xml_plist(client->parent, dict) != PROPERTY_LIST_SERVICE_E_SUCCESS) {
+	if (property_list_service_send_plist(client->parent, dict) != PROPERTY_LIST_SERVICE_E_SUCCESS) {
 		debug_info("ERROR: Could not send request to device!");
 		err = FILE_RELAY_E_MUX_ERROR;
 		goto leave;
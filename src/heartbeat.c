@@ -76,6 +76,9 @@ LIBIMOBILEDEVICE_API heartbeat_error_t heartbeat_client_new(idevice_t device, lo
 		return ret;
 	}
 
+	/* the device sends the heartbeat, the client only answers */
+	service_client_set_measure_rtt(plclient->parent, 0);
+
 	heartbeat_client_t client_loc = (heartbeat_client_t) malloc(sizeof(struct heartbeat_client_private));
 	client_loc->parent = plclient;
 
@@ -28,10 +28,25 @@
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include <limits.h>
+#include <time.h>
+#include <unistd.h>
+#if defined(HAVE_SYS_SENDFILE_H) && defined(HAVE_SENDFILE)
+#include <sys/sendfile.h>
+#define HAVE_LINUX_SENDFILE 1
+#endif
 
 #ifdef WIN32
+#include <winsock2.h>
 #include <windows.h>
 #include <process.h>
+#else
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#endif
+#ifdef HAVE_SYS_EVENTFD_H
+#include <sys/eventfd.h>
 #endif
 
 #include <usbmuxd.h>
@@ -49,7 +64,23 @@
 #include "idevice.h"
 #include "common/userpref.h"
 #include "common/thread.h"
+#include "common/socket.h"
 #include "common/debug.h"
+#include "common/utils.h"
+#include "common/trace.h"
+
+#ifdef HAVE_OPENSSL
+/* AEAD suites first, then the CBC suites older devices are limited to */
+#define IDEVICE_SSL_CIPHER_LIST "ECDHE-RSA-AES128-GCM-SHA256:ECDHE-RSA-AES256-GCM-SHA384:AES128-GCM-SHA256:AES256-GCM-SHA384:AES128-SHA:AES256-SHA:HIGH:!aNULL:!eNULL:!MD5"
+#else
+/* tried in order until the GnuTLS version in use accepts one of them */
+static const char *ssl_priorities[] = {
+	"NORMAL:%COMPAT:+VERS-SSL3.0:+RSA:+AES-128-CBC:+AES-256-CBC:+SHA1:+MD5:+COMP-NULL",
+	"NORMAL:%COMPAT:+RSA:+AES-128-CBC:+AES-256-CBC:+SHA1:+COMP-NULL",
+	"NONE:+VERS-SSL3.0:+ANON-DH:+RSA:+AES-128-CBC:+AES-256-CBC:+SHA1:+MD5:+COMP-NULL",
+	NULL
+};
+#endif
 
 #ifdef HAVE_OPENSSL
 static mutex_t *mutex_buf = NULL;
@@ -112,6 +143,10 @@ static void internal_idevice_deinit(void)
 #endif
 }
 
+#ifdef HAVE_KTLS
+static int ktls_enabled = 0;
+#endif
+
 static thread_once_t init_once = THREAD_ONCE_INIT;
 static thread_once_t deinit_once = THREAD_ONCE_INIT;
 
@@ -146,7 +181,226 @@ static void __attribute__((destructor)) libimobiledevice_deinitialize(void)
 }
 #endif
 
-static idevice_event_cb_t event_cb = NULL;
+/* event not yet delivered to a subscriber */
+struct pending_event {
+	enum idevice_event_type event;
+	char udid[41];
+	int conn_type;
+	/* set when this ADD replaced an undelivered REMOVE of the same device */
+	int replug;
+	struct pending_event *next;
+};
+
+struct idevice_subscription_context {
+	idevice_event_cb_t callback;
+	void *user_data;
+	mutex_t mutex;
+	cond_t cond;
+	struct pending_event *queue;
+	int quit;
+	/* set when the dispatch thread has to free the context itself */
+	int detached;
+	thread_t thread;
+	struct idevice_subscription_context *next;
+};
+
+/* subscribers, protected by registry_mutex */
+static struct idevice_subscription_context *subscribers = NULL;
+/* context used by idevice_event_subscribe() */
+static idevice_subscription_context_t legacy_context = NULL;
+
+/* in-process list of attached devices, kept current by usbmuxd events */
+struct device_registry_entry {
+	char udid[41];
+	uint32_t handle;
+};
+
+static thread_once_t registry_once = THREAD_ONCE_INIT;
+/* serializes (un)subscribing; separate from registry_mutex because
+ * usbmuxd_unsubscribe() waits for the event thread, which takes it.
+ * registry_mutex protects the registry and the list of subscribers. */
+static mutex_t subscription_mutex;
+static mutex_t registry_mutex;
+static int registry_enabled = 0;
+static int usbmux_subscribed = 0;
+static struct device_registry_entry *registry = NULL;
+static int registry_count = 0;
+static int registry_capacity = 0;
+static unsigned int registry_generation = 0;
+
+static void registry_init(void)
+{
+	mutex_init(&subscription_mutex);
+	mutex_init(&registry_mutex);
+}
+
+/* must be called with registry_mutex held */
+static int registry_find(const char *udid)
+{
+	int i;
+	for (i = 0; i < registry_count; i++) {
+		if (!strcmp(registry[i].udid, udid)) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+/* must be called with registry_mutex held */
+static void registry_add(const usbmuxd_device_info_t *muxdev)
+{
+	int idx = registry_find(muxdev->udid);
+	if (idx < 0) {
+		if (registry_count == registry_capacity) {
+			int capacity = (registry_capacity > 0) ? registry_capacity * 2 : 16;
+			struct device_registry_entry *entries = realloc(registry, capacity * sizeof(struct device_registry_entry));
+			if (!entries) {
+				debug_info("ERROR: out of memory, not adding %s to the registry", muxdev->udid);
+				return;
+			}
+			registry = entries;
+			registry_capacity = capacity;
+		}
+		idx = registry_count++;
+		strncpy(registry[idx].udid, muxdev->udid, sizeof(registry[idx].udid) - 1);
+		registry[idx].udid[sizeof(registry[idx].udid) - 1] = '\0';
+	} else if (registry[idx].handle == muxdev->handle) {
+		return;
+	}
+	registry[idx].handle = muxdev->handle;
+	registry_generation++;
+}
+
+/* must be called with registry_mutex held */
+static void registry_remove(const char *udid)
+{
+	int idx = registry_find(udid);
+	if (idx < 0)
+		return;
+	registry_count--;
+	if (idx < registry_count) {
+		registry[idx] = registry[registry_count];
+	}
+	registry_generation++;
+}
+
+/**
+ * Queues an event for delivery to a subscriber. An undelivered REMOVE
+ * followed by an ADD of the same device is delivered as a single ADD, so
+ * unplug/replug storms reach the subscriber as one event. An undelivered
+ * ADD followed by a REMOVE is dropped, as the subscriber never saw the
+ * device; if that ADD replaced a REMOVE, the REMOVE is delivered instead.
+ */
+static void subscription_queue_event(struct idevice_subscription_context *context, const idevice_event_t *ev)
+{
+	struct pending_event *pev;
+	struct pending_event *match = NULL;
+	struct pending_event *match_prev = NULL;
+	struct pending_event *prev = NULL;
+	struct pending_event *last = NULL;
+
+	mutex_lock(&context->mutex);
+	/* find the most recent undelivered event of the device */
+	for (pev = context->queue; pev; pev = pev->next) {
+		if (!strcmp(pev->udid, ev->udid)) {
+			match = pev;
+			match_prev = prev;
+		}
+		prev = pev;
+		last = pev;
+	}
+	if (match && match->event == IDEVICE_DEVICE_REMOVE && ev->event == IDEVICE_DEVICE_ADD) {
+		match->event = IDEVICE_DEVICE_ADD;
+		match->conn_type = ev->conn_type;
+		match->replug = 1;
+	} else if (match && match->event == IDEVICE_DEVICE_ADD && ev->event == IDEVICE_DEVICE_REMOVE) {
+		if (match->replug) {
+			match->event = IDEVICE_DEVICE_REMOVE;
+			match->conn_type = ev->conn_type;
+			match->replug = 0;
+		} else {
+			if (match_prev) {
+				match_prev->next = match->next;
+			} else {
+				context->queue = match->next;
+			}
+			free(match);
+		}
+	} else {
+		pev = (struct pending_event*)malloc(sizeof(struct pending_event));
+		if (!pev) {
+			debug_info("ERROR: out of memory, dropping event %d for %s", ev->event, ev->udid);
+			mutex_unlock(&context->mutex);
+			return;
+		}
+		pev->event = ev->event;
+		strncpy(pev->udid, ev->udid, sizeof(pev->udid) - 1);
+		pev->udid[sizeof(pev->udid) - 1] = '\0';
+		pev->conn_type = ev->conn_type;
+		pev->replug = 0;
+		pev->next = NULL;
+		if (last) {
+			last->next = pev;
+		} else {
+			context->queue = pev;
+		}
+		cond_signal(&context->cond);
+	}
+	mutex_unlock(&context->mutex);
+}
+
+static void subscription_free(struct idevice_subscription_context *context)
+{
+	struct pending_event *pev = context->queue;
+	while (pev) {
+		struct pending_event *next = pev->next;
+		free(pev);
+		pev = next;
+	}
+	cond_destroy(&context->cond);
+	mutex_destroy(&context->mutex);
+	free(context);
+}
+
+/**
+ * Delivers the queued events of a subscriber on its own thread, so that a
+ * slow callback does not hold up other subscribers or libusbmuxd.
+ */
+static void *subscription_dispatch_thread(void *arg)
+{
+	struct idevice_subscription_context *context = (struct idevice_subscription_context*)arg;
+
+	while (1) {
+		struct pending_event *pev;
+		idevice_event_t ev;
+
+		mutex_lock(&context->mutex);
+		while (!context->queue && !context->quit) {
+			cond_wait(&context->cond, &context->mutex);
+		}
+		if (context->quit) {
+			mutex_unlock(&context->mutex);
+			break;
+		}
+		pev = context->queue;
+		context->queue = pev->next;
+		mutex_unlock(&context->mutex);
+
+		ev.event = pev->event;
+		ev.udid = pev->udid;
+		ev.conn_type = pev->conn_type;
+		context->callback(&ev, context->user_data);
+
+		free(pev);
+	}
+
+	if (context->detached) {
+		/* unsubscribed from within the callback */
+		subscription_free(context);
+	}
+
+	return NULL;
+}
 
 static void usbmux_event_cb(const usbmuxd_event_t *event, void *user_data)
 {
@@ -156,34 +410,246 @@ static void usbmux_event_cb(const usbmuxd_event_t *event, void *user_data)
 	ev.udid = event->device.udid;
 	ev.conn_type = CONNECTION_USBMUXD;
 
-	if (event_cb) {
-		event_cb(&ev, user_data);
+	if (ev.event == IDEVICE_DEVICE_REMOVE) {
+		/* the device might get paired differently before it comes back */
+		userpref_cache_invalidate(ev.udid);
 	}
+
+	mutex_lock(&registry_mutex);
+	if (registry_enabled) {
+		if (ev.event == IDEVICE_DEVICE_ADD) {
+			registry_add(&event->device);
+		} else if (ev.event == IDEVICE_DEVICE_REMOVE) {
+			registry_remove(ev.udid);
+		}
+	}
+	struct idevice_subscription_context *context;
+	for (context = subscribers; context; context = context->next) {
+		subscription_queue_event(context, &ev);
+	}
+	mutex_unlock(&registry_mutex);
 }
 
-LIBIMOBILEDEVICE_API idevice_error_t idevice_event_subscribe(idevice_event_cb_t callback, void *user_data)
+/* must be called with subscription_mutex held */
+static idevice_error_t usbmux_update_subscription(void)
 {
-	event_cb = callback;
-	int res = usbmuxd_subscribe(usbmux_event_cb, user_data);
-	if (res != 0) {
-		event_cb = NULL;
-		debug_info("ERROR: usbmuxd_subscribe() returned %d!", res);
-		return IDEVICE_E_UNKNOWN_ERROR;
+	int want = (registry_enabled || subscribers);
+	int res;
+
+	if (want == usbmux_subscribed)
+		return IDEVICE_E_SUCCESS;
+
+	if (want) {
+		res = usbmuxd_subscribe(usbmux_event_cb, NULL);
+		if (res != 0) {
+			debug_info("ERROR: usbmuxd_subscribe() returned %d!", res);
+			return IDEVICE_E_UNKNOWN_ERROR;
+		}
+	} else {
+		res = usbmuxd_unsubscribe();
+		if (res != 0) {
+			debug_info("ERROR: usbmuxd_unsubscribe() returned %d!", res);
+			return IDEVICE_E_UNKNOWN_ERROR;
+		}
 	}
+	usbmux_subscribed = want;
+
 	return IDEVICE_E_SUCCESS;
 }
 
-LIBIMOBILEDEVICE_API idevice_error_t idevice_event_unsubscribe()
+LIBIMOBILEDEVICE_API idevice_error_t idevice_events_subscribe(idevice_subscription_context_t *context, idevice_event_cb_t callback, void *user_data)
 {
-	event_cb = NULL;
-	int res = usbmuxd_unsubscribe();
-	if (res != 0) {
-		debug_info("ERROR: usbmuxd_unsubscribe() returned %d!", res);
+	idevice_error_t ret;
+	struct idevice_subscription_context *ctx;
+
+	if (!context || !callback)
+		return IDEVICE_E_INVALID_ARG;
+
+	thread_once(&registry_once, registry_init);
+
+	ctx = (struct idevice_subscription_context*)calloc(1, sizeof(struct idevice_subscription_context));
+	if (!ctx)
 		return IDEVICE_E_UNKNOWN_ERROR;
+	ctx->callback = callback;
+	ctx->user_data = user_data;
+	mutex_init(&ctx->mutex);
+	cond_init(&ctx->cond);
+
+	if (thread_new(&ctx->thread, subscription_dispatch_thread, ctx) != 0) {
+		debug_info("ERROR: Could not start event dispatch thread");
+		subscription_free(ctx);
+		return IDEVICE_E_UNKNOWN_ERROR;
+	}
+
+	mutex_lock(&subscription_mutex);
+	mutex_lock(&registry_mutex);
+	ctx->next = subscribers;
+	subscribers = ctx;
+	mutex_unlock(&registry_mutex);
+
+	ret = usbmux_update_subscription();
+	if (ret != IDEVICE_E_SUCCESS) {
+		mutex_lock(&registry_mutex);
+		subscribers = ctx->next;
+		mutex_unlock(&registry_mutex);
 	}
+	mutex_unlock(&subscription_mutex);
+
+	if (ret != IDEVICE_E_SUCCESS) {
+		mutex_lock(&ctx->mutex);
+		ctx->quit = 1;
+		cond_signal(&ctx->cond);
+		mutex_unlock(&ctx->mutex);
+		thread_join(ctx->thread);
+		thread_free(ctx->thread);
+		subscription_free(ctx);
+		return ret;
+	}
+
+	*context = ctx;
+
 	return IDEVICE_E_SUCCESS;
 }
 
+LIBIMOBILEDEVICE_API idevice_error_t idevice_events_unsubscribe(idevice_subscription_context_t context)
+{
+	idevice_error_t ret;
+	struct idevice_subscription_context **pctx;
+
+	if (!context)
+		return IDEVICE_E_INVALID_ARG;
+
+	thread_once(&registry_once, registry_init);
+
+	mutex_lock(&subscription_mutex);
+	mutex_lock(&registry_mutex);
+	for (pctx = &subscribers; *pctx; pctx = &(*pctx)->next) {
+		if (*pctx == context) {
+			*pctx = context->next;
+			break;
+		}
+	}
+	mutex_unlock(&registry_mutex);
+	ret = usbmux_update_subscription();
+	mutex_unlock(&subscription_mutex);
+
+	if (thread_is_current(context->thread)) {
+		/* called from the callback, the thread cannot join itself */
+		mutex_lock(&context->mutex);
+		context->quit = 1;
+		context->detached = 1;
+		mutex_unlock(&context->mutex);
+		thread_detach(context->thread);
+		return ret;
+	}
+
+	mutex_lock(&context->mutex);
+	context->quit = 1;
+	cond_signal(&context->cond);
+	mutex_unlock(&context->mutex);
+
+	thread_join(context->thread);
+	thread_free(context->thread);
+	subscription_free(context);
+
+	return ret;
+}
+
+LIBIMOBILEDEVICE_API idevice_error_t idevice_event_subscribe(idevice_event_cb_t callback, void *user_data)
+{
+	if (legacy_context) {
+		idevice_events_unsubscribe(legacy_context);
+		legacy_context = NULL;
+	}
+	return idevice_events_subscribe(&legacy_context, callback, user_data);
+}
+
+LIBIMOBILEDEVICE_API idevice_error_t idevice_event_unsubscribe()
+{
+	idevice_error_t ret = IDEVICE_E_SUCCESS;
+	if (legacy_context) {
+		ret = idevice_events_unsubscribe(legacy_context);
+		legacy_context = NULL;
+	}
+	return ret;
+}
+
+LIBIMOBILEDEVICE_API idevice_error_t idevice_device_registry_set_enabled(int enable)
+{
+	idevice_error_t ret = IDEVICE_E_SUCCESS;
+	usbmuxd_device_info_t *dev_list = NULL;
+	int i;
+
+	int seed;
+
+	thread_once(&registry_once, registry_init);
+
+	mutex_lock(&subscription_mutex);
+
+	mutex_lock(&registry_mutex);
+	seed = (enable && !registry_enabled);
+	registry_enabled = (enable != 0);
+	mutex_unlock(&registry_mutex);
+
+	ret = usbmux_update_subscription();
+
+	mutex_lock(&registry_mutex);
+	if (ret == IDEVICE_E_SUCCESS && seed) {
+		/* subscribed first, so no change is missed; events that arrive
+		 * while seeding wait for registry_mutex and are applied on top */
+		if (usbmuxd_get_device_list(&dev_list) < 0) {
+			debug_info("ERROR: usbmuxd is not running!");
+			ret = IDEVICE_E_NO_DEVICE;
+		} else {
+			registry_count = 0;
+			for (i = 0; dev_list[i].handle > 0; i++) {
+				registry_add(&dev_list[i]);
+			}
+			registry_generation++;
+		}
+	}
+	if (ret != IDEVICE_E_SUCCESS) {
+		registry_enabled = 0;
+	}
+	if (!registry_enabled) {
+		free(registry);
+		registry = NULL;
+		registry_count = 0;
+		registry_capacity = 0;
+	}
+	mutex_unlock(&registry_mutex);
+
+	if (ret != IDEVICE_E_SUCCESS && seed) {
+		usbmux_update_subscription();
+	}
+
+	mutex_unlock(&subscription_mutex);
+
+	if (dev_list)
+		usbmuxd_device_list_free(&dev_list);
+
+	return ret;
+}
+
+LIBIMOBILEDEVICE_API idevice_error_t idevice_device_registry_get_generation(unsigned int *generation)
+{
+	idevice_error_t ret = IDEVICE_E_UNKNOWN_ERROR;
+
+	if (!generation)
+		return IDEVICE_E_INVALID_ARG;
+
+	thread_once(&registry_once, registry_init);
+
+	mutex_lock(&registry_mutex);
+	if (registry_enabled) {
+		*generation = registry_generation;
+		ret = IDEVICE_E_SUCCESS;
+	}
+	mutex_unlock(&registry_mutex);
+
+	return ret;
+}
+
 LIBIMOBILEDEVICE_API idevice_error_t idevice_get_device_list(char ***devices, int *count)
 {
 	usbmuxd_device_info_t *dev_list;
@@ -191,6 +657,23 @@ LIBIMOBILEDEVICE_API idevice_error_t idevice_get_device_list(char ***devices, in
 	*devices = NULL;
 	*count = 0;
 
+	thread_once(&registry_once, registry_init);
+
+	mutex_lock(&registry_mutex);
+	if (registry_enabled) {
+		int i;
+		char **newlist = malloc(sizeof(char*) * (registry_count+1));
+		for (i = 0; i < registry_count; i++) {
+			newlist[i] = strdup(registry[i].udid);
+		}
+		newlist[registry_count] = NULL;
+		*devices = newlist;
+		*count = registry_count;
+		mutex_unlock(&registry_mutex);
+		return IDEVICE_E_SUCCESS;
+	}
+	mutex_unlock(&registry_mutex);
+
 	if (usbmuxd_get_device_list(&dev_list) < 0) {
 		debug_info("ERROR: usbmuxd is not running!", __func__);
 		return IDEVICE_E_NO_DEVICE;
@@ -232,10 +715,80 @@ LIBIMOBILEDEVICE_API void idevice_set_debug_level(int level)
 	internal_set_debug_level(level);
 }
 
+LIBIMOBILEDEVICE_API void idevice_set_ktls(int enable)
+{
+#ifdef HAVE_KTLS
+	ktls_enabled = enable;
+#else
+	if (enable) {
+		debug_info("kernel TLS offload is not supported by this build");
+	}
+#endif
+}
+
+LIBIMOBILEDEVICE_API void idevice_set_pair_record_cache(int enable)
+{
+	userpref_cache_set_enabled(enable);
+}
+
+LIBIMOBILEDEVICE_API idevice_error_t idevice_trace_set_enabled(int enable)
+{
+#ifdef HAVE_TRACING
+	trace_set_enabled(enable);
+	return IDEVICE_E_SUCCESS;
+#else
+	debug_info("tracing support is not available");
+	return IDEVICE_E_UNKNOWN_ERROR;
+#endif
+}
+
+LIBIMOBILEDEVICE_API idevice_error_t idevice_trace_export(const char *filename, idevice_trace_format_t format)
+{
+	if (!filename)
+		return IDEVICE_E_INVALID_ARG;
+#ifdef HAVE_TRACING
+	if (trace_export(filename, (format == IDEVICE_TRACE_FORMAT_BINARY) ? TRACE_FORMAT_BINARY : TRACE_FORMAT_CHROME) < 0) {
+		debug_info("ERROR: could not write trace to %s", filename);
+		return IDEVICE_E_UNKNOWN_ERROR;
+	}
+	return IDEVICE_E_SUCCESS;
+#else
+	debug_info("tracing support is not available");
+	return IDEVICE_E_UNKNOWN_ERROR;
+#endif
+}
+
+LIBIMOBILEDEVICE_API idevice_error_t idevice_trace_clear(void)
+{
+#ifdef HAVE_TRACING
+	trace_clear();
+	return IDEVICE_E_SUCCESS;
+#else
+	debug_info("tracing support is not available");
+	return IDEVICE_E_UNKNOWN_ERROR;
+#endif
+}
+
 LIBIMOBILEDEVICE_API idevice_error_t idevice_new(idevice_t * device, const char *udid)
 {
 	usbmuxd_device_info_t muxdev;
-	int res = usbmuxd_get_device_by_udid(udid, &muxdev);
+	int res = 0;
+
+	thread_once(&registry_once, registry_init);
+
+	mutex_lock(&registry_mutex);
+	if (registry_enabled) {
+		int idx = (udid) ? registry_find(udid) : ((registry_count > 0) ? 0 : -1);
+		if (idx >= 0) {
+			strcpy(muxdev.udid, registry[idx].udid);
+			muxdev.handle = registry[idx].handle;
+			res = 1;
+		}
+		mutex_unlock(&registry_mutex);
+	} else {
+		mutex_unlock(&registry_mutex);
+		res = usbmuxd_get_device_by_udid(udid, &muxdev);
+	}
 	if (res > 0) {
 		idevice_t dev = (idevice_t) malloc(sizeof(struct idevice_private));
 		dev->udid = strdup(muxdev.udid);
@@ -249,6 +802,44 @@ LIBIMOBILEDEVICE_API idevice_error_t idevice_new(idevice_t * device, const char
 	return IDEVICE_E_NO_DEVICE;
 }
 
+LIBIMOBILEDEVICE_API idevice_error_t idevice_new_network(idevice_t *device, const char *udid, const char *address)
+{
+	struct network_conn_data *net;
+	const char *sep;
+	uint16_t port = LOCKDOWN_PORT;
+
+	if (!device || !udid || !address)
+		return IDEVICE_E_INVALID_ARG;
+
+	net = (struct network_conn_data*)malloc(sizeof(struct network_conn_data));
+	if (!net)
+		return IDEVICE_E_UNKNOWN_ERROR;
+
+	sep = strrchr(address, ':');
+	if (sep && sep == strchr(address, ':')) {
+		char *end = NULL;
+		long val = strtol(sep + 1, &end, 10);
+		if (!end || *end != '\0' || val <= 0 || val > 65535) {
+			debug_info("ERROR: Invalid port in address '%s'", address);
+			free(net);
+			return IDEVICE_E_INVALID_ARG;
+		}
+		port = (uint16_t)val;
+		net->host = strndup(address, sep - address);
+	} else {
+		net->host = strdup(address);
+	}
+	net->lockdown_port = port;
+
+	idevice_t dev = (idevice_t) malloc(sizeof(struct idevice_private));
+	dev->udid = strdup(udid);
+	dev->conn_type = CONNECTION_NETWORK;
+	dev->conn_data = net;
+	*device = dev;
+
+	return IDEVICE_E_SUCCESS;
+}
+
 LIBIMOBILEDEVICE_API idevice_error_t idevice_free(idevice_t device)
 {
 	if (!device)
@@ -261,6 +852,8 @@ LIBIMOBILEDEVICE_API idevice_error_t idevice_free(idevice_t device)
 
 	if (device->conn_type == CONNECTION_USBMUXD) {
 		device->conn_data = 0;
+	} else if (device->conn_type == CONNECTION_NETWORK && device->conn_data) {
+		free(((struct network_conn_data*)device->conn_data)->host);
 	}
 	if (device->conn_data) {
 		free(device->conn_data);
@@ -276,15 +869,52 @@ LIBIMOBILEDEVICE_API idevice_error_t idevice_connect(idevice_t device, uint16_t
 	}
 
 	if (device->conn_type == CONNECTION_USBMUXD) {
+		trace_begin("usbmuxd_connect");
 		int sfd = usbmuxd_connect((uint32_t)(long)device->conn_data, port);
+		trace_end("usbmuxd_connect");
 		if (sfd < 0) {
 			debug_info("ERROR: Connecting to usbmuxd failed: %d (%s)", sfd, strerror(-sfd));
 			return IDEVICE_E_UNKNOWN_ERROR;
 		}
 		idevice_connection_t new_connection = (idevice_connection_t)malloc(sizeof(struct idevice_connection_private));
+		if (!new_connection) {
+			usbmuxd_disconnect(sfd);
+			return IDEVICE_E_UNKNOWN_ERROR;
+		}
 		new_connection->type = CONNECTION_USBMUXD;
 		new_connection->data = (void*)(long)sfd;
 		new_connection->ssl_data = NULL;
+		new_connection->nonblocking = 0;
+		new_connection->cancel = NULL;
+		new_connection->ssl_read_deadline = 0;
+		mutex_init(&new_connection->stats_mutex);
+		memset(&new_connection->stats, 0, sizeof(new_connection->stats));
+		idevice_get_udid(device, &new_connection->udid);
+		*connection = new_connection;
+		return IDEVICE_E_SUCCESS;
+	} else if (device->conn_type == CONNECTION_NETWORK) {
+		struct network_conn_data *net = (struct network_conn_data*)device->conn_data;
+		uint16_t net_port = (port == LOCKDOWN_PORT) ? net->lockdown_port : port;
+		trace_begin("network_connect");
+		int sfd = socket_connect(net->host, net_port);
+		trace_end("network_connect");
+		if (sfd < 0) {
+			debug_info("ERROR: Connecting to %s:%d failed", net->host, net_port);
+			return IDEVICE_E_UNKNOWN_ERROR;
+		}
+		idevice_connection_t new_connection = (idevice_connection_t)malloc(sizeof(struct idevice_connection_private));
+		if (!new_connection) {
+			socket_close(sfd);
+			return IDEVICE_E_UNKNOWN_ERROR;
+		}
+		new_connection->type = CONNECTION_NETWORK;
+		new_connection->data = (void*)(long)sfd;
+		new_connection->ssl_data = NULL;
+		new_connection->nonblocking = 0;
+		new_connection->cancel = NULL;
+		new_connection->ssl_read_deadline = 0;
+		mutex_init(&new_connection->stats_mutex);
+		memset(&new_connection->stats, 0, sizeof(new_connection->stats));
 		idevice_get_udid(device, &new_connection->udid);
 		*connection = new_connection;
 		return IDEVICE_E_SUCCESS;
@@ -292,80 +922,736 @@ LIBIMOBILEDEVICE_API idevice_error_t idevice_connect(idevice_t device, uint16_t
 		debug_info("Unknown connection type %d", device->conn_type);
 	}
 
-	return IDEVICE_E_UNKNOWN_ERROR;
+	return IDEVICE_E_UNKNOWN_ERROR;
+}
+
+LIBIMOBILEDEVICE_API idevice_error_t idevice_disconnect(idevice_connection_t connection)
+{
+	if (!connection) {
+		return IDEVICE_E_INVALID_ARG;
+	}
+	/* shut down ssl if enabled */
+	if (connection->ssl_data) {
+		idevice_connection_disable_ssl(connection);
+	}
+	idevice_error_t result = IDEVICE_E_UNKNOWN_ERROR;
+	if (connection->type == CONNECTION_USBMUXD) {
+		usbmuxd_disconnect((int)(long)connection->data);
+		connection->data = NULL;
+		result = IDEVICE_E_SUCCESS;
+	} else if (connection->type == CONNECTION_NETWORK) {
+		socket_close((int)(long)connection->data);
+		connection->data = NULL;
+		result = IDEVICE_E_SUCCESS;
+	} else {
+		debug_info("Unknown connection type %d", connection->type);
+	}
+
+	if (connection->udid)
+		free(connection->udid);
+
+	mutex_destroy(&connection->stats_mutex);
+	free(connection);
+	connection = NULL;
+
+	return result;
+}
+
+static uint64_t internal_get_monotonic_ms(void)
+{
+	return get_monotonic_time_us() / 1000;
+}
+
+/* maximum plaintext size of a TLS record */
+#define TLS_MAX_RECORD_SIZE 16384
+
+/**
+ * Internally used function to account a socket operation that started at
+ * the given time and transferred the given number of bytes.
+ */
+static void internal_stats_add(idevice_connection_t connection, int do_send, uint32_t bytes, uint64_t start)
+{
+	uint64_t elapsed = get_monotonic_time_us() - start;
+	mutex_lock(&connection->stats_mutex);
+	if (do_send) {
+		connection->stats.send_calls++;
+		connection->stats.bytes_sent += bytes;
+		connection->stats.send_time_us += elapsed;
+	} else {
+		connection->stats.recv_calls++;
+		connection->stats.bytes_received += bytes;
+		connection->stats.recv_time_us += elapsed;
+	}
+	mutex_unlock(&connection->stats_mutex);
+}
+
+/**
+ * Internally used function to account an SSL read or write with the given
+ * result. With GnuTLS the socket operations pass through
+ * internal_connection_send() and internal_connection_receive() and are
+ * accounted there. OpenSSL drives the socket itself, so the call is
+ * accounted here and the byte counters are taken from its BIO.
+ */
+static void internal_ssl_stats_add(idevice_connection_t connection, int do_send, int res, uint64_t start)
+{
+#ifdef HAVE_OPENSSL
+	internal_stats_add(connection, do_send, 0, start);
+#endif
+	if (res <= 0)
+		return;
+	mutex_lock(&connection->stats_mutex);
+	if (do_send) {
+		connection->stats.tls_records_sent += ((uint32_t)res + TLS_MAX_RECORD_SIZE - 1) / TLS_MAX_RECORD_SIZE;
+	} else {
+		connection->stats.tls_records_received++;
+	}
+	mutex_unlock(&connection->stats_mutex);
+}
+
+/**
+ * Internally used function to switch a socket between blocking and
+ * non-blocking mode.
+ *
+ * @return 0 on success or -1 on error.
+ */
+static int internal_set_fd_nonblocking(int fd, int nonblocking)
+{
+#ifdef WIN32
+	u_long mode = (nonblocking) ? 1 : 0;
+	return (ioctlsocket(fd, FIONBIO, &mode) == 0) ? 0 : -1;
+#else
+	int flags = fcntl(fd, F_GETFL, 0);
+	if (flags < 0) {
+		return -1;
+	}
+	flags = (nonblocking) ? (flags | O_NONBLOCK) : (flags & ~O_NONBLOCK);
+	return fcntl(fd, F_SETFL, flags);
+#endif
+}
+
+/**
+ * Internally used function to send or receive raw data with a single
+ * non-blocking socket call.
+ *
+ * @return IDEVICE_E_SUCCESS if any data was transferred, IDEVICE_E_WANT_WRITE
+ *     or IDEVICE_E_WANT_READ if the socket is not ready, or
+ *     IDEVICE_E_UNKNOWN_ERROR on error or when the peer closed the connection.
+ */
+static idevice_error_t internal_connection_io_nonblocking(idevice_connection_t connection, char *data, uint32_t len, uint32_t *bytes, int do_send)
+{
+	int fd = (int)(long)connection->data;
+	int r;
+#ifdef MSG_NOSIGNAL
+	int flags = MSG_NOSIGNAL;
+#else
+	int flags = 0;
+#endif
+
+	*bytes = 0;
+	uint64_t start = get_monotonic_time_us();
+	do {
+		r = (do_send) ? send(fd, data, len, flags) : recv(fd, data, len, 0);
+	} while ((r < 0) && (errno == EINTR));
+	internal_stats_add(connection, do_send, (r > 0) ? (uint32_t)r : 0, start);
+
+	if (r < 0) {
+#ifdef WIN32
+		if (WSAGetLastError() == WSAEWOULDBLOCK)
+#else
+		if ((errno == EAGAIN) || (errno == EWOULDBLOCK))
+#endif
+			return (do_send) ? IDEVICE_E_WANT_WRITE : IDEVICE_E_WANT_READ;
+		debug_info("ERROR: %s failed: %s", (do_send) ? "send" : "recv", strerror(errno));
+		return IDEVICE_E_UNKNOWN_ERROR;
+	}
+	if ((r == 0) && !do_send && (len > 0)) {
+		debug_info("connection closed by peer");
+		return IDEVICE_E_UNKNOWN_ERROR;
+	}
+	*bytes = (uint32_t)r;
+	return IDEVICE_E_SUCCESS;
+}
+
+/**
+ * Internally used function to translate the result of a failed SSL read or
+ * write on a non-blocking connection.
+ *
+ * @return IDEVICE_E_WANT_READ or IDEVICE_E_WANT_WRITE if the operation has to
+ *     be repeated once the socket is ready, IDEVICE_E_SSL_ERROR otherwise.
+ */
+static idevice_error_t internal_ssl_nonblocking_error(idevice_connection_t connection, int res)
+{
+#ifdef HAVE_OPENSSL
+	switch (SSL_get_error(connection->ssl_data->session, res)) {
+		case SSL_ERROR_WANT_READ:
+			return IDEVICE_E_WANT_READ;
+		case SSL_ERROR_WANT_WRITE:
+			return IDEVICE_E_WANT_WRITE;
+		default:
+			break;
+	}
+#else
+	if ((res == GNUTLS_E_AGAIN) || (res == GNUTLS_E_INTERRUPTED)) {
+		return (gnutls_record_get_direction(connection->ssl_data->session)) ? IDEVICE_E_WANT_WRITE : IDEVICE_E_WANT_READ;
+	}
+#endif
+	return IDEVICE_E_SSL_ERROR;
+}
+
+/**
+ * Internally used function to send raw data over the given connection.
+ */
+static idevice_error_t internal_connection_send(idevice_connection_t connection, const char *data, uint32_t len, uint32_t *sent_bytes)
+{
+	if (!connection || !data) {
+		return IDEVICE_E_INVALID_ARG;
+	}
+
+	if (connection->nonblocking) {
+		return internal_connection_io_nonblocking(connection, (char*)data, len, sent_bytes, 1);
+	}
+
+	if (connection->type == CONNECTION_USBMUXD) {
+		uint64_t start = get_monotonic_time_us();
+		int res = usbmuxd_send((int)(long)connection->data, data, len, sent_bytes);
+		internal_stats_add(connection, 1, (res < 0) ? 0 : *sent_bytes, start);
+		if (res < 0) {
+			debug_info("ERROR: usbmuxd_send returned %d (%s)", res, strerror(-res));
+			return IDEVICE_E_UNKNOWN_ERROR;
+		}
+		return IDEVICE_E_SUCCESS;
+	} else if (connection->type == CONNECTION_NETWORK) {
+		uint64_t start = get_monotonic_time_us();
+		int res = socket_send((int)(long)connection->data, (void*)data, len);
+		internal_stats_add(connection, 1, (res < 0) ? 0 : (uint32_t)res, start);
+		if (res < 0) {
+			debug_info("ERROR: socket_send returned %d (%s)", res, strerror(errno));
+			*sent_bytes = 0;
+			return IDEVICE_E_UNKNOWN_ERROR;
+		}
+		*sent_bytes = (uint32_t)res;
+		return IDEVICE_E_SUCCESS;
+	} else {
+		debug_info("Unknown connection type %d", connection->type);
+	}
+	return IDEVICE_E_UNKNOWN_ERROR;
+
+}
+
+LIBIMOBILEDEVICE_API idevice_error_t idevice_connection_send(idevice_connection_t connection, const char *data, uint32_t len, uint32_t *sent_bytes)
+{
+	if (!connection || !data || (connection->ssl_data && !connection->ssl_data->session)) {
+		return IDEVICE_E_INVALID_ARG;
+	}
+
+	if (connection->ssl_data) {
+		uint64_t start = get_monotonic_time_us();
+#ifdef HAVE_OPENSSL
+		int sent = SSL_write(connection->ssl_data->session, (const void*)data, (int)len);
+		debug_info("SSL_write %d, sent %d", len, sent);
+#else
+		ssize_t sent = gnutls_record_send(connection->ssl_data->session, (void*)data, (size_t)len);
+#endif
+		internal_ssl_stats_add(connection, 1, (int)sent, start);
+		if (connection->nonblocking) {
+			if (sent > 0) {
+				*sent_bytes = sent;
+				return IDEVICE_E_SUCCESS;
+			}
+			*sent_bytes = 0;
+			return internal_ssl_nonblocking_error(connection, (int)sent);
+		}
+		if ((uint32_t)sent == (uint32_t)len) {
+			*sent_bytes = sent;
+			return IDEVICE_E_SUCCESS;
+		}
+		*sent_bytes = 0;
+		return IDEVICE_E_SSL_ERROR;
+	}
+	return internal_connection_send(connection, data, len, sent_bytes);
+}
+
+LIBIMOBILEDEVICE_API idevice_error_t idevice_connection_send_file(idevice_connection_t connection, int fd, uint64_t offset, uint64_t length, uint64_t *sent_bytes)
+{
+	if (!connection || (fd < 0) || !sent_bytes || (connection->ssl_data && !connection->ssl_data->session)) {
+		return IDEVICE_E_INVALID_ARG;
+	}
+
+	uint64_t sent = 0;
+	int read_errno = 0;
+	*sent_bytes = 0;
+
+#ifdef HAVE_LINUX_SENDFILE
+	int is_socket = (connection->type == CONNECTION_USBMUXD || connection->type == CONNECTION_NETWORK);
+	int use_sendfile = is_socket && !connection->ssl_data;
+#ifdef HAVE_KTLS
+	int use_ssl_sendfile = is_socket && connection->ssl_data && connection->ssl_data->ktls_send;
+#else
+	int use_ssl_sendfile = 0;
+#endif
+	if (use_sendfile || use_ssl_sendfile) {
+		int sfd = (int)(long)connection->data;
+		off_t off = (off_t)offset;
+		while (sent < length) {
+			size_t amount = ((length - sent) < 0x40000000) ? (size_t)(length - sent) : 0x40000000;
+			ssize_t r;
+			uint64_t start = get_monotonic_time_us();
+#ifdef HAVE_KTLS
+			if (use_ssl_sendfile) {
+				r = SSL_sendfile(connection->ssl_data->session, fd, off, amount, 0);
+				if (r > 0) {
+					off += r;
+				}
+			} else
+#endif
+			r = sendfile(sfd, fd, &off, amount);
+			internal_stats_add(connection, 1, (r > 0) ? (uint32_t)r : 0, start);
+			if (r < 0) {
+				if (errno == EINTR) {
+					continue;
+				}
+				if ((sent == 0) && ((errno == EINVAL) || (errno == ENOSYS))) {
+					/* not supported for this pair of descriptors */
+					debug_info("sendfile not usable (%s), falling back to buffered send", strerror(errno));
+					break;
+				}
+				read_errno = errno;
+				debug_info("ERROR: sendfile failed: %s", strerror(read_errno));
+				*sent_bytes = sent;
+				if (read_errno == EIO) {
+					/* reading the file failed */
+					errno = read_errno;
+					return IDEVICE_E_NOT_ENOUGH_DATA;
+				}
+				return (connection->ssl_data) ? IDEVICE_E_SSL_ERROR : IDEVICE_E_UNKNOWN_ERROR;
+			}
+			if (r == 0) {
+				/* end of file */
+				break;
+			}
+			sent += r;
+		}
+		if ((sent > 0) || (length == 0)) {
+			*sent_bytes = sent;
+			debug_info("sendfile sent %llu of %llu bytes", (unsigned long long)sent, (unsigned long long)length);
+			if (sent < length) {
+				/* end of file */
+				errno = 0;
+				return IDEVICE_E_NOT_ENOUGH_DATA;
+			}
+			return IDEVICE_E_SUCCESS;
+		}
+	}
+#endif
+
+	/* buffered fallback */
+	size_t bufsize = 65536;
+	char *buf = (char*)malloc(bufsize);
+	if (!buf) {
+		return IDEVICE_E_UNKNOWN_ERROR;
+	}
+#ifdef WIN32
+	if (lseek(fd, (off_t)offset, SEEK_SET) < 0) {
+		free(buf);
+		return IDEVICE_E_INVALID_ARG;
+	}
+#endif
+	idevice_error_t res = IDEVICE_E_SUCCESS;
+	while (sent < length) {
+		size_t amount = ((length - sent) < bufsize) ? (size_t)(length - sent) : bufsize;
+#ifdef WIN32
+		ssize_t r = read(fd, buf, amount);
+#else
+		ssize_t r = pread(fd, buf, amount, (off_t)(offset + sent));
+#endif
+		if (r < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			read_errno = errno;
+			debug_info("ERROR: read failed: %s", strerror(read_errno));
+			res = IDEVICE_E_NOT_ENOUGH_DATA;
+			break;
+		}
+		if (r == 0) {
+			res = IDEVICE_E_NOT_ENOUGH_DATA;
+			break;
+		}
+		uint32_t done = 0;
+		while (done < (uint32_t)r) {
+			uint32_t bytes = 0;
+			res = idevice_connection_send(connection, buf + done, (uint32_t)r - done, &bytes);
+			if (res != IDEVICE_E_SUCCESS) {
+				break;
+			}
+			if (bytes == 0) {
+				res = IDEVICE_E_UNKNOWN_ERROR;
+				break;
+			}
+			done += bytes;
+		}
+		sent += done;
+		if (res != IDEVICE_E_SUCCESS) {
+			break;
+		}
+	}
+	free(buf);
+	*sent_bytes = sent;
+	if (res == IDEVICE_E_NOT_ENOUGH_DATA) {
+		errno = read_errno;
+	}
+
+	return res;
+}
+
+/* how often a cancel token without file descriptor is checked while waiting */
+#define CANCEL_POLL_INTERVAL 100
+
+LIBIMOBILEDEVICE_API uint64_t idevice_deadline_from_timeout(unsigned int timeout)
+{
+	if (timeout == 0)
+		return 0;
+	return internal_get_monotonic_ms() + timeout;
+}
+
+/**
+ * Internally used function to set the triggered state of a cancel token.
+ */
+static void internal_cancel_set_triggered(idevice_cancel_t cancel, long triggered)
+{
+#ifdef WIN32
+	InterlockedExchange(&cancel->triggered, triggered);
+#else
+	__atomic_store_n(&cancel->triggered, triggered, __ATOMIC_SEQ_CST);
+#endif
+}
+
+/**
+ * Internally used function to check whether a cancel token was triggered.
+ */
+static int internal_cancel_is_triggered(idevice_cancel_t cancel)
+{
+#ifdef WIN32
+	return InterlockedCompareExchange(&cancel->triggered, 0, 0) != 0;
+#else
+	return __atomic_load_n(&cancel->triggered, __ATOMIC_SEQ_CST) != 0;
+#endif
+}
+
+LIBIMOBILEDEVICE_API idevice_error_t idevice_cancel_new(idevice_cancel_t *cancel)
+{
+	if (!cancel)
+		return IDEVICE_E_INVALID_ARG;
+
+	idevice_cancel_t cancel_loc = (idevice_cancel_t)calloc(1, sizeof(struct idevice_cancel_private));
+	if (!cancel_loc)
+		return IDEVICE_E_UNKNOWN_ERROR;
+	cancel_loc->fds[0] = -1;
+	cancel_loc->fds[1] = -1;
+
+#if defined(HAVE_SYS_EVENTFD_H)
+	cancel_loc->fds[0] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (cancel_loc->fds[0] < 0) {
+		debug_info("WARNING: could not create eventfd: %s", strerror(errno));
+	}
+#elif !defined(WIN32)
+	if (pipe(cancel_loc->fds) < 0) {
+		debug_info("WARNING: could not create cancel pipe: %s", strerror(errno));
+		cancel_loc->fds[0] = -1;
+		cancel_loc->fds[1] = -1;
+	} else {
+		fcntl(cancel_loc->fds[0], F_SETFL, fcntl(cancel_loc->fds[0], F_GETFL, 0) | O_NONBLOCK);
+		fcntl(cancel_loc->fds[1], F_SETFL, fcntl(cancel_loc->fds[1], F_GETFL, 0) | O_NONBLOCK);
+	}
+#endif
+
+	*cancel = cancel_loc;
+	return IDEVICE_E_SUCCESS;
+}
+
+LIBIMOBILEDEVICE_API idevice_error_t idevice_cancel_free(idevice_cancel_t cancel)
+{
+	if (!cancel)
+		return IDEVICE_E_INVALID_ARG;
+
+#ifndef WIN32
+	if (cancel->fds[0] >= 0)
+		close(cancel->fds[0]);
+	if (cancel->fds[1] >= 0)
+		close(cancel->fds[1]);
+#endif
+	free(cancel);
+	return IDEVICE_E_SUCCESS;
 }
 
-LIBIMOBILEDEVICE_API idevice_error_t idevice_disconnect(idevice_connection_t connection)
+LIBIMOBILEDEVICE_API idevice_error_t idevice_cancel_trigger(idevice_cancel_t cancel)
 {
-	if (!connection) {
+	if (!cancel)
 		return IDEVICE_E_INVALID_ARG;
+
+	internal_cancel_set_triggered(cancel, 1);
+#if defined(HAVE_SYS_EVENTFD_H)
+	if (cancel->fds[0] >= 0) {
+		uint64_t one = 1;
+		if (write(cancel->fds[0], &one, sizeof(one)) < 0 && errno != EAGAIN) {
+			debug_info("ERROR: could not signal eventfd: %s", strerror(errno));
+		}
 	}
-	/* shut down ssl if enabled */
-	if (connection->ssl_data) {
-		idevice_connection_disable_ssl(connection);
-	}
-	idevice_error_t result = IDEVICE_E_UNKNOWN_ERROR;
-	if (connection->type == CONNECTION_USBMUXD) {
-		usbmuxd_disconnect((int)(long)connection->data);
-		connection->data = NULL;
-		result = IDEVICE_E_SUCCESS;
-	} else {
-		debug_info("Unknown connection type %d", connection->type);
+#elif !defined(WIN32)
+	if (cancel->fds[1] >= 0) {
+		char c = 0;
+		if (write(cancel->fds[1], &c, 1) < 0 && errno != EAGAIN) {
+			debug_info("ERROR: could not write to cancel pipe: %s", strerror(errno));
+		}
 	}
+#endif
+	return IDEVICE_E_SUCCESS;
+}
 
-	if (connection->udid)
-		free(connection->udid);
+LIBIMOBILEDEVICE_API idevice_error_t idevice_cancel_reset(idevice_cancel_t cancel)
+{
+	if (!cancel)
+		return IDEVICE_E_INVALID_ARG;
 
-	free(connection);
-	connection = NULL;
+	internal_cancel_set_triggered(cancel, 0);
+#ifndef WIN32
+	if (cancel->fds[0] >= 0) {
+		char buf[64];
+		while (read(cancel->fds[0], buf, sizeof(buf)) > 0);
+	}
+#endif
+	return IDEVICE_E_SUCCESS;
+}
 
-	return result;
+LIBIMOBILEDEVICE_API idevice_error_t idevice_connection_set_cancel(idevice_connection_t connection, idevice_cancel_t cancel)
+{
+	if (!connection)
+		return IDEVICE_E_INVALID_ARG;
+
+	connection->cancel = cancel;
+	return IDEVICE_E_SUCCESS;
 }
 
 /**
- * Internally used function to send raw data over the given connection.
+ * Internally used function to wait until the given connection becomes
+ * readable, its cancel token is triggered or the deadline passes. With a
+ * deadline that already passed it only checks whether data is available.
+ *
+ * @param connection The connection to wait for.
+ * @param deadline Absolute deadline, or 0 to wait without time limit.
+ *
+ * @return IDEVICE_E_SUCCESS when the connection is readable,
+ *     IDEVICE_E_WANT_READ when the deadline passed, IDEVICE_E_CANCELLED when
+ *     the cancel token was triggered, or IDEVICE_E_UNKNOWN_ERROR.
  */
-static idevice_error_t internal_connection_send(idevice_connection_t connection, const char *data, uint32_t len, uint32_t *sent_bytes)
+static idevice_error_t internal_connection_wait(idevice_connection_t connection, uint64_t deadline)
 {
-	if (!connection || !data) {
-		return IDEVICE_E_INVALID_ARG;
+	idevice_cancel_t cancel = connection->cancel;
+	int cancel_fd = (cancel) ? cancel->fds[0] : -1;
+	struct pollfd pfds[2];
+	int nfds = 1;
+
+	pfds[0].fd = (int)(long)connection->data;
+	pfds[0].events = POLLIN;
+	if (cancel_fd >= 0) {
+		pfds[1].fd = cancel_fd;
+		pfds[1].events = POLLIN;
+		nfds = 2;
+	}
+
+	while (1) {
+		int timeout = -1;
+		int expired = 0;
+		if (cancel && internal_cancel_is_triggered(cancel)) {
+			return IDEVICE_E_CANCELLED;
+		}
+		if (deadline > 0) {
+			uint64_t now = internal_get_monotonic_ms();
+			if (now >= deadline) {
+				/* still report data that is available right now */
+				expired = 1;
+				timeout = 0;
+			} else {
+				timeout = (deadline - now > INT_MAX) ? INT_MAX : (int)(deadline - now);
+			}
+		}
+		if (cancel && cancel_fd < 0 && (timeout < 0 || timeout > CANCEL_POLL_INTERVAL)) {
+			timeout = CANCEL_POLL_INTERVAL;
+		}
+
+		pfds[0].revents = 0;
+		pfds[1].revents = 0;
+#ifdef WIN32
+		int res = WSAPoll(pfds, nfds, timeout);
+#else
+		int res = poll(pfds, nfds, timeout);
+#endif
+		if (res < 0) {
+			if (errno == EINTR)
+				continue;
+			debug_info("ERROR: poll failed: %s", strerror(errno));
+			return IDEVICE_E_UNKNOWN_ERROR;
+		}
+		if (nfds > 1 && pfds[1].revents) {
+			return IDEVICE_E_CANCELLED;
+		}
+		if (pfds[0].revents) {
+			return IDEVICE_E_SUCCESS;
+		}
+		if (expired) {
+			return IDEVICE_E_WANT_READ;
+		}
 	}
+}
 
+/**
+ * Internally used function for reading raw data from the given connection.
+ */
+static idevice_error_t internal_connection_read(idevice_connection_t connection, char *data, uint32_t len, uint32_t *recv_bytes)
+{
 	if (connection->type == CONNECTION_USBMUXD) {
-		int res = usbmuxd_send((int)(long)connection->data, data, len, sent_bytes);
+		uint64_t start = get_monotonic_time_us();
+		int res = usbmuxd_recv((int)(long)connection->data, data, len, recv_bytes);
+		internal_stats_add(connection, 0, (res < 0) ? 0 : *recv_bytes, start);
 		if (res < 0) {
-			debug_info("ERROR: usbmuxd_send returned %d (%s)", res, strerror(-res));
+			debug_info("ERROR: usbmuxd_recv returned %d (%s)", res, strerror(-res));
+			return IDEVICE_E_UNKNOWN_ERROR;
+		}
+
+		return IDEVICE_E_SUCCESS;
+	} else if (connection->type == CONNECTION_NETWORK) {
+		uint64_t start = get_monotonic_time_us();
+		/* a timeout of 0 waits until data arrives, the callers handle timeouts */
+		int res = socket_receive_timeout((int)(long)connection->data, data, len, 0, 0);
+		internal_stats_add(connection, 0, (res < 0) ? 0 : (uint32_t)res, start);
+		if (res < 0) {
+			debug_info("ERROR: socket_receive_timeout returned %d (%s)", res, strerror(-res));
+			*recv_bytes = 0;
 			return IDEVICE_E_UNKNOWN_ERROR;
 		}
+		*recv_bytes = (uint32_t)res;
 		return IDEVICE_E_SUCCESS;
 	} else {
 		debug_info("Unknown connection type %d", connection->type);
 	}
 	return IDEVICE_E_UNKNOWN_ERROR;
+}
 
+/**
+ * Internally used function for receiving raw data over the given connection
+ * until the given deadline.
+ */
+static idevice_error_t internal_connection_receive_deadline(idevice_connection_t connection, char *data, uint32_t len, uint32_t *recv_bytes, uint64_t deadline)
+{
+	idevice_error_t res = internal_connection_wait(connection, deadline);
+	if (res != IDEVICE_E_SUCCESS) {
+		*recv_bytes = 0;
+		/* a passed deadline is not an error, like with a timeout */
+		return (res == IDEVICE_E_WANT_READ) ? IDEVICE_E_SUCCESS : res;
+	}
+	return internal_connection_read(connection, data, len, recv_bytes);
 }
 
-LIBIMOBILEDEVICE_API idevice_error_t idevice_connection_send(idevice_connection_t connection, const char *data, uint32_t len, uint32_t *sent_bytes)
+#if defined(HAVE_OPENSSL) && !defined(WIN32)
+/**
+ * Internally used function to limit how long a single receive on the socket
+ * of the given connection may block, so that SSL_read() returns with
+ * SSL_ERROR_WANT_READ in the middle of a record instead of waiting past the
+ * deadline. With a cancel token the limit is CANCEL_POLL_INTERVAL, so that
+ * cancelling is noticed.
+ *
+ * @param enable 1 to set the limit for the given deadline, 0 to remove it.
+ */
+static void internal_ssl_set_recv_timeout(idevice_connection_t connection, uint64_t deadline, int enable)
 {
-	if (!connection || !data || (connection->ssl_data && !connection->ssl_data->session)) {
-		return IDEVICE_E_INVALID_ARG;
+	struct timeval tv = { 0, 0 };
+	if (enable) {
+		uint64_t ms = UINT64_MAX;
+		if (deadline > 0) {
+			uint64_t now = internal_get_monotonic_ms();
+			ms = (deadline > now) ? deadline - now : 1;
+		}
+		if (connection->cancel && ms > CANCEL_POLL_INTERVAL) {
+			ms = CANCEL_POLL_INTERVAL;
+		}
+		if (ms > INT_MAX) {
+			ms = INT_MAX;
+		}
+		tv.tv_sec = (time_t)(ms / 1000);
+		tv.tv_usec = (suseconds_t)((ms % 1000) * 1000);
 	}
+	if (setsockopt((int)(long)connection->data, SOL_SOCKET, SO_RCVTIMEO, (void*)&tv, sizeof(tv)) < 0) {
+		debug_info("WARNING: could not set receive timeout: %s", strerror(errno));
+	}
+}
+#endif
 
-	if (connection->ssl_data) {
+/**
+ * Internally used function for receiving data over an SSL enabled connection
+ * until the given deadline. Data that is already decrypted is returned
+ * without waiting. The deadline also applies while the rest of a partially
+ * received record is read.
+ *
+ * @param fill 1 to receive until len bytes were received or the deadline
+ *     passed, 0 to return after the first successful read.
+ */
+static idevice_error_t internal_ssl_receive_deadline(idevice_connection_t connection, char *data, uint32_t len, uint32_t *recv_bytes, uint64_t deadline, int fill)
+{
+	idevice_error_t res = IDEVICE_E_SUCCESS;
+	uint32_t received = 0;
+
+	*recv_bytes = 0;
+#ifndef HAVE_OPENSSL
+	connection->ssl_read_deadline = deadline;
+#endif
+	while (received < len) {
 #ifdef HAVE_OPENSSL
-		int sent = SSL_write(connection->ssl_data->session, (const void*)data, (int)len);
-		debug_info("SSL_write %d, sent %d", len, sent);
+		int pending = SSL_pending(connection->ssl_data->session);
 #else
-		ssize_t sent = gnutls_record_send(connection->ssl_data->session, (void*)data, (size_t)len);
+		int pending = (int)gnutls_record_check_pending(connection->ssl_data->session);
 #endif
-		if ((uint32_t)sent == (uint32_t)len) {
-			*sent_bytes = sent;
-			return IDEVICE_E_SUCCESS;
+		if (pending <= 0) {
+			res = internal_connection_wait(connection, deadline);
+			if (res != IDEVICE_E_SUCCESS) {
+				break;
+			}
 		}
-		*sent_bytes = 0;
-		return IDEVICE_E_SSL_ERROR;
+		uint64_t start = get_monotonic_time_us();
+#ifdef HAVE_OPENSSL
+#ifndef WIN32
+		internal_ssl_set_recv_timeout(connection, deadline, 1);
+#endif
+		int r = SSL_read(connection->ssl_data->session, (void*)(data+received), (int)(len-received));
+#else
+		ssize_t r = gnutls_record_recv(connection->ssl_data->session, (void*)(data+received), (size_t)(len-received));
+#endif
+		internal_ssl_stats_add(connection, 0, (int)r, start);
+		if (r <= 0) {
+			res = internal_ssl_nonblocking_error(connection, (int)r);
+			if (res == IDEVICE_E_WANT_READ || res == IDEVICE_E_WANT_WRITE) {
+				/* the record is incomplete, wait for the rest until the deadline */
+				res = IDEVICE_E_SUCCESS;
+				continue;
+			}
+			break;
+		}
+		received += r;
+		if (!fill)
+			break;
 	}
-	return internal_connection_send(connection, data, len, sent_bytes);
+#ifdef HAVE_OPENSSL
+#ifndef WIN32
+	internal_ssl_set_recv_timeout(connection, 0, 0);
+#endif
+#else
+	connection->ssl_read_deadline = 0;
+#endif
+	if (res != IDEVICE_E_SUCCESS && res != IDEVICE_E_WANT_READ && received == 0) {
+		return res;
+	}
+	debug_info("SSL read %d, received %d", len, received);
+	*recv_bytes = received;
+	return IDEVICE_E_SUCCESS;
 }
 
 /**
@@ -378,13 +1664,34 @@ static idevice_error_t internal_connection_receive_timeout(idevice_connection_t
 		return IDEVICE_E_INVALID_ARG;
 	}
 
+	if (connection->nonblocking) {
+		return internal_connection_io_nonblocking(connection, data, len, recv_bytes, 0);
+	}
+
+	if (connection->cancel) {
+		return internal_connection_receive_deadline(connection, data, len, recv_bytes, idevice_deadline_from_timeout(timeout));
+	}
+
 	if (connection->type == CONNECTION_USBMUXD) {
+		uint64_t start = get_monotonic_time_us();
 		int res = usbmuxd_recv_timeout((int)(long)connection->data, data, len, recv_bytes, timeout);
+		internal_stats_add(connection, 0, (res < 0) ? 0 : *recv_bytes, start);
 		if (res < 0) {
 			debug_info("ERROR: usbmuxd_recv_timeout returned %d (%s)", res, strerror(-res));
 			return IDEVICE_E_UNKNOWN_ERROR;
 		}
 		return IDEVICE_E_SUCCESS;
+	} else if (connection->type == CONNECTION_NETWORK) {
+		uint64_t start = get_monotonic_time_us();
+		int res = socket_receive_timeout((int)(long)connection->data, data, len, 0, timeout);
+		internal_stats_add(connection, 0, (res < 0) ? 0 : (uint32_t)res, start);
+		if (res < 0) {
+			debug_info("ERROR: socket_receive_timeout returned %d (%s)", res, strerror(-res));
+			*recv_bytes = 0;
+			return IDEVICE_E_UNKNOWN_ERROR;
+		}
+		*recv_bytes = (uint32_t)res;
+		return IDEVICE_E_SUCCESS;
 	} else {
 		debug_info("Unknown connection type %d", connection->type);
 	}
@@ -397,11 +1704,25 @@ LIBIMOBILEDEVICE_API idevice_error_t idevice_connection_receive_timeout(idevice_
 		return IDEVICE_E_INVALID_ARG;
 	}
 
+	if (connection->ssl_data && connection->nonblocking) {
+		return idevice_connection_receive(connection, data, len, recv_bytes);
+	}
+
+	if (connection->ssl_data && connection->cancel) {
+#ifdef HAVE_OPENSSL
+		return internal_ssl_receive_deadline(connection, data, len, recv_bytes, idevice_deadline_from_timeout(timeout), 1);
+#else
+		return internal_ssl_receive_deadline(connection, data, len, recv_bytes, idevice_deadline_from_timeout(timeout), 0);
+#endif
+	}
+
 	if (connection->ssl_data) {
 #ifdef HAVE_OPENSSL
 		uint32_t received = 0;
 		while (received < len) {
+			uint64_t start = get_monotonic_time_us();
 			int r = SSL_read(connection->ssl_data->session, (void*)((char*)(data+received)), (int)len-received);
+			internal_ssl_stats_add(connection, 0, r, start);
 			if (r > 0) {
 				received += r;
 			} else {
@@ -410,7 +1731,9 @@ LIBIMOBILEDEVICE_API idevice_error_t idevice_connection_receive_timeout(idevice_
 		}
 		debug_info("SSL_read %d, received %d", len, received);
 #else
+		uint64_t start = get_monotonic_time_us();
 		ssize_t received = gnutls_record_recv(connection->ssl_data->session, (void*)data, (size_t)len);
+		internal_ssl_stats_add(connection, 0, (int)received, start);
 #endif
 		if (received > 0) {
 			*recv_bytes = received;
@@ -431,18 +1754,19 @@ static idevice_error_t internal_connection_receive(idevice_connection_t connecti
 		return IDEVICE_E_INVALID_ARG;
 	}
 
-	if (connection->type == CONNECTION_USBMUXD) {
-		int res = usbmuxd_recv((int)(long)connection->data, data, len, recv_bytes);
-		if (res < 0) {
-			debug_info("ERROR: usbmuxd_recv returned %d (%s)", res, strerror(-res));
-			return IDEVICE_E_UNKNOWN_ERROR;
-		}
+	if (connection->nonblocking) {
+		return internal_connection_io_nonblocking(connection, data, len, recv_bytes, 0);
+	}
 
-		return IDEVICE_E_SUCCESS;
-	} else {
-		debug_info("Unknown connection type %d", connection->type);
+	if (connection->cancel) {
+		idevice_error_t res = internal_connection_wait(connection, 0);
+		if (res != IDEVICE_E_SUCCESS) {
+			*recv_bytes = 0;
+			return res;
+		}
 	}
-	return IDEVICE_E_UNKNOWN_ERROR;
+
+	return internal_connection_read(connection, data, len, recv_bytes);
 }
 
 LIBIMOBILEDEVICE_API idevice_error_t idevice_connection_receive(idevice_connection_t connection, char *data, uint32_t len, uint32_t *recv_bytes)
@@ -451,23 +1775,97 @@ LIBIMOBILEDEVICE_API idevice_error_t idevice_connection_receive(idevice_connecti
 		return IDEVICE_E_INVALID_ARG;
 	}
 
+	if (connection->ssl_data && connection->cancel && !connection->nonblocking) {
+		return internal_ssl_receive_deadline(connection, data, len, recv_bytes, 0, 0);
+	}
+
 	if (connection->ssl_data) {
+		uint64_t start = get_monotonic_time_us();
 #ifdef HAVE_OPENSSL
 		int received = SSL_read(connection->ssl_data->session, (void*)data, (int)len);
 		debug_info("SSL_read %d, received %d", len, received);
 #else
 		ssize_t received = gnutls_record_recv(connection->ssl_data->session, (void*)data, (size_t)len);
 #endif
+		internal_ssl_stats_add(connection, 0, (int)received, start);
 		if (received > 0) {
 			*recv_bytes = received;
 			return IDEVICE_E_SUCCESS;
 		}
 		*recv_bytes = 0;
+		if (connection->nonblocking) {
+			return internal_ssl_nonblocking_error(connection, (int)received);
+		}
 		return IDEVICE_E_SSL_ERROR;
 	}
 	return internal_connection_receive(connection, data, len, recv_bytes);
 }
 
+LIBIMOBILEDEVICE_API idevice_error_t idevice_connection_receive_deadline(idevice_connection_t connection, char *data, uint32_t len, uint32_t *recv_bytes, uint64_t deadline)
+{
+	if (!connection || !data || !recv_bytes || (connection->ssl_data && !connection->ssl_data->session)) {
+		return IDEVICE_E_INVALID_ARG;
+	}
+
+	if (connection->nonblocking) {
+		return idevice_connection_receive(connection, data, len, recv_bytes);
+	}
+
+	if (connection->ssl_data) {
+#ifdef HAVE_OPENSSL
+		return internal_ssl_receive_deadline(connection, data, len, recv_bytes, deadline, 1);
+#else
+		return internal_ssl_receive_deadline(connection, data, len, recv_bytes, deadline, 0);
+#endif
+	}
+	return internal_connection_receive_deadline(connection, data, len, recv_bytes, deadline);
+}
+
+LIBIMOBILEDEVICE_API idevice_error_t idevice_connection_get_fd(idevice_connection_t connection, int *fd)
+{
+	if (!connection || !fd) {
+		return IDEVICE_E_INVALID_ARG;
+	}
+
+	if (connection->type == CONNECTION_USBMUXD || connection->type == CONNECTION_NETWORK) {
+		*fd = (int)(long)connection->data;
+		return IDEVICE_E_SUCCESS;
+	} else {
+		debug_info("Unknown connection type %d", connection->type);
+	}
+	return IDEVICE_E_UNKNOWN_ERROR;
+}
+
+LIBIMOBILEDEVICE_API idevice_error_t idevice_connection_set_nonblocking(idevice_connection_t connection, int nonblocking)
+{
+	if (!connection) {
+		return IDEVICE_E_INVALID_ARG;
+	}
+
+	if (connection->type != CONNECTION_USBMUXD && connection->type != CONNECTION_NETWORK) {
+		debug_info("Unknown connection type %d", connection->type);
+		return IDEVICE_E_UNKNOWN_ERROR;
+	}
+
+	if (internal_set_fd_nonblocking((int)(long)connection->data, nonblocking) < 0) {
+		debug_info("ERROR: Could not change blocking mode: %s", strerror(errno));
+		return IDEVICE_E_UNKNOWN_ERROR;
+	}
+	connection->nonblocking = (nonblocking) ? 1 : 0;
+
+#ifdef HAVE_OPENSSL
+	if (connection->ssl_data && connection->ssl_data->session) {
+		if (nonblocking) {
+			SSL_set_mode(connection->ssl_data->session, SSL_MODE_ENABLE_PARTIAL_WRITE);
+		} else {
+			SSL_clear_mode(connection->ssl_data->session, SSL_MODE_ENABLE_PARTIAL_WRITE);
+		}
+	}
+#endif
+
+	return IDEVICE_E_SUCCESS;
+}
+
 LIBIMOBILEDEVICE_API idevice_error_t idevice_get_handle(idevice_t device, uint32_t *handle)
 {
 	if (!device)
@@ -510,7 +1908,25 @@ static ssize_t internal_ssl_read(gnutls_transport_ptr_t transport, char *buffer,
 
 	/* repeat until we have the full data or an error occurs */
 	do {
-		if ((res = internal_connection_receive(connection, recv_buffer, this_len, (uint32_t*)&bytes)) != IDEVICE_E_SUCCESS) {
+		if (connection->ssl_read_deadline > 0) {
+			/* a deadline read, do not wait for the rest of a record beyond it */
+			res = internal_connection_wait(connection, connection->ssl_read_deadline);
+			if (res == IDEVICE_E_SUCCESS) {
+				res = internal_connection_read(connection, recv_buffer, this_len, (uint32_t*)&bytes);
+			}
+		} else {
+			res = internal_connection_receive(connection, recv_buffer, this_len, (uint32_t*)&bytes);
+		}
+		if (res != IDEVICE_E_SUCCESS) {
+			if ((res == IDEVICE_E_WANT_READ || res == IDEVICE_E_CANCELLED) && connection->ssl_data) {
+				/* hand out what we have or let gnutls retry later */
+				free(recv_buffer);
+				if (tbytes > 0) {
+					return tbytes;
+				}
+				gnutls_transport_set_errno(connection->ssl_data->session, (res == IDEVICE_E_CANCELLED) ? EINTR : EAGAIN);
+				return -1;
+			}
 			debug_info("ERROR: idevice_connection_receive returned %d", res);
 			return res;
 		}
@@ -547,6 +1963,10 @@ static ssize_t internal_ssl_write(gnutls_transport_ptr_t transport, char *buffer
 	idevice_connection_t connection = (idevice_connection_t)transport;
 	debug_info("pre-send length = %zi", length);
 	if ((res = internal_connection_send(connection, buffer, length, &bytes)) != IDEVICE_E_SUCCESS) {
+		if ((res == IDEVICE_E_WANT_WRITE) && connection->ssl_data) {
+			gnutls_transport_set_errno(connection->ssl_data->session, EAGAIN);
+			return -1;
+		}
 		debug_info("ERROR: internal_connection_send returned %d", res);
 		return -1;
 	}
@@ -683,12 +2103,34 @@ LIBIMOBILEDEVICE_API idevice_error_t idevice_connection_enable_ssl(idevice_conne
 	}
 	BIO_set_fd(ssl_bio, (int)(long)connection->data, BIO_NOCLOSE);
 
-	SSL_CTX *ssl_ctx = SSL_CTX_new(SSLv3_method());
+	/* let the peer pick the highest protocol version we both support instead
+	 * of pinning SSLv3, so TLS 1.2 AEAD suites can be negotiated */
+#if OPENSSL_VERSION_NUMBER < 0x10100000L
+	SSL_CTX *ssl_ctx = SSL_CTX_new(SSLv23_method());
+#else
+	SSL_CTX *ssl_ctx = SSL_CTX_new(TLS_method());
+#endif
 	if (ssl_ctx == NULL) {
 		debug_info("ERROR: Could not create SSL context.");
 		BIO_free(ssl_bio);
 		return ret;
 	}
+	SSL_CTX_set_options(ssl_ctx, SSL_OP_NO_SSLv2);
+#if OPENSSL_VERSION_NUMBER >= 0x10100000L
+	/* pair record certificates are RSA/SHA1, keep them usable */
+	SSL_CTX_set_security_level(ssl_ctx, 0);
+#endif
+	if (SSL_CTX_set_cipher_list(ssl_ctx, IDEVICE_SSL_CIPHER_LIST) != 1) {
+		debug_info("WARNING: Could not set cipher list, using library defaults");
+	}
+#ifdef HAVE_KTLS
+	if (ktls_enabled) {
+		/* OpenSSL installs the keys into the kernel after the handshake if the
+		 * socket and negotiated cipher allow it, and silently stays in
+		 * userspace otherwise */
+		SSL_CTX_set_options(ssl_ctx, SSL_OP_ENABLE_KTLS);
+	}
+#endif
 
 	BIO* membp;
 	X509* rootCert = NULL;
@@ -721,8 +2163,21 @@ LIBIMOBILEDEVICE_API idevice_error_t idevice_connection_enable_ssl(idevice_conne
 	SSL_set_connect_state(ssl);
 	SSL_set_verify(ssl, 0, ssl_verify_callback);
 	SSL_set_bio(ssl, ssl_bio, ssl_bio);
+	SSL_set_mode(ssl, SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
+	if (connection->nonblocking) {
+		SSL_set_mode(ssl, SSL_MODE_ENABLE_PARTIAL_WRITE);
+	}
 
+	/* the handshake is always done in blocking mode */
+	if (connection->nonblocking) {
+		internal_set_fd_nonblocking((int)(long)connection->data, 0);
+	}
+	trace_begin("SSLHandshake");
 	return_me = SSL_do_handshake(ssl);
+	trace_end("SSLHandshake");
+	if (connection->nonblocking) {
+		internal_set_fd_nonblocking((int)(long)connection->data, 1);
+	}
 	if (return_me != 1) {
 		debug_info("ERROR in SSL_do_handshake: %s", ssl_error_to_string(SSL_get_error(ssl, return_me)));
 		SSL_free(ssl);
@@ -731,9 +2186,18 @@ LIBIMOBILEDEVICE_API idevice_error_t idevice_connection_enable_ssl(idevice_conne
 		ssl_data_t ssl_data_loc = (ssl_data_t)malloc(sizeof(struct ssl_data_private));
 		ssl_data_loc->session = ssl;
 		ssl_data_loc->ctx = ssl_ctx;
+		ssl_data_loc->ktls_send = 0;
+		ssl_data_loc->ktls_recv = 0;
+#ifdef HAVE_KTLS
+		if (ktls_enabled) {
+			ssl_data_loc->ktls_send = BIO_get_ktls_send(SSL_get_wbio(ssl));
+			ssl_data_loc->ktls_recv = BIO_get_ktls_recv(SSL_get_rbio(ssl));
+			debug_info("kTLS offload: send %s, receive %s", (ssl_data_loc->ktls_send) ? "on" : "off", (ssl_data_loc->ktls_recv) ? "on" : "off");
+		}
+#endif
 		connection->ssl_data = ssl_data_loc;
 		ret = IDEVICE_E_SUCCESS;
-		debug_info("SSL mode enabled, cipher: %s", SSL_get_cipher(ssl));
+		debug_info("SSL mode enabled, %s, cipher: %s", SSL_get_version(ssl), SSL_get_cipher(ssl));
 	}
 	/* required for proper multi-thread clean up to prevent leaks */
 #ifdef HAVE_ERR_REMOVE_THREAD_STATE
@@ -742,7 +2206,12 @@ LIBIMOBILEDEVICE_API idevice_error_t idevice_connection_enable_ssl(idevice_conne
 	ERR_remove_state(0);
 #endif
 #else
-	ssl_data_t ssl_data_loc = (ssl_data_t)malloc(sizeof(struct ssl_data_private));
+	int i;
+	ssl_data_t ssl_data_loc = (ssl_data_t)calloc(1, sizeof(struct ssl_data_private));
+	if (!ssl_data_loc) {
+		plist_free(pair_record);
+		return IDEVICE_E_UNKNOWN_ERROR;
+	}
 
 	/* Set up GnuTLS... */
 	debug_info("enabling SSL mode");
@@ -750,7 +2219,19 @@ LIBIMOBILEDEVICE_API idevice_error_t idevice_connection_enable_ssl(idevice_conne
 	gnutls_certificate_allocate_credentials(&ssl_data_loc->certificate);
 	gnutls_certificate_client_set_retrieve_function(ssl_data_loc->certificate, internal_cert_callback);
 	gnutls_init(&ssl_data_loc->session, GNUTLS_CLIENT);
-	gnutls_priority_set_direct(ssl_data_loc->session, "NONE:+VERS-SSL3.0:+ANON-DH:+RSA:+AES-128-CBC:+AES-256-CBC:+SHA1:+MD5:+COMP-NULL", NULL);
+	for (i = 0; ssl_priorities[i]; i++) {
+		if (gnutls_priority_set_direct(ssl_data_loc->session, ssl_priorities[i], NULL) == GNUTLS_E_SUCCESS) {
+			debug_info("using priority string %s", ssl_priorities[i]);
+			break;
+		}
+	}
+	if (!ssl_priorities[i]) {
+		debug_info("ERROR: none of the priority strings is supported by this GnuTLS");
+		internal_ssl_cleanup(ssl_data_loc);
+		free(ssl_data_loc);
+		plist_free(pair_record);
+		return IDEVICE_E_SSL_ERROR;
+	}
 	gnutls_credentials_set(ssl_data_loc->session, GNUTLS_CRD_CERTIFICATE, ssl_data_loc->certificate);
 	gnutls_session_set_ptr(ssl_data_loc->session, ssl_data_loc);
 
@@ -777,7 +2258,19 @@ LIBIMOBILEDEVICE_API idevice_error_t idevice_connection_enable_ssl(idevice_conne
 	if (errno) {
 		debug_info("WARNING: errno says %s before handshake!", strerror(errno));
 	}
+	/* the handshake is always done in blocking mode */
+	int nonblocking = connection->nonblocking;
+	connection->nonblocking = 0;
+	if (nonblocking) {
+		internal_set_fd_nonblocking((int)(long)connection->data, 0);
+	}
+	trace_begin("SSLHandshake");
 	return_me = gnutls_handshake(ssl_data_loc->session);
+	trace_end("SSLHandshake");
+	if (nonblocking) {
+		internal_set_fd_nonblocking((int)(long)connection->data, 1);
+	}
+	connection->nonblocking = nonblocking;
 	debug_info("GnuTLS handshake done...");
 
 	if (return_me != GNUTLS_E_SUCCESS) {
@@ -789,7 +2282,7 @@ LIBIMOBILEDEVICE_API idevice_error_t idevice_connection_enable_ssl(idevice_conne
 	} else {
 		connection->ssl_data = ssl_data_loc;
 		ret = IDEVICE_E_SUCCESS;
-		debug_info("SSL mode enabled");
+		debug_info("SSL mode enabled, %s, cipher: %s", gnutls_protocol_get_name(gnutls_protocol_get_version(ssl_data_loc->session)), gnutls_cipher_get_name(gnutls_cipher_get(ssl_data_loc->session)));
 	}
 #endif
 	return ret;
@@ -810,6 +2303,11 @@ LIBIMOBILEDEVICE_API idevice_error_t idevice_connection_disable_ssl(idevice_conn
 		if (SSL_shutdown(connection->ssl_data->session) == 0) {
 			SSL_shutdown(connection->ssl_data->session);
 		}
+		/* keep the traffic of the session in the counters */
+		mutex_lock(&connection->stats_mutex);
+		connection->stats.bytes_sent += BIO_number_written(SSL_get_wbio(connection->ssl_data->session));
+		connection->stats.bytes_received += BIO_number_read(SSL_get_rbio(connection->ssl_data->session));
+		mutex_unlock(&connection->stats_mutex);
 	}
 #else
 	if (connection->ssl_data->session) {
@@ -824,3 +2322,46 @@ LIBIMOBILEDEVICE_API idevice_error_t idevice_connection_disable_ssl(idevice_conn
 
 	return IDEVICE_E_SUCCESS;
 }
+
+LIBIMOBILEDEVICE_API idevice_error_t idevice_connection_get_stats(idevice_connection_t connection, idevice_connection_stats_t *stats)
+{
+	if (!connection || !stats)
+		return IDEVICE_E_INVALID_ARG;
+
+	mutex_lock(&connection->stats_mutex);
+	*stats = connection->stats;
+	mutex_unlock(&connection->stats_mutex);
+#ifdef HAVE_OPENSSL
+	if (connection->ssl_data && connection->ssl_data->session) {
+		stats->bytes_sent += BIO_number_written(SSL_get_wbio(connection->ssl_data->session));
+		stats->bytes_received += BIO_number_read(SSL_get_rbio(connection->ssl_data->session));
+	}
+#endif
+	return IDEVICE_E_SUCCESS;
+}
+
+LIBIMOBILEDEVICE_API idevice_error_t idevice_connection_get_ssl_info(idevice_connection_t connection, char **version, char **cipher)
+{
+	if (!connection || (!version && !cipher))
+		return IDEVICE_E_INVALID_ARG;
+
+	if (!connection->ssl_data || !connection->ssl_data->session)
+		return IDEVICE_E_SSL_ERROR;
+
+#ifdef HAVE_OPENSSL
+	const char *version_str = SSL_get_version(connection->ssl_data->session);
+	const char *cipher_str = SSL_get_cipher(connection->ssl_data->session);
+#else
+	gnutls_session_t session = connection->ssl_data->session;
+	const char *version_str = gnutls_protocol_get_name(gnutls_protocol_get_version(session));
+	const char *cipher_str = gnutls_cipher_suite_get_name(gnutls_kx_get(session), gnutls_cipher_get(session), gnutls_mac_get(session));
+#endif
+	if (version) {
+		*version = (version_str) ? strdup(version_str) : NULL;
+	}
+	if (cipher) {
+		*cipher = (cipher_str) ? strdup(cipher_str) : NULL;
+	}
+
+	return IDEVICE_E_SUCCESS;
+}
@@ -28,6 +28,10 @@
 
 #ifdef HAVE_OPENSSL
 #include <openssl/ssl.h>
+#if defined(__linux__) && defined(SSL_OP_ENABLE_KTLS)
+/* OpenSSL 3.0+ can hand the record keys to the Linux kernel TLS module */
+#define HAVE_KTLS 1
+#endif
 #else
 #include <gnutls/gnutls.h>
 #include <gnutls/x509.h>
@@ -44,16 +48,28 @@
 #endif
 
 #include "common/userpref.h"
+#include "common/thread.h"
 #include "libimobiledevice/libimobiledevice.h"
 
+/* lockdownd's port, redirected for network devices */
+#define LOCKDOWN_PORT 0xf27e
+
 enum connection_type {
-	CONNECTION_USBMUXD = 1
+	CONNECTION_USBMUXD = 1,
+	CONNECTION_NETWORK
+};
+
+struct network_conn_data {
+	char *host;
+	uint16_t lockdown_port;
 };
 
 struct ssl_data_private {
 #ifdef HAVE_OPENSSL
 	SSL *session;
 	SSL_CTX *ctx;
+	int ktls_send;
+	int ktls_recv;
 #else
 	gnutls_certificate_credentials_t certificate;
 	gnutls_session_t session;
@@ -65,11 +81,26 @@ struct ssl_data_private {
 };
 typedef struct ssl_data_private *ssl_data_t;
 
+struct idevice_cancel_private {
+	/* accessed atomically, set and reset from other threads than the waiting ones */
+	volatile long triggered;
+	/* eventfd in fds[0], or a pipe; -1 if neither is available */
+	int fds[2];
+};
+
 struct idevice_connection_private {
 	char *udid;
 	enum connection_type type;
 	void *data;
 	ssl_data_t ssl_data;
+	int nonblocking;
+	idevice_cancel_t cancel;
+	/* deadline for the reads done by the SSL library, 0 if none */
+	uint64_t ssl_read_deadline;
+	/* protects stats, which can be updated by a sending and a receiving
+	 * thread at the same time */
+	mutex_t stats_mutex;
+	idevice_connection_stats_t stats;
 };
 
 struct idevice_private {
@@ -40,6 +40,7 @@ struct instproxy_status_data {
 	plist_t command;
 	instproxy_status_cb_t cbfunc;
 	void *user_data;
+	idevice_reactor_t reactor;
 };
 
 /**
@@ -241,6 +242,7 @@ LIBIMOBILEDEVICE_API instproxy_error_t instproxy_client_new(idevice_t device, lo
 	client_loc->parent = plistclient;
 	mutex_init(&client_loc->mutex);
 	client_loc->receive_status_thread = (thread_t)NULL;
+	client_loc->receive_status_data = NULL;
 
 	*client = client_loc;
 	return INSTPROXY_E_SUCCESS;
@@ -258,6 +260,17 @@ LIBIMOBILEDEVICE_API instproxy_error_t instproxy_client_free(instproxy_client_t
 	if (!client)
 		return INSTPROXY_E_INVALID_ARG;
 
+	instproxy_lock(client);
+	struct instproxy_status_data *data = (struct instproxy_status_data*)client->receive_status_data;
+	client->receive_status_data = NULL;
+	instproxy_unlock(client);
+	if (data) {
+		debug_info("removing receive status callback from reactor");
+		idevice_reactor_remove(data->reactor, client->parent->parent->connection);
+		plist_free(data->command);
+		free(data);
+	}
+
 	property_list_service_client_free(client->parent);
 	client->parent = NULL;
 	if (client->receive_status_thread) {
@@ -290,7 +303,7 @@ static instproxy_error_t instproxy_send_command(instproxy_client_t client, plist
 	if (!client || !command)
 		return INSTPROXY_E_INVALID_ARG;
 
-	instproxy_error_t res = instproxy_error(property_list_service_send_xml_plist(client->parent, command));
+	instproxy_error_t res = instproxy_error(property_list_service_send_plist(client->parent, command));
 
 	if (res != INSTPROXY_E_SUCCESS) {
 		debug_info("could not send command plist, error %d", res);
@@ -300,6 +313,84 @@ static instproxy_error_t instproxy_send_command(instproxy_client_t client, plist
 	return res;
 }
 
+/**
+ * Internally used function that evaluates a single status message of a
+ * command and passes it to the status callback.
+ *
+ * @param command The command specification the status belongs to.
+ * @param command_name The name of the command, used in debug messages.
+ * @param node The received status message.
+ * @param status_cb Pointer to a callback function or NULL
+ * @param user_data Callback data passed to status_cb.
+ * @param complete Will be set to 1 if the command completed or failed.
+ *
+ * @return INSTPROXY_E_SUCCESS if the command completed,
+ *     INSTPROXY_E_OP_IN_PROGRESS while it is still running, or the
+ *     INSTPROXY_E_* error reported by the device.
+ */
+static instproxy_error_t instproxy_handle_status(plist_t command, const char *command_name, plist_t node, instproxy_status_cb_t status_cb, void *user_data, int *complete)
+{
+	instproxy_error_t res = INSTPROXY_E_UNKNOWN_ERROR;
+	char* status_name = NULL;
+	char* error_name = NULL;
+	char* error_description = NULL;
+	uint64_t error_code = 0;
+#ifndef STRIP_DEBUG_CODE
+	int percent_complete = 0;
+#endif
+
+	/* check status for possible error to allow reporting it and aborting it gracefully */
+	res = instproxy_status_get_error(node, &error_name, &error_description, &error_code);
+	if (res != INSTPROXY_E_SUCCESS) {
+		debug_info("command: %s, error %d, code 0x%08"PRIx64", name: %s, description: \"%s\"", command_name, res, error_code, error_name, error_description ? error_description: "N/A");
+		*complete = 1;
+	}
+
+	if (error_name) {
+		free(error_name);
+		error_name = NULL;
+	}
+
+	if (error_description) {
+		free(error_description);
+		error_description = NULL;
+	}
+
+	/* check status from response */
+	instproxy_status_get_name(node, &status_name);
+	if (!status_name) {
+		debug_info("failed to retrieve name from status response with error %d.", res);
+		*complete = 1;
+	}
+
+	if (status_name) {
+		if (!strcmp(status_name, "Complete")) {
+			*complete = 1;
+		} else {
+			res = INSTPROXY_E_OP_IN_PROGRESS;
+		}
+
+#ifndef STRIP_DEBUG_CODE
+		percent_complete = -1;
+		instproxy_status_get_percent_complete(node, &percent_complete);
+		if (percent_complete >= 0) {
+			debug_info("command: %s, status: %s, percent (%d%%)", command_name, status_name, percent_complete);
+		} else {
+			debug_info("command: %s, status: %s", command_name, status_name);
+		}
+#endif
+		free(status_name);
+		status_name = NULL;
+	}
+
+	/* invoke status callback function */
+	if (status_cb) {
+		status_cb(command, node, user_data);
+	}
+
+	return res;
+}
+
 /**
  * Internally used function that will synchronously receive messages from
  * the specified installation_proxy until it completes or an error occurs.
@@ -319,13 +410,6 @@ static instproxy_error_t instproxy_receive_status_loop(instproxy_client_t client
 	int complete = 0;
 	plist_t node = NULL;
 	char* command_name = NULL;
-	char* status_name = NULL;
-	char* error_name = NULL;
-	char* error_description = NULL;
-	uint64_t error_code = 0;
-#ifndef STRIP_DEBUG_CODE
-	int percent_complete = 0;
-#endif
 
 	instproxy_command_get_name(command, &command_name);
 
@@ -343,64 +427,74 @@ static instproxy_error_t instproxy_receive_status_loop(instproxy_client_t client
 
 		/* parse status response */
 		if (node) {
-			/* check status for possible error to allow reporting it and aborting it gracefully */
-			res = instproxy_status_get_error(node, &error_name, &error_description, &error_code);
-			if (res != INSTPROXY_E_SUCCESS) {
-				debug_info("command: %s, error %d, code 0x%08"PRIx64", name: %s, description: \"%s\"", command_name, res, error_code, error_name, error_description ? error_description: "N/A");
-				complete = 1;
-			}
-
-			if (error_name) {
-				free(error_name);
-				error_name = NULL;
-			}
+			res = instproxy_handle_status(command, command_name, node, status_cb, user_data, &complete);
+			plist_free(node);
+			node = NULL;
+		}
+	} while (!complete && client->parent);
 
-			if (error_description) {
-				free(error_description);
-				error_description = NULL;
-			}
+	if (command_name)
+		free(command_name);
 
-			/* check status from response */
-			instproxy_status_get_name(node, &status_name);
-			if (!status_name) {
-				debug_info("failed to retrieve name from status response with error %d.", res);
-				complete = 1;
-			}
+	return res;
+}
 
-			if (status_name) {
-				if (!strcmp(status_name, "Complete")) {
-					complete = 1;
-				} else {
-					res = INSTPROXY_E_OP_IN_PROGRESS;
-				}
+/**
+ * Internally used reactor callback that processes the status messages of an
+ * asynchronous command as they arrive, replacing the "receive status" thread.
+ *
+ * @param connection The connection of the installation proxy client.
+ * @param events The events reported by the reactor.
+ * @param user_data Pointer to the struct instproxy_status_data of the command.
+ */
+static void instproxy_status_reactor_cb(idevice_connection_t connection, int events, void *user_data)
+{
+	struct instproxy_status_data *data = (struct instproxy_status_data*)user_data;
+	instproxy_client_t client = data->client;
+	instproxy_error_t res = INSTPROXY_E_UNKNOWN_ERROR;
+	plist_t node = NULL;
+	int complete = 0;
 
-#ifndef STRIP_DEBUG_CODE
-				percent_complete = -1;
-				instproxy_status_get_percent_complete(node, &percent_complete);
-				if (percent_complete >= 0) {
-					debug_info("command: %s, status: %s, percent (%d%%)", command_name, status_name, percent_complete);
-				} else {
-					debug_info("command: %s, status: %s", command_name, status_name);
-				}
-#endif
-				free(status_name);
-				status_name = NULL;
-			}
+	/* only take what is available, the reactor thread is shared; loop as
+	   further messages might already be buffered by the SSL layer */
+	do {
+		node = NULL;
+		instproxy_lock(client);
+		res = instproxy_error(property_list_service_receive_plist_available(client->parent, &node));
+		instproxy_unlock(client);
 
-			/* invoke status callback function */
-			if (status_cb) {
-				status_cb(command, node, user_data);
-			}
+		if (res != INSTPROXY_E_SUCCESS && res != INSTPROXY_E_RECEIVE_TIMEOUT) {
+			debug_info("could not receive plist, error %d", res);
+			complete = 1;
+		}
 
+		if (node) {
+			char *command_name = NULL;
+			instproxy_command_get_name(data->command, &command_name);
+			instproxy_handle_status(data->command, command_name, node, data->cbfunc, data->user_data, &complete);
+			free(command_name);
 			plist_free(node);
-			node = NULL;
 		}
-	} while (!complete && client->parent);
+	} while (node && !complete);
 
-	if (command_name)
-		free(command_name);
+	if (!complete)
+		return;
 
-	return res;
+	debug_info("done, cleaning up.");
+
+	instproxy_lock(client);
+	int owner = (client->receive_status_data == data);
+	if (owner) {
+		client->receive_status_data = NULL;
+	}
+	instproxy_unlock(client);
+
+	/* instproxy_client_free() cleans up if it took over the data already */
+	if (owner) {
+		idevice_reactor_remove(data->reactor, connection);
+		plist_free(data->command);
+		free(data);
+	}
 }
 
 /**
@@ -465,7 +559,7 @@ static instproxy_error_t instproxy_receive_status_loop_with_callback(instproxy_c
 		return INSTPROXY_E_INVALID_ARG;
 	}
 
-	if (client->receive_status_thread) {
+	if (client->receive_status_thread || client->receive_status_data) {
 		return INSTPROXY_E_OP_IN_PROGRESS;
 	}
 
@@ -478,8 +572,19 @@ static instproxy_error_t instproxy_receive_status_loop_with_callback(instproxy_c
 			data->command = plist_copy(command);
 			data->cbfunc = status_cb;
 			data->user_data = user_data;
+			data->reactor = idevice_get_default_reactor();
 
-			if (thread_new(&client->receive_status_thread, instproxy_receive_status_loop_thread, data) == 0) {
+			if (data->reactor) {
+				/* let the shared reactor process the status messages */
+				client->receive_status_data = data;
+				if (idevice_reactor_add(data->reactor, client->parent->parent->connection, IDEVICE_REACTOR_READ, instproxy_status_reactor_cb, data) == IDEVICE_E_SUCCESS) {
+					res = INSTPROXY_E_SUCCESS;
+				} else {
+					client->receive_status_data = NULL;
+					plist_free(data->command);
+					free(data);
+				}
+			} else if (thread_new(&client->receive_status_thread, instproxy_receive_status_loop_thread, data) == 0) {
 				res = INSTPROXY_E_SUCCESS;
 			}
 		}
@@ -510,7 +615,7 @@ static instproxy_error_t instproxy_perform_command(instproxy_client_t client, pl
 		return INSTPROXY_E_INVALID_ARG;
 	}
 
-	if (client->receive_status_thread) {
+	if (client->receive_status_thread || client->receive_status_data) {
 		return INSTPROXY_E_OP_IN_PROGRESS;
 	}
 
@@ -546,26 +651,81 @@ LIBIMOBILEDEVICE_API instproxy_error_t instproxy_browse_with_callback(instproxy_
 	return res;
 }
 
-static void instproxy_append_current_list_to_result_cb(plist_t command, plist_t status, void *user_data)
+/**
+ * Internally used function that receives the pages of a Browse command
+ * until it completes or an error occurs. The status messages are decoded
+ * on demand, so only the items of each CurrentList are copied into the
+ * result.
+ *
+ * @param client The connected installation proxy client
+ * @param result_array The array the browsed items are appended to.
+ *
+ * @return INSTPROXY_E_SUCCESS if the command completed, or an INSTPROXY_E_*
+ *     error value if an error occured.
+ */
+static instproxy_error_t instproxy_browse_receive_list(instproxy_client_t client, plist_t result_array)
 {
-	plist_t *result_array = (plist_t*)user_data;
-	uint64_t current_amount = 0;
-	plist_t current_list = NULL;
-	uint64_t i;
+	instproxy_error_t res = INSTPROXY_E_UNKNOWN_ERROR;
+	property_list_view_t view = NULL;
+	int complete = 0;
 
-	instproxy_status_get_current_list(status, NULL, NULL, &current_amount, &current_list);
+	do {
+		instproxy_lock(client);
+		res = instproxy_error(property_list_service_receive_plist_view_with_timeout(client->parent, &view, 1000));
+		instproxy_unlock(client);
 
-	debug_info("current_amount: %d", current_amount);
+		if (res != INSTPROXY_E_SUCCESS && res != INSTPROXY_E_RECEIVE_TIMEOUT) {
+			debug_info("could not receive plist, error %d", res);
+			break;
+		}
+		if (!view) {
+			continue;
+		}
 
-	if (current_amount > 0) {
-		for (i = 0; current_list && (i < current_amount); i++) {
-			plist_t item = plist_array_get_item(current_list, i);
-			plist_array_append_item(*result_array, plist_copy(item));
+		property_list_view_node_t root = property_list_view_get_root(view);
+		property_list_view_node_t node = property_list_view_dict_get_item(view, root, "Error");
+		if (node) {
+			char *error_name = NULL;
+			char *error_description = NULL;
+			property_list_view_get_string_val(view, node, &error_name);
+			property_list_view_get_string_val(view, property_list_view_dict_get_item(view, root, "ErrorDescription"), &error_description);
+			res = (error_name) ? instproxy_strtoerr(error_name) : INSTPROXY_E_UNKNOWN_ERROR;
+			debug_info("command: Browse, error %d, name: %s, description: \"%s\"", res, error_name, error_description ? error_description : "N/A");
+			free(error_name);
+			free(error_description);
+			complete = 1;
+		} else {
+			char *status_name = NULL;
+			node = property_list_view_dict_get_item(view, root, "CurrentList");
+			if (node && property_list_view_get_node_type(view, node) == PLIST_ARRAY) {
+				uint32_t count = property_list_view_get_size(view, node);
+				uint32_t i;
+				debug_info("current_amount: %u", count);
+				for (i = 0; i < count; i++) {
+					plist_t item = property_list_view_copy_node(view, property_list_view_array_get_item(view, node, i));
+					if (item) {
+						plist_array_append_item(result_array, item);
+					}
+				}
+			}
+			property_list_view_get_string_val(view, property_list_view_dict_get_item(view, root, "Status"), &status_name);
+			if (!status_name) {
+				debug_info("failed to retrieve name from status response");
+				complete = 1;
+			} else if (!strcmp(status_name, "Complete")) {
+				complete = 1;
+			} else {
+				debug_info("command: Browse, status: %s", status_name);
+				res = INSTPROXY_E_OP_IN_PROGRESS;
+			}
+			free(status_name);
 		}
-	}
 
-	if (current_list)
-		plist_free(current_list);
+		property_list_view_free(view);
+		view = NULL;
+	} while (!complete && client->parent);
+
+	return res;
 }
 
 LIBIMOBILEDEVICE_API instproxy_error_t instproxy_browse(instproxy_client_t client, plist_t client_options, plist_t *result)
@@ -573,6 +733,9 @@ LIBIMOBILEDEVICE_API instproxy_error_t instproxy_browse(instproxy_client_t clien
 	if (!client || !client->parent || !result)
 		return INSTPROXY_E_INVALID_ARG;
 
+	if (client->receive_status_thread || client->receive_status_data)
+		return INSTPROXY_E_OP_IN_PROGRESS;
+
 	instproxy_error_t res = INSTPROXY_E_UNKNOWN_ERROR;
 
 	plist_t result_array = plist_new_array();
@@ -582,7 +745,13 @@ LIBIMOBILEDEVICE_API instproxy_error_t instproxy_browse(instproxy_client_t clien
 	if (client_options)
 		plist_dict_set_item(command, "ClientOptions", plist_copy(client_options));
 
-	res = instproxy_perform_command(client, command, INSTPROXY_COMMAND_TYPE_SYNC, instproxy_append_current_list_to_result_cb, (void*)&result_array);
+	instproxy_lock(client);
+	res = instproxy_send_command(client, command);
+	instproxy_unlock(client);
+
+	if (res == INSTPROXY_E_SUCCESS) {
+		res = instproxy_browse_receive_list(client, result_array);
+	}
 
 	if (res == INSTPROXY_E_SUCCESS) {
 		*result = result_array;
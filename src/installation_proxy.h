@@ -31,6 +31,7 @@ struct instproxy_client_private {
 	property_list_service_client_t parent;
 	mutex_t mutex;
 	thread_t receive_status_thread;
+	void *receive_status_data;
 };
 
 #endif
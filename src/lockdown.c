@@ -33,6 +33,7 @@
 #include <stdio.h>
 #include <ctype.h>
 #include <unistd.h>
+#include <time.h>
 #ifdef HAVE_OPENSSL
 #include <openssl/pem.h>
 #include <openssl/x509.h>
@@ -50,6 +51,8 @@
 #include "common/debug.h"
 #include "common/userpref.h"
 #include "common/utils.h"
+#include "common/thread.h"
+#include "common/trace.h"
 #include "asprintf.h"
 
 #ifdef WIN32
@@ -378,6 +381,48 @@ LIBIMOBILEDEVICE_API lockdownd_error_t lockdownd_send(lockdownd_client_t client,
 	return ret;
 }
 
+LIBIMOBILEDEVICE_API lockdownd_error_t lockdownd_request_batch(lockdownd_client_t client, plist_t *requests, unsigned int count, plist_t *responses)
+{
+	lockdownd_error_t ret = LOCKDOWN_E_SUCCESS;
+	unsigned int sent = 0;
+	unsigned int i;
+
+	if (!client || !requests || !responses || count == 0)
+		return LOCKDOWN_E_INVALID_ARG;
+
+	for (i = 0; i < count; i++) {
+		responses[i] = NULL;
+		if (!requests[i])
+			return LOCKDOWN_E_INVALID_ARG;
+	}
+
+	/* send all requests first; lockdownd answers them in order */
+	for (i = 0; i < count; i++) {
+		ret = lockdownd_send(client, requests[i]);
+		if (ret != LOCKDOWN_E_SUCCESS) {
+			debug_info("ERROR: could not send request %u of %u: %d", i, count, ret);
+			break;
+		}
+		sent++;
+	}
+
+	/* collect the responses of all requests that went out */
+	for (i = 0; i < sent; i++) {
+		lockdownd_error_t res = lockdownd_receive(client, &responses[i]);
+		if (res != LOCKDOWN_E_SUCCESS) {
+			debug_info("ERROR: could not receive response %u of %u: %d", i, sent, res);
+			plist_free(responses[i]);
+			responses[i] = NULL;
+			/* the stream is out of sync now, the remaining responses are lost */
+			if (ret == LOCKDOWN_E_SUCCESS)
+				ret = res;
+			break;
+		}
+	}
+
+	return ret;
+}
+
 LIBIMOBILEDEVICE_API lockdownd_error_t lockdownd_query_type(lockdownd_client_t client, char **type)
 {
 	if (!client)
@@ -390,12 +435,14 @@ LIBIMOBILEDEVICE_API lockdownd_error_t lockdownd_query_type(lockdownd_client_t c
 	plist_dict_set_item(dict,"Request", plist_new_string("QueryType"));
 
 	debug_info("called");
+	trace_begin("QueryType");
 	ret = lockdownd_send(client, dict);
 
 	plist_free(dict);
 	dict = NULL;
 
 	ret = lockdownd_receive(client, &dict);
+	trace_end("QueryType");
 
 	if (LOCKDOWN_E_SUCCESS != ret)
 		return ret;
@@ -423,16 +470,151 @@ LIBIMOBILEDEVICE_API lockdownd_error_t lockdownd_query_type(lockdownd_client_t c
 	return ret;
 }
 
-LIBIMOBILEDEVICE_API lockdownd_error_t lockdownd_get_value(lockdownd_client_t client, const char *domain, const char *key, plist_t *value)
+/* cache of values that never change for a device */
+
+struct lockdownd_value_cache_entry {
+	char *udid;
+	plist_t values;
+	struct lockdownd_value_cache_entry *next;
+};
+
+static const char *immutable_keys[] = {
+	"BoardId",
+	"BluetoothAddress",
+	"CPUArchitecture",
+	"ChipID",
+	"DeviceClass",
+	"HardwareModel",
+	"HardwarePlatform",
+	"ModelNumber",
+	"ProductType",
+	"SerialNumber",
+	"UniqueChipID",
+	"UniqueDeviceID",
+	"WiFiAddress",
+	NULL
+};
+
+static thread_once_t value_cache_once = THREAD_ONCE_INIT;
+static mutex_t value_cache_mutex;
+static struct lockdownd_value_cache_entry *value_cache = NULL;
+static int value_cache_enabled = 0;
+
+static void value_cache_init(void)
 {
-	if (!client)
-		return LOCKDOWN_E_INVALID_ARG;
+	mutex_init(&value_cache_mutex);
+}
 
-	plist_t dict = NULL;
-	lockdownd_error_t ret = LOCKDOWN_E_UNKNOWN_ERROR;
+/**
+ * Checks if the given key of the global domain never changes for a device
+ * and may therefore be cached.
+ */
+static int value_cache_is_cacheable(const char *domain, const char *key)
+{
+	int i;
 
-	/* setup request plist */
-	dict = plist_new_dict();
+	if (domain || !key)
+		return 0;
+
+	for (i = 0; immutable_keys[i]; i++) {
+		if (!strcmp(immutable_keys[i], key))
+			return 1;
+	}
+
+	return 0;
+}
+
+/**
+ * Looks up a cached value.
+ *
+ * @return A copy of the cached value or NULL if it is not cached.
+ */
+static plist_t value_cache_lookup(lockdownd_client_t client, const char *domain, const char *key)
+{
+	struct lockdownd_value_cache_entry *entry;
+	plist_t value = NULL;
+
+	if (!value_cache_enabled || !client->udid || !value_cache_is_cacheable(domain, key))
+		return NULL;
+
+	thread_once(&value_cache_once, value_cache_init);
+
+	mutex_lock(&value_cache_mutex);
+	for (entry = value_cache; entry; entry = entry->next) {
+		if (!strcmp(entry->udid, client->udid)) {
+			plist_t node = plist_dict_get_item(entry->values, key);
+			if (node) {
+				value = plist_copy(node);
+			}
+			break;
+		}
+	}
+	mutex_unlock(&value_cache_mutex);
+
+	return value;
+}
+
+static void value_cache_store(lockdownd_client_t client, const char *domain, const char *key, plist_t value)
+{
+	struct lockdownd_value_cache_entry *entry;
+
+	if (!value_cache_enabled || !client->udid || !value || !value_cache_is_cacheable(domain, key))
+		return;
+
+	thread_once(&value_cache_once, value_cache_init);
+
+	mutex_lock(&value_cache_mutex);
+	for (entry = value_cache; entry; entry = entry->next) {
+		if (!strcmp(entry->udid, client->udid))
+			break;
+	}
+	if (!entry) {
+		entry = (struct lockdownd_value_cache_entry*)malloc(sizeof(struct lockdownd_value_cache_entry));
+		entry->udid = strdup(client->udid);
+		entry->values = plist_new_dict();
+		entry->next = value_cache;
+		value_cache = entry;
+	}
+	plist_dict_set_item(entry->values, key, plist_copy(value));
+	mutex_unlock(&value_cache_mutex);
+}
+
+LIBIMOBILEDEVICE_API void lockdownd_value_cache_invalidate(const char *udid)
+{
+	struct lockdownd_value_cache_entry **pp;
+
+	thread_once(&value_cache_once, value_cache_init);
+
+	mutex_lock(&value_cache_mutex);
+	pp = &value_cache;
+	while (*pp) {
+		struct lockdownd_value_cache_entry *entry = *pp;
+		if (!udid || !strcmp(entry->udid, udid)) {
+			*pp = entry->next;
+			free(entry->udid);
+			plist_free(entry->values);
+			free(entry);
+		} else {
+			pp = &entry->next;
+		}
+	}
+	mutex_unlock(&value_cache_mutex);
+}
+
+LIBIMOBILEDEVICE_API void lockdownd_value_cache_set_enabled(int enable)
+{
+	value_cache_enabled = (enable) ? 1 : 0;
+	if (!value_cache_enabled) {
+		lockdownd_value_cache_invalidate(NULL);
+	}
+}
+
+/**
+ * Creates a GetValue request for the given domain and key.
+ */
+static plist_t lockdownd_build_get_value_request(lockdownd_client_t client, const char *domain, const char *key)
+{
+	plist_t dict = plist_new_dict();
 	plist_dict_add_label(dict, client->label);
 	if (domain) {
 		plist_dict_set_item(dict,"Domain", plist_new_string(domain));
@@ -442,6 +624,53 @@ LIBIMOBILEDEVICE_API lockdownd_error_t lockdownd_get_value(lockdownd_client_t cl
 	}
 	plist_dict_set_item(dict,"Request", plist_new_string("GetValue"));
 
+	return dict;
+}
+
+/**
+ * Evaluates the response to a GetValue request.
+ *
+ * @param dict The response received from lockdownd
+ * @param value Set to a copy of the returned value if there is one
+ */
+static lockdownd_error_t lockdownd_parse_get_value_response(plist_t dict, plist_t *value)
+{
+	lockdownd_error_t ret = lockdown_check_result(dict, "GetValue");
+	if (ret == LOCKDOWN_E_SUCCESS) {
+		debug_info("success");
+	}
+
+	if (ret != LOCKDOWN_E_SUCCESS) {
+		return ret;
+	}
+
+	plist_t value_node = plist_dict_get_item(dict, "Value");
+
+	if (value_node) {
+		debug_info("has a value");
+		*value = plist_copy(value_node);
+	}
+
+	return ret;
+}
+
+LIBIMOBILEDEVICE_API lockdownd_error_t lockdownd_get_value(lockdownd_client_t client, const char *domain, const char *key, plist_t *value)
+{
+	if (!client)
+		return LOCKDOWN_E_INVALID_ARG;
+
+	plist_t dict = NULL;
+	lockdownd_error_t ret = LOCKDOWN_E_UNKNOWN_ERROR;
+
+	plist_t cached = value_cache_lookup(client, domain, key);
+	if (cached) {
+		*value = cached;
+		return LOCKDOWN_E_SUCCESS;
+	}
+
+	/* setup request plist */
+	dict = lockdownd_build_get_value_request(client, domain, key);
+
 	/* send to device */
 	ret = lockdownd_send(client, dict);
 
@@ -456,24 +685,82 @@ LIBIMOBILEDEVICE_API lockdownd_error_t lockdownd_get_value(lockdownd_client_t cl
 	if (ret != LOCKDOWN_E_SUCCESS)
 		return ret;
 
-	ret = lockdown_check_result(dict, "GetValue");
+	ret = lockdownd_parse_get_value_response(dict, value);
 	if (ret == LOCKDOWN_E_SUCCESS) {
-		debug_info("success");
+		value_cache_store(client, domain, key, *value);
 	}
 
-	if (ret != LOCKDOWN_E_SUCCESS) {
-		plist_free(dict);
-		return ret;
+	plist_free(dict);
+	return ret;
+}
+
+LIBIMOBILEDEVICE_API lockdownd_error_t lockdownd_get_values(lockdownd_client_t client, const char *domain, const char **keys, unsigned int count, plist_t *values)
+{
+	lockdownd_error_t ret = LOCKDOWN_E_SUCCESS;
+	unsigned int *pending = NULL;
+	unsigned int num_pending = 0;
+	plist_t *requests = NULL;
+	plist_t *responses = NULL;
+	unsigned int i;
+
+	if (!client || !keys || !values || count == 0)
+		return LOCKDOWN_E_INVALID_ARG;
+
+	pending = (unsigned int*)malloc(count * sizeof(unsigned int));
+	if (!pending) {
+		for (i = 0; i < count; i++) {
+			values[i] = NULL;
+		}
+		return LOCKDOWN_E_UNKNOWN_ERROR;
+	}
+	for (i = 0; i < count; i++) {
+		values[i] = value_cache_lookup(client, domain, keys[i]);
+		if (!values[i]) {
+			pending[num_pending++] = i;
+		}
 	}
 
-	plist_t value_node = plist_dict_get_item(dict, "Value");
+	if (num_pending == 0) {
+		free(pending);
+		return LOCKDOWN_E_SUCCESS;
+	}
 
-	if (value_node) {
-		debug_info("has a value");
-		*value = plist_copy(value_node);
+	requests = (plist_t*)malloc(num_pending * sizeof(plist_t));
+	responses = (plist_t*)malloc(num_pending * sizeof(plist_t));
+	if (!requests || !responses) {
+		/* the cached values stay valid, the others are left NULL */
+		free(requests);
+		free(responses);
+		free(pending);
+		return LOCKDOWN_E_UNKNOWN_ERROR;
+	}
+	for (i = 0; i < num_pending; i++) {
+		requests[i] = lockdownd_build_get_value_request(client, domain, keys[pending[i]]);
 	}
 
-	plist_free(dict);
+	ret = lockdownd_request_batch(client, requests, num_pending, responses);
+
+	for (i = 0; i < num_pending; i++) {
+		unsigned int idx = pending[i];
+		lockdownd_error_t res = LOCKDOWN_E_UNKNOWN_ERROR;
+		if (responses[i]) {
+			res = lockdownd_parse_get_value_response(responses[i], &values[idx]);
+			plist_free(responses[i]);
+		}
+		plist_free(requests[i]);
+		if (res == LOCKDOWN_E_SUCCESS) {
+			value_cache_store(client, domain, keys[idx], values[idx]);
+			continue;
+		}
+		debug_info("ERROR: could not get value for key %s: %d", (keys[idx]) ? keys[idx] : "(null)", res);
+		if (ret == LOCKDOWN_E_SUCCESS)
+			ret = res;
+	}
+
+	free(requests);
+	free(responses);
+	free(pending);
+
 	return ret;
 }
 
@@ -495,6 +782,11 @@ LIBIMOBILEDEVICE_API lockdownd_error_t lockdownd_set_value(lockdownd_client_t cl
 		plist_dict_set_item(dict,"Key", plist_new_string(key));
 	}
 	plist_dict_set_item(dict,"Request", plist_new_string("SetValue"));
+
+	/* the device might derive other values from the changed one */
+	if (client->udid) {
+		lockdownd_value_cache_invalidate(client->udid);
+	}
 	plist_dict_set_item(dict,"Value", value);
 
 	/* send to device */
@@ -544,6 +836,11 @@ LIBIMOBILEDEVICE_API lockdownd_error_t lockdownd_remove_value(lockdownd_client_t
 	}
 	plist_dict_set_item(dict,"Request", plist_new_string("RemoveValue"));
 
+	/* the device might derive other values from the changed one */
+	if (client->udid) {
+		lockdownd_value_cache_invalidate(client->udid);
+	}
+
 	/* send to device */
 	ret = lockdownd_send(client, dict);
 
@@ -641,7 +938,7 @@ LIBIMOBILEDEVICE_API lockdownd_error_t lockdownd_client_new(idevice_t device, lo
 		return LOCKDOWN_E_INVALID_ARG;
 
 	static struct lockdownd_service_descriptor service = {
-		.port = 0xf27e,
+		.port = LOCKDOWN_PORT,
 		.ssl_enabled = 0
 	};
 
@@ -922,11 +1219,13 @@ static lockdownd_error_t lockdownd_do_pair(lockdownd_client_t client, lockdownd_
 	}
 
 	/* send to device */
+	trace_begin(verb);
 	ret = lockdownd_send(client, dict);
 	plist_free(dict);
 	dict = NULL;
 
 	if (ret != LOCKDOWN_E_SUCCESS) {
+		trace_end(verb);
 		plist_free(pair_record_plist);
 		if (wifi_node)
 			plist_free(wifi_node);
@@ -935,6 +1234,7 @@ static lockdownd_error_t lockdownd_do_pair(lockdownd_client_t client, lockdownd_
 
 	/* Now get device's answer */
 	ret = lockdownd_receive(client, &dict);
+	trace_end(verb);
 
 	if (ret != LOCKDOWN_E_SUCCESS) {
 		plist_free(pair_record_plist);
@@ -1050,6 +1350,28 @@ LIBIMOBILEDEVICE_API lockdownd_error_t lockdownd_unpair(lockdownd_client_t clien
 	return lockdownd_do_pair(client, pair_record, "Unpair", NULL, NULL);
 }
 
+LIBIMOBILEDEVICE_API lockdownd_error_t lockdownd_key_pool_start(unsigned int depth, unsigned int num_threads)
+{
+	switch (userpref_key_pool_start(depth, num_threads)) {
+		case USERPREF_E_SUCCESS:
+			return LOCKDOWN_E_SUCCESS;
+		case USERPREF_E_INVALID_ARG:
+			return LOCKDOWN_E_INVALID_ARG;
+		default:
+			return LOCKDOWN_E_UNKNOWN_ERROR;
+	}
+}
+
+LIBIMOBILEDEVICE_API void lockdownd_key_pool_stop(void)
+{
+	userpref_key_pool_stop();
+}
+
+LIBIMOBILEDEVICE_API void lockdownd_key_pool_get_stats(unsigned int *available, uint64_t *generated, double *rate)
+{
+	userpref_key_pool_get_stats(available, generated, rate);
+}
+
 LIBIMOBILEDEVICE_API lockdownd_error_t lockdownd_enter_recovery(lockdownd_client_t client)
 {
 	if (!client)
@@ -1149,14 +1471,18 @@ LIBIMOBILEDEVICE_API lockdownd_error_t lockdownd_start_session(lockdownd_client_
 		}
 	}
 
+	trace_begin("StartSession");
 	ret = lockdownd_send(client, dict);
 	plist_free(dict);
 	dict = NULL;
 
-	if (ret != LOCKDOWN_E_SUCCESS)
+	if (ret != LOCKDOWN_E_SUCCESS) {
+		trace_end("StartSession");
 		return ret;
+	}
 
 	ret = lockdownd_receive(client, &dict);
+	trace_end("StartSession");
 
 	if (!dict)
 		return LOCKDOWN_E_PLIST_ERROR;
@@ -1261,6 +1587,61 @@ static lockdownd_error_t lockdownd_build_start_service_request(lockdownd_client_
 	return LOCKDOWN_E_SUCCESS;
 }
 
+/**
+ * Function used internally to evaluate the response to a StartService
+ * request.
+ *
+ * @param dict The response received from lockdownd
+ * @param service The service descriptor to fill, allocated if it points to NULL
+ *
+ * @return LOCKDOWN_E_SUCCESS on success or the LOCKDOWN_E_* error that
+ *  matches the error reported by the device.
+ */
+static lockdownd_error_t lockdownd_parse_start_service_response(plist_t dict, lockdownd_service_descriptor_t *service)
+{
+	uint16_t port_loc = 0;
+	lockdownd_error_t ret = lockdown_check_result(dict, "StartService");
+	if (ret == LOCKDOWN_E_SUCCESS) {
+		if (*service == NULL)
+			*service = (lockdownd_service_descriptor_t)malloc(sizeof(struct lockdownd_service_descriptor));
+		(*service)->port = 0;
+		(*service)->ssl_enabled = 0;
+
+		/* read service port number */
+		plist_t node = plist_dict_get_item(dict, "Port");
+		if (node && (plist_get_node_type(node) == PLIST_UINT)) {
+			uint64_t port_value = 0;
+			plist_get_uint_val(node, &port_value);
+
+			if (port_value) {
+				port_loc = port_value;
+				ret = LOCKDOWN_E_SUCCESS;
+			}
+			if (port_loc && ret == LOCKDOWN_E_SUCCESS) {
+				(*service)->port = port_loc;
+			}
+		}
+
+		/* check if the service requires SSL */
+		node = plist_dict_get_item(dict, "EnableServiceSSL");
+		if (node && (plist_get_node_type(node) == PLIST_BOOLEAN)) {
+			uint8_t b = 0;
+			plist_get_bool_val(node, &b);
+			(*service)->ssl_enabled = b;
+		}
+	} else {
+		plist_t error_node = plist_dict_get_item(dict, "Error");
+		if (error_node && PLIST_STRING == plist_get_node_type(error_node)) {
+			char *error = NULL;
+			plist_get_string_val(error_node, &error);
+			ret = lockdownd_strtoerr(error);
+			free(error);
+		}
+	}
+
+	return ret;
+}
+
 /**
  * Function used internally by lockdownd_start_service and lockdownd_start_service_with_escrow_bag.
  *
@@ -1287,7 +1668,6 @@ static lockdownd_error_t lockdownd_do_start_service(lockdownd_client_t client, c
 	}
 
 	plist_t dict = NULL;
-	uint16_t port_loc = 0;
 	lockdownd_error_t ret = LOCKDOWN_E_UNKNOWN_ERROR;
 
 	/* create StartService request */
@@ -1296,14 +1676,18 @@ static lockdownd_error_t lockdownd_do_start_service(lockdownd_client_t client, c
 		return ret;
 
 	/* send to device */
+	trace_begin_arg("StartService", identifier);
 	ret = lockdownd_send(client, dict);
 	plist_free(dict);
 	dict = NULL;
 
-	if (LOCKDOWN_E_SUCCESS != ret)
+	if (LOCKDOWN_E_SUCCESS != ret) {
+		trace_end("StartService");
 		return ret;
+	}
 
 	ret = lockdownd_receive(client, &dict);
+	trace_end("StartService");
 
 	if (LOCKDOWN_E_SUCCESS != ret)
 		return ret;
@@ -1311,44 +1695,7 @@ static lockdownd_error_t lockdownd_do_start_service(lockdownd_client_t client, c
 	if (!dict)
 		return LOCKDOWN_E_PLIST_ERROR;
 
-	ret = lockdown_check_result(dict, "StartService");
-	if (ret == LOCKDOWN_E_SUCCESS) {
-		if (*service == NULL)
-			*service = (lockdownd_service_descriptor_t)malloc(sizeof(struct lockdownd_service_descriptor));
-		(*service)->port = 0;
-		(*service)->ssl_enabled = 0;
-
-		/* read service port number */
-		plist_t node = plist_dict_get_item(dict, "Port");
-		if (node && (plist_get_node_type(node) == PLIST_UINT)) {
-			uint64_t port_value = 0;
-			plist_get_uint_val(node, &port_value);
-
-			if (port_value) {
-				port_loc = port_value;
-				ret = LOCKDOWN_E_SUCCESS;
-			}
-			if (port_loc && ret == LOCKDOWN_E_SUCCESS) {
-				(*service)->port = port_loc;
-			}
-		}
-
-		/* check if the service requires SSL */
-		node = plist_dict_get_item(dict, "EnableServiceSSL");
-		if (node && (plist_get_node_type(node) == PLIST_BOOLEAN)) {
-			uint8_t b = 0;
-			plist_get_bool_val(node, &b);
-			(*service)->ssl_enabled = b;
-		}
-	} else {
-		plist_t error_node = plist_dict_get_item(dict, "Error");
-		if (error_node && PLIST_STRING == plist_get_node_type(error_node)) {
-			char *error = NULL;
-			plist_get_string_val(error_node, &error);
-			ret = lockdownd_strtoerr(error);
-			free(error);
-		}
-	}
+	ret = lockdownd_parse_start_service_response(dict, service);
 
 	plist_free(dict);
 	dict = NULL;
@@ -1366,6 +1713,63 @@ LIBIMOBILEDEVICE_API lockdownd_error_t lockdownd_start_service_with_escrow_bag(l
 	return lockdownd_do_start_service(client, identifier, 1, service);
 }
 
+LIBIMOBILEDEVICE_API lockdownd_error_t lockdownd_start_services(lockdownd_client_t client, const char **identifiers, unsigned int count, lockdownd_service_descriptor_t *services)
+{
+	lockdownd_error_t ret = LOCKDOWN_E_SUCCESS;
+	plist_t *requests = NULL;
+	plist_t *responses = NULL;
+	unsigned int i;
+
+	if (!client || !identifiers || !services || count == 0)
+		return LOCKDOWN_E_INVALID_ARG;
+
+	for (i = 0; i < count; i++) {
+		services[i] = NULL;
+		if (!identifiers[i])
+			return LOCKDOWN_E_INVALID_ARG;
+	}
+
+	requests = (plist_t*)calloc(count, sizeof(plist_t));
+	responses = (plist_t*)calloc(count, sizeof(plist_t));
+	for (i = 0; i < count; i++) {
+		ret = lockdownd_build_start_service_request(client, identifiers[i], 0, &requests[i]);
+		if (ret != LOCKDOWN_E_SUCCESS) {
+			debug_info("ERROR: could not build StartService request for %s: %d", identifiers[i], ret);
+			break;
+		}
+	}
+
+	if (ret == LOCKDOWN_E_SUCCESS) {
+		trace_begin("StartServices");
+		ret = lockdownd_request_batch(client, requests, count, responses);
+		trace_end("StartServices");
+		for (i = 0; i < count; i++) {
+			lockdownd_error_t res = LOCKDOWN_E_UNKNOWN_ERROR;
+			if (responses[i]) {
+				res = lockdownd_parse_start_service_response(responses[i], &services[i]);
+			}
+			if (res != LOCKDOWN_E_SUCCESS) {
+				debug_info("ERROR: could not start service %s: %d", identifiers[i], res);
+				if (services[i]) {
+					lockdownd_service_descriptor_free(services[i]);
+					services[i] = NULL;
+				}
+				if (ret == LOCKDOWN_E_SUCCESS)
+					ret = res;
+			}
+		}
+	}
+
+	for (i = 0; i < count; i++) {
+		plist_free(requests[i]);
+		plist_free(responses[i]);
+	}
+	free(requests);
+	free(responses);
+
+	return ret;
+}
+
 LIBIMOBILEDEVICE_API lockdownd_error_t lockdownd_activate(lockdownd_client_t client, plist_t activation_record)
 {
 	if (!client)
@@ -1526,3 +1930,230 @@ LIBIMOBILEDEVICE_API lockdownd_error_t lockdownd_service_descriptor_free(lockdow
 
 	return LOCKDOWN_E_SUCCESS;
 }
+
+/* lockdown session pool */
+
+struct lockdownd_pool_entry {
+	/* a session is only reused for the same device, connection and label */
+	char *udid;
+	enum connection_type conn_type;
+	char *label;
+	lockdownd_client_t client;
+	int in_use;
+	time_t last_used;
+	struct lockdownd_pool_entry *next;
+};
+
+static thread_once_t session_pool_once = THREAD_ONCE_INIT;
+static mutex_t session_pool_mutex;
+static struct lockdownd_pool_entry *session_pool = NULL;
+static unsigned int session_pool_idle_timeout = 0;
+
+static void session_pool_init(void)
+{
+	mutex_init(&session_pool_mutex);
+}
+
+static int session_pool_entry_matches(struct lockdownd_pool_entry *entry, idevice_t device, const char *label)
+{
+	if (entry->conn_type != device->conn_type || strcmp(entry->udid, device->udid))
+		return 0;
+	if (!entry->label || !label)
+		return (entry->label == label);
+	return !strcmp(entry->label, label);
+}
+
+/**
+ * Moves all idle pool entries of the given device (or all devices if udid
+ * is NULL) that are expired, or all idle ones if force is set, to a list
+ * that the caller has to pass to session_pool_free_entries().
+ * Must be called with the pool mutex held.
+ */
+static struct lockdownd_pool_entry *session_pool_collect(const char *udid, int force)
+{
+	struct lockdownd_pool_entry *collected = NULL;
+	struct lockdownd_pool_entry **pp = &session_pool;
+	time_t now = time(NULL);
+
+	while (*pp) {
+		struct lockdownd_pool_entry *entry = *pp;
+		if (!entry->in_use && (!udid || !strcmp(entry->udid, udid))
+		    && (force || (now - entry->last_used >= (time_t)session_pool_idle_timeout))) {
+			*pp = entry->next;
+			entry->next = collected;
+			collected = entry;
+		} else {
+			pp = &entry->next;
+		}
+	}
+
+	return collected;
+}
+
+/**
+ * Closes the sessions of the given list of pool entries and frees them.
+ * Must be called without holding the pool mutex since it talks to the device.
+ */
+static void session_pool_free_entries(struct lockdownd_pool_entry *entry)
+{
+	while (entry) {
+		struct lockdownd_pool_entry *next = entry->next;
+		debug_info("closing pooled lockdown session for %s", entry->udid);
+		lockdownd_client_free(entry->client);
+		free(entry->udid);
+		free(entry->label);
+		free(entry);
+		entry = next;
+	}
+}
+
+lockdownd_error_t lockdownd_session_pool_acquire(idevice_t device, lockdownd_client_t *client, const char *label, int *reused)
+{
+	struct lockdownd_pool_entry *entry = NULL;
+	struct lockdownd_pool_entry *expired = NULL;
+	lockdownd_error_t ret;
+
+	if (!device || !device->udid || !client)
+		return LOCKDOWN_E_INVALID_ARG;
+
+	if (reused)
+		*reused = 0;
+
+	thread_once(&session_pool_once, session_pool_init);
+
+	mutex_lock(&session_pool_mutex);
+	if (session_pool_idle_timeout == 0) {
+		mutex_unlock(&session_pool_mutex);
+		return lockdownd_client_new_with_handshake(device, client, label);
+	}
+
+	expired = session_pool_collect(NULL, 0);
+	for (entry = session_pool; entry; entry = entry->next) {
+		if (!entry->in_use && session_pool_entry_matches(entry, device, label)) {
+			entry->in_use = 1;
+			break;
+		}
+	}
+	mutex_unlock(&session_pool_mutex);
+
+	session_pool_free_entries(expired);
+
+	if (entry) {
+		debug_info("reusing pooled lockdown session for %s", device->udid);
+		*client = entry->client;
+		if (reused)
+			*reused = 1;
+		return LOCKDOWN_E_SUCCESS;
+	}
+
+	ret = lockdownd_client_new_with_handshake(device, client, label);
+	if (ret != LOCKDOWN_E_SUCCESS) {
+		return ret;
+	}
+
+	entry = (struct lockdownd_pool_entry*)calloc(1, sizeof(struct lockdownd_pool_entry));
+	if (entry) {
+		entry->udid = strdup(device->udid);
+		entry->label = (label) ? strdup(label) : NULL;
+	}
+	if (!entry || !entry->udid || (label && !entry->label)) {
+		/* the session still works, it is just not pooled */
+		debug_info("ERROR: out of memory, not pooling the lockdown session");
+		if (entry) {
+			free(entry->udid);
+			free(entry->label);
+			free(entry);
+		}
+		return LOCKDOWN_E_SUCCESS;
+	}
+	entry->conn_type = device->conn_type;
+	entry->client = *client;
+	entry->in_use = 1;
+	entry->last_used = time(NULL);
+
+	mutex_lock(&session_pool_mutex);
+	entry->next = session_pool;
+	session_pool = entry;
+	mutex_unlock(&session_pool_mutex);
+
+	return LOCKDOWN_E_SUCCESS;
+}
+
+void lockdownd_session_pool_release(lockdownd_client_t client, int discard)
+{
+	struct lockdownd_pool_entry **pp;
+	struct lockdownd_pool_entry *entry = NULL;
+	struct lockdownd_pool_entry *expired = NULL;
+
+	if (!client)
+		return;
+
+	thread_once(&session_pool_once, session_pool_init);
+
+	mutex_lock(&session_pool_mutex);
+	for (pp = &session_pool; *pp; pp = &(*pp)->next) {
+		if ((*pp)->client == client) {
+			entry = *pp;
+			break;
+		}
+	}
+	if (entry && !discard && session_pool_idle_timeout > 0) {
+		entry->in_use = 0;
+		entry->last_used = time(NULL);
+		expired = session_pool_collect(NULL, 0);
+		mutex_unlock(&session_pool_mutex);
+		session_pool_free_entries(expired);
+		return;
+	}
+	if (entry) {
+		*pp = entry->next;
+		free(entry->udid);
+		free(entry->label);
+		free(entry);
+	}
+	expired = session_pool_collect(NULL, 0);
+	mutex_unlock(&session_pool_mutex);
+
+	session_pool_free_entries(expired);
+	lockdownd_client_free(client);
+}
+
+LIBIMOBILEDEVICE_API void lockdownd_session_pool_set_idle_timeout(unsigned int idle_timeout)
+{
+	struct lockdownd_pool_entry *collected = NULL;
+
+	thread_once(&session_pool_once, session_pool_init);
+
+	mutex_lock(&session_pool_mutex);
+	session_pool_idle_timeout = idle_timeout;
+	if (idle_timeout == 0) {
+		collected = session_pool_collect(NULL, 1);
+	}
+	mutex_unlock(&session_pool_mutex);
+
+	session_pool_free_entries(collected);
+}
+
+LIBIMOBILEDEVICE_API void lockdownd_session_pool_flush(const char *udid)
+{
+	struct lockdownd_pool_entry *collected = NULL;
+
+	thread_once(&session_pool_once, session_pool_init);
+
+	mutex_lock(&session_pool_mutex);
+	collected = session_pool_collect(udid, 1);
+	if (udid) {
+		/* also close the expired sessions of other devices */
+		struct lockdownd_pool_entry *expired = session_pool_collect(NULL, 0);
+		if (expired) {
+			struct lockdownd_pool_entry *last = expired;
+			while (last->next)
+				last = last->next;
+			last->next = collected;
+			collected = expired;
+		}
+	}
+	mutex_unlock(&session_pool_mutex);
+
+	session_pool_free_entries(collected);
+}
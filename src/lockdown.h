@@ -36,4 +36,19 @@ struct lockdownd_client_private {
 	char *label;
 };
 
+/**
+ * Borrows an authenticated lockdown session for the given device, connection
+ * type and label from the session pool, creating a new one if none is idle. Without an enabled pool
+ * this is lockdownd_client_new_with_handshake().
+ *
+ * @param reused Set to 1 if an existing pooled session was handed out.
+ */
+lockdownd_error_t lockdownd_session_pool_acquire(idevice_t device, lockdownd_client_t *client, const char *label, int *reused);
+
+/**
+ * Returns a session obtained with lockdownd_session_pool_acquire() to the
+ * pool, or closes it if discard is set or the pool is disabled.
+ */
+void lockdownd_session_pool_release(lockdownd_client_t client, int discard);
+
 #endif
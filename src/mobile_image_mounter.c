@@ -123,7 +123,7 @@ LIBIMOBILEDEVICE_API mobile_image_mounter_error_t mobile_image_mounter_lookup_im
 	plist_dict_set_item(dict,"Command", plist_new_string("LookupImage"));
 	plist_dict_set_item(dict,"ImageType", plist_new_string(image_type));
 
-	mobile_image_mounter_error_t res = mobile_image_mounter_error(property_list_service_send_xml_plist(client->parent, dict));
+	mobile_image_mounter_error_t res = mobile_image_mounter_error(property_list_service_send_plist(client->parent, dict));
 	plist_free(dict);
 
 	if (res != MOBILE_IMAGE_MOUNTER_E_SUCCESS) {
@@ -141,11 +141,16 @@ leave_unlock:
 	return res;
 }
 
-LIBIMOBILEDEVICE_API mobile_image_mounter_error_t mobile_image_mounter_upload_image(mobile_image_mounter_client_t client, const char *image_type, size_t image_size, const char *signature, uint16_t signature_size, mobile_image_mounter_upload_cb_t upload_cb, void* userdata)
+/**
+ * Internally used function to upload an image either from an upload callback
+ * or directly from a file descriptor.
+ *
+ * @param upload_cb Callback that gets the data chunks, or NULL to read from fd
+ * @param userdata User data for upload_cb
+ * @param fd File descriptor to upload the image from if upload_cb is NULL
+ */
+static mobile_image_mounter_error_t mobile_image_mounter_upload(mobile_image_mounter_client_t client, const char *image_type, size_t image_size, const char *signature, uint16_t signature_size, mobile_image_mounter_upload_cb_t upload_cb, void* userdata, int fd)
 {
-	if (!client || !image_type || (image_size == 0) || !upload_cb) {
-		return MOBILE_IMAGE_MOUNTER_E_INVALID_ARG;
-	}
 	mobile_image_mounter_lock(client);
 	plist_t result = NULL;
 
@@ -156,7 +161,7 @@ LIBIMOBILEDEVICE_API mobile_image_mounter_error_t mobile_image_mounter_upload_im
 	plist_dict_set_item(dict, "ImageSize", plist_new_uint(image_size));
 	plist_dict_set_item(dict, "ImageType", plist_new_string(image_type));
 
-	mobile_image_mounter_error_t res = mobile_image_mounter_error(property_list_service_send_xml_plist(client->parent, dict));
+	mobile_image_mounter_error_t res = mobile_image_mounter_error(property_list_service_send_plist(client->parent, dict));
 	plist_free(dict);
 
 	if (res != MOBILE_IMAGE_MOUNTER_E_SUCCESS) {
@@ -188,30 +193,38 @@ LIBIMOBILEDEVICE_API mobile_image_mounter_error_t mobile_image_mounter_upload_im
 	free(strval);
 
 	size_t tx = 0;
-	size_t bufsize = 65536;
-	unsigned char *buf = (unsigned char*)malloc(bufsize);
-	if (!buf) {
-		debug_info("Out of memory");
-		res = MOBILE_IMAGE_MOUNTER_E_UNKNOWN_ERROR;
-		goto leave_unlock;
-	}
 	debug_info("uploading image (%d bytes)", (int)image_size);
-	while (tx < image_size) {
-		size_t remaining = image_size - tx;
-		size_t amount = (remaining < bufsize) ? remaining : bufsize;
-		ssize_t r = upload_cb(buf, amount, userdata);
-		if (r < 0) {
-			debug_info("upload_cb returned %d", (int)r);
-			break;
+	if (!upload_cb) {
+		uint64_t sent = 0;
+		if (service_send_file(client->parent->parent, fd, 0, image_size, &sent) != SERVICE_E_SUCCESS) {
+			debug_info("service_send_file failed");
 		}
-		uint32_t sent = 0;
-		if (service_send(client->parent->parent, (const char*)buf, (uint32_t)r, &sent) != SERVICE_E_SUCCESS) {
-			debug_info("service_send failed");
-			break;
+		tx = (size_t)sent;
+	} else {
+		size_t bufsize = 65536;
+		unsigned char *buf = (unsigned char*)malloc(bufsize);
+		if (!buf) {
+			debug_info("Out of memory");
+			res = MOBILE_IMAGE_MOUNTER_E_UNKNOWN_ERROR;
+			goto leave_unlock;
+		}
+		while (tx < image_size) {
+			size_t remaining = image_size - tx;
+			size_t amount = (remaining < bufsize) ? remaining : bufsize;
+			ssize_t r = upload_cb(buf, amount, userdata);
+			if (r < 0) {
+				debug_info("upload_cb returned %d", (int)r);
+				break;
+			}
+			uint32_t sent = 0;
+			if (service_send(client->parent->parent, (const char*)buf, (uint32_t)r, &sent) != SERVICE_E_SUCCESS) {
+				debug_info("service_send failed");
+				break;
+			}
+			tx += r;
 		}
-		tx += r;
+		free(buf);
 	}
-	free(buf);
 	if (tx < image_size) {
 		debug_info("Error: failed to upload image");
 		goto leave_unlock;
@@ -252,6 +265,22 @@ leave_unlock:
 
 }
 
+LIBIMOBILEDEVICE_API mobile_image_mounter_error_t mobile_image_mounter_upload_image(mobile_image_mounter_client_t client, const char *image_type, size_t image_size, const char *signature, uint16_t signature_size, mobile_image_mounter_upload_cb_t upload_cb, void* userdata)
+{
+	if (!client || !image_type || (image_size == 0) || !upload_cb) {
+		return MOBILE_IMAGE_MOUNTER_E_INVALID_ARG;
+	}
+	return mobile_image_mounter_upload(client, image_type, image_size, signature, signature_size, upload_cb, userdata, -1);
+}
+
+LIBIMOBILEDEVICE_API mobile_image_mounter_error_t mobile_image_mounter_upload_image_file(mobile_image_mounter_client_t client, const char *image_type, int fd, size_t image_size, const char *signature, uint16_t signature_size)
+{
+	if (!client || !image_type || (fd < 0) || (image_size == 0)) {
+		return MOBILE_IMAGE_MOUNTER_E_INVALID_ARG;
+	}
+	return mobile_image_mounter_upload(client, image_type, image_size, signature, signature_size, NULL, NULL, fd);
+}
+
 LIBIMOBILEDEVICE_API mobile_image_mounter_error_t mobile_image_mounter_mount_image(mobile_image_mounter_client_t client, const char *image_path, const char *signature, uint16_t signature_size, const char *image_type, plist_t *result)
 {
 	if (!client || !image_path || !image_type || !result) {
@@ -266,7 +295,7 @@ LIBIMOBILEDEVICE_API mobile_image_mounter_error_t mobile_image_mounter_mount_ima
 		plist_dict_set_item(dict, "ImageSignature", plist_new_data(signature, signature_size));
 	plist_dict_set_item(dict, "ImageType", plist_new_string(image_type));
 
-	mobile_image_mounter_error_t res = mobile_image_mounter_error(property_list_service_send_xml_plist(client->parent, dict));
+	mobile_image_mounter_error_t res = mobile_image_mounter_error(property_list_service_send_plist(client->parent, dict));
 	plist_free(dict);
 
 	if (res != MOBILE_IMAGE_MOUNTER_E_SUCCESS) {
@@ -294,7 +323,7 @@ LIBIMOBILEDEVICE_API mobile_image_mounter_error_t mobile_image_mounter_hangup(mo
 	plist_t dict = plist_new_dict();
 	plist_dict_set_item(dict, "Command", plist_new_string("Hangup"));
 
-	mobile_image_mounter_error_t res = mobile_image_mounter_error(property_list_service_send_xml_plist(client->parent, dict));
+	mobile_image_mounter_error_t res = mobile_image_mounter_error(property_list_service_send_plist(client->parent, dict));
 	plist_free(dict);
 
 	if (res != MOBILE_IMAGE_MOUNTER_E_SUCCESS) {
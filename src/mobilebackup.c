@@ -71,6 +71,9 @@ LIBIMOBILEDEVICE_API mobilebackup_error_t mobilebackup_client_new(idevice_t devi
 		return ret;
 	}
 
+	/* the device drives the backup and sends its requests on its own */
+	service_client_set_measure_rtt(dlclient->parent->parent, 0);
+
 	mobilebackup_client_t client_loc = (mobilebackup_client_t) malloc(sizeof(struct mobilebackup_client_private));
 	client_loc->parent = dlclient;
 
@@ -155,8 +158,7 @@ static mobilebackup_error_t mobilebackup_send_message(mobilebackup_client_t clie
 		plist_dict_set_item(dict, "BackupMessageTypeKey", plist_new_string(message));
 
 		/* send it as DLMessageProcessMessage */
-		err = mobilebackup_error(device_link_service_send_process_message(client->parent, dict));
-		plist_free(dict);
+		err = mobilebackup_error(device_link_service_send_process_message_owned(client->parent, dict));
 	} else {
 		err = mobilebackup_error(device_link_service_send_process_message(client->parent, options));
 	}
@@ -22,6 +22,7 @@
 #include <plist/plist.h>
 #include <string.h>
 #include <stdlib.h>
+#include <errno.h>
 
 #include "mobilebackup2.h"
 #include "device_link_service.h"
@@ -73,6 +74,9 @@ LIBIMOBILEDEVICE_API mobilebackup2_error_t mobilebackup2_client_new(idevice_t de
 		return ret;
 	}
 
+	/* the device drives the backup and sends its requests on its own */
+	service_client_set_measure_rtt(dlclient->parent->parent, 0);
+
 	mobilebackup2_client_t client_loc = (mobilebackup2_client_t) malloc(sizeof(struct mobilebackup2_client_private));
 	client_loc->parent = dlclient;
 
@@ -130,8 +134,7 @@ LIBIMOBILEDEVICE_API mobilebackup2_error_t mobilebackup2_send_message(mobileback
 		plist_dict_set_item(dict, "MessageName", plist_new_string(message));
 
 		/* send it as DLMessageProcessMessage */
-		err = mobilebackup2_error(device_link_service_send_process_message(client->parent, dict));
-		plist_free(dict);
+		err = mobilebackup2_error(device_link_service_send_process_message_owned(client->parent, dict));
 	} else {
 		err = mobilebackup2_error(device_link_service_send_process_message(client->parent, options));
 	}
@@ -212,6 +215,20 @@ LIBIMOBILEDEVICE_API mobilebackup2_error_t mobilebackup2_receive_message(mobileb
 	return mobilebackup2_error(device_link_service_receive_message(client->parent, msg_plist, dlmessage));
 }
 
+LIBIMOBILEDEVICE_API mobilebackup2_error_t mobilebackup2_set_message_handler(mobilebackup2_client_t client, const char *dlmessage, mobilebackup2_message_handler_t handler)
+{
+	if (!client || !client->parent)
+		return MOBILEBACKUP2_E_INVALID_ARG;
+	return mobilebackup2_error(device_link_service_set_handler(client->parent, dlmessage, handler));
+}
+
+LIBIMOBILEDEVICE_API mobilebackup2_error_t mobilebackup2_dispatch_message(mobilebackup2_client_t client, void *user_data, int *result)
+{
+	if (!client || !client->parent)
+		return MOBILEBACKUP2_E_INVALID_ARG;
+	return mobilebackup2_error(device_link_service_dispatch_message(client->parent, user_data, result));
+}
+
 LIBIMOBILEDEVICE_API mobilebackup2_error_t mobilebackup2_send_raw(mobilebackup2_client_t client, const char *data, uint32_t length, uint32_t *bytes)
 {
 	if (!client || !client->parent || !data || (length == 0) || !bytes)
@@ -238,6 +255,36 @@ LIBIMOBILEDEVICE_API mobilebackup2_error_t mobilebackup2_send_raw(mobilebackup2_
 	}
 }
 
+LIBIMOBILEDEVICE_API mobilebackup2_error_t mobilebackup2_send_raw_file(mobilebackup2_client_t client, int fd, uint64_t offset, uint64_t length, uint64_t *bytes, int *read_error)
+{
+	if (!client || !client->parent || (fd < 0) || (length == 0) || !bytes)
+		return MOBILEBACKUP2_E_INVALID_ARG;
+
+	*bytes = 0;
+	if (read_error)
+		*read_error = 0;
+
+	service_client_t raw = client->parent->parent->parent;
+
+	uint64_t sent = 0;
+	service_error_t err = service_send_file(raw, fd, offset, length, &sent);
+	*bytes = sent;
+	switch (err) {
+		case SERVICE_E_SUCCESS:
+			return MOBILEBACKUP2_E_SUCCESS;
+		case SERVICE_E_INVALID_ARG:
+			return MOBILEBACKUP2_E_INVALID_ARG;
+		case SERVICE_E_NOT_ENOUGH_DATA:
+			/* service_send_file() sets errno to 0 if the file is too short */
+			if (read_error)
+				*read_error = errno;
+			return MOBILEBACKUP2_E_NOT_ENOUGH_DATA;
+		default:
+			break;
+	}
+	return MOBILEBACKUP2_E_MUX_ERROR;
+}
+
 LIBIMOBILEDEVICE_API mobilebackup2_error_t mobilebackup2_receive_raw(mobilebackup2_client_t client, char *data, uint32_t length, uint32_t *bytes)
 {
 	if (!client || !client->parent || !data || (length == 0) || !bytes)
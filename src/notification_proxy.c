@@ -86,6 +86,30 @@ static np_error_t np_error(property_list_service_error_t err)
 	return NP_E_UNKNOWN_ERROR;
 }
 
+/**
+ * Unregisters the notification callback of the given client from the
+ * reactor it was registered with, if any.
+ *
+ * @param client The notification_proxy client
+ * @param notify Whether to signal the end of notifications by invoking the
+ *     callback with an empty notification name, like the notifier thread does.
+ */
+static void np_reactor_stop(np_client_t client, int notify)
+{
+	struct np_thread *npt = (struct np_thread*)client->reactor_data;
+
+	if (!client->reactor)
+		return;
+
+	/* the callback already signalled a lost connection if it removed itself */
+	if (idevice_reactor_remove(client->reactor, client->parent->parent->connection) == IDEVICE_E_SUCCESS && notify) {
+		npt->cbfunc("", npt->user_data);
+	}
+	free(npt);
+	client->reactor = NULL;
+	client->reactor_data = NULL;
+}
+
 LIBIMOBILEDEVICE_API np_error_t np_client_new(idevice_t device, lockdownd_service_descriptor_t service, np_client_t *client)
 {
 	property_list_service_client_t plistclient = NULL;
@@ -94,11 +118,16 @@ LIBIMOBILEDEVICE_API np_error_t np_client_new(idevice_t device, lockdownd_servic
 		return err;
 	}
 
+	/* notifications are no replies to the requests sent */
+	service_client_set_measure_rtt(plistclient->parent, 0);
+
 	np_client_t client_loc = (np_client_t) malloc(sizeof(struct np_client_private));
 	client_loc->parent = plistclient;
 
 	mutex_init(&client_loc->mutex);
 	client_loc->notifier = (thread_t)NULL;
+	client_loc->reactor = NULL;
+	client_loc->reactor_data = NULL;
 
 	*client = client_loc;
 	return NP_E_SUCCESS;
@@ -119,6 +148,8 @@ LIBIMOBILEDEVICE_API np_error_t np_client_free(np_client_t client)
 	if (!client)
 		return NP_E_INVALID_ARG;
 
+	np_reactor_stop(client, 1);
+
 	dict = plist_new_dict();
 	plist_dict_set_item(dict,"Command", plist_new_string("Shutdown"));
 	property_list_service_send_xml_plist(client->parent, dict);
@@ -238,6 +269,8 @@ LIBIMOBILEDEVICE_API np_error_t np_observe_notifications(np_client_t client, con
  * @param client NP to get a notification from
  * @param notification Pointer to a buffer that will be allocated and filled
  *  with the notification that has been received.
+ * @param nowait 1 to only take the data that is available, 0 to wait up to
+ *  500 ms for a notification.
  *
  * @return 0 if a notification has been received or nothing has been received,
  *         or a negative value if an error occured.
@@ -245,7 +278,7 @@ LIBIMOBILEDEVICE_API np_error_t np_observe_notifications(np_client_t client, con
  * @note You probably want to check out np_set_notify_callback
  * @see np_set_notify_callback
  */
-static int np_get_notification(np_client_t client, char **notification)
+static int np_get_notification(np_client_t client, char **notification, int nowait)
 {
 	int res = 0;
 	plist_t dict = NULL;
@@ -255,7 +288,12 @@ static int np_get_notification(np_client_t client, char **notification)
 
 	np_lock(client);
 
-	property_list_service_error_t perr = property_list_service_receive_plist_with_timeout(client->parent, &dict, 500);
+	property_list_service_error_t perr;
+	if (nowait) {
+		perr = property_list_service_receive_plist_available(client->parent, &dict);
+	} else {
+		perr = property_list_service_receive_plist_with_timeout(client->parent, &dict, 500);
+	}
 	if (perr == PROPERTY_LIST_SERVICE_E_RECEIVE_TIMEOUT) {
 		debug_info("NotificationProxy: no notification received!");
 		res = 0;
@@ -318,7 +356,7 @@ void* np_notifier( void* arg )
 
 	debug_info("starting callback.");
 	while (npt->client->parent) {
-		if (np_get_notification(npt->client, &notification) < 0) {
+		if (np_get_notification(npt->client, &notification, 0) < 0) {
 			npt->cbfunc("", npt->user_data);
 			break;
 		}
@@ -336,6 +374,30 @@ void* np_notifier( void* arg )
 	return NULL;
 }
 
+/**
+ * Internally used reactor callback that receives a notification and passes
+ * it to the notify callback.
+ */
+static void np_reactor_cb(idevice_connection_t connection, int events, void *user_data)
+{
+	struct np_thread *npt = (struct np_thread*)user_data;
+
+	/* the reactor thread is shared, so do not wait for more data; loop as
+	   further notifications might already be buffered by the SSL layer */
+	while (1) {
+		char *notification = NULL;
+		if (np_get_notification(npt->client, &notification, 1) < 0) {
+			npt->cbfunc("", npt->user_data);
+			idevice_reactor_remove(npt->client->reactor, connection);
+			return;
+		}
+		if (!notification)
+			break;
+		npt->cbfunc(notification, npt->user_data);
+		free(notification);
+	}
+}
+
 LIBIMOBILEDEVICE_API np_error_t np_set_notify_callback( np_client_t client, np_notify_cb_t notify_cb, void *user_data )
 {
 	if (!client)
@@ -343,6 +405,9 @@ LIBIMOBILEDEVICE_API np_error_t np_set_notify_callback( np_client_t client, np_n
 
 	np_error_t res = NP_E_UNKNOWN_ERROR;
 
+	/* must not hold the client lock, the reactor callback might be waiting for it */
+	np_reactor_stop(client, 0);
+
 	np_lock(client);
 	if (client->notifier) {
 		debug_info("callback already set, removing");
@@ -361,7 +426,19 @@ LIBIMOBILEDEVICE_API np_error_t np_set_notify_callback( np_client_t client, np_n
 			npt->cbfunc = notify_cb;
 			npt->user_data = user_data;
 
-			if (thread_new(&client->notifier, np_notifier, npt) == 0) {
+			idevice_reactor_t reactor = idevice_get_default_reactor();
+			if (reactor) {
+				/* let the shared reactor deliver the notifications */
+				client->reactor = reactor;
+				client->reactor_data = npt;
+				if (idevice_reactor_add(reactor, client->parent->parent->connection, IDEVICE_REACTOR_READ, np_reactor_cb, npt) == IDEVICE_E_SUCCESS) {
+					res = NP_E_SUCCESS;
+				} else {
+					client->reactor = NULL;
+					client->reactor_data = NULL;
+					free(npt);
+				}
+			} else if (thread_new(&client->notifier, np_notifier, npt) == 0) {
 				res = NP_E_SUCCESS;
 			}
 		}
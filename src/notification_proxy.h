@@ -30,6 +30,8 @@ struct np_client_private {
 	property_list_service_client_t parent;
 	mutex_t mutex;
 	thread_t notifier;
+	idevice_reactor_t reactor;
+	void *reactor_data;
 };
 
 void* np_notifier(void* arg);
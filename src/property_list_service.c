@@ -22,12 +22,36 @@
 #include <config.h>
 #endif
 #include <stdlib.h>
+#include <stdio.h>
 #include <string.h>
+#include <errno.h>
+#if defined(HAVE_SYS_MMAN_H) && defined(HAVE_MMAP) && !defined(WIN32)
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#define HAVE_PLIST_SPILL 1
+#endif
 
 #include "property_list_service.h"
+#include "property_list_view.h"
+#include "sanitize_xml.h"
 #include "common/debug.h"
+#include "common/trace.h"
+#include "common/utils.h"
 #include "endianness.h"
 
+/* buffers up to this size are always kept for reuse */
+#define PLIST_BUFFER_KEEP_SIZE 0x10000
+/* number of received messages after which an oversized buffer is shrunk */
+#define PLIST_BUFFER_SHRINK_INTERVAL 32
+/* messages up to this size are sent in one piece with their length header,
+   larger ones are sent in two writes as copying them costs more than it saves */
+#define PLIST_SEND_COALESCE_MAX 0x1000
+/* default limit for the size of a received message */
+#define PLIST_DEFAULT_MAX_MESSAGE_SIZE (1 << 24)
+/* chunk size used when receiving a message into a temporary file */
+#define PLIST_SPILL_CHUNK_SIZE 0x10000
+
 /**
  * Convert a service_error_t value to a property_list_service_error_t value.
  * Used internally to get correct error codes.
@@ -48,6 +72,8 @@ static property_list_service_error_t service_to_property_list_service_error(serv
 			return PROPERTY_LIST_SERVICE_E_MUX_ERROR;
 		case SERVICE_E_SSL_ERROR:
 			return PROPERTY_LIST_SERVICE_E_SSL_ERROR;
+		case SERVICE_E_CANCELLED:
+			return PROPERTY_LIST_SERVICE_E_CANCELLED;
 		default:
 			break;
 	}
@@ -66,8 +92,11 @@ LIBIMOBILEDEVICE_API property_list_service_error_t property_list_service_client_
 	}
 
 	/* create client object */
-	property_list_service_client_t client_loc = (property_list_service_client_t)malloc(sizeof(struct property_list_service_client_private));
+	property_list_service_client_t client_loc = (property_list_service_client_t)calloc(1, sizeof(struct property_list_service_client_private));
 	client_loc->parent = parent;
+	client_loc->wire_format = PROPERTY_LIST_SERVICE_FORMAT_XML;
+	client_loc->max_message_size = PLIST_DEFAULT_MAX_MESSAGE_SIZE;
+	client_loc->spill_threshold = 0;
 
 	/* all done, return success */
 	*client = client_loc;
@@ -81,12 +110,78 @@ LIBIMOBILEDEVICE_API property_list_service_error_t property_list_service_client_
 
 	property_list_service_error_t err = service_to_property_list_service_error(service_client_free(client->parent));
 
+	free(client->recv_buf);
 	free(client);
 	client = NULL;
 
 	return err;
 }
 
+/**
+ * Makes sure the given buffer can hold at least size bytes.
+ * Buffers only grow here; see internal_recv_buffer_shrink().
+ *
+ * @return 1 on success, 0 when out of memory.
+ */
+static int internal_buffer_reserve(char **buf, uint32_t *buf_size, uint32_t size)
+{
+	if (*buf && *buf_size >= size) {
+		return 1;
+	}
+	uint32_t newsize = (size < 0x1000) ? 0x1000 : size;
+	char *newbuf = (char*)realloc(*buf, newsize);
+	if (!newbuf) {
+		return 0;
+	}
+	*buf = newbuf;
+	*buf_size = newsize;
+	return 1;
+}
+
+/**
+ * Makes sure the receive buffer can hold at least size bytes and accounts
+ * whether an allocation was needed.
+ *
+ * @return 1 on success, 0 when out of memory.
+ */
+static int internal_recv_buffer_reserve(property_list_service_client_t client, uint32_t size)
+{
+	if (client->recv_buf && client->recv_buf_size >= size) {
+		client->buf_reuses++;
+		return 1;
+	}
+	if (!internal_buffer_reserve(&client->recv_buf, &client->recv_buf_size, size)) {
+		return 0;
+	}
+	client->buf_allocs++;
+	return 1;
+}
+
+/**
+ * Gives memory of an oversized receive buffer back once the recent messages
+ * have been much smaller than the buffer.
+ */
+static void internal_recv_buffer_shrink(property_list_service_client_t client, uint32_t pktlen)
+{
+	if (pktlen > client->recv_high_water)
+		client->recv_high_water = pktlen;
+
+	if (++client->recv_count < PLIST_BUFFER_SHRINK_INTERVAL)
+		return;
+
+	if (client->recv_buf_size > PLIST_BUFFER_KEEP_SIZE && client->recv_high_water < client->recv_buf_size / 4) {
+		uint32_t newsize = (client->recv_high_water > PLIST_BUFFER_KEEP_SIZE) ? client->recv_high_water : PLIST_BUFFER_KEEP_SIZE;
+		char *newbuf = (char*)realloc(client->recv_buf, newsize);
+		if (newbuf) {
+			debug_info("shrinking receive buffer from %d to %d bytes", client->recv_buf_size, newsize);
+			client->recv_buf = newbuf;
+			client->recv_buf_size = newsize;
+		}
+	}
+	client->recv_high_water = 0;
+	client->recv_count = 0;
+}
+
 /**
  * Sends a plist using the given property list service client.
  * Internally used generic plist send function.
@@ -113,6 +208,7 @@ static property_list_service_error_t internal_plist_send(property_list_service_c
 		return PROPERTY_LIST_SERVICE_E_INVALID_ARG;
 	}
 
+	trace_begin("plist_send");
 	if (binary) {
 		plist_to_bin(plist, &content, &length);
 	} else {
@@ -120,11 +216,39 @@ static property_list_service_error_t internal_plist_send(property_list_service_c
 	}
 
 	if (!content || length == 0) {
+		trace_end("plist_send");
 		return PROPERTY_LIST_SERVICE_E_PLIST_ERROR;
 	}
 
 	nlen = htobe32(length);
 	debug_info("sending %d bytes", length);
+	if (sizeof(nlen) + length <= PLIST_SEND_COALESCE_MAX) {
+		/* length header and payload in a single write */
+		char buf[PLIST_SEND_COALESCE_MAX];
+		memcpy(buf, &nlen, sizeof(nlen));
+		memcpy(buf + sizeof(nlen), content, length);
+		service_send(client->parent, buf, sizeof(nlen) + length, (uint32_t*)&bytes);
+		if (bytes >= (int)sizeof(nlen)) {
+			bytes -= sizeof(nlen);
+			if (bytes > 0) {
+				debug_info("sent %d bytes", bytes);
+				debug_plist(plist);
+			}
+			if ((uint32_t)bytes == length) {
+				service_client_stats_message_sent(client->parent);
+				res = PROPERTY_LIST_SERVICE_E_SUCCESS;
+			} else {
+				debug_info("ERROR: Could not send all data (%d of %d)!", bytes, length);
+			}
+		}
+		free(content);
+		if (bytes <= 0) {
+			debug_info("ERROR: sending to device failed.");
+		}
+		trace_end("plist_send");
+		return res;
+	}
+
 	service_send(client->parent, (const char*)&nlen, sizeof(nlen), (uint32_t*)&bytes);
 	if (bytes == sizeof(nlen)) {
 		service_send(client->parent, content, length, (uint32_t*)&bytes);
@@ -132,6 +256,7 @@ static property_list_service_error_t internal_plist_send(property_list_service_c
 			debug_info("sent %d bytes", bytes);
 			debug_plist(plist);
 			if ((uint32_t)bytes == length) {
+				service_client_stats_message_sent(client->parent);
 				res = PROPERTY_LIST_SERVICE_E_SUCCESS;
 			} else {
 				debug_info("ERROR: Could not send all data (%d of %d)!", bytes, length);
@@ -143,6 +268,7 @@ static property_list_service_error_t internal_plist_send(property_list_service_c
 	}
 
 	free(content);
+	trace_end("plist_send");
 
 	return res;
 }
@@ -157,57 +283,300 @@ LIBIMOBILEDEVICE_API property_list_service_error_t property_list_service_send_bi
 	return internal_plist_send(client, plist, 1);
 }
 
+LIBIMOBILEDEVICE_API property_list_service_error_t property_list_service_send_plist(property_list_service_client_t client, plist_t plist)
+{
+	if (!client)
+		return PROPERTY_LIST_SERVICE_E_INVALID_ARG;
+	return internal_plist_send(client, plist, (client->wire_format == PROPERTY_LIST_SERVICE_FORMAT_BINARY));
+}
+
+LIBIMOBILEDEVICE_API property_list_service_error_t property_list_service_set_wire_format(property_list_service_client_t client, property_list_service_format_t format)
+{
+	if (!client)
+		return PROPERTY_LIST_SERVICE_E_INVALID_ARG;
+	client->wire_format = format;
+	return PROPERTY_LIST_SERVICE_E_SUCCESS;
+}
+
+/** Turns a received message into the result of a receive function */
+typedef property_list_service_error_t (*internal_parse_func_t)(property_list_service_client_t client, char *content, uint32_t pktlen, void *result);
+
+/**
+ * Parses a received message into a plist.
+ *
+ * @param client The client the message was received on
+ * @param content The message data, modified in place for XML plists
+ * @param pktlen Size of the message
+ * @param result pointer to a plist_t that will point to the parsed plist
+ *
+ * @return PROPERTY_LIST_SERVICE_E_SUCCESS on success, or
+ *      PROPERTY_LIST_SERVICE_E_PLIST_ERROR when the data is not a plist.
+ */
+static property_list_service_error_t internal_plist_parse(property_list_service_client_t client, char *content, uint32_t pktlen, void *result)
+{
+	plist_t *plist = (plist_t*)result;
+	if ((pktlen > 8) && !memcmp(content, "bplist00", 8)) {
+		plist_from_bin(content, pktlen, plist);
+	} else if ((pktlen > 5) && !memcmp(content, "<?xml", 5)) {
+		/* iOS 4.3+ hack: plist data might contain invalid characters, thus we convert those to spaces */
+		sanitize_xml(content, pktlen-1);
+		plist_from_xml(content, pktlen, plist);
+	} else {
+		debug_info("WARNING: received unexpected non-plist content");
+		debug_buffer(content, (pktlen > 256) ? 256 : pktlen);
+	}
+	if (*plist) {
+		debug_plist(*plist);
+		return PROPERTY_LIST_SERVICE_E_SUCCESS;
+	}
+	return PROPERTY_LIST_SERVICE_E_PLIST_ERROR;
+}
+
+/**
+ * Creates a property_list_view_t for a received message. Binary plists are
+ * kept as they are; the mapping of a spilled message is handed over to the
+ * view, as is the receive buffer when the message fills most of it.
+ * Otherwise the message is copied so the buffer stays available for reuse.
+ *
+ * @param client The client the message was received on
+ * @param content The message data
+ * @param pktlen Size of the message
+ * @param result pointer to a property_list_view_t that will point to the
+ *      new view
+ *
+ * @return PROPERTY_LIST_SERVICE_E_SUCCESS on success, or
+ *      PROPERTY_LIST_SERVICE_E_PLIST_ERROR when the data is not a plist.
+ */
+static property_list_service_error_t internal_plist_view_parse(property_list_service_client_t client, char *content, uint32_t pktlen, void *result)
+{
+	property_list_view_t *view = (property_list_view_t*)result;
+	property_list_service_error_t res;
+
+	if ((pktlen > 8) && !memcmp(content, "bplist00", 8)) {
+		char *data = NULL;
+		if (content == client->spill_map) {
+			res = property_list_view_new_from_bin(content, pktlen, view);
+			if (res == PROPERTY_LIST_SERVICE_E_SUCCESS) {
+				(*view)->mapped = 1;
+				client->spill_map = NULL;
+			}
+			return res;
+		}
+		if (content == client->recv_buf && client->recv_buf_size - pktlen < PLIST_BUFFER_KEEP_SIZE) {
+			data = client->recv_buf;
+			client->recv_buf = NULL;
+			client->recv_buf_size = 0;
+		} else {
+			data = (char*)malloc(pktlen);
+			if (!data) {
+				return PROPERTY_LIST_SERVICE_E_UNKNOWN_ERROR;
+			}
+			memcpy(data, content, pktlen);
+		}
+		res = property_list_view_new_from_bin(data, pktlen, view);
+		if (res != PROPERTY_LIST_SERVICE_E_SUCCESS) {
+			free(data);
+		}
+		return res;
+	}
+
+	/* other formats can't be decoded on demand */
+	plist_t plist = NULL;
+	res = internal_plist_parse(client, content, pktlen, &plist);
+	if (res == PROPERTY_LIST_SERVICE_E_SUCCESS) {
+		res = property_list_view_new_from_plist(plist, view);
+		if (res != PROPERTY_LIST_SERVICE_E_SUCCESS) {
+			plist_free(plist);
+		}
+	}
+	return res;
+}
+
+/**
+ * Receives (part of) a message body, either with the default timeout or,
+ * when deadline is not NULL, until the given absolute deadline.
+ */
+static service_error_t internal_plist_receive_body(property_list_service_client_t client, char *data, uint32_t size, uint32_t *received, const uint64_t *deadline)
+{
+	if (deadline) {
+		return service_receive_with_deadline(client->parent, data, size, received, *deadline);
+	}
+	return service_receive(client->parent, data, size, received);
+}
+
+#ifdef HAVE_PLIST_SPILL
+/**
+ * Receives a large message into a temporary file in fixed size chunks and
+ * parses the plist from a private mapping of that file, so that the
+ * message itself never has to be held in memory as a whole.
+ */
+static property_list_service_error_t internal_plist_receive_spilled(property_list_service_client_t client, uint32_t pktlen, internal_parse_func_t parse, void *result, const uint64_t *deadline)
+{
+	property_list_service_error_t res = PROPERTY_LIST_SERVICE_E_UNKNOWN_ERROR;
+	service_error_t serr = SERVICE_E_SUCCESS;
+	uint32_t curlen = 0;
+	uint32_t bytes = 0;
+	char *chunk = NULL;
+	void *map = NULL;
+	FILE *f = NULL;
+	struct stat st;
+	int write_failed = 0;
+	int fd;
+
+	debug_info("receiving %d bytes into temporary file", pktlen);
+
+	f = tmpfile();
+	if (!f) {
+		debug_info("ERROR: could not create temporary file: %s", strerror(errno));
+		return PROPERTY_LIST_SERVICE_E_UNKNOWN_ERROR;
+	}
+	fd = fileno(f);
+
+	if (!internal_recv_buffer_reserve(client, PLIST_SPILL_CHUNK_SIZE)) {
+		fclose(f);
+		return PROPERTY_LIST_SERVICE_E_UNKNOWN_ERROR;
+	}
+	chunk = client->recv_buf;
+
+	while (curlen < pktlen) {
+		uint32_t want = ((pktlen - curlen) < PLIST_SPILL_CHUNK_SIZE) ? (pktlen - curlen) : PLIST_SPILL_CHUNK_SIZE;
+		uint32_t got = 0;
+		while (got < want) {
+			serr = internal_plist_receive_body(client, chunk + got, want - got, &bytes, deadline);
+			if (bytes <= 0) {
+				break;
+			}
+			got += bytes;
+		}
+		uint32_t written = 0;
+		while (written < got) {
+			ssize_t w = write(fd, chunk + written, got - written);
+			if (w < 0) {
+				if (errno == EINTR)
+					continue;
+				debug_info("ERROR: could not write to temporary file: %s", strerror(errno));
+				write_failed = 1;
+				break;
+			}
+			written += w;
+		}
+		curlen += written;
+		if (got < want || write_failed) {
+			break;
+		}
+	}
+	if (write_failed) {
+		fclose(f);
+		return PROPERTY_LIST_SERVICE_E_UNKNOWN_ERROR;
+	}
+	if (curlen < pktlen) {
+		debug_info("received incomplete packet (%d of %d bytes)", curlen, pktlen);
+		fclose(f);
+		if (serr == SERVICE_E_CANCELLED)
+			return PROPERTY_LIST_SERVICE_E_CANCELLED;
+		return (deadline && serr == SERVICE_E_SUCCESS) ? PROPERTY_LIST_SERVICE_E_RECEIVE_TIMEOUT : PROPERTY_LIST_SERVICE_E_MUX_ERROR;
+	}
+
+	/* accessing pages beyond the end of the file would raise SIGBUS */
+	if (fstat(fd, &st) < 0 || (uint64_t)st.st_size < pktlen) {
+		debug_info("ERROR: temporary file is smaller than the message");
+		fclose(f);
+		return PROPERTY_LIST_SERVICE_E_UNKNOWN_ERROR;
+	}
+
+	/* private mapping, so the XML sanitizing does not touch the file */
+	map = mmap(NULL, pktlen, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+	if (map == MAP_FAILED) {
+		debug_info("ERROR: could not map temporary file: %s", strerror(errno));
+	} else {
+		service_client_stats_message_received(client->parent);
+		client->spill_map = (char*)map;
+		res = parse(client, (char*)map, pktlen, result);
+		/* unless the parse function took over the mapping */
+		if (client->spill_map) {
+			munmap(map, pktlen);
+			client->spill_map = NULL;
+		}
+	}
+	fclose(f);
+
+	return res;
+}
+#endif
+
 /**
  * Receives a plist using the given property list service client.
  * Internally used generic plist receive function.
  *
  * @param client The property list service client to use for receiving
- * @param plist pointer to a plist_t that will point to the received plist
- *      upon successful return
- * @param timeout Maximum time in milliseconds to wait for data.
+ * @param parse The function that turns the received message into the result
+ * @param result pointer that will be set by parse upon successful return
+ * @param timeout Maximum time in milliseconds to wait for the message to
+ *      start arriving. Ignored when deadline is given.
+ * @param deadline Pointer to an absolute deadline for receiving the whole
+ *      message, or NULL to use timeout instead.
  *
  * @return PROPERTY_LIST_SERVICE_E_SUCCESS on success,
- *      PROPERTY_LIST_SERVICE_E_INVALID_ARG when client or *plist is NULL,
+ *      PROPERTY_LIST_SERVICE_E_INVALID_ARG when client or result is NULL,
  *      PROPERTY_LIST_SERVICE_E_PLIST_ERROR when the received data cannot be
  *      converted to a plist, PROPERTY_LIST_SERVICE_E_MUX_ERROR when a
  *      communication error occurs, or PROPERTY_LIST_SERVICE_E_UNKNOWN_ERROR
- *      when an unspecified error occurs.
+ *      when an unspecified error occurs or the message exceeds the maximum
+ *      message size.
  */
-static property_list_service_error_t internal_plist_receive_timeout(property_list_service_client_t client, plist_t *plist, unsigned int timeout)
+static property_list_service_error_t internal_plist_receive_message(property_list_service_client_t client, internal_parse_func_t parse, void *result, unsigned int timeout, const uint64_t *deadline)
 {
 	property_list_service_error_t res = PROPERTY_LIST_SERVICE_E_UNKNOWN_ERROR;
+	service_error_t serr;
 	uint32_t pktlen = 0;
 	uint32_t bytes = 0;
 
-	if (!client || (client && !client->parent) || !plist) {
+	if (!client || (client && !client->parent) || !result) {
 		return PROPERTY_LIST_SERVICE_E_INVALID_ARG;
 	}
 
-	*plist = NULL;
-	service_error_t serr = service_receive_with_timeout(client->parent, (char*)&pktlen, sizeof(pktlen), &bytes, timeout);
+	if (deadline) {
+		serr = service_receive_with_deadline(client->parent, (char*)&pktlen, sizeof(pktlen), &bytes, *deadline);
+	} else {
+		serr = service_receive_with_timeout(client->parent, (char*)&pktlen, sizeof(pktlen), &bytes, timeout);
+	}
 	if ((serr == SERVICE_E_SUCCESS) && (bytes == 0)) {
 		return PROPERTY_LIST_SERVICE_E_RECEIVE_TIMEOUT;
 	}
+	if (serr == SERVICE_E_CANCELLED) {
+		return PROPERTY_LIST_SERVICE_E_CANCELLED;
+	}
 	debug_info("initial read=%i", bytes);
 	if (bytes < 4) {
 		debug_info("initial read failed!");
 		return PROPERTY_LIST_SERVICE_E_MUX_ERROR;
 	} else {
 		pktlen = be32toh(pktlen);
-		if (pktlen < (1 << 24)) { /* prevent huge buffers */
+		if (pktlen < client->max_message_size) { /* prevent huge buffers */
 			uint32_t curlen = 0;
 			char *content = NULL;
 			debug_info("%d bytes following", pktlen);
-			content = (char*)malloc(pktlen);
-			if (!content) {
+#ifdef HAVE_PLIST_SPILL
+			if (client->spill_threshold > 0 && pktlen > client->spill_threshold) {
+				return internal_plist_receive_spilled(client, pktlen, parse, result, deadline);
+			}
+#endif
+			if (!internal_recv_buffer_reserve(client, pktlen)) {
 				debug_info("out of memory when allocating %d bytes", pktlen);
 				return PROPERTY_LIST_SERVICE_E_UNKNOWN_ERROR;
 			}
+			content = client->recv_buf;
 
 			while (curlen < pktlen) {
-				service_receive(client->parent, content+curlen, pktlen-curlen, &bytes);
+				serr = internal_plist_receive_body(client, content+curlen, pktlen-curlen, &bytes, deadline);
 				if (bytes <= 0) {
-					res = PROPERTY_LIST_SERVICE_E_MUX_ERROR;
+					if (serr == SERVICE_E_CANCELLED) {
+						res = PROPERTY_LIST_SERVICE_E_CANCELLED;
+					} else if (deadline && serr == SERVICE_E_SUCCESS) {
+						res = PROPERTY_LIST_SERVICE_E_RECEIVE_TIMEOUT;
+					} else {
+						res = PROPERTY_LIST_SERVICE_E_MUX_ERROR;
+					}
 					break;
 				}
 				debug_info("received %d bytes", bytes);
@@ -219,45 +588,164 @@ static property_list_service_error_t internal_plist_receive_timeout(property_lis
 					debug_info("incomplete packet following:");
 					debug_buffer(content, curlen);
 				}
-				free(content);
+				internal_recv_buffer_shrink(client, pktlen);
 				return res;
 			}
-			if ((pktlen > 8) && !memcmp(content, "bplist00", 8)) {
-				plist_from_bin(content, pktlen, plist);
-			} else if ((pktlen > 5) && !memcmp(content, "<?xml", 5)) {
-				/* iOS 4.3+ hack: plist data might contain invalid characters, thus we convert those to spaces */
-				for (bytes = 0; bytes < pktlen-1; bytes++) {
-					if ((content[bytes] >= 0) && (content[bytes] < 0x20) && (content[bytes] != 0x09) && (content[bytes] != 0x0a) && (content[bytes] != 0x0d))
-						content[bytes] = 0x20;
-				}
-				plist_from_xml(content, pktlen, plist);
-			} else {
-				debug_info("WARNING: received unexpected non-plist content");
-				debug_buffer(content, pktlen);
-			}
-			if (*plist) {
-				debug_plist(*plist);
-				res = PROPERTY_LIST_SERVICE_E_SUCCESS;
-			} else {
-				res = PROPERTY_LIST_SERVICE_E_PLIST_ERROR;
-			}
-			free(content);
+			service_client_stats_message_received(client->parent);
+			res = parse(client, content, pktlen, result);
+			internal_recv_buffer_shrink(client, pktlen);
 			content = NULL;
 		} else {
+			debug_info("ERROR: message of %u bytes exceeds the maximum size of %u bytes", pktlen, client->max_message_size);
 			res = PROPERTY_LIST_SERVICE_E_UNKNOWN_ERROR;
 		}
 	}
 	return res;
 }
 
+/**
+ * Receives a plist like internal_plist_receive_message(), recording the
+ * receive as a trace span.
+ */
+static property_list_service_error_t internal_plist_receive(property_list_service_client_t client, internal_parse_func_t parse, void *result, unsigned int timeout, const uint64_t *deadline)
+{
+	trace_begin("plist_receive");
+	property_list_service_error_t res = internal_plist_receive_message(client, parse, result, timeout, deadline);
+	trace_end("plist_receive");
+	return res;
+}
+
 LIBIMOBILEDEVICE_API property_list_service_error_t property_list_service_receive_plist_with_timeout(property_list_service_client_t client, plist_t *plist, unsigned int timeout)
 {
-	return internal_plist_receive_timeout(client, plist, timeout);
+	if (plist)
+		*plist = NULL;
+	return internal_plist_receive(client, internal_plist_parse, plist, timeout, NULL);
+}
+
+LIBIMOBILEDEVICE_API property_list_service_error_t property_list_service_receive_plist_with_deadline(property_list_service_client_t client, plist_t *plist, uint64_t deadline)
+{
+	if (plist)
+		*plist = NULL;
+	return internal_plist_receive(client, internal_plist_parse, plist, 0, &deadline);
+}
+
+property_list_service_error_t property_list_service_receive_plist_available(property_list_service_client_t client, plist_t *plist)
+{
+	property_list_service_error_t res;
+	service_error_t serr;
+	uint32_t bytes = 0;
+	/* a deadline that already passed only returns the data that is available */
+	uint64_t deadline = get_monotonic_time_us() / 1000;
+
+	if (!client || !client->parent || !plist) {
+		return PROPERTY_LIST_SERVICE_E_INVALID_ARG;
+	}
+	*plist = NULL;
+
+	if (client->partial_hdr_len < sizeof(client->partial_hdr)) {
+		serr = service_receive_with_deadline(client->parent, client->partial_hdr + client->partial_hdr_len, sizeof(client->partial_hdr) - client->partial_hdr_len, &bytes, deadline);
+		if (serr != SERVICE_E_SUCCESS) {
+			client->partial_hdr_len = 0;
+			return service_to_property_list_service_error(serr);
+		}
+		client->partial_hdr_len += bytes;
+		if (client->partial_hdr_len < sizeof(client->partial_hdr)) {
+			return PROPERTY_LIST_SERVICE_E_RECEIVE_TIMEOUT;
+		}
+
+		uint32_t pktlen = 0;
+		memcpy(&pktlen, client->partial_hdr, sizeof(pktlen));
+		pktlen = be32toh(pktlen);
+		if (pktlen >= client->max_message_size) {
+			debug_info("ERROR: message of %u bytes exceeds the maximum size of %u bytes", pktlen, client->max_message_size);
+			client->partial_hdr_len = 0;
+			return PROPERTY_LIST_SERVICE_E_UNKNOWN_ERROR;
+		}
+		if (!internal_recv_buffer_reserve(client, pktlen)) {
+			debug_info("out of memory when allocating %d bytes", pktlen);
+			client->partial_hdr_len = 0;
+			return PROPERTY_LIST_SERVICE_E_UNKNOWN_ERROR;
+		}
+		client->partial_pktlen = pktlen;
+		client->partial_len = 0;
+	}
+
+	while (client->partial_len < client->partial_pktlen) {
+		serr = service_receive_with_deadline(client->parent, client->recv_buf + client->partial_len, client->partial_pktlen - client->partial_len, &bytes, deadline);
+		if (serr != SERVICE_E_SUCCESS) {
+			client->partial_hdr_len = 0;
+			return service_to_property_list_service_error(serr);
+		}
+		if (bytes == 0) {
+			return PROPERTY_LIST_SERVICE_E_RECEIVE_TIMEOUT;
+		}
+		client->partial_len += bytes;
+	}
+	client->partial_hdr_len = 0;
+
+	service_client_stats_message_received(client->parent);
+	res = internal_plist_parse(client, client->recv_buf, client->partial_pktlen, plist);
+	internal_recv_buffer_shrink(client, client->partial_pktlen);
+	return res;
 }
 
 LIBIMOBILEDEVICE_API property_list_service_error_t property_list_service_receive_plist(property_list_service_client_t client, plist_t *plist)
 {
-	return internal_plist_receive_timeout(client, plist, 10000);
+	if (plist)
+		*plist = NULL;
+	return internal_plist_receive(client, internal_plist_parse, plist, 10000, NULL);
+}
+
+LIBIMOBILEDEVICE_API property_list_service_error_t property_list_service_receive_plist_view(property_list_service_client_t client, property_list_view_t *view)
+{
+	if (view)
+		*view = NULL;
+	return internal_plist_receive(client, internal_plist_view_parse, view, 10000, NULL);
+}
+
+property_list_service_error_t property_list_service_receive_plist_view_with_timeout(property_list_service_client_t client, property_list_view_t *view, unsigned int timeout)
+{
+	if (view)
+		*view = NULL;
+	return internal_plist_receive(client, internal_plist_view_parse, view, timeout, NULL);
+}
+
+LIBIMOBILEDEVICE_API property_list_service_error_t property_list_service_set_receive_limits(property_list_service_client_t client, uint32_t max_message_size, uint32_t spill_threshold)
+{
+	if (!client)
+		return PROPERTY_LIST_SERVICE_E_INVALID_ARG;
+	client->max_message_size = (max_message_size > 0) ? max_message_size : PLIST_DEFAULT_MAX_MESSAGE_SIZE;
+#ifdef HAVE_PLIST_SPILL
+	client->spill_threshold = spill_threshold;
+#else
+	if (spill_threshold > 0) {
+		debug_info("receiving into temporary files is not supported on this platform");
+	}
+#endif
+	return PROPERTY_LIST_SERVICE_E_SUCCESS;
+}
+
+LIBIMOBILEDEVICE_API property_list_service_error_t property_list_service_get_buffer_stats(property_list_service_client_t client, uint64_t *allocations, uint64_t *reuses)
+{
+	if (!client)
+		return PROPERTY_LIST_SERVICE_E_INVALID_ARG;
+	if (allocations)
+		*allocations = client->buf_allocs;
+	if (reuses)
+		*reuses = client->buf_reuses;
+	return PROPERTY_LIST_SERVICE_E_SUCCESS;
+}
+
+LIBIMOBILEDEVICE_API property_list_service_error_t property_list_service_set_cancel(property_list_service_client_t client, idevice_cancel_t cancel)
+{
+	idevice_connection_t connection = NULL;
+
+	if (!client || !client->parent)
+		return PROPERTY_LIST_SERVICE_E_INVALID_ARG;
+	if (service_get_connection(client->parent, &connection) != SERVICE_E_SUCCESS)
+		return PROPERTY_LIST_SERVICE_E_INVALID_ARG;
+	idevice_connection_set_cancel(connection, cancel);
+	return PROPERTY_LIST_SERVICE_E_SUCCESS;
 }
 
 LIBIMOBILEDEVICE_API property_list_service_error_t property_list_service_enable_ssl(property_list_service_client_t client)
@@ -27,6 +27,44 @@
 
 struct property_list_service_client_private {
 	service_client_t parent;
+	/* receive buffer reused across messages */
+	char *recv_buf;
+	uint32_t recv_buf_size;
+	uint32_t recv_high_water;
+	unsigned int recv_count;
+	/* format used by property_list_service_send_plist() */
+	property_list_service_format_t wire_format;
+	/* receive limits */
+	uint32_t max_message_size;
+	uint32_t spill_threshold;
+	/* mapping of a spilled message while it is parsed, NULL if taken over */
+	char *spill_map;
+	/* receive buffer statistics */
+	uint64_t buf_allocs;
+	uint64_t buf_reuses;
+	/* message partially received by property_list_service_receive_plist_available() */
+	char partial_hdr[4];
+	uint32_t partial_hdr_len;
+	uint32_t partial_pktlen;
+	uint32_t partial_len;
 };
 
+/**
+ * Receives a plist view like property_list_service_receive_plist_view(),
+ * waiting at most timeout milliseconds for the message to start arriving.
+ */
+property_list_service_error_t property_list_service_receive_plist_view_with_timeout(property_list_service_client_t client, property_list_view_t *view, unsigned int timeout);
+
+/**
+ * Receives the part of a plist message that is available without waiting.
+ * A partially received message is kept in the client and completed by the
+ * next calls, so reactor callbacks never block the shared reactor thread.
+ * Other receive functions must not be used while a message is incomplete.
+ *
+ * @return PROPERTY_LIST_SERVICE_E_SUCCESS with plist set once a message is
+ *     complete, PROPERTY_LIST_SERVICE_E_RECEIVE_TIMEOUT when the rest of the
+ *     message has not arrived yet, or an error code.
+ */
+property_list_service_error_t property_list_service_receive_plist_available(property_list_service_client_t client, plist_t *plist);
+
 #endif
@@ -0,0 +1,753 @@
+/*
+ * property_list_view.c
+ * Lazily decoded view of a received property list.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+#include <stdlib.h>
+#include <string.h>
+#if defined(HAVE_SYS_MMAN_H) && defined(HAVE_MMAP) && !defined(WIN32)
+#include <sys/mman.h>
+#endif
+
+#include "property_list_view.h"
+#include "idevice.h"
+#include "common/debug.h"
+
+#define BPLIST_MAGIC "bplist00"
+#define BPLIST_MAGIC_SIZE 8
+#define BPLIST_TRAILER_SIZE 32
+
+/* object markers */
+#define BPLIST_NULL   0x00
+#define BPLIST_FALSE  0x08
+#define BPLIST_TRUE   0x09
+#define BPLIST_UINT   0x10
+#define BPLIST_REAL   0x20
+#define BPLIST_DATE   0x30
+#define BPLIST_DATA   0x40
+#define BPLIST_STRING 0x50
+#define BPLIST_UNICODE 0x60
+#define BPLIST_UID    0x80
+#define BPLIST_ARRAY  0xA0
+#define BPLIST_DICT   0xD0
+#define BPLIST_MASK   0xF0
+
+/* limit for nested containers when copying nodes, protects against cycles */
+#define BPLIST_MAX_DEPTH 512
+
+/*
+ * Nodes of binary plists are the object index + 1, nodes of parsed plists
+ * are the plist_t itself. 0 is never a valid node.
+ */
+#define NODE_TO_PLIST(node) ((plist_t)(uintptr_t)(node))
+#define PLIST_TO_NODE(plist) ((property_list_view_node_t)(uintptr_t)(plist))
+
+static uint64_t bplist_read_uint(const uint8_t *p, uint8_t size)
+{
+	uint64_t val = 0;
+	uint8_t i;
+	for (i = 0; i < size; i++) {
+		val = (val << 8) | p[i];
+	}
+	return val;
+}
+
+property_list_service_error_t property_list_view_new_from_bin(char *data, uint64_t size, property_list_view_t *view)
+{
+	if (!data || !view)
+		return PROPERTY_LIST_SERVICE_E_INVALID_ARG;
+
+	if ((size < BPLIST_MAGIC_SIZE + 1 + BPLIST_TRAILER_SIZE) || memcmp(data, BPLIST_MAGIC, BPLIST_MAGIC_SIZE)) {
+		return PROPERTY_LIST_SERVICE_E_PLIST_ERROR;
+	}
+
+	const uint8_t *trailer = (const uint8_t*)data + size - BPLIST_TRAILER_SIZE;
+	uint8_t offset_size = trailer[6];
+	uint8_t ref_size = trailer[7];
+	uint64_t num_objects = bplist_read_uint(trailer + 8, 8);
+	uint64_t root_object = bplist_read_uint(trailer + 16, 8);
+	uint64_t offset_table = bplist_read_uint(trailer + 24, 8);
+
+	if ((offset_size < 1) || (offset_size > 8) || (ref_size < 1) || (ref_size > 8)
+	    || (num_objects == 0) || (root_object >= num_objects)
+	    || (offset_table < BPLIST_MAGIC_SIZE) || (offset_table >= size - BPLIST_TRAILER_SIZE)
+	    || (num_objects > (size - BPLIST_TRAILER_SIZE - offset_table) / offset_size)) {
+		debug_info("ERROR: invalid binary plist trailer");
+		return PROPERTY_LIST_SERVICE_E_PLIST_ERROR;
+	}
+
+	property_list_view_t view_loc = (property_list_view_t)calloc(1, sizeof(struct property_list_view_private));
+	if (!view_loc)
+		return PROPERTY_LIST_SERVICE_E_UNKNOWN_ERROR;
+
+	view_loc->data = data;
+	view_loc->size = size;
+	view_loc->offset_size = offset_size;
+	view_loc->ref_size = ref_size;
+	view_loc->num_objects = num_objects;
+	view_loc->root_object = root_object;
+	view_loc->offset_table = offset_table;
+
+	*view = view_loc;
+	return PROPERTY_LIST_SERVICE_E_SUCCESS;
+}
+
+property_list_service_error_t property_list_view_new_from_plist(plist_t plist, property_list_view_t *view)
+{
+	if (!plist || !view)
+		return PROPERTY_LIST_SERVICE_E_INVALID_ARG;
+
+	property_list_view_t view_loc = (property_list_view_t)calloc(1, sizeof(struct property_list_view_private));
+	if (!view_loc)
+		return PROPERTY_LIST_SERVICE_E_UNKNOWN_ERROR;
+
+	view_loc->tree = plist;
+
+	*view = view_loc;
+	return PROPERTY_LIST_SERVICE_E_SUCCESS;
+}
+
+LIBIMOBILEDEVICE_API void property_list_view_free(property_list_view_t view)
+{
+	if (!view)
+		return;
+	free(view->iter);
+	if (view->tree)
+		plist_free(view->tree);
+#if defined(HAVE_SYS_MMAN_H) && defined(HAVE_MMAP) && !defined(WIN32)
+	if (view->mapped) {
+		munmap(view->data, view->size);
+		view->data = NULL;
+	}
+#endif
+	free(view->data);
+	free(view);
+}
+
+/**
+ * Looks up the object of the given node in the offset table.
+ *
+ * @return A pointer to the marker byte of the object, or NULL if the node or
+ *     its offset is invalid.
+ */
+static const uint8_t *bplist_get_object(property_list_view_t view, property_list_view_node_t node)
+{
+	if (node == 0 || node > view->num_objects)
+		return NULL;
+
+	uint64_t offset = bplist_read_uint((const uint8_t*)view->data + view->offset_table + (node - 1) * view->offset_size, view->offset_size);
+	if (offset < BPLIST_MAGIC_SIZE || offset >= view->offset_table)
+		return NULL;
+
+	return (const uint8_t*)view->data + offset;
+}
+
+/**
+ * Gets the element count of a string, data, array or dict object and the
+ * start of its payload. Counts of 15 and more follow the marker as an
+ * integer object.
+ *
+ * @return 0 on success or -1 if the object exceeds the object area.
+ */
+static int bplist_get_count(property_list_view_t view, const uint8_t *obj, uint64_t *count, const uint8_t **payload)
+{
+	const uint8_t *end = (const uint8_t*)view->data + view->offset_table;
+	const uint8_t *p = obj + 1;
+
+	*count = obj[0] & 0x0F;
+	if (*count == 0x0F) {
+		if (p >= end || (*p & BPLIST_MASK) != BPLIST_UINT)
+			return -1;
+		uint8_t size = 1 << (*p & 0x0F);
+		if (size > 8 || (uint64_t)(end - p) < (uint64_t)1 + size)
+			return -1;
+		*count = bplist_read_uint(p + 1, size);
+		p += 1 + size;
+	}
+	*payload = p;
+	return 0;
+}
+
+/**
+ * Gets the payload of an object if it holds count elements of unit bytes
+ * within the object area.
+ */
+static const uint8_t *bplist_get_payload(property_list_view_t view, const uint8_t *obj, uint64_t *count, uint64_t unit)
+{
+	const uint8_t *payload = NULL;
+	if (bplist_get_count(view, obj, count, &payload) < 0)
+		return NULL;
+	const uint8_t *end = (const uint8_t*)view->data + view->offset_table;
+	if (*count > (uint64_t)(end - payload) / unit)
+		return NULL;
+	return payload;
+}
+
+/**
+ * Gets the payload of a fixed size int, real, date or uid object.
+ */
+static const uint8_t *bplist_get_scalar(property_list_view_t view, const uint8_t *obj, uint8_t size)
+{
+	const uint8_t *end = (const uint8_t*)view->data + view->offset_table;
+	if ((uint64_t)(end - obj) < (uint64_t)1 + size)
+		return NULL;
+	return obj + 1;
+}
+
+static property_list_view_node_t bplist_get_ref(property_list_view_t view, const uint8_t *refs, uint64_t index)
+{
+	uint64_t ref = bplist_read_uint(refs + index * view->ref_size, view->ref_size);
+	if (ref >= view->num_objects)
+		return 0;
+	return ref + 1;
+}
+
+static char *bplist_utf16be_to_utf8(const uint8_t *p, uint64_t count)
+{
+	char *out = (char*)malloc(count * 3 + 1);
+	uint64_t i = 0;
+	size_t o = 0;
+
+	if (!out)
+		return NULL;
+
+	while (i < count) {
+		uint32_t c = (p[i*2] << 8) | p[i*2+1];
+		i++;
+		if (c >= 0xD800 && c < 0xDC00 && i < count) {
+			uint32_t c2 = (p[i*2] << 8) | p[i*2+1];
+			if (c2 >= 0xDC00 && c2 < 0xE000) {
+				c = 0x10000 + ((c - 0xD800) << 10) + (c2 - 0xDC00);
+				i++;
+			}
+		}
+		if (c < 0x80) {
+			out[o++] = (char)c;
+		} else if (c < 0x800) {
+			out[o++] = (char)(0xC0 | (c >> 6));
+			out[o++] = (char)(0x80 | (c & 0x3F));
+		} else if (c < 0x10000) {
+			out[o++] = (char)(0xE0 | (c >> 12));
+			out[o++] = (char)(0x80 | ((c >> 6) & 0x3F));
+			out[o++] = (char)(0x80 | (c & 0x3F));
+		} else {
+			out[o++] = (char)(0xF0 | (c >> 18));
+			out[o++] = (char)(0x80 | ((c >> 12) & 0x3F));
+			out[o++] = (char)(0x80 | ((c >> 6) & 0x3F));
+			out[o++] = (char)(0x80 | (c & 0x3F));
+		}
+	}
+	out[o] = '\0';
+	return out;
+}
+
+static char *bplist_get_string(property_list_view_t view, const uint8_t *obj)
+{
+	uint64_t count = 0;
+	const uint8_t *payload = NULL;
+	char *str = NULL;
+
+	if ((obj[0] & BPLIST_MASK) == BPLIST_STRING) {
+		payload = bplist_get_payload(view, obj, &count, 1);
+		if (payload) {
+			str = (char*)malloc(count + 1);
+			if (str) {
+				memcpy(str, payload, count);
+				str[count] = '\0';
+			}
+		}
+	} else if ((obj[0] & BPLIST_MASK) == BPLIST_UNICODE) {
+		payload = bplist_get_payload(view, obj, &count, 2);
+		if (payload) {
+			str = bplist_utf16be_to_utf8(payload, count);
+		}
+	}
+	return str;
+}
+
+/**
+ * Compares a string object with the given key without decoding ASCII
+ * strings.
+ *
+ * @return 1 if they are equal, 0 otherwise.
+ */
+static int bplist_string_equals(property_list_view_t view, const uint8_t *obj, const char *key, size_t key_len)
+{
+	uint64_t count = 0;
+	const uint8_t *payload = NULL;
+
+	if ((obj[0] & BPLIST_MASK) == BPLIST_STRING) {
+		payload = bplist_get_payload(view, obj, &count, 1);
+		return (payload && count == key_len && memcmp(payload, key, key_len) == 0);
+	} else if ((obj[0] & BPLIST_MASK) == BPLIST_UNICODE) {
+		char *str = bplist_get_string(view, obj);
+		int res = (str && strcmp(str, key) == 0);
+		free(str);
+		return res;
+	}
+	return 0;
+}
+
+LIBIMOBILEDEVICE_API property_list_view_node_t property_list_view_get_root(property_list_view_t view)
+{
+	if (!view)
+		return 0;
+	if (view->tree)
+		return PLIST_TO_NODE(view->tree);
+	return view->root_object + 1;
+}
+
+LIBIMOBILEDEVICE_API plist_type property_list_view_get_node_type(property_list_view_t view, property_list_view_node_t node)
+{
+	if (!view || !node)
+		return PLIST_NONE;
+	if (view->tree)
+		return plist_get_node_type(NODE_TO_PLIST(node));
+
+	const uint8_t *obj = bplist_get_object(view, node);
+	if (!obj)
+		return PLIST_NONE;
+
+	switch (obj[0] & BPLIST_MASK) {
+		case BPLIST_NULL:
+			if (obj[0] == BPLIST_FALSE || obj[0] == BPLIST_TRUE)
+				return PLIST_BOOLEAN;
+			break;
+		case BPLIST_UINT:
+			return PLIST_UINT;
+		case BPLIST_REAL:
+			return PLIST_REAL;
+		case BPLIST_DATE:
+			return PLIST_DATE;
+		case BPLIST_DATA:
+			return PLIST_DATA;
+		case BPLIST_STRING:
+		case BPLIST_UNICODE:
+			return PLIST_STRING;
+		case BPLIST_UID:
+			return PLIST_UID;
+		case BPLIST_ARRAY:
+			return PLIST_ARRAY;
+		case BPLIST_DICT:
+			return PLIST_DICT;
+		default:
+			break;
+	}
+	return PLIST_NONE;
+}
+
+LIBIMOBILEDEVICE_API uint32_t property_list_view_get_size(property_list_view_t view, property_list_view_node_t node)
+{
+	if (!view || !node)
+		return 0;
+
+	if (view->tree) {
+		plist_t plist = NODE_TO_PLIST(node);
+		switch (plist_get_node_type(plist)) {
+			case PLIST_ARRAY:
+				return plist_array_get_size(plist);
+			case PLIST_DICT:
+				return plist_dict_get_size(plist);
+			default:
+				return 0;
+		}
+	}
+
+	const uint8_t *obj = bplist_get_object(view, node);
+	uint64_t count = 0;
+	if (!obj)
+		return 0;
+	if ((obj[0] & BPLIST_MASK) == BPLIST_ARRAY) {
+		if (!bplist_get_payload(view, obj, &count, view->ref_size))
+			return 0;
+	} else if ((obj[0] & BPLIST_MASK) == BPLIST_DICT) {
+		if (!bplist_get_payload(view, obj, &count, 2 * view->ref_size))
+			return 0;
+	}
+	return (count > UINT32_MAX) ? 0 : (uint32_t)count;
+}
+
+LIBIMOBILEDEVICE_API property_list_view_node_t property_list_view_array_get_item(property_list_view_t view, property_list_view_node_t node, uint32_t n)
+{
+	if (!view || !node)
+		return 0;
+
+	if (view->tree) {
+		plist_t plist = NODE_TO_PLIST(node);
+		if (plist_get_node_type(plist) != PLIST_ARRAY || n >= plist_array_get_size(plist))
+			return 0;
+		return PLIST_TO_NODE(plist_array_get_item(plist, n));
+	}
+
+	const uint8_t *obj = bplist_get_object(view, node);
+	const uint8_t *refs = NULL;
+	uint64_t count = 0;
+	if (!obj || (obj[0] & BPLIST_MASK) != BPLIST_ARRAY)
+		return 0;
+	refs = bplist_get_payload(view, obj, &count, view->ref_size);
+	if (!refs || n >= count)
+		return 0;
+	return bplist_get_ref(view, refs, n);
+}
+
+LIBIMOBILEDEVICE_API property_list_view_node_t property_list_view_dict_get_item(property_list_view_t view, property_list_view_node_t node, const char *key)
+{
+	if (!view || !node || !key)
+		return 0;
+
+	if (view->tree) {
+		plist_t plist = NODE_TO_PLIST(node);
+		if (plist_get_node_type(plist) != PLIST_DICT)
+			return 0;
+		return PLIST_TO_NODE(plist_dict_get_item(plist, key));
+	}
+
+	const uint8_t *obj = bplist_get_object(view, node);
+	const uint8_t *refs = NULL;
+	uint64_t count = 0;
+	uint64_t i;
+	size_t key_len = strlen(key);
+	if (!obj || (obj[0] & BPLIST_MASK) != BPLIST_DICT)
+		return 0;
+	refs = bplist_get_payload(view, obj, &count, 2 * view->ref_size);
+	if (!refs)
+		return 0;
+
+	/* the key references are followed by the value references */
+	for (i = 0; i < count; i++) {
+		const uint8_t *key_obj = bplist_get_object(view, bplist_get_ref(view, refs, i));
+		if (key_obj && bplist_string_equals(view, key_obj, key, key_len)) {
+			return bplist_get_ref(view, refs, count + i);
+		}
+	}
+	return 0;
+}
+
+LIBIMOBILEDEVICE_API property_list_view_node_t property_list_view_dict_get_item_at(property_list_view_t view, property_list_view_node_t node, uint32_t n, char **key)
+{
+	if (key)
+		*key = NULL;
+	if (!view || !node)
+		return 0;
+
+	if (view->tree) {
+		plist_t plist = NODE_TO_PLIST(node);
+		plist_t val = NULL;
+		char *k = NULL;
+		if (plist_get_node_type(plist) != PLIST_DICT || n >= plist_dict_get_size(plist))
+			return 0;
+		/* continue the previous iteration when accessing items in order */
+		if (view->iter_dict != plist || !view->iter || n < view->iter_index) {
+			free(view->iter);
+			view->iter = NULL;
+			plist_dict_new_iter(plist, &view->iter);
+			view->iter_dict = plist;
+			view->iter_index = 0;
+		}
+		if (!view->iter)
+			return 0;
+		do {
+			free(k);
+			k = NULL;
+			val = NULL;
+			plist_dict_next_item(plist, view->iter, &k, &val);
+			if (!val)
+				break;
+		} while (view->iter_index++ < n);
+		if (val && key)
+			*key = k;
+		else
+			free(k);
+		return PLIST_TO_NODE(val);
+	}
+
+	const uint8_t *obj = bplist_get_object(view, node);
+	const uint8_t *refs = NULL;
+	uint64_t count = 0;
+	if (!obj || (obj[0] & BPLIST_MASK) != BPLIST_DICT)
+		return 0;
+	refs = bplist_get_payload(view, obj, &count, 2 * view->ref_size);
+	if (!refs || n >= count)
+		return 0;
+	if (key) {
+		const uint8_t *key_obj = bplist_get_object(view, bplist_get_ref(view, refs, n));
+		if (key_obj)
+			*key = bplist_get_string(view, key_obj);
+	}
+	return bplist_get_ref(view, refs, count + n);
+}
+
+LIBIMOBILEDEVICE_API void property_list_view_get_string_val(property_list_view_t view, property_list_view_node_t node, char **val)
+{
+	if (!val)
+		return;
+	*val = NULL;
+	if (!view || !node)
+		return;
+
+	if (view->tree) {
+		if (plist_get_node_type(NODE_TO_PLIST(node)) == PLIST_STRING)
+			plist_get_string_val(NODE_TO_PLIST(node), val);
+		return;
+	}
+
+	const uint8_t *obj = bplist_get_object(view, node);
+	if (obj)
+		*val = bplist_get_string(view, obj);
+}
+
+LIBIMOBILEDEVICE_API void property_list_view_get_uint_val(property_list_view_t view, property_list_view_node_t node, uint64_t *val)
+{
+	if (!val)
+		return;
+	*val = 0;
+	if (!view || !node)
+		return;
+
+	if (view->tree) {
+		if (plist_get_node_type(NODE_TO_PLIST(node)) == PLIST_UINT)
+			plist_get_uint_val(NODE_TO_PLIST(node), val);
+		return;
+	}
+
+	const uint8_t *obj = bplist_get_object(view, node);
+	if (!obj || (obj[0] & BPLIST_MASK) != BPLIST_UINT)
+		return;
+	uint8_t size = 1 << (obj[0] & 0x0F);
+	if (size > 16)
+		return;
+	const uint8_t *p = bplist_get_scalar(view, obj, size);
+	if (!p)
+		return;
+	/* 128 bit integers only hold 64 bit values in their lower half */
+	if (size == 16) {
+		p += 8;
+		size = 8;
+	}
+	*val = bplist_read_uint(p, size);
+}
+
+LIBIMOBILEDEVICE_API void property_list_view_get_bool_val(property_list_view_t view, property_list_view_node_t node, uint8_t *val)
+{
+	if (!val)
+		return;
+	*val = 0;
+	if (!view || !node)
+		return;
+
+	if (view->tree) {
+		if (plist_get_node_type(NODE_TO_PLIST(node)) == PLIST_BOOLEAN)
+			plist_get_bool_val(NODE_TO_PLIST(node), val);
+		return;
+	}
+
+	const uint8_t *obj = bplist_get_object(view, node);
+	if (obj && obj[0] == BPLIST_TRUE)
+		*val = 1;
+}
+
+/**
+ * Reads the value of a real or date object.
+ *
+ * @return 0 on success or -1 if the object is not a valid real or date.
+ */
+static int bplist_get_real(property_list_view_t view, const uint8_t *obj, double *val)
+{
+	uint8_t size = 1 << (obj[0] & 0x0F);
+	if (size != 4 && size != 8)
+		return -1;
+	const uint8_t *p = bplist_get_scalar(view, obj, size);
+	if (!p)
+		return -1;
+	if (size == 4) {
+		uint32_t bits = (uint32_t)bplist_read_uint(p, 4);
+		float f;
+		memcpy(&f, &bits, sizeof(f));
+		*val = f;
+	} else {
+		uint64_t bits = bplist_read_uint(p, 8);
+		memcpy(val, &bits, sizeof(*val));
+	}
+	return 0;
+}
+
+LIBIMOBILEDEVICE_API void property_list_view_get_real_val(property_list_view_t view, property_list_view_node_t node, double *val)
+{
+	if (!val)
+		return;
+	*val = 0.0;
+	if (!view || !node)
+		return;
+
+	if (view->tree) {
+		if (plist_get_node_type(NODE_TO_PLIST(node)) == PLIST_REAL)
+			plist_get_real_val(NODE_TO_PLIST(node), val);
+		return;
+	}
+
+	const uint8_t *obj = bplist_get_object(view, node);
+	if (obj && (obj[0] & BPLIST_MASK) == BPLIST_REAL)
+		bplist_get_real(view, obj, val);
+}
+
+LIBIMOBILEDEVICE_API void property_list_view_get_data_val(property_list_view_t view, property_list_view_node_t node, char **val, uint64_t *length)
+{
+	if (!val || !length)
+		return;
+	*val = NULL;
+	*length = 0;
+	if (!view || !node)
+		return;
+
+	if (view->tree) {
+		if (plist_get_node_type(NODE_TO_PLIST(node)) == PLIST_DATA)
+			plist_get_data_val(NODE_TO_PLIST(node), val, length);
+		return;
+	}
+
+	const uint8_t *obj = bplist_get_object(view, node);
+	const uint8_t *payload = NULL;
+	uint64_t count = 0;
+	if (!obj || (obj[0] & BPLIST_MASK) != BPLIST_DATA)
+		return;
+	payload = bplist_get_payload(view, obj, &count, 1);
+	if (!payload)
+		return;
+	*val = (char*)malloc(count > 0 ? count : 1);
+	if (*val) {
+		memcpy(*val, payload, count);
+		*length = count;
+	}
+}
+
+/**
+ * Copies a node and its children into a plist_t.
+ *
+ * @param budget The number of nodes that may still be created. Objects can
+ *     be referenced from several containers, so a small plist that shares
+ *     containers could otherwise expand into an exponential number of nodes.
+ */
+static plist_t bplist_copy_node(property_list_view_t view, property_list_view_node_t node, int depth, uint64_t *budget)
+{
+	const uint8_t *obj = bplist_get_object(view, node);
+	const uint8_t *refs = NULL;
+	plist_t result = NULL;
+	uint64_t count = 0;
+	uint64_t i;
+
+	if (!obj || depth > BPLIST_MAX_DEPTH)
+		return NULL;
+	if (*budget == 0) {
+		debug_info("ERROR: binary plist expands to too many nodes");
+		return NULL;
+	}
+	(*budget)--;
+
+	switch (property_list_view_get_node_type(view, node)) {
+		case PLIST_BOOLEAN:
+			result = plist_new_bool(obj[0] == BPLIST_TRUE);
+			break;
+		case PLIST_UINT: {
+			uint64_t val = 0;
+			property_list_view_get_uint_val(view, node, &val);
+			result = plist_new_uint(val);
+			} break;
+		case PLIST_REAL: {
+			double val = 0.0;
+			if (bplist_get_real(view, obj, &val) == 0)
+				result = plist_new_real(val);
+			} break;
+		case PLIST_DATE: {
+			double val = 0.0;
+			if (bplist_get_real(view, obj, &val) == 0) {
+				int32_t sec = (int32_t)val;
+				result = plist_new_date(sec, (int32_t)((val - sec) * 1000000));
+			}
+			} break;
+		case PLIST_DATA: {
+			char *val = NULL;
+			uint64_t length = 0;
+			property_list_view_get_data_val(view, node, &val, &length);
+			if (val) {
+				result = plist_new_data(val, length);
+				free(val);
+			}
+			} break;
+		case PLIST_STRING: {
+			char *val = bplist_get_string(view, obj);
+			if (val) {
+				result = plist_new_string(val);
+				free(val);
+			}
+			} break;
+		case PLIST_UID: {
+			uint8_t size = (obj[0] & 0x0F) + 1;
+			const uint8_t *p = (size <= 8) ? bplist_get_scalar(view, obj, size) : NULL;
+			if (p)
+				result = plist_new_uid(bplist_read_uint(p, size));
+			} break;
+		case PLIST_ARRAY:
+			refs = bplist_get_payload(view, obj, &count, view->ref_size);
+			if (!refs)
+				break;
+			result = plist_new_array();
+			for (i = 0; i < count; i++) {
+				plist_t item = bplist_copy_node(view, bplist_get_ref(view, refs, i), depth + 1, budget);
+				if (!item) {
+					plist_free(result);
+					return NULL;
+				}
+				plist_array_append_item(result, item);
+			}
+			break;
+		case PLIST_DICT:
+			refs = bplist_get_payload(view, obj, &count, 2 * view->ref_size);
+			if (!refs)
+				break;
+			result = plist_new_dict();
+			for (i = 0; i < count; i++) {
+				const uint8_t *key_obj = bplist_get_object(view, bplist_get_ref(view, refs, i));
+				char *key = key_obj ? bplist_get_string(view, key_obj) : NULL;
+				plist_t item = key ? bplist_copy_node(view, bplist_get_ref(view, refs, count + i), depth + 1, budget) : NULL;
+				if (!item) {
+					free(key);
+					plist_free(result);
+					return NULL;
+				}
+				plist_dict_set_item(result, key, item);
+				free(key);
+			}
+			break;
+		default:
+			break;
+	}
+	return result;
+}
+
+LIBIMOBILEDEVICE_API plist_t property_list_view_copy_node(property_list_view_t view, property_list_view_node_t node)
+{
+	if (!view || !node)
+		return NULL;
+	if (view->tree)
+		return plist_copy(NODE_TO_PLIST(node));
+	/* every node but the root has a reference of its own, unless
+	 * containers are shared, which plist writers do not do */
+	uint64_t budget = 1 + (view->offset_table - BPLIST_MAGIC_SIZE) / view->ref_size;
+	return bplist_copy_node(view, node, 0, &budget);
+}
@@ -0,0 +1,67 @@
+/*
+ * property_list_view.h
+ * Lazily decoded view of a received property list -- header file.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef __PROPERTY_LIST_VIEW_H
+#define __PROPERTY_LIST_VIEW_H
+
+#include <stdint.h>
+#include <plist/plist.h>
+
+#include "libimobiledevice/property_list_service.h"
+
+struct property_list_view_private {
+	/* binary plist, owned by the view */
+	char *data;
+	uint64_t size;
+	/* data is a file mapping that has to be unmapped instead of freed */
+	int mapped;
+	uint8_t offset_size;
+	uint8_t ref_size;
+	uint64_t num_objects;
+	uint64_t root_object;
+	uint64_t offset_table;
+	/* completely parsed plist for other formats */
+	plist_t tree;
+	plist_t iter_dict;
+	plist_dict_iter iter;
+	uint32_t iter_index;
+};
+
+/**
+ * Creates a view of a binary plist. Only the trailer and the offset table
+ * are checked here, objects are decoded when they are accessed.
+ *
+ * @param data The binary plist data. The view takes ownership of it on
+ *     success, it has to be allocated with malloc().
+ * @param size The size of the binary plist data.
+ * @param view Set to the new view upon successful return.
+ *
+ * @return PROPERTY_LIST_SERVICE_E_SUCCESS on success, or
+ *     PROPERTY_LIST_SERVICE_E_PLIST_ERROR when data is not a valid binary
+ *     plist.
+ */
+property_list_service_error_t property_list_view_new_from_bin(char *data, uint64_t size, property_list_view_t *view);
+
+/**
+ * Creates a view of an already parsed plist, used for formats that cannot
+ * be decoded on demand. The view takes ownership of the plist.
+ */
+property_list_service_error_t property_list_view_new_from_plist(plist_t plist, property_list_view_t *view);
+
+#endif
@@ -0,0 +1,616 @@
+/*
+ * reactor.c
+ * Shared event loop dispatching connection readiness to callbacks.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#ifdef WIN32
+#include <winsock2.h>
+#include <windows.h>
+#else
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#endif
+
+#ifdef HAVE_SYS_EPOLL_H
+#include <sys/epoll.h>
+#endif
+
+#include "reactor.h"
+#include "common/debug.h"
+
+#ifdef WIN32
+#define poll WSAPoll
+/* there is no wakeup pipe, so the poll loop rescans periodically */
+#define REACTOR_POLL_TIMEOUT 100
+#else
+#define REACTOR_POLL_TIMEOUT -1
+#endif
+
+#define REACTOR_MAX_EVENTS 32
+
+/* initial number of buckets of the watch indexes */
+#define REACTOR_TABLE_SIZE 64
+
+static idevice_reactor_t default_reactor = NULL;
+
+/**
+ * Checks if the calling thread is the one that is currently running the
+ * callback of the given watch.
+ */
+static int reactor_is_current_thread(struct reactor_watch *watch)
+{
+#ifdef WIN32
+	return (watch->active_thread == GetCurrentThreadId());
+#else
+	return pthread_equal(watch->active_thread, pthread_self());
+#endif
+}
+
+static unsigned int reactor_id_bucket(idevice_reactor_t reactor, uint64_t id)
+{
+	/* ids are sequential, so the low bits spread evenly */
+	return (unsigned int)(id & (reactor->table_size - 1));
+}
+
+static unsigned int reactor_fd_bucket(idevice_reactor_t reactor, int fd)
+{
+	return (unsigned int)fd & (reactor->table_size - 1);
+}
+
+static struct reactor_watch *reactor_find_id(idevice_reactor_t reactor, uint64_t id)
+{
+	struct reactor_watch *watch;
+	if (!reactor->id_table)
+		return NULL;
+	watch = reactor->id_table[reactor_id_bucket(reactor, id)];
+	while (watch && (watch->id != id)) {
+		watch = watch->id_next;
+	}
+	return watch;
+}
+
+static struct reactor_watch *reactor_find_connection(idevice_reactor_t reactor, idevice_connection_t connection, int fd)
+{
+	struct reactor_watch *watch;
+	if (!reactor->fd_table)
+		return NULL;
+	watch = reactor->fd_table[reactor_fd_bucket(reactor, fd)];
+	while (watch && (watch->connection != connection || watch->removed)) {
+		watch = watch->fd_next;
+	}
+	return watch;
+}
+
+/**
+ * Resizes the watch indexes to the given number of buckets.
+ *
+ * @return 0 on success, -1 when out of memory.
+ */
+static int reactor_resize_tables(idevice_reactor_t reactor, unsigned int size)
+{
+	struct reactor_watch **id_table = (struct reactor_watch**)calloc(size, sizeof(struct reactor_watch*));
+	struct reactor_watch **fd_table = (struct reactor_watch**)calloc(size, sizeof(struct reactor_watch*));
+	struct reactor_watch *watch;
+
+	if (!id_table || !fd_table) {
+		free(id_table);
+		free(fd_table);
+		return -1;
+	}
+	free(reactor->id_table);
+	free(reactor->fd_table);
+	reactor->id_table = id_table;
+	reactor->fd_table = fd_table;
+	reactor->table_size = size;
+
+	for (watch = reactor->watches; watch; watch = watch->next) {
+		unsigned int idx = reactor_id_bucket(reactor, watch->id);
+		watch->id_next = id_table[idx];
+		id_table[idx] = watch;
+		idx = reactor_fd_bucket(reactor, watch->fd);
+		watch->fd_next = fd_table[idx];
+		fd_table[idx] = watch;
+	}
+	return 0;
+}
+
+/**
+ * Adds a watch to the list and the indexes, growing the indexes so that
+ * chains stay short.
+ *
+ * @return 0 on success, -1 when out of memory.
+ */
+static int reactor_link(idevice_reactor_t reactor, struct reactor_watch *watch)
+{
+	unsigned int idx;
+
+	if (reactor->num_watches + 1 > reactor->table_size) {
+		unsigned int size = (reactor->table_size > 0) ? reactor->table_size * 2 : REACTOR_TABLE_SIZE;
+		if (reactor_resize_tables(reactor, size) < 0 && !reactor->id_table) {
+			return -1;
+		}
+	}
+
+	watch->prev = NULL;
+	watch->next = reactor->watches;
+	if (reactor->watches)
+		reactor->watches->prev = watch;
+	reactor->watches = watch;
+	reactor->num_watches++;
+
+	idx = reactor_id_bucket(reactor, watch->id);
+	watch->id_next = reactor->id_table[idx];
+	reactor->id_table[idx] = watch;
+	idx = reactor_fd_bucket(reactor, watch->fd);
+	watch->fd_next = reactor->fd_table[idx];
+	reactor->fd_table[idx] = watch;
+	return 0;
+}
+
+static void reactor_unlink(idevice_reactor_t reactor, struct reactor_watch *watch)
+{
+	struct reactor_watch **pp;
+
+	if (watch->prev)
+		watch->prev->next = watch->next;
+	else
+		reactor->watches = watch->next;
+	if (watch->next)
+		watch->next->prev = watch->prev;
+	reactor->num_watches--;
+
+	pp = &reactor->id_table[reactor_id_bucket(reactor, watch->id)];
+	while (*pp && *pp != watch) {
+		pp = &(*pp)->id_next;
+	}
+	if (*pp)
+		*pp = watch->id_next;
+	pp = &reactor->fd_table[reactor_fd_bucket(reactor, watch->fd)];
+	while (*pp && *pp != watch) {
+		pp = &(*pp)->fd_next;
+	}
+	if (*pp)
+		*pp = watch->fd_next;
+}
+
+/**
+ * Wakes up the reactor threads so they notice changes to the watch list or
+ * the quit flag.
+ */
+static void reactor_wakeup(idevice_reactor_t reactor)
+{
+#ifndef WIN32
+	char c = 0;
+	if (write(reactor->wakeup[1], &c, 1) < 0 && errno != EAGAIN) {
+		debug_info("ERROR: could not write to wakeup pipe: %s", strerror(errno));
+	}
+#endif
+}
+
+#ifdef HAVE_SYS_EPOLL_H
+/**
+ * (Re)arms the given watch in the epoll set. Watches are one-shot so a
+ * connection is only ever handed to a single reactor thread at a time.
+ */
+static int reactor_arm(idevice_reactor_t reactor, struct reactor_watch *watch, int op)
+{
+	struct epoll_event ev;
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLONESHOT;
+	if (watch->events & IDEVICE_REACTOR_READ)
+		ev.events |= EPOLLIN;
+	if (watch->events & IDEVICE_REACTOR_WRITE)
+		ev.events |= EPOLLOUT;
+	ev.data.u64 = watch->id;
+	return epoll_ctl(reactor->epfd, op, watch->fd, &ev);
+}
+#endif
+
+/**
+ * Runs the callback of the watch with the given id unless it was removed
+ * or is already being handled by another thread.
+ */
+static void reactor_dispatch(idevice_reactor_t reactor, uint64_t id, int events)
+{
+	struct reactor_watch *watch;
+
+	mutex_lock(&reactor->mutex);
+	watch = reactor_find_id(reactor, id);
+	if (!watch || watch->removed || watch->active) {
+		mutex_unlock(&reactor->mutex);
+		return;
+	}
+	watch->active = 1;
+#ifdef WIN32
+	watch->active_thread = GetCurrentThreadId();
+#else
+	watch->active_thread = pthread_self();
+#endif
+	mutex_unlock(&reactor->mutex);
+
+	watch->callback(watch->connection, events & (watch->events | IDEVICE_REACTOR_ERROR), watch->user_data);
+
+	mutex_lock(&reactor->mutex);
+	watch->active = 0;
+	if (watch->removed) {
+		reactor_unlink(reactor, watch);
+		free(watch);
+		cond_broadcast(&reactor->watch_freed);
+	} else {
+#ifdef HAVE_SYS_EPOLL_H
+		if (reactor_arm(reactor, watch, EPOLL_CTL_MOD) < 0) {
+			debug_info("ERROR: could not re-arm fd %d: %s", watch->fd, strerror(errno));
+		}
+#endif
+	}
+	mutex_unlock(&reactor->mutex);
+}
+
+static int reactor_should_quit(idevice_reactor_t reactor)
+{
+	int quit;
+	mutex_lock(&reactor->mutex);
+	quit = reactor->quit;
+	mutex_unlock(&reactor->mutex);
+	return quit;
+}
+
+#ifdef HAVE_SYS_EPOLL_H
+static void* reactor_thread(void *arg)
+{
+	idevice_reactor_t reactor = (idevice_reactor_t)arg;
+	struct epoll_event ev[REACTOR_MAX_EVENTS];
+
+	debug_info("Running");
+
+	while (!reactor_should_quit(reactor)) {
+		int i;
+		int n = epoll_wait(reactor->epfd, ev, REACTOR_MAX_EVENTS, -1);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			debug_info("ERROR: epoll_wait failed: %s", strerror(errno));
+			break;
+		}
+		for (i = 0; i < n; i++) {
+			int events = 0;
+			if (ev[i].data.u64 == 0) {
+				/* wakeup pipe, only used to quit */
+				continue;
+			}
+			if (ev[i].events & EPOLLIN)
+				events |= IDEVICE_REACTOR_READ;
+			if (ev[i].events & EPOLLOUT)
+				events |= IDEVICE_REACTOR_WRITE;
+			if (ev[i].events & (EPOLLERR | EPOLLHUP))
+				events |= IDEVICE_REACTOR_ERROR;
+			reactor_dispatch(reactor, ev[i].data.u64, events);
+		}
+	}
+
+	debug_info("Exiting");
+
+	return NULL;
+}
+#else
+static void* reactor_thread(void *arg)
+{
+	idevice_reactor_t reactor = (idevice_reactor_t)arg;
+	struct pollfd *pfds = NULL;
+	uint64_t *ids = NULL;
+	unsigned int capacity = 0;
+
+	debug_info("Running");
+
+	while (!reactor_should_quit(reactor)) {
+		struct reactor_watch *watch;
+		unsigned int count;
+		unsigned int i;
+		int n;
+
+		mutex_lock(&reactor->mutex);
+		count = reactor->num_watches;
+		if (count + 1 > capacity) {
+			capacity = count + 1;
+			pfds = (struct pollfd*)realloc(pfds, capacity * sizeof(struct pollfd));
+			ids = (uint64_t*)realloc(ids, capacity * sizeof(uint64_t));
+		}
+		count = 0;
+#ifndef WIN32
+		pfds[count].fd = reactor->wakeup[0];
+		pfds[count].events = POLLIN;
+		pfds[count].revents = 0;
+		ids[count] = 0;
+		count++;
+#endif
+		for (watch = reactor->watches; watch; watch = watch->next) {
+			if (watch->removed || watch->active)
+				continue;
+			pfds[count].fd = watch->fd;
+			pfds[count].events = 0;
+			if (watch->events & IDEVICE_REACTOR_READ)
+				pfds[count].events |= POLLIN;
+			if (watch->events & IDEVICE_REACTOR_WRITE)
+				pfds[count].events |= POLLOUT;
+			pfds[count].revents = 0;
+			ids[count] = watch->id;
+			count++;
+		}
+		mutex_unlock(&reactor->mutex);
+
+		n = poll(pfds, count, REACTOR_POLL_TIMEOUT);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			debug_info("ERROR: poll failed: %s", strerror(errno));
+			break;
+		}
+		for (i = 0; i < count && n > 0; i++) {
+			int events = 0;
+			if (pfds[i].revents == 0)
+				continue;
+			n--;
+			if (ids[i] == 0) {
+				char buf[64];
+				while (read(pfds[i].fd, buf, sizeof(buf)) > 0);
+				continue;
+			}
+			if (pfds[i].revents & POLLIN)
+				events |= IDEVICE_REACTOR_READ;
+			if (pfds[i].revents & POLLOUT)
+				events |= IDEVICE_REACTOR_WRITE;
+			if (pfds[i].revents & (POLLERR | POLLHUP | POLLNVAL))
+				events |= IDEVICE_REACTOR_ERROR;
+			reactor_dispatch(reactor, ids[i], events);
+		}
+	}
+
+	free(pfds);
+	free(ids);
+
+	debug_info("Exiting");
+
+	return NULL;
+}
+#endif
+
+LIBIMOBILEDEVICE_API idevice_error_t idevice_reactor_new(unsigned int num_threads, idevice_reactor_t *reactor)
+{
+	unsigned int i;
+
+	if (!reactor)
+		return IDEVICE_E_INVALID_ARG;
+
+	idevice_reactor_t reactor_loc = (idevice_reactor_t)calloc(1, sizeof(struct idevice_reactor_private));
+	if (!reactor_loc)
+		return IDEVICE_E_UNKNOWN_ERROR;
+
+	mutex_init(&reactor_loc->mutex);
+	cond_init(&reactor_loc->watch_freed);
+	reactor_loc->next_id = 1;
+	reactor_loc->wakeup[0] = -1;
+	reactor_loc->wakeup[1] = -1;
+	reactor_loc->epfd = -1;
+
+#ifndef WIN32
+	if (pipe(reactor_loc->wakeup) < 0) {
+		debug_info("ERROR: could not create wakeup pipe: %s", strerror(errno));
+		cond_destroy(&reactor_loc->watch_freed);
+		mutex_destroy(&reactor_loc->mutex);
+		free(reactor_loc);
+		return IDEVICE_E_UNKNOWN_ERROR;
+	}
+	fcntl(reactor_loc->wakeup[0], F_SETFL, fcntl(reactor_loc->wakeup[0], F_GETFL, 0) | O_NONBLOCK);
+	fcntl(reactor_loc->wakeup[1], F_SETFL, fcntl(reactor_loc->wakeup[1], F_GETFL, 0) | O_NONBLOCK);
+#endif
+
+#ifdef HAVE_SYS_EPOLL_H
+	reactor_loc->epfd = epoll_create(REACTOR_MAX_EVENTS);
+	if (reactor_loc->epfd >= 0) {
+		struct epoll_event ev;
+		memset(&ev, 0, sizeof(ev));
+		/* level triggered and never drained, so every thread sees it */
+		ev.events = EPOLLIN;
+		ev.data.u64 = 0;
+		epoll_ctl(reactor_loc->epfd, EPOLL_CTL_ADD, reactor_loc->wakeup[0], &ev);
+	} else {
+		debug_info("ERROR: could not create epoll instance: %s", strerror(errno));
+		close(reactor_loc->wakeup[0]);
+		close(reactor_loc->wakeup[1]);
+		cond_destroy(&reactor_loc->watch_freed);
+		mutex_destroy(&reactor_loc->mutex);
+		free(reactor_loc);
+		return IDEVICE_E_UNKNOWN_ERROR;
+	}
+#else
+	/* without epoll a single thread polls all watches */
+	num_threads = 1;
+#endif
+	if (num_threads == 0)
+		num_threads = 1;
+
+	reactor_loc->threads = (thread_t*)calloc(num_threads, sizeof(thread_t));
+	for (i = 0; i < num_threads; i++) {
+		if (thread_new(&reactor_loc->threads[i], reactor_thread, reactor_loc) != 0) {
+			debug_info("ERROR: could not start reactor thread %u", i);
+			break;
+		}
+		reactor_loc->num_threads++;
+	}
+	if (reactor_loc->num_threads == 0) {
+		idevice_reactor_free(reactor_loc);
+		return IDEVICE_E_UNKNOWN_ERROR;
+	}
+
+	*reactor = reactor_loc;
+
+	return IDEVICE_E_SUCCESS;
+}
+
+LIBIMOBILEDEVICE_API idevice_error_t idevice_reactor_free(idevice_reactor_t reactor)
+{
+	unsigned int i;
+
+	if (!reactor)
+		return IDEVICE_E_INVALID_ARG;
+
+	if (default_reactor == reactor)
+		default_reactor = NULL;
+
+	mutex_lock(&reactor->mutex);
+	reactor->quit = 1;
+	mutex_unlock(&reactor->mutex);
+	reactor_wakeup(reactor);
+
+	for (i = 0; i < reactor->num_threads; i++) {
+		thread_join(reactor->threads[i]);
+		thread_free(reactor->threads[i]);
+	}
+	free(reactor->threads);
+
+	while (reactor->watches) {
+		struct reactor_watch *watch = reactor->watches;
+		debug_info("WARNING: connection %p still registered", watch->connection);
+		reactor->watches = watch->next;
+		free(watch);
+	}
+	free(reactor->id_table);
+	free(reactor->fd_table);
+
+#ifdef HAVE_SYS_EPOLL_H
+	if (reactor->epfd >= 0)
+		close(reactor->epfd);
+#endif
+#ifndef WIN32
+	close(reactor->wakeup[0]);
+	close(reactor->wakeup[1]);
+#endif
+	cond_destroy(&reactor->watch_freed);
+	mutex_destroy(&reactor->mutex);
+	free(reactor);
+
+	return IDEVICE_E_SUCCESS;
+}
+
+LIBIMOBILEDEVICE_API idevice_error_t idevice_reactor_add(idevice_reactor_t reactor, idevice_connection_t connection, int events, idevice_reactor_cb_t callback, void *user_data)
+{
+	int fd = -1;
+
+	if (!reactor || !connection || !callback || !(events & (IDEVICE_REACTOR_READ | IDEVICE_REACTOR_WRITE)))
+		return IDEVICE_E_INVALID_ARG;
+
+	if (idevice_connection_get_fd(connection, &fd) != IDEVICE_E_SUCCESS)
+		return IDEVICE_E_UNKNOWN_ERROR;
+
+	struct reactor_watch *watch = (struct reactor_watch*)calloc(1, sizeof(struct reactor_watch));
+	if (!watch)
+		return IDEVICE_E_UNKNOWN_ERROR;
+
+	watch->connection = connection;
+	watch->fd = fd;
+	watch->events = events;
+	watch->callback = callback;
+	watch->user_data = user_data;
+
+	mutex_lock(&reactor->mutex);
+	if (reactor_find_connection(reactor, connection, fd)) {
+		mutex_unlock(&reactor->mutex);
+		debug_info("connection %p is already registered", connection);
+		free(watch);
+		return IDEVICE_E_INVALID_ARG;
+	}
+	watch->id = reactor->next_id++;
+	if (reactor_link(reactor, watch) < 0) {
+		mutex_unlock(&reactor->mutex);
+		free(watch);
+		return IDEVICE_E_UNKNOWN_ERROR;
+	}
+#ifdef HAVE_SYS_EPOLL_H
+	if (reactor_arm(reactor, watch, EPOLL_CTL_ADD) < 0) {
+		debug_info("ERROR: could not add fd %d: %s", fd, strerror(errno));
+		reactor_unlink(reactor, watch);
+		mutex_unlock(&reactor->mutex);
+		free(watch);
+		return IDEVICE_E_UNKNOWN_ERROR;
+	}
+#endif
+	mutex_unlock(&reactor->mutex);
+#ifndef HAVE_SYS_EPOLL_H
+	reactor_wakeup(reactor);
+#endif
+
+	return IDEVICE_E_SUCCESS;
+}
+
+LIBIMOBILEDEVICE_API idevice_error_t idevice_reactor_remove(idevice_reactor_t reactor, idevice_connection_t connection)
+{
+	struct reactor_watch *watch;
+	uint64_t id;
+	int fd = -1;
+
+	if (!reactor || !connection)
+		return IDEVICE_E_INVALID_ARG;
+
+	if (idevice_connection_get_fd(connection, &fd) != IDEVICE_E_SUCCESS)
+		return IDEVICE_E_INVALID_ARG;
+
+	mutex_lock(&reactor->mutex);
+	watch = reactor_find_connection(reactor, connection, fd);
+	if (!watch) {
+		mutex_unlock(&reactor->mutex);
+		return IDEVICE_E_INVALID_ARG;
+	}
+
+	watch->removed = 1;
+#ifdef HAVE_SYS_EPOLL_H
+	epoll_ctl(reactor->epfd, EPOLL_CTL_DEL, watch->fd, NULL);
+#endif
+	if (!watch->active) {
+		reactor_unlink(reactor, watch);
+		free(watch);
+	} else if (!reactor_is_current_thread(watch)) {
+		/* the dispatching thread frees the watch once the callback returns */
+		id = watch->id;
+		while (reactor_find_id(reactor, id)) {
+			cond_wait(&reactor->watch_freed, &reactor->mutex);
+		}
+	}
+	mutex_unlock(&reactor->mutex);
+#ifndef HAVE_SYS_EPOLL_H
+	reactor_wakeup(reactor);
+#endif
+
+	return IDEVICE_E_SUCCESS;
+}
+
+LIBIMOBILEDEVICE_API void idevice_set_default_reactor(idevice_reactor_t reactor)
+{
+	default_reactor = reactor;
+}
+
+LIBIMOBILEDEVICE_API idevice_reactor_t idevice_get_default_reactor(void)
+{
+	return default_reactor;
+}
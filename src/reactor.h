@@ -0,0 +1,70 @@
+/*
+ * reactor.h
+ * Shared event loop for connection readiness -- header file.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef __REACTOR_H
+#define __REACTOR_H
+
+#include <stdint.h>
+
+#include "idevice.h"
+#include "common/thread.h"
+
+#ifdef WIN32
+typedef DWORD reactor_thread_id_t;
+#else
+typedef pthread_t reactor_thread_id_t;
+#endif
+
+struct reactor_watch {
+	uint64_t id;
+	idevice_connection_t connection;
+	int fd;
+	int events;
+	idevice_reactor_cb_t callback;
+	void *user_data;
+	int active;
+	reactor_thread_id_t active_thread;
+	int removed;
+	/* list of all watches */
+	struct reactor_watch *prev;
+	struct reactor_watch *next;
+	/* hash chains of the id and fd indexes */
+	struct reactor_watch *id_next;
+	struct reactor_watch *fd_next;
+};
+
+struct idevice_reactor_private {
+	mutex_t mutex;
+	/* signalled when a removed watch was freed after its callback returned */
+	cond_t watch_freed;
+	int quit;
+	int wakeup[2];
+	int epfd;
+	uint64_t next_id;
+	struct reactor_watch *watches;
+	unsigned int num_watches;
+	/* watches indexed by id and by fd, table_size is a power of two */
+	struct reactor_watch **id_table;
+	struct reactor_watch **fd_table;
+	unsigned int table_size;
+	unsigned int num_threads;
+	thread_t *threads;
+};
+
+#endif
@@ -0,0 +1,143 @@
+/*
+ * sanitize_xml.c
+ * Replacement of invalid control characters in received XML plists.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+#include <stdint.h>
+
+#include "sanitize_xml.h"
+#include "common/thread.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#ifdef HAVE_AVX2_DISPATCH
+#include <immintrin.h>
+#endif
+#elif defined(HAVE_NEON)
+#include <arm_neon.h>
+#endif
+
+/**
+ * Replaces control characters other than tab, LF and CR with spaces.
+ * iOS 4.3+ may send XML plists containing such characters, which the
+ * XML parser rejects.
+ */
+void sanitize_xml_scalar(char *buf, uint32_t len)
+{
+	uint32_t i;
+	for (i = 0; i < len; i++) {
+		unsigned char c = (unsigned char)buf[i];
+		if ((c < 0x20) && (c != 0x09) && (c != 0x0a) && (c != 0x0d))
+			buf[i] = 0x20;
+	}
+}
+
+#if defined(__SSE2__)
+void sanitize_xml_sse2(char *buf, uint32_t len)
+{
+	const __m128i max_ctrl = _mm_set1_epi8(0x1f);
+	const __m128i tab = _mm_set1_epi8(0x09);
+	const __m128i lf = _mm_set1_epi8(0x0a);
+	const __m128i cr = _mm_set1_epi8(0x0d);
+	const __m128i space = _mm_set1_epi8(0x20);
+	uint32_t i = 0;
+
+	for (; i + 16 <= len; i += 16) {
+		__m128i v = _mm_loadu_si128((const __m128i*)(buf + i));
+		/* unsigned v <= 0x1f */
+		__m128i ctrl = _mm_cmpeq_epi8(_mm_min_epu8(v, max_ctrl), v);
+		__m128i keep = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, tab), _mm_cmpeq_epi8(v, lf)), _mm_cmpeq_epi8(v, cr));
+		__m128i mask = _mm_andnot_si128(keep, ctrl);
+		if (_mm_movemask_epi8(mask)) {
+			v = _mm_or_si128(_mm_and_si128(mask, space), _mm_andnot_si128(mask, v));
+			_mm_storeu_si128((__m128i*)(buf + i), v);
+		}
+	}
+	sanitize_xml_scalar(buf + i, len - i);
+}
+
+#ifdef HAVE_AVX2_DISPATCH
+__attribute__((target("avx2")))
+void sanitize_xml_avx2(char *buf, uint32_t len)
+{
+	const __m256i max_ctrl = _mm256_set1_epi8(0x1f);
+	const __m256i tab = _mm256_set1_epi8(0x09);
+	const __m256i lf = _mm256_set1_epi8(0x0a);
+	const __m256i cr = _mm256_set1_epi8(0x0d);
+	const __m256i space = _mm256_set1_epi8(0x20);
+	uint32_t i = 0;
+
+	for (; i + 32 <= len; i += 32) {
+		__m256i v = _mm256_loadu_si256((const __m256i*)(buf + i));
+		__m256i ctrl = _mm256_cmpeq_epi8(_mm256_min_epu8(v, max_ctrl), v);
+		__m256i keep = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, tab), _mm256_cmpeq_epi8(v, lf)), _mm256_cmpeq_epi8(v, cr));
+		__m256i mask = _mm256_andnot_si256(keep, ctrl);
+		if (_mm256_movemask_epi8(mask)) {
+			_mm256_storeu_si256((__m256i*)(buf + i), _mm256_blendv_epi8(v, space, mask));
+		}
+	}
+	sanitize_xml_sse2(buf + i, len - i);
+}
+#endif
+#elif defined(HAVE_NEON)
+void sanitize_xml_neon(char *buf, uint32_t len)
+{
+	const uint8x16_t first_printable = vdupq_n_u8(0x20);
+	const uint8x16_t tab = vdupq_n_u8(0x09);
+	const uint8x16_t lf = vdupq_n_u8(0x0a);
+	const uint8x16_t cr = vdupq_n_u8(0x0d);
+	uint32_t i = 0;
+
+	for (; i + 16 <= len; i += 16) {
+		uint8x16_t v = vld1q_u8((const uint8_t*)(buf + i));
+		uint8x16_t ctrl = vcltq_u8(v, first_printable);
+		uint8x16_t keep = vorrq_u8(vorrq_u8(vceqq_u8(v, tab), vceqq_u8(v, lf)), vceqq_u8(v, cr));
+		uint8x16_t mask = vbicq_u8(ctrl, keep);
+		uint64x2_t any = vreinterpretq_u64_u8(mask);
+		if (vgetq_lane_u64(any, 0) | vgetq_lane_u64(any, 1)) {
+			vst1q_u8((uint8_t*)(buf + i), vbslq_u8(mask, first_printable, v));
+		}
+	}
+	sanitize_xml_scalar(buf + i, len - i);
+}
+#endif
+
+static void (*sanitize_xml_func)(char *buf, uint32_t len) = sanitize_xml_scalar;
+static thread_once_t sanitize_xml_once = THREAD_ONCE_INIT;
+
+static void sanitize_xml_select(void)
+{
+#if defined(__SSE2__)
+	sanitize_xml_func = sanitize_xml_sse2;
+#ifdef HAVE_AVX2_DISPATCH
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) {
+		sanitize_xml_func = sanitize_xml_avx2;
+	}
+#endif
+#elif defined(HAVE_NEON)
+	sanitize_xml_func = sanitize_xml_neon;
+#endif
+}
+
+void sanitize_xml(char *buf, uint32_t len)
+{
+	thread_once(&sanitize_xml_once, sanitize_xml_select);
+	sanitize_xml_func(buf, len);
+}
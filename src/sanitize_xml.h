@@ -0,0 +1,48 @@
+/*
+ * sanitize_xml.h
+ * Replacement of invalid control characters in received XML plists.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef __SANITIZE_XML_H
+#define __SANITIZE_XML_H
+
+#include <stdint.h>
+
+#if defined(__SSE2__)
+#if defined(__GNUC__) && ((__GNUC__ >= 5) || defined(__clang__))
+#define HAVE_AVX2_DISPATCH 1
+#endif
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define HAVE_NEON 1
+#endif
+
+/* replaces control characters using the fastest variant for this CPU */
+void sanitize_xml(char *buf, uint32_t len);
+
+/* the individual variants, exported for tests/sanitize_xml_test */
+void sanitize_xml_scalar(char *buf, uint32_t len);
+#if defined(__SSE2__)
+void sanitize_xml_sse2(char *buf, uint32_t len);
+#ifdef HAVE_AVX2_DISPATCH
+/* requires a CPU with AVX2 */
+void sanitize_xml_avx2(char *buf, uint32_t len);
+#endif
+#elif defined(HAVE_NEON)
+void sanitize_xml_neon(char *buf, uint32_t len);
+#endif
+
+#endif
@@ -113,15 +113,16 @@ LIBIMOBILEDEVICE_API screenshotr_error_t screenshotr_take_screenshot(screenshotr
 	plist_t dict = plist_new_dict();
 	plist_dict_set_item(dict, "MessageType", plist_new_string("ScreenShotRequest"));
 
-	res = screenshotr_error(device_link_service_send_process_message(client->parent, dict));
-	plist_free(dict);
+	res = screenshotr_error(device_link_service_send_process_message_owned(client->parent, dict));
 	if (res != SCREENSHOTR_E_SUCCESS) {
 		debug_info("could not send plist, error %d", res);
 		return res;
 	}
 
+	/* the reply carries the image, so avoid copying it out of the envelope */
+	plist_t envelope = NULL;
 	dict = NULL;
-	res = screenshotr_error(device_link_service_receive_process_message(client->parent, &dict));
+	res = screenshotr_error(device_link_service_receive_process_message_borrowed(client->parent, &envelope, &dict));
 	if (res != SCREENSHOTR_E_SUCCESS) {
 		debug_info("could not get screenshot data, error %d", res);
 		goto leave;
@@ -151,8 +152,8 @@ LIBIMOBILEDEVICE_API screenshotr_error_t screenshotr_take_screenshot(screenshotr
 	res = SCREENSHOTR_E_SUCCESS;
 
 leave:
-	if (dict)
-		plist_free(dict);
+	if (envelope)
+		plist_free(envelope);
 
 	return res;
 }
@@ -23,10 +23,15 @@
 #endif
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
 
 #include "service.h"
 #include "idevice.h"
+#include "lockdown.h"
+#include "common/thread.h"
 #include "common/debug.h"
+#include "common/utils.h"
+#include "common/trace.h"
 
 /**
  * Convert an idevice_error_t value to an service_error_t value.
@@ -46,6 +51,10 @@ static service_error_t idevice_to_service_error(idevice_error_t err)
 			return SERVICE_E_INVALID_ARG;
 		case IDEVICE_E_SSL_ERROR:
 			return SERVICE_E_SSL_ERROR;
+		case IDEVICE_E_CANCELLED:
+			return SERVICE_E_CANCELLED;
+		case IDEVICE_E_NOT_ENOUGH_DATA:
+			return SERVICE_E_NOT_ENOUGH_DATA;
 		default:
 			break;
 	}
@@ -64,8 +73,10 @@ LIBIMOBILEDEVICE_API service_error_t service_client_new(idevice_t device, lockdo
 	}
 
 	/* create client object */
-	service_client_t client_loc = (service_client_t)malloc(sizeof(struct service_client_private));
+	service_client_t client_loc = (service_client_t)calloc(1, sizeof(struct service_client_private));
 	client_loc->connection = connection;
+	mutex_init(&client_loc->stats_mutex);
+	client_loc->measure_rtt = 1;
 
 	/* enable SSL if requested */
 	if (service->ssl_enabled == 1)
@@ -80,15 +91,28 @@ LIBIMOBILEDEVICE_API service_error_t service_client_factory_start_service(idevic
 {
 	*client = NULL;
 
-	lockdownd_client_t lckd = NULL;
-	if (LOCKDOWN_E_SUCCESS != lockdownd_client_new_with_handshake(device, &lckd, label)) {
-		debug_info("Could not create a lockdown client.");
-		return SERVICE_E_START_SERVICE_ERROR;
-	}
-
 	lockdownd_service_descriptor_t service = NULL;
-	lockdownd_start_service(lckd, service_name, &service);
-	lockdownd_client_free(lckd);
+	int attempt;
+	for (attempt = 0; attempt < 2; attempt++) {
+		lockdownd_client_t lckd = NULL;
+		int reused = 0;
+		if (LOCKDOWN_E_SUCCESS != lockdownd_session_pool_acquire(device, &lckd, label, &reused)) {
+			debug_info("Could not create a lockdown client.");
+			return SERVICE_E_START_SERVICE_ERROR;
+		}
+
+		lockdownd_error_t lerr = lockdownd_start_service(lckd, service_name, &service);
+		if (lerr == LOCKDOWN_E_SUCCESS || lerr == LOCKDOWN_E_INVALID_SERVICE || lerr == LOCKDOWN_E_SERVICE_PROHIBITED || lerr == LOCKDOWN_E_SERVICE_LIMIT) {
+			lockdownd_session_pool_release(lckd, 0);
+			break;
+		}
+
+		/* the session is unusable, e.g. it was closed by the device while idle */
+		lockdownd_session_pool_release(lckd, 1);
+		if (!reused)
+			break;
+		debug_info("Pooled lockdown session failed with error %d, retrying with a new session", lerr);
+	}
 
 	if (!service || service->port == 0) {
 		debug_info("Could not start service %s!", service_name);
@@ -96,11 +120,13 @@ LIBIMOBILEDEVICE_API service_error_t service_client_factory_start_service(idevic
 	}
 
 	int32_t ec;
+	trace_begin_arg("ServiceConnect", service_name);
 	if (constructor_func) {
 		ec = (int32_t)constructor_func(device, service, client);
 	} else {
 		ec = service_client_new(device, service, (service_client_t*)client);
 	}
+	trace_end("ServiceConnect");
 	if (error_code) {
 		*error_code = ec;
 	}
@@ -115,6 +141,125 @@ LIBIMOBILEDEVICE_API service_error_t service_client_factory_start_service(idevic
 	return (ec == SERVICE_E_SUCCESS) ? SERVICE_E_SUCCESS : SERVICE_E_START_SERVICE_ERROR;
 }
 
+struct service_constructor_job {
+	idevice_t device;
+	lockdownd_service_descriptor_t service;
+	int32_t (*constructor_func)(idevice_t, lockdownd_service_descriptor_t, void**);
+	void *client;
+	int32_t error_code;
+};
+
+/**
+ * Internally used thread function that connects a single client for
+ * service_client_factory_start_services().
+ */
+static void* service_constructor_thread(void *arg)
+{
+	struct service_constructor_job *job = (struct service_constructor_job*)arg;
+
+	if (job->constructor_func) {
+		job->error_code = job->constructor_func(job->device, job->service, &job->client);
+	} else {
+		job->error_code = service_client_new(job->device, job->service, (service_client_t*)&job->client);
+	}
+
+	return NULL;
+}
+
+LIBIMOBILEDEVICE_API service_error_t service_client_factory_start_services(idevice_t device, const char **service_names, unsigned int count, void **clients, const char* label, int32_t (**constructor_funcs)(idevice_t, lockdownd_service_descriptor_t, void**), int32_t *error_codes)
+{
+	service_error_t res = SERVICE_E_SUCCESS;
+	lockdownd_client_t lckd = NULL;
+	lockdownd_service_descriptor_t *services = NULL;
+	struct service_constructor_job *jobs = NULL;
+	thread_t *threads = NULL;
+	int *running = NULL;
+	lockdownd_error_t lerr;
+	unsigned int i;
+	int reused = 0;
+
+	if (!device || !service_names || !clients || count == 0)
+		return SERVICE_E_INVALID_ARG;
+
+	for (i = 0; i < count; i++) {
+		clients[i] = NULL;
+		if (error_codes)
+			error_codes[i] = SERVICE_E_START_SERVICE_ERROR;
+	}
+
+	services = (lockdownd_service_descriptor_t*)calloc(count, sizeof(lockdownd_service_descriptor_t));
+
+	if (LOCKDOWN_E_SUCCESS != lockdownd_session_pool_acquire(device, &lckd, label, &reused)) {
+		debug_info("Could not create a lockdown client.");
+		free(services);
+		return SERVICE_E_START_SERVICE_ERROR;
+	}
+	lerr = lockdownd_start_services(lckd, service_names, count, services);
+	if ((lerr == LOCKDOWN_E_MUX_ERROR || lerr == LOCKDOWN_E_SSL_ERROR) && reused) {
+		/* the pooled session went stale, try once more with a fresh one */
+		lockdownd_session_pool_release(lckd, 1);
+		lckd = NULL;
+		for (i = 0; i < count; i++) {
+			lockdownd_service_descriptor_free(services[i]);
+			services[i] = NULL;
+		}
+		if (LOCKDOWN_E_SUCCESS != lockdownd_session_pool_acquire(device, &lckd, label, NULL)) {
+			debug_info("Could not create a lockdown client.");
+			free(services);
+			return SERVICE_E_START_SERVICE_ERROR;
+		}
+		lerr = lockdownd_start_services(lckd, service_names, count, services);
+	}
+	lockdownd_session_pool_release(lckd, (lerr == LOCKDOWN_E_MUX_ERROR || lerr == LOCKDOWN_E_SSL_ERROR));
+
+	/* connect to all started services in parallel */
+	jobs = (struct service_constructor_job*)calloc(count, sizeof(struct service_constructor_job));
+	threads = (thread_t*)calloc(count, sizeof(thread_t));
+	running = (int*)calloc(count, sizeof(int));
+	for (i = 0; i < count; i++) {
+		if (!services[i] || services[i]->port == 0) {
+			debug_info("Could not start service %s!", service_names[i]);
+			continue;
+		}
+		jobs[i].device = device;
+		jobs[i].service = services[i];
+		jobs[i].constructor_func = (constructor_funcs) ? constructor_funcs[i] : NULL;
+		jobs[i].error_code = SERVICE_E_START_SERVICE_ERROR;
+		if (thread_new(&threads[i], service_constructor_thread, &jobs[i]) == 0) {
+			running[i] = 1;
+		} else {
+			/* connect from this thread instead */
+			service_constructor_thread(&jobs[i]);
+		}
+	}
+
+	for (i = 0; i < count; i++) {
+		if (running[i]) {
+			thread_join(threads[i]);
+			thread_free(threads[i]);
+		}
+		if (services[i] && services[i]->port != 0) {
+			clients[i] = jobs[i].client;
+			if (error_codes)
+				error_codes[i] = jobs[i].error_code;
+			if (jobs[i].error_code != SERVICE_E_SUCCESS) {
+				debug_info("Could not connect to service %s! Port: %i, error: %i", service_names[i], services[i]->port, jobs[i].error_code);
+				res = SERVICE_E_START_SERVICE_ERROR;
+			}
+		} else {
+			res = SERVICE_E_START_SERVICE_ERROR;
+		}
+		lockdownd_service_descriptor_free(services[i]);
+	}
+
+	free(running);
+	free(threads);
+	free(jobs);
+	free(services);
+
+	return res;
+}
+
 LIBIMOBILEDEVICE_API service_error_t service_client_free(service_client_t client)
 {
 	if (!client)
@@ -122,6 +267,7 @@ LIBIMOBILEDEVICE_API service_error_t service_client_free(service_client_t client
 
 	service_error_t err = idevice_to_service_error(idevice_disconnect(client->connection));
 
+	mutex_destroy(&client->stats_mutex);
 	free(client);
 	client = NULL;
 
@@ -149,6 +295,29 @@ LIBIMOBILEDEVICE_API service_error_t service_send(service_client_t client, const
 	return res;
 }
 
+LIBIMOBILEDEVICE_API service_error_t service_send_file(service_client_t client, int fd, uint64_t offset, uint64_t length, uint64_t *sent)
+{
+	service_error_t res = SERVICE_E_UNKNOWN_ERROR;
+	uint64_t bytes = 0;
+
+	if (!client || (client && !client->connection) || (fd < 0)) {
+		return SERVICE_E_INVALID_ARG;
+	}
+
+	debug_info("sending %llu bytes from file", (unsigned long long)length);
+	res = idevice_to_service_error(idevice_connection_send_file(client->connection, fd, offset, length, &bytes));
+	if (bytes < length) {
+		int read_errno = errno;
+		debug_info("ERROR: sent only %llu of %llu bytes.", (unsigned long long)bytes, (unsigned long long)length);
+		errno = read_errno;
+	}
+	if (sent) {
+		*sent = bytes;
+	}
+
+	return res;
+}
+
 LIBIMOBILEDEVICE_API service_error_t service_receive_with_timeout(service_client_t client, char* data, uint32_t size, uint32_t *received, unsigned int timeout)
 {
 	service_error_t res = SERVICE_E_UNKNOWN_ERROR;
@@ -169,6 +338,26 @@ LIBIMOBILEDEVICE_API service_error_t service_receive_with_timeout(service_client
 	return res;
 }
 
+LIBIMOBILEDEVICE_API service_error_t service_receive_with_deadline(service_client_t client, char* data, uint32_t size, uint32_t *received, uint64_t deadline)
+{
+	service_error_t res = SERVICE_E_UNKNOWN_ERROR;
+	uint32_t bytes = 0;
+
+	if (!client || (client && !client->connection) || !data || (size == 0)) {
+		return SERVICE_E_INVALID_ARG;
+	}
+
+	res = idevice_to_service_error(idevice_connection_receive_deadline(client->connection, data, size, &bytes, deadline));
+	if (bytes == 0) {
+		debug_info("could not read data");
+	}
+	if (received) {
+		*received = bytes;
+	}
+
+	return res;
+}
+
 LIBIMOBILEDEVICE_API service_error_t service_receive(service_client_t client, char* data, uint32_t size, uint32_t *received)
 {
 	return service_receive_with_timeout(client, data, size, received, 10000);
@@ -188,3 +377,70 @@ LIBIMOBILEDEVICE_API service_error_t service_disable_ssl(service_client_t client
 	return idevice_to_service_error(idevice_connection_disable_ssl(client->connection));
 }
 
+void service_client_stats_message_sent(service_client_t client)
+{
+	mutex_lock(&client->stats_mutex);
+	client->messages_sent++;
+	if (client->measure_rtt && client->request_start == 0) {
+		client->request_start = get_monotonic_time_us();
+	}
+	mutex_unlock(&client->stats_mutex);
+}
+
+void service_client_stats_message_received(service_client_t client)
+{
+	mutex_lock(&client->stats_mutex);
+	client->messages_received++;
+	if (client->request_start == 0) {
+		mutex_unlock(&client->stats_mutex);
+		return;
+	}
+
+	uint64_t rtt = get_monotonic_time_us() - client->request_start;
+	uint64_t ms = rtt / 1000;
+	int bucket = 0;
+	while (ms > 0 && bucket < SERVICE_RTT_HISTOGRAM_BUCKETS - 1) {
+		ms >>= 1;
+		bucket++;
+	}
+	client->rtt_histogram[bucket]++;
+	client->rtt_count++;
+	client->rtt_total_us += rtt;
+	client->request_start = 0;
+	mutex_unlock(&client->stats_mutex);
+}
+
+void service_client_set_measure_rtt(service_client_t client, int enable)
+{
+	mutex_lock(&client->stats_mutex);
+	client->measure_rtt = (enable) ? 1 : 0;
+	client->request_start = 0;
+	mutex_unlock(&client->stats_mutex);
+}
+
+LIBIMOBILEDEVICE_API service_error_t service_client_get_stats(service_client_t client, service_client_stats_t *stats)
+{
+	if (!client || !stats)
+		return SERVICE_E_INVALID_ARG;
+
+	memset(stats, 0, sizeof(service_client_stats_t));
+	if (client->connection) {
+		idevice_connection_get_stats(client->connection, &stats->connection);
+	}
+	mutex_lock(&client->stats_mutex);
+	stats->messages_sent = client->messages_sent;
+	stats->messages_received = client->messages_received;
+	stats->rtt_count = client->rtt_count;
+	stats->rtt_total_us = client->rtt_total_us;
+	memcpy(stats->rtt_histogram, client->rtt_histogram, sizeof(stats->rtt_histogram));
+	mutex_unlock(&client->stats_mutex);
+	return SERVICE_E_SUCCESS;
+}
+
+LIBIMOBILEDEVICE_API service_error_t service_get_connection(service_client_t client, idevice_connection_t *connection)
+{
+	if (!client || !client->connection || !connection)
+		return SERVICE_E_INVALID_ARG;
+	*connection = client->connection;
+	return SERVICE_E_SUCCESS;
+}
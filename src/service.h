@@ -24,9 +24,40 @@
 #include "libimobiledevice/service.h"
 #include "libimobiledevice/lockdown.h"
 #include "idevice.h"
+#include "common/thread.h"
 
 struct service_client_private {
 	idevice_connection_t connection;
+	/* protects the counters below, messages may be sent and received by different threads */
+	mutex_t stats_mutex;
+	uint64_t messages_sent;
+	uint64_t messages_received;
+	/* 0 for services where the device sends messages on its own */
+	int measure_rtt;
+	/* send time of the pending request, 0 if none */
+	uint64_t request_start;
+	uint64_t rtt_count;
+	uint64_t rtt_total_us;
+	uint64_t rtt_histogram[SERVICE_RTT_HISTOGRAM_BUCKETS];
 };
 
+/**
+ * Account a message sent with the given service client.
+ */
+void service_client_stats_message_sent(service_client_t client);
+
+/**
+ * Account a message received with the given service client and measure the
+ * round trip if a request is pending.
+ */
+void service_client_stats_message_received(service_client_t client);
+
+/**
+ * Enable or disable measuring round trips for the given service client.
+ * It is enabled by default and should be disabled for services where
+ * received messages are not replies to the messages sent, e.g.
+ * notifications or requests initiated by the device.
+ */
+void service_client_set_measure_rtt(service_client_t client, int enable);
+
 #endif
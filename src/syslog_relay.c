@@ -55,6 +55,8 @@ static syslog_relay_error_t syslog_relay_error(service_error_t err)
 			return SYSLOG_RELAY_E_MUX_ERROR;
 		case SERVICE_E_SSL_ERROR:
 			return SYSLOG_RELAY_E_SSL_ERROR;
+		case SERVICE_E_CANCELLED:
+			return SYSLOG_RELAY_E_CANCELLED;
 		default:
 			break;
 	}
@@ -82,6 +84,9 @@ LIBIMOBILEDEVICE_API syslog_relay_error_t syslog_relay_client_new(idevice_t devi
 	syslog_relay_client_t client_loc = (syslog_relay_client_t) malloc(sizeof(struct syslog_relay_client_private));
 	client_loc->parent = parent;
 	client_loc->worker = (thread_t)NULL;
+	client_loc->cancel = NULL;
+	client_loc->reactor = NULL;
+	client_loc->reactor_data = NULL;
 
 	*client = client_loc;
 
@@ -101,14 +106,27 @@ LIBIMOBILEDEVICE_API syslog_relay_error_t syslog_relay_client_free(syslog_relay_
 	if (!client)
 		return SYSLOG_RELAY_E_INVALID_ARG;
 
-	syslog_relay_error_t err = syslog_relay_error(service_client_free(client->parent));
+	if (client->reactor) {
+		idevice_reactor_remove(client->reactor, client->parent->connection);
+		free(client->reactor_data);
+		client->reactor = NULL;
+		client->reactor_data = NULL;
+	}
+
+	service_client_t parent = client->parent;
 	client->parent = NULL;
 	if (client->worker) {
+		/* the worker must not use the connection after it is freed */
+		if (client->cancel)
+			idevice_cancel_trigger(client->cancel);
 		debug_info("Joining syslog capture callback worker thread");
 		thread_join(client->worker);
 		thread_free(client->worker);
 		client->worker = (thread_t)NULL;
 	}
+	syslog_relay_error_t err = syslog_relay_error(service_client_free(parent));
+	if (client->cancel)
+		idevice_cancel_free(client->cancel);
 	free(client);
 
 	return err;
@@ -149,10 +167,14 @@ void *syslog_relay_worker(void *arg)
 
 	debug_info("Running");
 
+	/* with a cancel token the worker is woken up by stop/free, without one
+	 * it has to check for them periodically */
+	unsigned int timeout = (srwt->client->cancel) ? 0 : 100;
+
 	while (srwt->client->parent) {
 		char c;
 		uint32_t bytes = 0;
-		ret = syslog_relay_receive_with_timeout(srwt->client, &c, 1, &bytes, 100);
+		ret = syslog_relay_receive_with_timeout(srwt->client, &c, 1, &bytes, timeout);
 		if ((bytes == 0) && (ret == SYSLOG_RELAY_E_SUCCESS)) {
 			continue;
 		} else if (ret < 0) {
@@ -173,6 +195,30 @@ void *syslog_relay_worker(void *arg)
 	return NULL;
 }
 
+/**
+ * Internally used reactor callback that forwards the available syslog data
+ * to the capture callback.
+ */
+static void syslog_relay_reactor_cb(idevice_connection_t connection, int events, void *user_data)
+{
+	struct syslog_relay_worker_thread *srwt = (struct syslog_relay_worker_thread*)user_data;
+	char buf[4096];
+	uint32_t bytes = 0;
+	uint32_t i;
+
+	syslog_relay_error_t ret = syslog_relay_receive_with_timeout(srwt->client, buf, sizeof(buf), &bytes, 1);
+	if ((ret < 0 && bytes == 0) || (bytes == 0 && (events & IDEVICE_REACTOR_ERROR))) {
+		debug_info("Connection to syslog relay interrupted");
+		idevice_reactor_remove(srwt->client->reactor, connection);
+		return;
+	}
+	for (i = 0; i < bytes; i++) {
+		if (buf[i] != 0) {
+			srwt->cbfunc(buf[i], srwt->user_data);
+		}
+	}
+}
+
 LIBIMOBILEDEVICE_API syslog_relay_error_t syslog_relay_start_capture(syslog_relay_client_t client, syslog_relay_receive_cb_t callback, void* user_data)
 {
 	if (!client || !callback)
@@ -180,7 +226,7 @@ LIBIMOBILEDEVICE_API syslog_relay_error_t syslog_relay_start_capture(syslog_rela
 
 	syslog_relay_error_t res = SYSLOG_RELAY_E_UNKNOWN_ERROR;
 
-	if (client->worker) {
+	if (client->worker || client->reactor) {
 		debug_info("Another syslog capture thread appears to be running already.");
 		return res;
 	}
@@ -192,8 +238,28 @@ LIBIMOBILEDEVICE_API syslog_relay_error_t syslog_relay_start_capture(syslog_rela
 		srwt->cbfunc = callback;
 		srwt->user_data = user_data;
 
-		if (thread_new(&client->worker, syslog_relay_worker, srwt) == 0) {
-			res = SYSLOG_RELAY_E_SUCCESS;
+		idevice_reactor_t reactor = idevice_get_default_reactor();
+		if (reactor) {
+			/* let the shared reactor drive the capture instead */
+			client->reactor = reactor;
+			client->reactor_data = srwt;
+			if (idevice_reactor_add(reactor, client->parent->connection, IDEVICE_REACTOR_READ, syslog_relay_reactor_cb, srwt) == IDEVICE_E_SUCCESS) {
+				return SYSLOG_RELAY_E_SUCCESS;
+			}
+			client->reactor = NULL;
+			client->reactor_data = NULL;
+			free(srwt);
+		} else {
+			if (!client->cancel && idevice_cancel_new(&client->cancel) != IDEVICE_E_SUCCESS) {
+				client->cancel = NULL;
+			}
+			idevice_connection_set_cancel(client->parent->connection, client->cancel);
+			if (thread_new(&client->worker, syslog_relay_worker, srwt) == 0) {
+				res = SYSLOG_RELAY_E_SUCCESS;
+			} else {
+				idevice_connection_set_cancel(client->parent->connection, NULL);
+				free(srwt);
+			}
 		}
 	}
 
@@ -202,15 +268,28 @@ LIBIMOBILEDEVICE_API syslog_relay_error_t syslog_relay_start_capture(syslog_rela
 
 LIBIMOBILEDEVICE_API syslog_relay_error_t syslog_relay_stop_capture(syslog_relay_client_t client)
 {
+	if (client->reactor) {
+		idevice_reactor_remove(client->reactor, client->parent->connection);
+		free(client->reactor_data);
+		client->reactor = NULL;
+		client->reactor_data = NULL;
+	}
+
 	if (client->worker) {
 		/* notify thread to finish */
 		service_client_t parent = client->parent;
 		client->parent = NULL;
+		if (client->cancel)
+			idevice_cancel_trigger(client->cancel);
 		/* join thread to make it exit */
 		thread_join(client->worker);
 		thread_free(client->worker);
 		client->worker = (thread_t)NULL;
 		client->parent = parent;
+		if (client->cancel) {
+			idevice_connection_set_cancel(parent->connection, NULL);
+			idevice_cancel_reset(client->cancel);
+		}
 	}
 
 	return SYSLOG_RELAY_E_SUCCESS;
@@ -29,6 +29,9 @@
 struct syslog_relay_client_private {
 	service_client_t parent;
 	thread_t worker;
+	idevice_cancel_t cancel;
+	idevice_reactor_t reactor;
+	void *reactor_data;
 };
 
 void *syslog_relay_worker(void *arg);
@@ -0,0 +1,465 @@
+/*
+ * plist_view_test.c
+ * Checks the binary plist view against libplist and its bounds checking
+ * with malformed input.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "src/property_list_view.h"
+
+/*
+ * [ 5 ] as binary plist: an array (object 0 at offset 8) referencing an
+ * integer (object 1 at offset 10), followed by the offset table at 12 and
+ * the trailer.
+ */
+#define VALID_SIZE 46
+#define OFS_ARRAY 8
+#define OFS_REF 9
+#define OFS_INT 10
+#define OFS_TABLE 12
+#define OFS_TRAILER 14
+
+static const uint8_t valid_plist[VALID_SIZE] = {
+	'b', 'p', 'l', 'i', 's', 't', '0', '0',
+	0xA1, 0x01,
+	0x10, 0x05,
+	0x08, 0x0A,
+	0, 0, 0, 0, 0, 0, 1, 1,
+	0, 0, 0, 0, 0, 0, 0, 2,
+	0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, OFS_TABLE
+};
+
+/*
+ * { "a": 1, "name": "x", "uni": "\u00e9\u20ac\U0001f600", "list": [ true, "a" ] }
+ * with the key "uni" and its value as UTF-16 strings and "a" used twice.
+ */
+static const uint8_t dict_objects[] = {
+	0xD4, 1, 2, 3, 4, 5, 6, 7, 8,
+	0x51, 'a',
+	0x54, 'n', 'a', 'm', 'e',
+	0x63, 0, 'u', 0, 'n', 0, 'i',
+	0x54, 'l', 'i', 's', 't',
+	0x10, 0x01,
+	0x51, 'x',
+	0x64, 0x00, 0xE9, 0x20, 0xAC, 0xD8, 0x3D, 0xDE, 0x00,
+	0xA2, 9, 1,
+	0x09
+};
+static const uint8_t dict_lengths[] = { 9, 2, 5, 7, 5, 2, 2, 9, 3, 1 };
+#define DICT_NUM_OBJECTS 10
+#define UNI_UTF8 "\xC3\xA9\xE2\x82\xAC\xF0\x9F\x98\x80"
+
+/* nested arrays each referencing the next one twice */
+#define NESTED_LEVELS 40
+
+static int failures = 0;
+
+#define CHECK(cond, msg) do { if (!(cond)) { fprintf(stderr, "FAIL: %s\n", msg); failures++; } } while (0)
+
+static void set_be64(uint8_t *p, uint64_t val)
+{
+	int i;
+	for (i = 7; i >= 0; i--) {
+		p[i] = (uint8_t)(val & 0xFF);
+		val >>= 8;
+	}
+}
+
+/* creates a view from a copy of data, NULL if it is rejected */
+static property_list_view_t view_from(const uint8_t *data, uint64_t size)
+{
+	property_list_view_t view = NULL;
+	char *copy = (char*)malloc(size);
+	memcpy(copy, data, size);
+	if (property_list_view_new_from_bin(copy, size, &view) != PROPERTY_LIST_SERVICE_E_SUCCESS) {
+		free(copy);
+		return NULL;
+	}
+	return view;
+}
+
+/*
+ * Assembles a binary plist with 1 byte offsets and references from the
+ * concatenated encoded objects, object 0 being the root.
+ *
+ * @return the size of the plist in buf.
+ */
+static uint64_t build_plist(uint8_t *buf, const uint8_t *objects, const uint8_t *lengths, int num_objects)
+{
+	uint64_t size = 8;
+	int i;
+
+	memcpy(buf, "bplist00", 8);
+	for (i = 0; i < num_objects; i++) {
+		memcpy(buf + size, objects, lengths[i]);
+		objects += lengths[i];
+		size += lengths[i];
+	}
+	uint64_t offset_table = size;
+	uint8_t offset = 8;
+	for (i = 0; i < num_objects; i++) {
+		buf[size++] = offset;
+		offset += lengths[i];
+	}
+	memset(buf + size, 0, 6);
+	buf[size + 6] = 1;
+	buf[size + 7] = 1;
+	set_be64(buf + size + 8, num_objects);
+	set_be64(buf + size + 16, 0);
+	set_be64(buf + size + 24, offset_table);
+	return size + 32;
+}
+
+/* compares two plists by value, dictionaries regardless of order */
+static int plists_equal(plist_t a, plist_t b)
+{
+	plist_type type = plist_get_node_type(a);
+	uint32_t i;
+	int res = 0;
+
+	if (!a || !b || type != plist_get_node_type(b))
+		return 0;
+
+	switch (type) {
+		case PLIST_BOOLEAN: {
+			uint8_t va = 0, vb = 0;
+			plist_get_bool_val(a, &va);
+			plist_get_bool_val(b, &vb);
+			return va == vb;
+			}
+		case PLIST_UINT: {
+			uint64_t va = 0, vb = 0;
+			plist_get_uint_val(a, &va);
+			plist_get_uint_val(b, &vb);
+			return va == vb;
+			}
+		case PLIST_STRING: {
+			char *va = NULL, *vb = NULL;
+			plist_get_string_val(a, &va);
+			plist_get_string_val(b, &vb);
+			res = (va && vb && strcmp(va, vb) == 0);
+			free(va);
+			free(vb);
+			return res;
+			}
+		case PLIST_ARRAY:
+			if (plist_array_get_size(a) != plist_array_get_size(b))
+				return 0;
+			for (i = 0; i < plist_array_get_size(a); i++) {
+				if (!plists_equal(plist_array_get_item(a, i), plist_array_get_item(b, i)))
+					return 0;
+			}
+			return 1;
+		case PLIST_DICT: {
+			plist_dict_iter iter = NULL;
+			char *key = NULL;
+			plist_t val = NULL;
+			if (plist_dict_get_size(a) != plist_dict_get_size(b))
+				return 0;
+			res = 1;
+			plist_dict_new_iter(a, &iter);
+			do {
+				key = NULL;
+				val = NULL;
+				plist_dict_next_item(a, iter, &key, &val);
+				if (val && !plists_equal(val, plist_dict_get_item(b, key)))
+					res = 0;
+				free(key);
+			} while (val);
+			free(iter);
+			return res;
+			}
+		default:
+			break;
+	}
+	return 0;
+}
+
+static void expect_rejected(const uint8_t *data, uint64_t size, const char *msg)
+{
+	property_list_view_t view = view_from(data, size);
+	CHECK(view == NULL, msg);
+	property_list_view_free(view);
+}
+
+static void test_valid(void)
+{
+	property_list_view_t view = view_from(valid_plist, VALID_SIZE);
+	CHECK(view != NULL, "valid plist rejected");
+	if (!view)
+		return;
+
+	property_list_view_node_t root = property_list_view_get_root(view);
+	CHECK(property_list_view_get_node_type(view, root) == PLIST_ARRAY, "root is not an array");
+	CHECK(property_list_view_get_size(view, root) == 1, "array size");
+
+	uint64_t val = 0;
+	property_list_view_get_uint_val(view, property_list_view_array_get_item(view, root, 0), &val);
+	CHECK(val == 5, "array item value");
+	CHECK(property_list_view_array_get_item(view, root, 1) == 0, "item past the end");
+
+	plist_t copy = property_list_view_copy_node(view, root);
+	CHECK(copy && plist_array_get_size(copy) == 1, "copy of root");
+	plist_free(copy);
+
+	property_list_view_free(view);
+}
+
+static void test_dict(void)
+{
+	uint8_t data[128];
+	uint64_t size = build_plist(data, dict_objects, dict_lengths, DICT_NUM_OBJECTS);
+	property_list_view_t view = view_from(data, size);
+	CHECK(view != NULL, "dict plist rejected");
+	if (!view)
+		return;
+
+	property_list_view_node_t root = property_list_view_get_root(view);
+	CHECK(property_list_view_get_node_type(view, root) == PLIST_DICT, "root is not a dict");
+	CHECK(property_list_view_get_size(view, root) == 4, "dict size");
+
+	/* lookup by key */
+	uint64_t uval = 0;
+	property_list_view_get_uint_val(view, property_list_view_dict_get_item(view, root, "a"), &uval);
+	CHECK(uval == 1, "value of key a");
+	char *str = NULL;
+	property_list_view_get_string_val(view, property_list_view_dict_get_item(view, root, "name"), &str);
+	CHECK(str && strcmp(str, "x") == 0, "value of key name");
+	free(str);
+	CHECK(property_list_view_dict_get_item(view, root, "nam") == 0, "key prefix matched");
+	CHECK(property_list_view_dict_get_item(view, root, "missing") == 0, "missing key matched");
+
+	/* UTF-16 key and value */
+	str = NULL;
+	property_list_view_get_string_val(view, property_list_view_dict_get_item(view, root, "uni"), &str);
+	CHECK(str && strcmp(str, UNI_UTF8) == 0, "UTF-16 key or value");
+	free(str);
+
+	/* access by index */
+	const char *keys[] = { "a", "name", "uni", "list" };
+	uint32_t i;
+	for (i = 0; i < 4; i++) {
+		char *key = NULL;
+		property_list_view_node_t item = property_list_view_dict_get_item_at(view, root, i, &key);
+		CHECK(item != 0 && key && strcmp(key, keys[i]) == 0, "key at index");
+		CHECK(item == property_list_view_dict_get_item(view, root, keys[i]), "item at index");
+		free(key);
+	}
+	char *key = (char*)"x";
+	CHECK(property_list_view_dict_get_item_at(view, root, 4, &key) == 0 && key == NULL, "item past the end of the dict");
+
+	property_list_view_node_t list = property_list_view_dict_get_item(view, root, "list");
+	uint8_t bval = 0;
+	property_list_view_get_bool_val(view, property_list_view_array_get_item(view, list, 0), &bval);
+	CHECK(bval == 1, "boolean in array");
+	str = NULL;
+	property_list_view_get_string_val(view, property_list_view_array_get_item(view, list, 1), &str);
+	CHECK(str && strcmp(str, "a") == 0, "shared string in array");
+	free(str);
+
+	/* the copy has to match what libplist decodes */
+	plist_t copy = property_list_view_copy_node(view, root);
+	plist_t expected = NULL;
+	plist_from_bin((const char*)data, (uint32_t)size, &expected);
+	CHECK(expected != NULL, "libplist rejected the dict plist");
+	CHECK(plists_equal(copy, expected), "copy differs from plist_from_bin");
+	plist_free(copy);
+	plist_free(expected);
+
+	property_list_view_free(view);
+}
+
+static void test_expansion(void)
+{
+	uint8_t objects[NESTED_LEVELS * 3 + 2];
+	uint8_t lengths[NESTED_LEVELS + 1];
+	uint8_t data[NESTED_LEVELS * 4 + 64];
+	int i;
+
+	for (i = 0; i < NESTED_LEVELS; i++) {
+		objects[i * 3] = 0xA2;
+		objects[i * 3 + 1] = (uint8_t)(i + 1);
+		objects[i * 3 + 2] = (uint8_t)(i + 1);
+		lengths[i] = 3;
+	}
+	objects[NESTED_LEVELS * 3] = 0x10;
+	objects[NESTED_LEVELS * 3 + 1] = 0x00;
+	lengths[NESTED_LEVELS] = 2;
+
+	uint64_t size = build_plist(data, objects, lengths, NESTED_LEVELS + 1);
+	property_list_view_t view = view_from(data, size);
+	CHECK(view != NULL, "nested plist rejected");
+	if (!view)
+		return;
+
+	property_list_view_node_t root = property_list_view_get_root(view);
+	CHECK(property_list_view_get_size(view, root) == 2, "nested array size");
+	/* 2^40 nodes if every reference was expanded */
+	CHECK(property_list_view_copy_node(view, root) == NULL, "copy of exponentially expanding plist");
+
+	property_list_view_free(view);
+}
+
+static void test_trailer(void)
+{
+	uint8_t data[VALID_SIZE];
+
+	expect_rejected(valid_plist, VALID_SIZE - 6, "truncated plist accepted");
+
+	memcpy(data, valid_plist, VALID_SIZE);
+	data[0] = 'x';
+	expect_rejected(data, VALID_SIZE, "bad magic accepted");
+
+	memcpy(data, valid_plist, VALID_SIZE);
+	data[OFS_TRAILER + 6] = 0;
+	expect_rejected(data, VALID_SIZE, "offset size 0 accepted");
+	data[OFS_TRAILER + 6] = 9;
+	expect_rejected(data, VALID_SIZE, "offset size 9 accepted");
+
+	memcpy(data, valid_plist, VALID_SIZE);
+	data[OFS_TRAILER + 7] = 0;
+	expect_rejected(data, VALID_SIZE, "ref size 0 accepted");
+	data[OFS_TRAILER + 7] = 9;
+	expect_rejected(data, VALID_SIZE, "ref size 9 accepted");
+
+	memcpy(data, valid_plist, VALID_SIZE);
+	set_be64(data + OFS_TRAILER + 8, 0);
+	expect_rejected(data, VALID_SIZE, "zero objects accepted");
+	set_be64(data + OFS_TRAILER + 8, 3);
+	expect_rejected(data, VALID_SIZE, "offset table past the trailer accepted");
+	set_be64(data + OFS_TRAILER + 8, UINT64_MAX);
+	expect_rejected(data, VALID_SIZE, "huge object count accepted");
+
+	memcpy(data, valid_plist, VALID_SIZE);
+	set_be64(data + OFS_TRAILER + 16, 2);
+	expect_rejected(data, VALID_SIZE, "root out of range accepted");
+
+	memcpy(data, valid_plist, VALID_SIZE);
+	set_be64(data + OFS_TRAILER + 24, 4);
+	expect_rejected(data, VALID_SIZE, "offset table inside the magic accepted");
+	set_be64(data + OFS_TRAILER + 24, OFS_TRAILER);
+	expect_rejected(data, VALID_SIZE, "offset table at the trailer accepted");
+	set_be64(data + OFS_TRAILER + 24, UINT64_MAX);
+	expect_rejected(data, VALID_SIZE, "offset table past the end accepted");
+}
+
+static void test_offsets(void)
+{
+	uint8_t data[VALID_SIZE];
+	property_list_view_t view;
+
+	/* integer object placed into the offset table */
+	memcpy(data, valid_plist, VALID_SIZE);
+	data[OFS_TABLE + 1] = OFS_TABLE;
+	view = view_from(data, VALID_SIZE);
+	CHECK(view != NULL, "plist with bad object offset rejected early");
+	if (view) {
+		property_list_view_node_t item = property_list_view_array_get_item(view, property_list_view_get_root(view), 0);
+		CHECK(property_list_view_get_node_type(view, item) == PLIST_NONE, "object in the offset table accessed");
+		CHECK(property_list_view_copy_node(view, property_list_view_get_root(view)) == NULL, "copy with bad object offset");
+		property_list_view_free(view);
+	}
+
+	/* integer object payload running into the offset table */
+	memcpy(data, valid_plist, VALID_SIZE);
+	data[OFS_INT] = 0x13;
+	view = view_from(data, VALID_SIZE);
+	if (view) {
+		uint64_t val = 1;
+		property_list_view_get_uint_val(view, property_list_view_array_get_item(view, property_list_view_get_root(view), 0), &val);
+		CHECK(val == 0, "integer read past the object area");
+		property_list_view_free(view);
+	}
+}
+
+static void test_counts(void)
+{
+	uint8_t data[VALID_SIZE];
+	property_list_view_t view;
+
+	/* array claiming more refs than there are bytes */
+	memcpy(data, valid_plist, VALID_SIZE);
+	data[OFS_ARRAY] = 0xA5;
+	view = view_from(data, VALID_SIZE);
+	if (view) {
+		property_list_view_node_t root = property_list_view_get_root(view);
+		CHECK(property_list_view_get_size(view, root) == 0, "oversized array count");
+		CHECK(property_list_view_array_get_item(view, root, 4) == 0, "item of oversized array");
+		CHECK(property_list_view_copy_node(view, root) == NULL, "copy of oversized array");
+		property_list_view_free(view);
+	}
+
+	/* extended count without the following integer */
+	memcpy(data, valid_plist, VALID_SIZE);
+	data[OFS_ARRAY] = 0xAF;
+	data[OFS_REF] = 0x00;
+	view = view_from(data, VALID_SIZE);
+	if (view) {
+		CHECK(property_list_view_get_size(view, property_list_view_get_root(view)) == 0, "invalid extended count");
+		property_list_view_free(view);
+	}
+}
+
+static void test_refs(void)
+{
+	uint8_t data[VALID_SIZE];
+	property_list_view_t view;
+
+	/* reference to an object that does not exist */
+	memcpy(data, valid_plist, VALID_SIZE);
+	data[OFS_REF] = 0x07;
+	view = view_from(data, VALID_SIZE);
+	if (view) {
+		property_list_view_node_t root = property_list_view_get_root(view);
+		CHECK(property_list_view_array_get_item(view, root, 0) == 0, "out of range reference");
+		CHECK(property_list_view_copy_node(view, root) == NULL, "copy with out of range reference");
+		property_list_view_free(view);
+	}
+
+	/* array containing itself */
+	memcpy(data, valid_plist, VALID_SIZE);
+	data[OFS_REF] = 0x00;
+	view = view_from(data, VALID_SIZE);
+	if (view) {
+		CHECK(property_list_view_copy_node(view, property_list_view_get_root(view)) == NULL, "copy of cyclic array");
+		property_list_view_free(view);
+	}
+}
+
+int main(int argc, char **argv)
+{
+	test_valid();
+	test_dict();
+	test_expansion();
+	test_trailer();
+	test_offsets();
+	test_counts();
+	test_refs();
+
+	if (failures > 0) {
+		fprintf(stderr, "%d checks failed\n", failures);
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,158 @@
+/*
+ * plist_wire_format_bench.c
+ * Compares the size and the encoding and decoding time of XML and binary
+ * plists for typical service messages.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <plist/plist.h>
+
+#include "src/sanitize_xml.h"
+#include "common/utils.h"
+
+/* number of encode and decode operations measured per message */
+#define BENCH_ITERATIONS 200
+
+/* a single command like the ones sent to mobile_image_mounter */
+static plist_t create_command(void)
+{
+	char signature[128];
+	memset(signature, 0xA5, sizeof(signature));
+
+	plist_t dict = plist_new_dict();
+	plist_dict_set_item(dict, "Command", plist_new_string("MountImage"));
+	plist_dict_set_item(dict, "ImagePath", plist_new_string("/private/var/mobile/Media/PublicStaging/staging.dimage"));
+	plist_dict_set_item(dict, "ImageSignature", plist_new_data(signature, sizeof(signature)));
+	plist_dict_set_item(dict, "ImageType", plist_new_string("Developer"));
+	return dict;
+}
+
+/* a page of an installation_proxy Browse response with count apps */
+static plist_t create_browse_page(int count)
+{
+	plist_t list = plist_new_array();
+	char str[128];
+	int i;
+
+	for (i = 0; i < count; i++) {
+		plist_t app = plist_new_dict();
+		snprintf(str, sizeof(str), "com.example.application%d", i);
+		plist_dict_set_item(app, "CFBundleIdentifier", plist_new_string(str));
+		snprintf(str, sizeof(str), "Application %d", i);
+		plist_dict_set_item(app, "CFBundleDisplayName", plist_new_string(str));
+		plist_dict_set_item(app, "CFBundleVersion", plist_new_string("1.0.42"));
+		plist_dict_set_item(app, "CFBundleShortVersionString", plist_new_string("1.0"));
+		snprintf(str, sizeof(str), "/private/var/containers/Bundle/Application/%08X-0000-0000-0000-000000000000/App%d.app", i * 2654435761u, i);
+		plist_dict_set_item(app, "Path", plist_new_string(str));
+		plist_dict_set_item(app, "ApplicationType", plist_new_string("User"));
+		plist_dict_set_item(app, "StaticDiskUsage", plist_new_uint(1024 * 1024 * (uint64_t)(i + 1)));
+		plist_dict_set_item(app, "IsUpgradeable", plist_new_bool(1));
+		plist_array_append_item(list, app);
+	}
+
+	plist_t dict = plist_new_dict();
+	plist_dict_set_item(dict, "CurrentAmount", plist_new_uint(count));
+	plist_dict_set_item(dict, "CurrentIndex", plist_new_uint(0));
+	plist_dict_set_item(dict, "CurrentList", list);
+	plist_dict_set_item(dict, "Status", plist_new_string("BrowsingApplications"));
+	plist_dict_set_item(dict, "Total", plist_new_uint(count));
+	return dict;
+}
+
+static void bench_message(const char *name, plist_t plist)
+{
+	char *xml = NULL;
+	char *bin = NULL;
+	uint32_t xml_size = 0;
+	uint32_t bin_size = 0;
+	uint64_t start;
+	uint64_t xml_enc, xml_dec, bin_enc, bin_dec;
+	int i;
+
+	start = get_monotonic_time_us();
+	for (i = 0; i < BENCH_ITERATIONS; i++) {
+		free(xml);
+		xml = NULL;
+		plist_to_xml(plist, &xml, &xml_size);
+	}
+	xml_enc = get_monotonic_time_us() - start;
+
+	start = get_monotonic_time_us();
+	for (i = 0; i < BENCH_ITERATIONS; i++) {
+		free(bin);
+		bin = NULL;
+		plist_to_bin(plist, &bin, &bin_size);
+	}
+	bin_enc = get_monotonic_time_us() - start;
+
+	if (!xml || !bin) {
+		fprintf(stderr, "%s: could not encode the message\n", name);
+		free(xml);
+		free(bin);
+		return;
+	}
+
+	/* decoding XML includes the sanitizing done by the receive path */
+	start = get_monotonic_time_us();
+	for (i = 0; i < BENCH_ITERATIONS; i++) {
+		plist_t decoded = NULL;
+		sanitize_xml(xml, xml_size);
+		plist_from_xml(xml, xml_size, &decoded);
+		plist_free(decoded);
+	}
+	xml_dec = get_monotonic_time_us() - start;
+
+	start = get_monotonic_time_us();
+	for (i = 0; i < BENCH_ITERATIONS; i++) {
+		plist_t decoded = NULL;
+		plist_from_bin(bin, bin_size, &decoded);
+		plist_free(decoded);
+	}
+	bin_dec = get_monotonic_time_us() - start;
+
+	printf("%-16s xml %8u bytes, encode %8.1f us, decode %8.1f us\n", name, xml_size,
+		(double)xml_enc / BENCH_ITERATIONS, (double)xml_dec / BENCH_ITERATIONS);
+	printf("%-16s bin %8u bytes, encode %8.1f us, decode %8.1f us\n", "", bin_size,
+		(double)bin_enc / BENCH_ITERATIONS, (double)bin_dec / BENCH_ITERATIONS);
+
+	free(xml);
+	free(bin);
+}
+
+int main(int argc, char **argv)
+{
+	plist_t plist;
+
+	plist = create_command();
+	bench_message("command", plist);
+	plist_free(plist);
+
+	plist = create_browse_page(20);
+	bench_message("browse page", plist);
+	plist_free(plist);
+
+	plist = create_browse_page(500);
+	bench_message("browse 500 apps", plist);
+	plist_free(plist);
+
+	return 0;
+}
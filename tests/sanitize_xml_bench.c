@@ -0,0 +1,97 @@
+/*
+ * sanitize_xml_bench.c
+ * Measures the throughput of the XML sanitizer variants.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#if defined(__i386__) || defined(__x86_64__)
+#include <x86intrin.h>
+#define HAVE_CYCLE_COUNTER 1
+#endif
+
+#include "sanitize_xml_variants.h"
+#include "common/utils.h"
+
+/* size of the buffer used for measuring */
+#define BENCH_SIZE (16 * 1024 * 1024)
+#define BENCH_ROUNDS 16
+
+static void bench_variant(const struct variant *v, const char *data, char *buf)
+{
+	uint64_t best_us = UINT64_MAX;
+#ifdef HAVE_CYCLE_COUNTER
+	uint64_t best_cycles = UINT64_MAX;
+#endif
+	int i;
+
+	for (i = 0; i < BENCH_ROUNDS; i++) {
+		memcpy(buf, data, BENCH_SIZE);
+		uint64_t start_us = get_monotonic_time_us();
+#ifdef HAVE_CYCLE_COUNTER
+		uint64_t start_cycles = __rdtsc();
+#endif
+		v->func(buf, BENCH_SIZE);
+#ifdef HAVE_CYCLE_COUNTER
+		uint64_t cycles = __rdtsc() - start_cycles;
+		if (cycles < best_cycles)
+			best_cycles = cycles;
+#endif
+		uint64_t us = get_monotonic_time_us() - start_us;
+		if (us < best_us)
+			best_us = us;
+	}
+	if (best_us == 0)
+		best_us = 1;
+
+#ifdef HAVE_CYCLE_COUNTER
+	printf("%-8s %8.3f bytes/cycle %10.1f MB/s\n", v->name, (double)BENCH_SIZE / (double)best_cycles, (double)BENCH_SIZE / (double)best_us);
+#else
+	printf("%-8s %10.1f MB/s\n", v->name, (double)BENCH_SIZE / (double)best_us);
+#endif
+}
+
+int main(int argc, char **argv)
+{
+	struct variant variants[MAX_VARIANTS];
+	int num_variants;
+	int i;
+
+	num_variants = get_variants(variants);
+
+	char *data = (char*)malloc(BENCH_SIZE);
+	char *buf = (char*)malloc(BENCH_SIZE);
+	if (!data || !buf) {
+		fprintf(stderr, "out of memory\n");
+		free(data);
+		free(buf);
+		return 1;
+	}
+	fill_buffer(data, BENCH_SIZE, 0);
+
+	for (i = 0; i < num_variants; i++) {
+		bench_variant(&variants[i], data, buf);
+	}
+
+	free(data);
+	free(buf);
+	return 0;
+}
@@ -0,0 +1,90 @@
+/*
+ * sanitize_xml_test.c
+ * Checks the vectorized XML sanitizers against the scalar one.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "sanitize_xml_variants.h"
+
+/* maximum length used for the comparison with the scalar variant */
+#define CHECK_MAX_LEN 320
+
+/**
+ * Compares a variant with sanitize_xml_scalar() for all lengths up to
+ * CHECK_MAX_LEN, so that every tail length is covered, at each alignment.
+ *
+ * @return 0 if the results match, -1 otherwise.
+ */
+static int check_variant(const struct variant *v)
+{
+	char *input = (char*)malloc(CHECK_MAX_LEN + 32);
+	char *expected = (char*)malloc(CHECK_MAX_LEN + 32);
+	char *actual = (char*)malloc(CHECK_MAX_LEN + 32);
+	uint32_t len;
+	uint32_t align;
+	int res = 0;
+
+	if (!input || !expected || !actual) {
+		fprintf(stderr, "out of memory\n");
+		res = -1;
+	}
+
+	for (len = 0; len <= CHECK_MAX_LEN && res == 0; len++) {
+		for (align = 0; align < 32; align++) {
+			fill_buffer(input, CHECK_MAX_LEN + 32, 1);
+			memcpy(expected, input, CHECK_MAX_LEN + 32);
+			memcpy(actual, input, CHECK_MAX_LEN + 32);
+			sanitize_xml_scalar(expected + align, len);
+			v->func(actual + align, len);
+			if (memcmp(expected, actual, CHECK_MAX_LEN + 32) != 0) {
+				fprintf(stderr, "FAIL: %s differs from scalar at length %u, alignment %u\n", v->name, len, align);
+				res = -1;
+				break;
+			}
+		}
+	}
+
+	free(input);
+	free(expected);
+	free(actual);
+	return res;
+}
+
+int main(int argc, char **argv)
+{
+	struct variant variants[MAX_VARIANTS];
+	int num_variants;
+	int failures = 0;
+	int i;
+
+	num_variants = get_variants(variants);
+	for (i = 1; i < num_variants; i++) {
+		if (check_variant(&variants[i]) < 0) {
+			failures++;
+		} else {
+			printf("%-8s matches scalar\n", variants[i].name);
+		}
+	}
+
+	return (failures > 0) ? 1 : 0;
+}
@@ -0,0 +1,96 @@
+/*
+ * sanitize_xml_variants.h
+ * The XML sanitizer variants available on this CPU, shared by
+ * sanitize_xml_test and sanitize_xml_bench.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef __SANITIZE_XML_VARIANTS_H
+#define __SANITIZE_XML_VARIANTS_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "src/sanitize_xml.h"
+
+#define MAX_VARIANTS 4
+
+typedef void (*sanitize_func_t)(char *buf, uint32_t len);
+
+struct variant {
+	const char *name;
+	sanitize_func_t func;
+};
+
+static uint32_t rand_state = 0x2545f491;
+
+static uint8_t next_byte(void)
+{
+	/* xorshift, so every run uses the same data */
+	rand_state ^= rand_state << 13;
+	rand_state ^= rand_state >> 17;
+	rand_state ^= rand_state << 5;
+	return (uint8_t)(rand_state >> 24);
+}
+
+/* fills buf with mostly printable text and some control and non-ASCII bytes */
+static void fill_buffer(char *buf, uint32_t len, int all_bytes)
+{
+	uint32_t i;
+	for (i = 0; i < len; i++) {
+		uint8_t c = next_byte();
+		if (!all_bytes && (c & 0xC0)) {
+			c = 0x20 + (c % 0x5F);
+		}
+		buf[i] = (char)c;
+	}
+}
+
+/**
+ * Collects the variants supported by this CPU, the scalar one first and
+ * the dispatching one last.
+ *
+ * @return the number of variants stored in variants.
+ */
+static int get_variants(struct variant variants[MAX_VARIANTS])
+{
+	int num_variants = 0;
+
+	variants[num_variants].name = "scalar";
+	variants[num_variants++].func = sanitize_xml_scalar;
+#if defined(__SSE2__)
+	variants[num_variants].name = "sse2";
+	variants[num_variants++].func = sanitize_xml_sse2;
+#ifdef HAVE_AVX2_DISPATCH
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) {
+		variants[num_variants].name = "avx2";
+		variants[num_variants++].func = sanitize_xml_avx2;
+	} else {
+		printf("avx2     not supported by this CPU, skipped\n");
+	}
+#endif
+#elif defined(HAVE_NEON)
+	variants[num_variants].name = "neon";
+	variants[num_variants++].func = sanitize_xml_neon;
+#endif
+	variants[num_variants].name = "dispatch";
+	variants[num_variants++].func = sanitize_xml;
+
+	return num_variants;
+}
+
+#endif
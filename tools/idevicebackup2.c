@@ -58,6 +58,9 @@
 #define CODE_ERROR_REMOTE 0x0b
 #define CODE_FILE_DATA 0x0c
 
+/* maximum amount of file data sent in a single CODE_FILE_DATA frame */
+#define FILE_DATA_FRAME_SIZE (8 * 1024 * 1024)
+
 static int verbose = 1;
 static int quit_flag = 0;
 
@@ -404,7 +407,7 @@ static void mb2_set_overall_progress(double progress)
 		overall_progress = progress;
 }
 
-static void mb2_set_overall_progress_from_message(plist_t message, char* identifier)
+static void mb2_set_overall_progress_from_message(plist_t message, const char* identifier)
 {
 	plist_t node = NULL;
 	double progress = 0.0;
@@ -541,7 +544,7 @@ static int mb2_handle_send_file(mobilebackup2_client_t mobilebackup2, const char
 
 	sent = 0;
 	do {
-		length = ((total-sent) < (long long)sizeof(buf)) ? (uint32_t)total-sent : (uint32_t)sizeof(buf);
+		length = ((total-sent) < FILE_DATA_FRAME_SIZE) ? (uint32_t)(total-sent) : FILE_DATA_FRAME_SIZE;
 		/* send data size (file size + 1) */
 		nlen = htobe32(length+1);
 		memcpy(buf, &nlen, sizeof(nlen));
@@ -555,21 +558,23 @@ static int mb2_handle_send_file(mobilebackup2_client_t mobilebackup2, const char
 		}
 
 		/* send file contents */
-		size_t r = fread(buf, 1, sizeof(buf), f);
-		if (r <= 0) {
-			printf("%s: read error\n", __func__);
-			errcode = errno;
+		uint64_t fbytes = 0;
+		int read_error = 0;
+		err = mobilebackup2_send_raw_file(mobilebackup2, fileno(f), sent, length, &fbytes, &read_error);
+		if (err == MOBILEBACKUP2_E_NOT_ENOUGH_DATA) {
+			printf("%s: read error: %d\n", __func__, read_error);
+			/* no error means the file got shorter since it was stat'ed */
+			errcode = (read_error) ? read_error : EIO;
 			goto leave;
 		}
-		err = mobilebackup2_send_raw(mobilebackup2, buf, r, &bytes);
 		if (err != MOBILEBACKUP2_E_SUCCESS) {
 			goto leave_proto_err;
 		}
-		if (bytes != (uint32_t)r) {
-			printf("Error: sent only %d of %d bytes\n", bytes, (int)r);
+		if (fbytes != length) {
+			printf("Error: sent only %d of %d bytes\n", (int)fbytes, (int)length);
 			goto leave_proto_err;
 		}
-		sent += r;
+		sent += length;
 	} while (sent < total);
 	fclose(f);
 	f = NULL;
@@ -1032,6 +1037,329 @@ static void mb2_copy_directory_by_path(const char *src, const char *dst)
 	}
 }
 
+struct mb2_dl_state {
+	mobilebackup2_client_t mobilebackup2;
+	const char *backup_dir;
+	int file_count;
+	int operation_ok;
+	int result_code;
+};
+
+enum {
+	MB2_DL_CONTINUE = 0,
+	MB2_DL_DONE = 1
+};
+
+static int mb2_dl_download_files(plist_t message, const char *dlmessage, void *user_data)
+{
+	struct mb2_dl_state *state = (struct mb2_dl_state*)user_data;
+
+	/* device wants to download files from the computer */
+	mb2_set_overall_progress_from_message(message, dlmessage);
+	mb2_handle_send_files(state->mobilebackup2, message, state->backup_dir);
+	return MB2_DL_CONTINUE;
+}
+
+static int mb2_dl_upload_files(plist_t message, const char *dlmessage, void *user_data)
+{
+	struct mb2_dl_state *state = (struct mb2_dl_state*)user_data;
+
+	/* device wants to send files to the computer */
+	mb2_set_overall_progress_from_message(message, dlmessage);
+	state->file_count += mb2_handle_receive_files(state->mobilebackup2, message, state->backup_dir);
+	return MB2_DL_CONTINUE;
+}
+
+static int mb2_dl_get_free_disk_space(plist_t message, const char *dlmessage, void *user_data)
+{
+	struct mb2_dl_state *state = (struct mb2_dl_state*)user_data;
+
+	/* device wants to know how much disk space is available on the computer */
+	uint64_t freespace = 0;
+	int res = -1;
+#ifdef WIN32
+	if (GetDiskFreeSpaceEx(state->backup_dir, (PULARGE_INTEGER)&freespace, NULL, NULL)) {
+		res = 0;
+	}
+#else
+	struct statvfs fs;
+	memset(&fs, '\0', sizeof(fs));
+	res = statvfs(state->backup_dir, &fs);
+	if (res == 0) {
+		freespace = (uint64_t)fs.f_bavail * (uint64_t)fs.f_bsize;
+	}
+#endif
+	plist_t freespace_item = plist_new_uint(freespace);
+	mobilebackup2_send_status_response(state->mobilebackup2, res, NULL, freespace_item);
+	plist_free(freespace_item);
+	return MB2_DL_CONTINUE;
+}
+
+static int mb2_dl_contents_of_directory(plist_t message, const char *dlmessage, void *user_data)
+{
+	struct mb2_dl_state *state = (struct mb2_dl_state*)user_data;
+
+	/* list directory contents */
+	mb2_handle_list_directory(state->mobilebackup2, message, state->backup_dir);
+	return MB2_DL_CONTINUE;
+}
+
+static int mb2_dl_create_directory(plist_t message, const char *dlmessage, void *user_data)
+{
+	struct mb2_dl_state *state = (struct mb2_dl_state*)user_data;
+
+	/* make a directory */
+	mb2_handle_make_directory(state->mobilebackup2, message, state->backup_dir);
+	return MB2_DL_CONTINUE;
+}
+
+static int mb2_dl_move_items(plist_t message, const char *dlmessage, void *user_data)
+{
+	struct mb2_dl_state *state = (struct mb2_dl_state*)user_data;
+	int errcode = 0;
+	const char *errdesc = NULL;
+#ifdef WIN32
+	struct stat st;
+#endif
+
+	/* perform a series of rename operations */
+	mb2_set_overall_progress_from_message(message, dlmessage);
+	plist_t moves = plist_array_get_item(message, 1);
+	uint32_t cnt = plist_dict_get_size(moves);
+	PRINT_VERBOSE(1, "Moving %d file%s\n", cnt, (cnt == 1) ? "" : "s");
+	plist_dict_iter iter = NULL;
+	plist_dict_new_iter(moves, &iter);
+	if (iter) {
+		char *key = NULL;
+		plist_t val = NULL;
+		do {
+			plist_dict_next_item(moves, iter, &key, &val);
+			if (key && (plist_get_node_type(val) == PLIST_STRING)) {
+				char *str = NULL;
+				plist_get_string_val(val, &str);
+				if (str) {
+					char *newpath = string_build_path(state->backup_dir, str, NULL);
+					free(str);
+					char *oldpath = string_build_path(state->backup_dir, key, NULL);
+
+#ifdef WIN32
+					if ((stat(newpath, &st) == 0) && S_ISDIR(st.st_mode))
+						RemoveDirectory(newpath);
+					else
+						DeleteFile(newpath);
+#else
+					remove(newpath);
+#endif
+					if (rename(oldpath, newpath) < 0) {
+						printf("Renameing '%s' to '%s' failed: %s (%d)\n", oldpath, newpath, strerror(errno), errno);
+						errcode = errno_to_device_error(errno);
+						errdesc = strerror(errno);
+						break;
+					}
+					free(oldpath);
+					free(newpath);
+				}
+				free(key);
+				key = NULL;
+			}
+		} while (val);
+		free(iter);
+	} else {
+		errcode = -1;
+		errdesc = "Could not create dict iterator";
+		printf("Could not create dict iterator\n");
+	}
+	plist_t empty_dict = plist_new_dict();
+	mobilebackup2_error_t err = mobilebackup2_send_status_response(state->mobilebackup2, errcode, errdesc, empty_dict);
+	plist_free(empty_dict);
+	if (err != MOBILEBACKUP2_E_SUCCESS) {
+		printf("Could not send status response, error %d\n", err);
+	}
+	return MB2_DL_CONTINUE;
+}
+
+static int mb2_dl_remove_items(plist_t message, const char *dlmessage, void *user_data)
+{
+	struct mb2_dl_state *state = (struct mb2_dl_state*)user_data;
+	int errcode = 0;
+	const char *errdesc = NULL;
+#ifdef WIN32
+	struct stat st;
+#endif
+
+	mb2_set_overall_progress_from_message(message, dlmessage);
+	plist_t removes = plist_array_get_item(message, 1);
+	uint32_t cnt = plist_array_get_size(removes);
+	PRINT_VERBOSE(1, "Removing %d file%s\n", cnt, (cnt == 1) ? "" : "s");
+	uint32_t ii = 0;
+	for (ii = 0; ii < cnt; ii++) {
+		plist_t val = plist_array_get_item(removes, ii);
+		if (plist_get_node_type(val) == PLIST_STRING) {
+			char *str = NULL;
+			plist_get_string_val(val, &str);
+			if (str) {
+				const char *checkfile = strchr(str, '/');
+				int suppress_warning = 0;
+				if (checkfile) {
+					if (strcmp(checkfile+1, "Manifest.mbdx") == 0) {
+						suppress_warning = 1;
+					}
+				}
+				char *newpath = string_build_path(state->backup_dir, str, NULL);
+				free(str);
+#ifdef WIN32
+				int res = 0;
+				if ((stat(newpath, &st) == 0) && S_ISDIR(st.st_mode))
+					res = RemoveDirectory(newpath);
+				else
+					res = DeleteFile(newpath);
+				if (!res) {
+					int e = win32err_to_errno(GetLastError());
+					if (!suppress_warning)
+						printf("Could not remove '%s': %s (%d)\n", newpath, strerror(e), e);
+					errcode = errno_to_device_error(e);
+					errdesc = strerror(e);
+				}
+#else
+				if (remove(newpath) < 0) {
+					if (!suppress_warning)
+						printf("Could not remove '%s': %s (%d)\n", newpath, strerror(errno), errno);
+					errcode = errno_to_device_error(errno);
+					errdesc = strerror(errno);
+				}
+#endif
+				free(newpath);
+			}
+		}
+	}
+	plist_t empty_dict = plist_new_dict();
+	mobilebackup2_error_t err = mobilebackup2_send_status_response(state->mobilebackup2, errcode, errdesc, empty_dict);
+	plist_free(empty_dict);
+	if (err != MOBILEBACKUP2_E_SUCCESS) {
+		printf("Could not send status response, error %d\n", err);
+	}
+	return MB2_DL_CONTINUE;
+}
+
+static int mb2_dl_copy_item(plist_t message, const char *dlmessage, void *user_data)
+{
+	struct mb2_dl_state *state = (struct mb2_dl_state*)user_data;
+	struct stat st;
+
+	plist_t srcpath = plist_array_get_item(message, 1);
+	plist_t dstpath = plist_array_get_item(message, 2);
+	if ((plist_get_node_type(srcpath) == PLIST_STRING) && (plist_get_node_type(dstpath) == PLIST_STRING)) {
+		char *src = NULL;
+		char *dst = NULL;
+		plist_get_string_val(srcpath, &src);
+		plist_get_string_val(dstpath, &dst);
+		if (src && dst) {
+			char *oldpath = string_build_path(state->backup_dir, src, NULL);
+			char *newpath = string_build_path(state->backup_dir, dst, NULL);
+
+			PRINT_VERBOSE(1, "Copying '%s' to '%s'\n", src, dst);
+
+			/* check that src exists */
+			if ((stat(oldpath, &st) == 0) && S_ISDIR(st.st_mode)) {
+				mb2_copy_directory_by_path(oldpath, newpath);
+			} else if ((stat(oldpath, &st) == 0) && S_ISREG(st.st_mode)) {
+				mb2_copy_file_by_path(oldpath, newpath);
+			}
+
+			free(newpath);
+			free(oldpath);
+		}
+		free(src);
+		free(dst);
+	}
+	plist_t empty_dict = plist_new_dict();
+	mobilebackup2_error_t err = mobilebackup2_send_status_response(state->mobilebackup2, 0, NULL, empty_dict);
+	plist_free(empty_dict);
+	if (err != MOBILEBACKUP2_E_SUCCESS) {
+		printf("Could not send status response, error %d\n", err);
+	}
+	return MB2_DL_CONTINUE;
+}
+
+static int mb2_dl_disconnect(plist_t message, const char *dlmessage, void *user_data)
+{
+	return MB2_DL_DONE;
+}
+
+static int mb2_dl_process_message(plist_t message, const char *dlmessage, void *user_data)
+{
+	struct mb2_dl_state *state = (struct mb2_dl_state*)user_data;
+
+	plist_t node_tmp = plist_array_get_item(message, 1);
+	if (plist_get_node_type(node_tmp) != PLIST_DICT) {
+		printf("Unknown message received!\n");
+	}
+	plist_t nn;
+	int error_code = -1;
+	nn = plist_dict_get_item(node_tmp, "ErrorCode");
+	if (nn && (plist_get_node_type(nn) == PLIST_UINT)) {
+		uint64_t ec = 0;
+		plist_get_uint_val(nn, &ec);
+		error_code = (uint32_t)ec;
+		if (error_code == 0) {
+			state->operation_ok = 1;
+			state->result_code = 0;
+		} else {
+			state->result_code = -error_code;
+		}
+	}
+	nn = plist_dict_get_item(node_tmp, "ErrorDescription");
+	char *str = NULL;
+	if (nn && (plist_get_node_type(nn) == PLIST_STRING)) {
+		plist_get_string_val(nn, &str);
+	}
+	if (error_code != 0) {
+		if (str) {
+			printf("ErrorCode %d: %s\n", error_code, str);
+		} else {
+			printf("ErrorCode %d: (Unknown)\n", error_code);
+		}
+	}
+	if (str) {
+		free(str);
+	}
+	nn = plist_dict_get_item(node_tmp, "Content");
+	if (nn && (plist_get_node_type(nn) == PLIST_STRING)) {
+		str = NULL;
+		plist_get_string_val(nn, &str);
+		PRINT_VERBOSE(1, "Content:\n");
+		printf("%s", str);
+		free(str);
+	}
+	return MB2_DL_DONE;
+}
+
+static void mb2_register_dl_handlers(mobilebackup2_client_t mobilebackup2)
+{
+	static const struct {
+		const char *dlmessage;
+		mobilebackup2_message_handler_t handler;
+	} handlers[] = {
+		{ "DLMessageDownloadFiles", mb2_dl_download_files },
+		{ "DLMessageUploadFiles", mb2_dl_upload_files },
+		{ "DLMessageGetFreeDiskSpace", mb2_dl_get_free_disk_space },
+		{ "DLContentsOfDirectory", mb2_dl_contents_of_directory },
+		{ "DLMessageCreateDirectory", mb2_dl_create_directory },
+		{ "DLMessageMoveFiles", mb2_dl_move_items },
+		{ "DLMessageMoveItems", mb2_dl_move_items },
+		{ "DLMessageRemoveFiles", mb2_dl_remove_items },
+		{ "DLMessageRemoveItems", mb2_dl_remove_items },
+		{ "DLMessageCopyItem", mb2_dl_copy_item },
+		{ "DLMessageDisconnect", mb2_dl_disconnect },
+		{ "DLMessageProcessMessage", mb2_dl_process_message },
+		{ NULL, NULL }
+	};
+	int i;
+	for (i = 0; handlers[i].dlmessage; i++) {
+		mobilebackup2_set_message_handler(mobilebackup2, handlers[i].dlmessage, handlers[i].handler);
+	}
+}
+
 #ifdef WIN32
 #define BS_CC '\b'
 #define my_getch getch
@@ -1813,266 +2141,29 @@ checkpoint:
 
 		if (cmd != CMD_LEAVE) {
 			/* reset operation success status */
-			int operation_ok = 0;
-			plist_t message = NULL;
+			struct mb2_dl_state dlstate;
+			memset(&dlstate, '\0', sizeof(dlstate));
+			dlstate.mobilebackup2 = mobilebackup2;
+			dlstate.backup_dir = backup_directory;
+			dlstate.result_code = result_code;
 
-			char *dlmsg = NULL;
-			int file_count = 0;
-			int errcode = 0;
-			const char *errdesc = NULL;
+			mb2_register_dl_handlers(mobilebackup2);
 
 			/* process series of DLMessage* operations */
 			do {
-				if (dlmsg) {
-					free(dlmsg);
-					dlmsg = NULL;
-				}
-				mobilebackup2_receive_message(mobilebackup2, &message, &dlmsg);
-				if (!message || !dlmsg) {
+				int res = MB2_DL_CONTINUE;
+				err = mobilebackup2_dispatch_message(mobilebackup2, &dlstate, &res);
+				if (err != MOBILEBACKUP2_E_SUCCESS) {
 					PRINT_VERBOSE(1, "Device is not ready yet. Going to try again in 2 seconds...\n");
 					sleep(2);
-					goto files_out;
-				}
-
-				if (!strcmp(dlmsg, "DLMessageDownloadFiles")) {
-					/* device wants to download files from the computer */
-					mb2_set_overall_progress_from_message(message, dlmsg);
-					mb2_handle_send_files(mobilebackup2, message, backup_directory);
-				} else if (!strcmp(dlmsg, "DLMessageUploadFiles")) {
-					/* device wants to send files to the computer */
-					mb2_set_overall_progress_from_message(message, dlmsg);
-					file_count += mb2_handle_receive_files(mobilebackup2, message, backup_directory);
-				} else if (!strcmp(dlmsg, "DLMessageGetFreeDiskSpace")) {
-					/* device wants to know how much disk space is available on the computer */
-					uint64_t freespace = 0;
-					int res = -1;
-#ifdef WIN32
-					if (GetDiskFreeSpaceEx(backup_directory, (PULARGE_INTEGER)&freespace, NULL, NULL)) {
-						res = 0;
-					}
-#else
-					struct statvfs fs;
-					memset(&fs, '\0', sizeof(fs));
-					res = statvfs(backup_directory, &fs);
-					if (res == 0) {
-						freespace = (uint64_t)fs.f_bavail * (uint64_t)fs.f_bsize;
-					}
-#endif
-					plist_t freespace_item = plist_new_uint(freespace);
-					mobilebackup2_send_status_response(mobilebackup2, res, NULL, freespace_item);
-					plist_free(freespace_item);
-				} else if (!strcmp(dlmsg, "DLContentsOfDirectory")) {
-					/* list directory contents */
-					mb2_handle_list_directory(mobilebackup2, message, backup_directory);
-				} else if (!strcmp(dlmsg, "DLMessageCreateDirectory")) {
-					/* make a directory */
-					mb2_handle_make_directory(mobilebackup2, message, backup_directory);
-				} else if (!strcmp(dlmsg, "DLMessageMoveFiles") || !strcmp(dlmsg, "DLMessageMoveItems")) {
-					/* perform a series of rename operations */
-					mb2_set_overall_progress_from_message(message, dlmsg);
-					plist_t moves = plist_array_get_item(message, 1);
-					uint32_t cnt = plist_dict_get_size(moves);
-					PRINT_VERBOSE(1, "Moving %d file%s\n", cnt, (cnt == 1) ? "" : "s");
-					plist_dict_iter iter = NULL;
-					plist_dict_new_iter(moves, &iter);
-					errcode = 0;
-					errdesc = NULL;
-					if (iter) {
-						char *key = NULL;
-						plist_t val = NULL;
-						do {
-							plist_dict_next_item(moves, iter, &key, &val);
-							if (key && (plist_get_node_type(val) == PLIST_STRING)) {
-								char *str = NULL;
-								plist_get_string_val(val, &str);
-								if (str) {
-									char *newpath = string_build_path(backup_directory, str, NULL);
-									free(str);
-									char *oldpath = string_build_path(backup_directory, key, NULL);
-
-#ifdef WIN32
-									if ((stat(newpath, &st) == 0) && S_ISDIR(st.st_mode))
-										RemoveDirectory(newpath);
-									else
-										DeleteFile(newpath);
-#else
-									remove(newpath);
-#endif
-									if (rename(oldpath, newpath) < 0) {
-										printf("Renameing '%s' to '%s' failed: %s (%d)\n", oldpath, newpath, strerror(errno), errno);
-										errcode = errno_to_device_error(errno);
-										errdesc = strerror(errno);
-										break;
-									}
-									free(oldpath);
-									free(newpath);
-								}
-								free(key);
-								key = NULL;
-							}
-						} while (val);
-						free(iter);
-					} else {
-						errcode = -1;
-						errdesc = "Could not create dict iterator";
-						printf("Could not create dict iterator\n");
-					}
-					plist_t empty_dict = plist_new_dict();
-					err = mobilebackup2_send_status_response(mobilebackup2, errcode, errdesc, empty_dict);
-					plist_free(empty_dict);
-					if (err != MOBILEBACKUP2_E_SUCCESS) {
-						printf("Could not send status response, error %d\n", err);
-					}
-				} else if (!strcmp(dlmsg, "DLMessageRemoveFiles") || !strcmp(dlmsg, "DLMessageRemoveItems")) {
-					mb2_set_overall_progress_from_message(message, dlmsg);
-					plist_t removes = plist_array_get_item(message, 1);
-					uint32_t cnt = plist_array_get_size(removes);
-					PRINT_VERBOSE(1, "Removing %d file%s\n", cnt, (cnt == 1) ? "" : "s");
-					uint32_t ii = 0;
-					errcode = 0;
-					errdesc = NULL;
-					for (ii = 0; ii < cnt; ii++) {
-						plist_t val = plist_array_get_item(removes, ii);
-						if (plist_get_node_type(val) == PLIST_STRING) {
-							char *str = NULL;
-							plist_get_string_val(val, &str);
-							if (str) {
-								const char *checkfile = strchr(str, '/');
-								int suppress_warning = 0;
-								if (checkfile) {
-									if (strcmp(checkfile+1, "Manifest.mbdx") == 0) {
-										suppress_warning = 1;
-									}
-								}
-								char *newpath = string_build_path(backup_directory, str, NULL);
-								free(str);
-#ifdef WIN32
-								int res = 0;
-								if ((stat(newpath, &st) == 0) && S_ISDIR(st.st_mode))
-									res = RemoveDirectory(newpath);
-								else
-									res = DeleteFile(newpath);
-								if (!res) {
-									int e = win32err_to_errno(GetLastError());
-									if (!suppress_warning)
-										printf("Could not remove '%s': %s (%d)\n", newpath, strerror(e), e);
-									errcode = errno_to_device_error(e);
-									errdesc = strerror(e);
-								}
-#else
-								if (remove(newpath) < 0) {
-									if (!suppress_warning)
-										printf("Could not remove '%s': %s (%d)\n", newpath, strerror(errno), errno);
-									errcode = errno_to_device_error(errno);
-									errdesc = strerror(errno);
-								}
-#endif
-								free(newpath);
-							}
-						}
-					}
-					plist_t empty_dict = plist_new_dict();
-					err = mobilebackup2_send_status_response(mobilebackup2, errcode, errdesc, empty_dict);
-					plist_free(empty_dict);
-					if (err != MOBILEBACKUP2_E_SUCCESS) {
-						printf("Could not send status response, error %d\n", err);
-					}
-				} else if (!strcmp(dlmsg, "DLMessageCopyItem")) {
-					plist_t srcpath = plist_array_get_item(message, 1);
-					plist_t dstpath = plist_array_get_item(message, 2);
-					errcode = 0;
-					errdesc = NULL;
-					if ((plist_get_node_type(srcpath) == PLIST_STRING) && (plist_get_node_type(dstpath) == PLIST_STRING)) {
-						char *src = NULL;
-						char *dst = NULL;
-						plist_get_string_val(srcpath, &src);
-						plist_get_string_val(dstpath, &dst);
-						if (src && dst) {
-							char *oldpath = string_build_path(backup_directory, src, NULL);
-							char *newpath = string_build_path(backup_directory, dst, NULL);
-
-							PRINT_VERBOSE(1, "Copying '%s' to '%s'\n", src, dst);
-
-							/* check that src exists */
-							if ((stat(oldpath, &st) == 0) && S_ISDIR(st.st_mode)) {
-								mb2_copy_directory_by_path(oldpath, newpath);
-							} else if ((stat(oldpath, &st) == 0) && S_ISREG(st.st_mode)) {
-								mb2_copy_file_by_path(oldpath, newpath);
-							}
-
-							free(newpath);
-							free(oldpath);
-						}
-						free(src);
-						free(dst);
-					}
-					plist_t empty_dict = plist_new_dict();
-					err = mobilebackup2_send_status_response(mobilebackup2, errcode, errdesc, empty_dict);
-					plist_free(empty_dict);
-					if (err != MOBILEBACKUP2_E_SUCCESS) {
-						printf("Could not send status response, error %d\n", err);
-					}
-				} else if (!strcmp(dlmsg, "DLMessageDisconnect")) {
-					break;
-				} else if (!strcmp(dlmsg, "DLMessageProcessMessage")) {
-					node_tmp = plist_array_get_item(message, 1);
-					if (plist_get_node_type(node_tmp) != PLIST_DICT) {
-						printf("Unknown message received!\n");
-					}
-					plist_t nn;
-					int error_code = -1;
-					nn = plist_dict_get_item(node_tmp, "ErrorCode");
-					if (nn && (plist_get_node_type(nn) == PLIST_UINT)) {
-						uint64_t ec = 0;
-						plist_get_uint_val(nn, &ec);
-						error_code = (uint32_t)ec;
-						if (error_code == 0) {
-							operation_ok = 1;
-							result_code = 0;
-						} else {
-							result_code = -error_code;
-						}
-					}
-					nn = plist_dict_get_item(node_tmp, "ErrorDescription");
-					char *str = NULL;
-					if (nn && (plist_get_node_type(nn) == PLIST_STRING)) {
-						plist_get_string_val(nn, &str);
-					}
-					if (error_code != 0) {
-						if (str) {
-							printf("ErrorCode %d: %s\n", error_code, str);
-						} else {
-							printf("ErrorCode %d: (Unknown)\n", error_code);
-						}
-					}
-					if (str) {
-						free(str);
-					}
-					nn = plist_dict_get_item(node_tmp, "Content");
-					if (nn && (plist_get_node_type(nn) == PLIST_STRING)) {
-						str = NULL;
-						plist_get_string_val(nn, &str);
-						PRINT_VERBOSE(1, "Content:\n");
-						printf("%s", str);
-						free(str);
-					}
+				} else if (res == MB2_DL_DONE) {
 					break;
-				}
-
-				/* print status */
-				if (overall_progress > 0) {
+				} else if (overall_progress > 0) {
+					/* print status */
 					print_progress_real(overall_progress, 0);
 					PRINT_VERBOSE(1, " Finished\n");
 				}
 
-files_out:
-				if (message)
-					plist_free(message);
-				message = NULL;
-				if (dlmsg)
-					free(dlmsg);
-				dlmsg = NULL;
-
 				if (quit_flag > 0) {
 					/* need to cancel the backup here */
 					//mobilebackup_send_error(mobilebackup, "Cancelling DLSendFile");
@@ -2085,18 +2176,19 @@ files_out:
 					break;
 				}
 			} while (1);
+			result_code = dlstate.result_code;
 
 			/* report operation status to user */
 			switch (cmd) {
 				case CMD_CLOUD:
 				if (cmd_flags & CMD_FLAG_CLOUD_ENABLE) {
-					if (operation_ok) {
+					if (dlstate.operation_ok) {
 						PRINT_VERBOSE(1, "Cloud backup has been enabled successfully.\n");
 					} else {
 						PRINT_VERBOSE(1, "Could not enable cloud backup.\n");
 					}
 				} else if (cmd_flags & CMD_FLAG_CLOUD_DISABLE) {
-					if (operation_ok) {
+					if (dlstate.operation_ok) {
 						PRINT_VERBOSE(1, "Cloud backup has been disabled successfully.\n");
 					} else {
 						PRINT_VERBOSE(1, "Could not disable cloud backup.\n");
@@ -2104,8 +2196,8 @@ files_out:
 				}
 				break;
 				case CMD_BACKUP:
-					PRINT_VERBOSE(1, "Received %d files from device.\n", file_count);
-					if (operation_ok && mb2_status_check_snapshot_state(backup_directory, udid, "finished")) {
+					PRINT_VERBOSE(1, "Received %d files from device.\n", dlstate.file_count);
+					if (dlstate.operation_ok && mb2_status_check_snapshot_state(backup_directory, udid, "finished")) {
 						PRINT_VERBOSE(1, "Backup Successful.\n");
 					} else {
 						if (quit_flag) {
@@ -2125,19 +2217,19 @@ files_out:
 				break;
 				case CMD_CHANGEPW:
 				if (cmd_flags & CMD_FLAG_ENCRYPTION_ENABLE) {
-					if (operation_ok) {
+					if (dlstate.operation_ok) {
 						PRINT_VERBOSE(1, "Backup encryption has been enabled successfully.\n");
 					} else {
 						PRINT_VERBOSE(1, "Could not enable backup encryption.\n");
 					}
 				} else if (cmd_flags & CMD_FLAG_ENCRYPTION_DISABLE) {
-					if (operation_ok) {
+					if (dlstate.operation_ok) {
 						PRINT_VERBOSE(1, "Backup encryption has been disabled successfully.\n");
 					} else {
 						PRINT_VERBOSE(1, "Could not disable backup encryption.\n");
 					}
 				} else if (cmd_flags & CMD_FLAG_ENCRYPTION_CHANGEPW) {
-					if (operation_ok) {
+					if (dlstate.operation_ok) {
 						PRINT_VERBOSE(1, "Backup encryption password has been changed successfully.\n");
 					} else {
 						PRINT_VERBOSE(1, "Could not change backup encryption password.\n");
@@ -2147,7 +2239,7 @@ files_out:
 				case CMD_RESTORE:
 				if (cmd_flags & CMD_FLAG_RESTORE_REBOOT)
 					PRINT_VERBOSE(1, "The device should reboot now.\n");
-				if (operation_ok) {
+				if (dlstate.operation_ok) {
 					PRINT_VERBOSE(1, "Restore Successful.\n");
 				} else {
 					PRINT_VERBOSE(1, "Restore Failed (Error Code %d).\n", -result_code);
@@ -130,11 +130,6 @@ static void print_xml(plist_t node)
 		puts(xml);
 }
 
-static ssize_t mim_upload_cb(void* buf, size_t size, void* userdata)
-{
-	return fread(buf, 1, size, (FILE*)userdata);
-}
-
 int main(int argc, char **argv)
 {
 	idevice_t device = NULL;
@@ -303,7 +298,7 @@ int main(int argc, char **argv)
 		switch(disk_image_upload_type) {
 			case DISK_IMAGE_UPLOAD_TYPE_UPLOAD_IMAGE:
 				printf("Uploading %s\n", image_path);
-				err = mobile_image_mounter_upload_image(mim, imagetype, image_size, sig, sig_length, mim_upload_cb, f);
+				err = mobile_image_mounter_upload_image_file(mim, imagetype, fileno(f), image_size, sig, sig_length);
 				break;
 			case DISK_IMAGE_UPLOAD_TYPE_AFC:
 			default:
@@ -24,12 +24,55 @@
 #include <string.h>
 #include <stdlib.h>
 #include <getopt.h>
+#include <sys/time.h>
+#ifdef WIN32
+#include <windows.h>
+#define usleep(x) Sleep(x/1000)
+#else
+#include <unistd.h>
+#endif
 #include "common/userpref.h"
+#include "common/thread.h"
 
 #include <libimobiledevice/libimobiledevice.h>
 #include <libimobiledevice/lockdown.h>
 
+/* how long to keep retrying a device that shows the trust dialog */
+#define PAIR_DIALOG_TIMEOUT 60000
+#define PAIR_DIALOG_RETRY_INTERVAL 1000
+#define DEFAULT_JOBS 8
+
+typedef enum {
+	OP_NONE = 0, OP_PAIR, OP_VALIDATE, OP_UNPAIR, OP_LIST, OP_HOSTID, OP_SYSTEMBUID
+} op_t;
+
 static char *udid = NULL;
+static int use_all = 0;
+static int num_jobs = DEFAULT_JOBS;
+
+typedef enum {
+	JOB_QUEUED = 0,
+	JOB_RUNNING,
+	JOB_DONE
+} job_state_t;
+
+struct pair_job {
+	char *udid;
+	job_state_t state;
+	lockdownd_error_t lerr;
+	const char *failure;
+	unsigned int attempts;
+	uint64_t start;
+	uint64_t not_before;
+	uint64_t elapsed;
+};
+
+struct pair_jobs {
+	struct pair_job *jobs;
+	int count;
+	op_t op;
+	mutex_t mutex;
+};
 
 static void print_error_message(lockdownd_error_t err)
 {
@@ -69,6 +112,8 @@ static void print_usage(int argc, char **argv)
 	printf(" The following OPTIONS are accepted:\n");
 	printf("  -d, --debug      enable communication debugging\n");
 	printf("  -u, --udid UDID  target specific device by its 40-digit device UDID\n");
+	printf("  -a, --all        run pair, validate or unpair for all connected devices\n");
+	printf("  -j, --jobs NUM   number of devices to handle in parallel with --all (default %d)\n", DEFAULT_JOBS);
 	printf("  -h, --help       prints usage information\n");
 	printf("\n");
 	printf("Homepage: <http://libimobiledevice.org>\n");
@@ -80,12 +125,14 @@ static void parse_opts(int argc, char **argv)
 		{"help", 0, NULL, 'h'},
 		{"udid", 1, NULL, 'u'},
 		{"debug", 0, NULL, 'd'},
+		{"all", 0, NULL, 'a'},
+		{"jobs", 1, NULL, 'j'},
 		{NULL, 0, NULL, 0}
 	};
 	int c;
 
 	while (1) {
-		c = getopt_long(argc, argv, "hu:d", longopts, (int*)0);
+		c = getopt_long(argc, argv, "hu:daj:", longopts, (int*)0);
 		if (c == -1) {
 			break;
 		}
@@ -105,6 +152,17 @@ static void parse_opts(int argc, char **argv)
 		case 'd':
 			idevice_set_debug_level(1);
 			break;
+		case 'a':
+			use_all = 1;
+			break;
+		case 'j':
+			num_jobs = atoi(optarg);
+			if (num_jobs <= 0) {
+				printf("%s: invalid number of jobs specified\n", argv[0]);
+				print_usage(argc, argv);
+				exit(2);
+			}
+			break;
 		default:
 			print_usage(argc, argv);
 			exit(EXIT_SUCCESS);
@@ -112,6 +170,213 @@ static void parse_opts(int argc, char **argv)
 	}
 }
 
+static uint64_t now_ms(void)
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return (uint64_t)tv.tv_sec * 1000 + tv.tv_usec / 1000;
+}
+
+static const char *pair_error_string(lockdownd_error_t err)
+{
+	switch (err) {
+		case LOCKDOWN_E_SUCCESS:
+			return "OK";
+		case LOCKDOWN_E_PASSWORD_PROTECTED:
+			return "passcode set";
+		case LOCKDOWN_E_INVALID_HOST_ID:
+			return "not paired";
+		case LOCKDOWN_E_PAIRING_DIALOG_RESPONSE_PENDING:
+			return "trust dialog not accepted";
+		case LOCKDOWN_E_USER_DENIED_PAIRING:
+			return "user denied pairing";
+		default:
+			return NULL;
+	}
+}
+
+static lockdownd_error_t pair_job_run(struct pair_job *job, op_t op)
+{
+	idevice_t device = NULL;
+	lockdownd_client_t client = NULL;
+	lockdownd_error_t lerr;
+	char *type = NULL;
+
+	if (idevice_new(&device, job->udid) != IDEVICE_E_SUCCESS) {
+		job->failure = "device not found";
+		return LOCKDOWN_E_MUX_ERROR;
+	}
+
+	lerr = lockdownd_client_new(device, &client, "idevicepair");
+	if (lerr != LOCKDOWN_E_SUCCESS) {
+		idevice_free(device);
+		job->failure = "could not connect to lockdownd";
+		return lerr;
+	}
+
+	lerr = lockdownd_query_type(client, &type);
+	if (lerr != LOCKDOWN_E_SUCCESS) {
+		job->failure = "QueryType failed";
+	} else {
+		free(type);
+		switch (op) {
+			default:
+			case OP_PAIR:
+			lerr = lockdownd_pair(client, NULL);
+			break;
+			case OP_VALIDATE:
+			lerr = lockdownd_validate_pair(client, NULL);
+			break;
+			case OP_UNPAIR:
+			lerr = lockdownd_unpair(client, NULL);
+			break;
+		}
+		job->failure = NULL;
+	}
+
+	lockdownd_client_free(client);
+	idevice_free(device);
+
+	return lerr;
+}
+
+static void* pair_worker(void *arg)
+{
+	struct pair_jobs *jobs = (struct pair_jobs*)arg;
+
+	while (1) {
+		struct pair_job *job = NULL;
+		int pending = 0;
+		int i;
+		uint64_t now = now_ms();
+
+		mutex_lock(&jobs->mutex);
+		for (i = 0; i < jobs->count; i++) {
+			if (jobs->jobs[i].state == JOB_DONE)
+				continue;
+			pending++;
+			if (jobs->jobs[i].state == JOB_QUEUED && jobs->jobs[i].not_before <= now) {
+				job = &jobs->jobs[i];
+				job->state = JOB_RUNNING;
+				if (job->attempts == 0)
+					job->start = now;
+				job->attempts++;
+				break;
+			}
+		}
+		mutex_unlock(&jobs->mutex);
+
+		if (!job) {
+			if (pending == 0)
+				break;
+			/* only devices waiting for the trust dialog (or running) are left */
+			usleep(100000);
+			continue;
+		}
+
+		lockdownd_error_t lerr = pair_job_run(job, jobs->op);
+
+		mutex_lock(&jobs->mutex);
+		now = now_ms();
+		job->lerr = lerr;
+		job->elapsed = now - job->start;
+		if (lerr == LOCKDOWN_E_PAIRING_DIALOG_RESPONSE_PENDING && job->elapsed < PAIR_DIALOG_TIMEOUT) {
+			/* let other devices proceed while the user answers the dialog */
+			job->not_before = now + PAIR_DIALOG_RETRY_INTERVAL;
+			job->state = JOB_QUEUED;
+		} else {
+			job->state = JOB_DONE;
+		}
+		mutex_unlock(&jobs->mutex);
+	}
+
+	return NULL;
+}
+
+static int pair_all_devices(op_t op)
+{
+	struct pair_jobs jobs;
+	thread_t *workers = NULL;
+	char **dev_list = NULL;
+	int count = 0;
+	int num_workers = 0;
+	int failed = 0;
+	int i;
+	uint64_t start;
+
+	if (idevice_get_device_list(&dev_list, &count) != IDEVICE_E_SUCCESS) {
+		printf("ERROR: Unable to retrieve device list!\n");
+		return EXIT_FAILURE;
+	}
+	if (count == 0) {
+		idevice_device_list_free(dev_list);
+		printf("No device found, is it plugged in?\n");
+		return EXIT_FAILURE;
+	}
+
+	memset(&jobs, '\0', sizeof(jobs));
+	jobs.jobs = (struct pair_job*)calloc(count, sizeof(struct pair_job));
+	jobs.count = count;
+	jobs.op = op;
+	mutex_init(&jobs.mutex);
+	for (i = 0; i < count; i++) {
+		jobs.jobs[i].udid = dev_list[i];
+	}
+
+	if (op == OP_PAIR) {
+		/* have keys for the next devices ready while the current ones pair */
+		lockdownd_key_pool_start((count < num_jobs) ? count : num_jobs, (count < num_jobs) ? count : num_jobs);
+	}
+
+	start = now_ms();
+
+	num_workers = (count < num_jobs) ? count : num_jobs;
+	workers = (thread_t*)calloc(num_workers, sizeof(thread_t));
+	for (i = 0; i < num_workers; i++) {
+		if (thread_new(&workers[i], pair_worker, &jobs) != 0) {
+			break;
+		}
+	}
+	num_workers = i;
+	if (num_workers == 0) {
+		/* no threads available, do the work on this thread */
+		pair_worker(&jobs);
+	}
+	for (i = 0; i < num_workers; i++) {
+		thread_join(workers[i]);
+		thread_free(workers[i]);
+	}
+	free(workers);
+
+	if (op == OP_PAIR) {
+		lockdownd_key_pool_stop();
+	}
+
+	printf("%-40s  %-8s  %8s  %9s  %s\n", "UDID", "RESULT", "ATTEMPTS", "TIME (ms)", "DETAILS");
+	for (i = 0; i < count; i++) {
+		struct pair_job *job = &jobs.jobs[i];
+		const char *details = job->failure;
+		char errbuf[32];
+		if (!details) {
+			details = pair_error_string(job->lerr);
+		}
+		if (!details) {
+			snprintf(errbuf, sizeof(errbuf), "error code %d", job->lerr);
+			details = errbuf;
+		}
+		if (job->lerr != LOCKDOWN_E_SUCCESS)
+			failed++;
+		printf("%-40s  %-8s  %8u  %9llu  %s\n", job->udid, (job->lerr == LOCKDOWN_E_SUCCESS) ? "SUCCESS" : "FAILED", job->attempts, (unsigned long long)job->elapsed, details);
+	}
+	printf("%d of %d devices succeeded in %llu ms\n", count - failed, count, (unsigned long long)(now_ms() - start));
+
+	mutex_destroy(&jobs.mutex);
+	free(jobs.jobs);
+	idevice_device_list_free(dev_list);
+
+	return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
 int main(int argc, char **argv)
 {
 	lockdownd_client_t client = NULL;
@@ -122,9 +387,6 @@ int main(int argc, char **argv)
 
 	char *type = NULL;
 	char *cmd;
-	typedef enum {
-		OP_NONE = 0, OP_PAIR, OP_VALIDATE, OP_UNPAIR, OP_LIST, OP_HOSTID, OP_SYSTEMBUID
-	} op_t;
 	op_t op = OP_NONE;
 
 	parse_opts(argc, argv);
@@ -155,6 +417,20 @@ int main(int argc, char **argv)
 		exit(EXIT_FAILURE);
 	}
 
+	if (use_all) {
+		if (op != OP_PAIR && op != OP_VALIDATE && op != OP_UNPAIR) {
+			printf("ERROR: --all can only be used with pair, validate or unpair\n");
+			print_usage(argc, argv);
+			exit(EXIT_FAILURE);
+		}
+		if (udid) {
+			printf("ERROR: --all and --udid cannot be used together\n");
+			print_usage(argc, argv);
+			exit(EXIT_FAILURE);
+		}
+		return pair_all_devices(op);
+	}
+
 	if (op == OP_SYSTEMBUID) {
 		char *systembuid = NULL;
 		userpref_read_system_buid(&systembuid);